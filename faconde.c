@@ -1,10 +1,13 @@
-#line 1 "glob.c"
+#line 1 "align.c"
+#include <assert.h>
+#include <string.h>
 #line 1 "api.h"
 #ifndef FACONDE_H
 #define FACONDE_H
 
 #define FC_VERSION "0.1"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <uchar.h>
@@ -72,6 +75,20 @@ double fc_ndamerau(enum fc_norm_method method,
                    const char32_t *seq1, int32_t len1,
                    const char32_t *seq2, int32_t len2);
 
+/* Same as fc_nlevenshtein() and fc_ndamerau(), but give up as soon as the
+ * distance is known to be larger than "max". The exact distance is returned if
+ * it is lower than or equal to "max", and a value larger than "max"
+ * otherwise. This is much faster when most sequences are far apart, because
+ * pairs whose length difference is too large are rejected immediately, and
+ * only a band of the matrix around the diagonal is computed.
+ */
+double fc_nlevenshtein_bounded(enum fc_norm_method method, double max,
+                               const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2);
+double fc_ndamerau_bounded(enum fc_norm_method method, double max,
+                           const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2);
+
 /* Computes the distance between the provided sequences upto a maximum value
  * of 1. If the distance between the sequences is larger than that, a value
  * larger than 1 is returned.
@@ -89,6 +106,30 @@ int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
 extern int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t,
                                           const char32_t *, int32_t);
 
+/* Same as the above functions, but for an arbitrary maximum distance "k".
+ * Only a band of k + 1 diagonals (at most) of the matrix is computed, and
+ * computation stops as soon as no cell of the band holds a value <= k. If the
+ * distance between the sequences is larger than "k", a value larger than "k"
+ * is returned. For k <= 2, the relevant function in fc_lev_bounded is used.
+ */
+int32_t fc_lev_bounded_k(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2, int32_t k);
+
+/* Same as fc_lev_bounded1() and fc_lev_bounded2(), but for the Damerau
+ * distance, as computed by fc_damerau().
+ */
+int32_t fc_dam_bounded1(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+
+int32_t fc_dam_bounded2(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+
+/* Table of pointers to the above functions.
+ * The function at index 0 is the same as in fc_lev_bounded.
+ */
+extern int32_t (*const fc_dam_bounded[3])(const char32_t *, int32_t,
+                                          const char32_t *, int32_t);
+
 /* Computes the Jaro distance between two sequences.
  * Contrary to the canonical implementation, this returns 0 for identity, and
  * 1 to indicate absolute difference, instead of the reverse.
@@ -96,6 +137,56 @@ extern int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t,
 double fc_jaro(const char32_t *seq1, int32_t len1,
                const char32_t *seq2, int32_t len2);
 
+/* Computes the Jaro-Winkler distance between two sequences. This is the Jaro
+ * distance multiplied by (1 - l * prefix_scale), where "l" is the length of the
+ * common prefix of the sequences, up to "max_prefix" characters. The usual
+ * values are 0.1 and 4. The product of "prefix_scale" and "max_prefix" must
+ * not exceed 1. The bonus is applied whatever the Jaro distance is.
+ */
+double fc_jaro_winkler(const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2,
+                       double prefix_scale, int32_t max_prefix);
+
+/* Same as fc_jaro_winkler(), but returns a value larger than "max" if the
+ * distance is larger than "max". Pairs that can't be within the bound are
+ * rejected from their lengths or from their number of matching characters,
+ * without computing the distance.
+ */
+double fc_jaro_winkler_bounded(const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2,
+                               double prefix_scale, int32_t max_prefix,
+                               double max);
+
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* Computes the Hamming distance between two sequences of length "len", which
+ * is the number of positions at which their characters differ. Characters are
+ * compared several at a time with SIMD instructions. There is no limit on the
+ * length of the sequences.
+ */
+int32_t fc_hamming(const char32_t *seq1, const char32_t *seq2, int32_t len);
+
+/* Same as fc_hamming(), but returns a value larger than "k" as soon as the
+ * distance is known to be larger than "k".
+ */
+int32_t fc_hamming_bounded(const char32_t *seq1, const char32_t *seq2,
+                           int32_t len, int32_t k);
+
+/* Compares a query of length "len" to "nr" keys of the same length, stored one
+ * after the other in "keys", so that the key "i" starts at keys[i * len]. The
+ * indexes of the keys whose distance to the query is at most "k" are written
+ * in increasing order to "matches", and their distances to "dists", if it is
+ * not NULL. Both must have room for "nr" values. Returns the number of matching
+ * keys. Keys that fit in a vector are compared to the query with a single
+ * vector comparison.
+ */
+size_t fc_hamming_search(const char32_t *query, int32_t len,
+                         const char32_t *keys, size_t nr, int32_t k,
+                         size_t *matches, int32_t *dists);
+
 
 /*******************************************************************************
  * Longest Common Substring and Subsequence
@@ -114,6 +205,33 @@ int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
                             const char32_t *seq2, int32_t len2,
                             const char32_t **pos);
 
+/* Index of a reference sequence, for comparing it to many sequences with
+ * fc_lcsubstr_index_query(). This is a suffix automaton of the reference
+ * sequence, built in linear time, so that each query only takes time linear
+ * in the length of the compared sequence. Contrary to fc_memo, the space used
+ * is linear in the length of the reference sequence, and the compared
+ * sequences can have any length.
+ */
+struct fc_sam;
+
+struct fc_lcsubstr_index {
+   struct fc_sam *sam;     /* Suffix automaton of the reference sequence. */
+};
+
+/* Initializer. The reference sequence is not referenced afterwards. */
+void fc_lcsubstr_index_init(struct fc_lcsubstr_index *,
+                            const char32_t *ref, int32_t len);
+
+/* Destructor. */
+void fc_lcsubstr_index_fini(struct fc_lcsubstr_index *);
+
+/* Same as fc_lcsubstr_extract(seq, len, ref, ref_len, pos), where "ref" is
+ * the reference sequence of the index.
+ */
+int32_t fc_lcsubstr_index_query(const struct fc_lcsubstr_index *,
+                                const char32_t *seq, int32_t len,
+                                const char32_t **pos);
+
 /* Computes the length of the longest common subsequence between two
  * sequences.
  */
@@ -124,6 +242,218 @@ int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1,
 double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
                     const char32_t *seq2, int32_t len2);
 
+/* Same as fc_nlcsubseq(), but returns a value larger than "max" as soon as the
+ * result is known to be larger than "max".
+ */
+double fc_nlcsubseq_bounded(double max, const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Alignment
+ ******************************************************************************/
+
+/* Edit operations. They transform the first sequence into the second one.
+ * FC_EDIT_MATCH      Copy a character that is the same in both sequences.
+ * FC_EDIT_SUB        Replace a character of the first sequence with one of
+ *                    the second sequence.
+ * FC_EDIT_INS        Insert a character of the second sequence.
+ * FC_EDIT_DEL        Delete a character of the first sequence.
+ * FC_EDIT_TRANSPOSE  Swap two adjacent characters of the first sequence.
+ */
+enum fc_edit_op {
+   FC_EDIT_MATCH,
+   FC_EDIT_SUB,
+   FC_EDIT_INS,
+   FC_EDIT_DEL,
+   FC_EDIT_TRANSPOSE,
+};
+
+/* A run of identical operations. For FC_EDIT_TRANSPOSE, "len" is the number of
+ * transpositions, which span 2 * len characters in both sequences.
+ */
+struct fc_edit {
+   enum fc_edit_op op;
+   int32_t len;
+};
+
+/* Maximum number of runs in the script of two sequences. */
+#define FC_EDIT_SCRIPT_MAX(len1, len2) ((len1) + (len2))
+
+/* Computes the Levenshtein distance between two sequences, together with an
+ * edit script that achieves it. The script is written to "script", which must
+ * have room for FC_EDIT_SCRIPT_MAX(len1, len2) runs, and its number of runs
+ * to "nr". Consecutive runs always have distinct operations. This uses
+ * Hirschberg's algorithm, so the space needed is linear in the length of the
+ * sequences, while the running time is about twice that of a matrix
+ * computation.
+ */
+int32_t fc_levenshtein_align(const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             struct fc_edit *script, int32_t *nr);
+
+/* Same as fc_levenshtein_align(), but for the distance computed by
+ * fc_damerau(). The script can include transpositions.
+ */
+int32_t fc_damerau_align(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2,
+                         struct fc_edit *script, int32_t *nr);
+
+/* Computes the length of the longest common subsequence between two sequences,
+ * together with an alignment that achieves it. The script only includes
+ * matches, insertions, and deletions. The matched characters form a longest
+ * common subsequence.
+ */
+int32_t fc_lcsubseq_align(const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          struct fc_edit *script, int32_t *nr);
+
+
+/*******************************************************************************
+ * Long sequences
+ ******************************************************************************/
+
+/* Same as fc_levenshtein(), fc_damerau(), and fc_lcsubseq(), but for
+ * sequences of any length. The matrix is cut into tiles, which are computed in
+ * a wavefront by "threads" threads, or by as many threads as there are CPUs if
+ * "threads" is not positive. The space used is linear in the length of the
+ * sequences. If both sequences are not longer than FC_MAX_SEQ_LEN, this is the
+ * same as calling the corresponding function.
+ */
+int64_t fc_levenshtein_long(const char32_t *seq1, int64_t len1,
+                            const char32_t *seq2, int64_t len2, int threads);
+int64_t fc_damerau_long(const char32_t *seq1, int64_t len1,
+                        const char32_t *seq2, int64_t len2, int threads);
+int64_t fc_lcsubseq_long(const char32_t *seq1, int64_t len1,
+                         const char32_t *seq2, int64_t len2, int threads);
+
+
+/*******************************************************************************
+ * Packed sequences
+ ******************************************************************************/
+
+/* Sequences over a small alphabet, such as nucleotides, can be packed with
+ * "bits" bits per symbol, which must be 2 for up to 4 symbols, or 4 for up to
+ * 16 symbols. The symbol at position "i" is held in the word
+ * (i * bits) / 64, starting at the bit (i * bits) % 64. The pattern-match
+ * masks of the bit-parallel algorithms are computed on whole packed words, and
+ * symbols are mapped to masks without any lookup, so this is faster than
+ * comparing the unpacked sequences, and takes 16 or 8 times less memory.
+ */
+
+/* Number of words of a packed sequence of length "len". */
+#define FC_PACKED_WORDS(len, bits) (((int64_t)(len) * (bits) + 63) / 64)
+
+/* Packs a sequence into "packed", which must have room for
+ * FC_PACKED_WORDS(len, bits) words. Each character is replaced with its index
+ * in "alphabet", which is a NUL-terminated string of at most 1 << bits
+ * characters. Returns false if a character of "seq" is not in "alphabet".
+ */
+bool fc_pack(int bits, const char32_t *alphabet,
+             const char32_t *seq, int32_t len, uint64_t *packed);
+
+/* Same as fc_levenshtein() and fc_lcsubseq(), for two sequences packed with
+ * the same number of bits and the same alphabet. Their lengths must not
+ * exceed FC_MAX_SEQ_LEN.
+ */
+int32_t fc_levenshtein_packed(int bits, const uint64_t *seq1, int32_t len1,
+                              const uint64_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_packed(int bits, const uint64_t *seq1, int32_t len1,
+                           const uint64_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Run-length encoded sequences
+ ******************************************************************************/
+
+/* A run of "len" times the character "c". "len" must be positive. */
+struct fc_run {
+   char32_t c;
+   int32_t len;
+};
+
+/* Encodes a sequence as runs, which are written to "runs". It must have room
+ * for "len" runs. Returns the number of runs.
+ */
+int32_t fc_rle_encode(const char32_t *seq, int32_t len, struct fc_run *runs);
+
+/* Same as fc_levenshtein(), for two run-length encoded sequences. Adjacent
+ * runs can have the same character. The matrix is cut into blocks, one per
+ * pair of runs, and only the edges of the blocks are computed, so the running
+ * time is proportional to nr1 * len2 + nr2 * len1, where "len1" and "len2" are
+ * the lengths of the decoded sequences, and the space to the shortest one.
+ * When runs are too short for this to be faster than the bit-parallel
+ * algorithm, the sequences are decoded instead. They can be longer than
+ * FC_MAX_SEQ_LEN, but must fit in an int32_t.
+ */
+int32_t fc_levenshtein_rle(const struct fc_run *runs1, int32_t nr1,
+                           const struct fc_run *runs2, int32_t nr2);
+
+
+/*******************************************************************************
+ * Weighted distances
+ ******************************************************************************/
+
+/* Maximum cost of an edit operation. */
+#define FC_MAX_COST (1 << 16)
+
+/* Cost of substituting "c2" for "c1". */
+struct fc_sub_cost {
+   char32_t c1, c2;
+   int32_t cost;
+};
+
+struct fc_sub_table;
+
+/* Costs of edit operations, for weighted distances. Matches cost nothing.
+ * Costs must be between 0 and FC_MAX_COST.
+ */
+struct fc_costs {
+   int32_t ins;                  /* Insertion of a character of "seq2". */
+   int32_t del;                  /* Deletion of a character of "seq1". */
+   int32_t sub;                  /* Default substitution cost. */
+   int32_t transpose;            /* For the Damerau distance. */
+   struct fc_sub_table *table;   /* Specific substitution costs, or NULL. */
+};
+
+/* Initializer. "subs" holds "nr" substitutions whose cost differs from "sub",
+ * such as those of adjacent keys, or of characters confused by OCR. It is
+ * copied into a hash table, and can be NULL if "nr" is zero. Pairs are not
+ * symmetric: both (a, b) and (b, a) must be given if needed. If a pair appears
+ * several times, the last one wins.
+ */
+void fc_costs_init(struct fc_costs *, int32_t ins, int32_t del,
+                   int32_t sub, int32_t transpose,
+                   const struct fc_sub_cost *subs, size_t nr);
+
+/* Destructor. */
+void fc_costs_fini(struct fc_costs *);
+
+/* Same as fc_levenshtein() and fc_damerau(), with the given costs. When all
+ * operations cost the same, without specific substitution costs, the
+ * unit-cost functions are used, and their result scaled. Otherwise, the
+ * matrix is computed one cell at a time, with a kernel specialized for
+ * whether there is a substitution table, so it is much slower.
+ */
+int32_t fc_wlevenshtein(const struct fc_costs *,
+                        const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+int32_t fc_wdamerau(const struct fc_costs *,
+                    const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2);
+
+/* Same as the above, but if the distance is larger than "max", computation
+ * stops as soon as this is known, and INT32_MAX is returned.
+ */
+int32_t fc_wlevenshtein_bounded(const struct fc_costs *,
+                                const char32_t *seq1, int32_t len1,
+                                const char32_t *seq2, int32_t len2,
+                                int32_t max);
+int32_t fc_wdamerau_bounded(const struct fc_costs *,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            int32_t max);
+
 
 /*******************************************************************************
  * Memoized string metrics.
@@ -142,11 +472,13 @@ struct fc_memo {
    int32_t (*compute)(struct fc_memo *, const char32_t *, int32_t);
    void *matrix;           /* Similarity matrix. */
    int32_t mdim;           /* Matrix dimension. */
-   const char32_t *seq1;   /* Reference sequence. */
+   const void *seq1;       /* Reference sequence. */
    int32_t len1;           /* Length of the reference sequence. */
    char32_t *seq2;         /* Previous sequence seen. */
    int32_t len2;           /* Length of this sequence. */
    int32_t max_dist;       /* Maximum allowed distance (for Levenshtein). */
+   int elem_size;          /* Size of the elements of the sequences. */
+   const struct fc_costs *costs; /* Costs of edit operations, or NULL. */
 };
 
 /* Initializer.
@@ -174,6 +506,13 @@ enum fc_metric fc_memo_metric(const struct fc_memo *);
  */
 void fc_memo_set_ref(struct fc_memo *, const char32_t *seq1, int32_t len1);
 
+/* Sets the costs of edit operations, for the Levenshtein and Damerau
+ * distances, which are then computed as by fc_wlevenshtein() and
+ * fc_wdamerau(), and "max_dist" is expressed in the same unit as costs. They
+ * are not copied internally. Passing NULL restores unit costs.
+ */
+void fc_memo_set_costs(struct fc_memo *, const struct fc_costs *);
+
 /* Compares the reference sequence to a new one. */
 static inline int32_t fc_memo_compute(struct fc_memo *m,
                                       const char32_t *seq2, int32_t len2)
@@ -189,65 +528,329 @@ int32_t fc_memo_damerau(struct fc_memo *, const char32_t *, int32_t);
 int32_t fc_memo_lcsubstr(struct fc_memo *, const char32_t *, int32_t);
 int32_t fc_memo_lcsubseq(struct fc_memo *, const char32_t *, int32_t);
 
-#endif
-#line 2 "glob.c"
+/* Same as fc_memo_set_ref() and fc_memo_compute(), for sequences of other
+ * element types (see below). The compared sequences must have the same type as
+ * the reference sequence.
+ */
+void fc_memo_set_ref_u8(struct fc_memo *, const uint8_t *seq1, int32_t len1);
+void fc_memo_set_ref_u16(struct fc_memo *, const uint16_t *seq1, int32_t len1);
+void fc_memo_set_ref_u32(struct fc_memo *, const uint32_t *seq1, int32_t len1);
+int32_t fc_memo_compute_u8(struct fc_memo *, const uint8_t *seq2, int32_t len2);
+int32_t fc_memo_compute_u16(struct fc_memo *, const uint16_t *seq2, int32_t len2);
+int32_t fc_memo_compute_u32(struct fc_memo *, const uint32_t *seq2, int32_t len2);
 
-/* Could be refactored to remove recursion altogether. */
-bool fc_glob(const char32_t *pat, const char32_t *str)
-{
-   for (;;) {
-      switch (*pat) {
-      case U'\0':
-         return !*str;
-         break;
-      case U'?':
-         if (!*str++)
-            return false;
-         pat++;
-         break;
-      case U'*':
-         /* Could skip following trailing stars, don't think it's that useful.
-          */
-         if (!*++pat)
-            return true;
-         do {
-            if (fc_glob(pat, str))
-               return true;
-         } while (*str++);
-         return false;
-         break;
-      case U'[': {
-         bool invert = false;
-         pat++;
-         if (*pat == U'^') {
-            invert = true;
-            pat++;
-         }
-         while ((*pat == *str) == invert) {
-            if (!*pat || *pat == U']')
-               return false;
-            pat++;
-         }
-         do {
-            if (!*pat++)
-               return false;
-         } while (*pat != U']');
-         pat++;
-         str++;
-         break;
-      }
-      default:
-         if (*str++ != *pat++)
-            return false;
-         break;
-      }
-   }
-   return false;
-}
-#line 1 "mem.c"
-#include <stdlib.h>
-#include <stdio.h>
-#include <assert.h>
+
+/*******************************************************************************
+ * Batch computation.
+ ******************************************************************************/
+
+/* Compares a query sequence to "nr" candidate sequences.
+ * The candidates are given in "cands", and their lengths in "lens". The result
+ * of the comparison of the query with cands[i] is stored in out[i]. This is
+ * the same as calling the corresponding function for each candidate in turn,
+ * but much faster on short sequences, because several candidates are compared
+ * to the query simultaneously with SIMD instructions.
+ */
+void fc_levenshtein_batch(const char32_t *query, int32_t qlen,
+                          const char32_t *const *cands, const int32_t *lens,
+                          size_t nr, int32_t *out);
+void fc_damerau_batch(const char32_t *query, int32_t qlen,
+                      const char32_t *const *cands, const int32_t *lens,
+                      size_t nr, int32_t *out);
+void fc_lcsubseq_batch(const char32_t *query, int32_t qlen,
+                       const char32_t *const *cands, const int32_t *lens,
+                       size_t nr, int32_t *out);
+
+
+/*******************************************************************************
+ * Multiple metrics
+ ******************************************************************************/
+
+/* Metrics that can be requested from fc_multi_metric(). */
+enum {
+   FC_MULTI_LEVENSHTEIN = 1 << FC_LEVENSHTEIN,
+   FC_MULTI_DAMERAU = 1 << FC_DAMERAU,
+   FC_MULTI_LCSUBSTR = 1 << FC_LCSUBSTR,
+   FC_MULTI_LCSUBSEQ = 1 << FC_LCSUBSEQ,
+   FC_MULTI_JARO = 1 << FC_METRIC_NR,
+
+   FC_MULTI_ALL = (1 << (FC_METRIC_NR + 1)) - 1,
+};
+
+/* Results of fc_multi_metric(). Each field holds the value returned by the
+ * function of the same name.
+ */
+struct fc_multi {
+   int32_t levenshtein;
+   int32_t damerau;
+   int32_t lcsubstr;
+   int32_t lcsubseq;
+   double jaro;
+};
+
+/* Computes the metrics whose flags are set in "mask" between two sequences,
+ * and stores them in "out". The other fields of "out" are left untouched.
+ * This is faster than calling each function in turn, because the
+ * pattern-match masks of "seq1" are built once, and all the metrics but Jaro
+ * are computed in a single pass over "seq2", with a single lookup of the masks
+ * of each character.
+ */
+void fc_multi_metric(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     unsigned mask, struct fc_multi *out);
+
+/* Same as fc_multi_metric(), for a query and "nr" candidates, in the same way
+ * as fc_levenshtein_batch(). The masks of the query are built once.
+ */
+void fc_multi_metric_batch(const char32_t *query, int32_t qlen,
+                           const char32_t *const *cands, const int32_t *lens,
+                           size_t nr, unsigned mask, struct fc_multi *out);
+
+
+/*******************************************************************************
+ * Compiled queries
+ ******************************************************************************/
+
+/* A query sequence, prepared for being compared to many sequences. Its
+ * pattern-match masks, and, for long sequences, the lists of the positions of
+ * its characters, are built once, instead of at each comparison. Contrary to
+ * fc_memo, there is no limit on the length of the compared sequences but
+ * FC_MAX_SEQ_LEN, and no previous sequence to share a prefix with.
+ */
+struct fc_profile;
+
+struct fc_query {
+   struct fc_profile *profile;   /* Masks and copy of the query. */
+};
+
+/* Initializer. The query sequence is copied. */
+void fc_query_init(struct fc_query *, const char32_t *seq, int32_t len);
+
+/* Destructor. */
+void fc_query_fini(struct fc_query *);
+
+/* Same as fc_levenshtein(seq1, len1, seq2, len2), etc., where "seq1" is the
+ * query sequence. When "seq2" is much shorter than the query, its own masks
+ * are built instead, as the standard functions do.
+ */
+int32_t fc_query_levenshtein(const struct fc_query *,
+                             const char32_t *seq2, int32_t len2);
+int32_t fc_query_damerau(const struct fc_query *,
+                         const char32_t *seq2, int32_t len2);
+int32_t fc_query_lcsubseq(const struct fc_query *,
+                          const char32_t *seq2, int32_t len2);
+double fc_query_jaro(const struct fc_query *,
+                     const char32_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Other element types
+ ******************************************************************************/
+
+/* Same as fc_levenshtein(), fc_damerau(), fc_lcsubseq(), and fc_jaro(), for
+ * sequences of bytes (such as Latin-1 text) or of 16 or 32 bits integers (such
+ * as token identifiers), which are compared without being converted to
+ * char32_t first. The kernels are compiled for each element type.
+ */
+int32_t fc_levenshtein_u8(const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2);
+int32_t fc_levenshtein_u16(const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2);
+int32_t fc_levenshtein_u32(const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2);
+
+int32_t fc_damerau_u8(const uint8_t *seq1, int32_t len1,
+                      const uint8_t *seq2, int32_t len2);
+int32_t fc_damerau_u16(const uint16_t *seq1, int32_t len1,
+                       const uint16_t *seq2, int32_t len2);
+int32_t fc_damerau_u32(const uint32_t *seq1, int32_t len1,
+                       const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lcsubseq_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+double fc_jaro_u8(const uint8_t *seq1, int32_t len1,
+                  const uint8_t *seq2, int32_t len2);
+double fc_jaro_u16(const uint16_t *seq1, int32_t len1,
+                   const uint16_t *seq2, int32_t len2);
+double fc_jaro_u32(const uint32_t *seq1, int32_t len1,
+                   const uint32_t *seq2, int32_t len2);
+
+/* Same as the functions of the same name without a suffix, for the same
+ * element types. The vectorized Hamming kernels compare 4 bytes characters, so
+ * the Hamming distances of narrower elements are computed one element at a
+ * time.
+ */
+double fc_nlevenshtein_u8(enum fc_norm_method method,
+                          const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2);
+double fc_nlevenshtein_u16(enum fc_norm_method method,
+                           const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2);
+double fc_nlevenshtein_u32(enum fc_norm_method method,
+                           const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2);
+
+double fc_ndamerau_u8(enum fc_norm_method method,
+                      const uint8_t *seq1, int32_t len1,
+                      const uint8_t *seq2, int32_t len2);
+double fc_ndamerau_u16(enum fc_norm_method method,
+                       const uint16_t *seq1, int32_t len1,
+                       const uint16_t *seq2, int32_t len2);
+double fc_ndamerau_u32(enum fc_norm_method method,
+                       const uint32_t *seq1, int32_t len1,
+                       const uint32_t *seq2, int32_t len2);
+
+double fc_nlevenshtein_bounded_u8(enum fc_norm_method method, double max,
+                                  const uint8_t *seq1, int32_t len1,
+                                  const uint8_t *seq2, int32_t len2);
+double fc_nlevenshtein_bounded_u16(enum fc_norm_method method, double max,
+                                   const uint16_t *seq1, int32_t len1,
+                                   const uint16_t *seq2, int32_t len2);
+double fc_nlevenshtein_bounded_u32(enum fc_norm_method method, double max,
+                                   const uint32_t *seq1, int32_t len1,
+                                   const uint32_t *seq2, int32_t len2);
+
+double fc_ndamerau_bounded_u8(enum fc_norm_method method, double max,
+                              const uint8_t *seq1, int32_t len1,
+                              const uint8_t *seq2, int32_t len2);
+double fc_ndamerau_bounded_u16(enum fc_norm_method method, double max,
+                               const uint16_t *seq1, int32_t len1,
+                               const uint16_t *seq2, int32_t len2);
+double fc_ndamerau_bounded_u32(enum fc_norm_method method, double max,
+                               const uint32_t *seq1, int32_t len1,
+                               const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lev_bounded1_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_lev_bounded1_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_lev_bounded1_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lev_bounded2_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_lev_bounded2_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_lev_bounded2_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+extern int32_t (*const fc_lev_bounded_u8[3])(const uint8_t *, int32_t,
+                                             const uint8_t *, int32_t);
+extern int32_t (*const fc_lev_bounded_u16[3])(const uint16_t *, int32_t,
+                                              const uint16_t *, int32_t);
+extern int32_t (*const fc_lev_bounded_u32[3])(const uint32_t *, int32_t,
+                                              const uint32_t *, int32_t);
+
+int32_t fc_lev_bounded_k_u8(const uint8_t *seq1, int32_t len1,
+                            const uint8_t *seq2, int32_t len2, int32_t k);
+int32_t fc_lev_bounded_k_u16(const uint16_t *seq1, int32_t len1,
+                             const uint16_t *seq2, int32_t len2, int32_t k);
+int32_t fc_lev_bounded_k_u32(const uint32_t *seq1, int32_t len1,
+                             const uint32_t *seq2, int32_t len2, int32_t k);
+
+int32_t fc_dam_bounded1_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_dam_bounded1_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_dam_bounded1_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+int32_t fc_dam_bounded2_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_dam_bounded2_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_dam_bounded2_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+extern int32_t (*const fc_dam_bounded_u8[3])(const uint8_t *, int32_t,
+                                             const uint8_t *, int32_t);
+extern int32_t (*const fc_dam_bounded_u16[3])(const uint16_t *, int32_t,
+                                              const uint16_t *, int32_t);
+extern int32_t (*const fc_dam_bounded_u32[3])(const uint32_t *, int32_t,
+                                              const uint32_t *, int32_t);
+
+double fc_jaro_winkler_u8(const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2,
+                          double prefix_scale, int32_t max_prefix);
+double fc_jaro_winkler_u16(const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2,
+                           double prefix_scale, int32_t max_prefix);
+double fc_jaro_winkler_u32(const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2,
+                           double prefix_scale, int32_t max_prefix);
+
+double fc_jaro_winkler_bounded_u8(const uint8_t *seq1, int32_t len1,
+                                  const uint8_t *seq2, int32_t len2,
+                                  double prefix_scale, int32_t max_prefix,
+                                  double max);
+double fc_jaro_winkler_bounded_u16(const uint16_t *seq1, int32_t len1,
+                                   const uint16_t *seq2, int32_t len2,
+                                   double prefix_scale, int32_t max_prefix,
+                                   double max);
+double fc_jaro_winkler_bounded_u32(const uint32_t *seq1, int32_t len1,
+                                   const uint32_t *seq2, int32_t len2,
+                                   double prefix_scale, int32_t max_prefix,
+                                   double max);
+
+int32_t fc_hamming_u8(const uint8_t *seq1, const uint8_t *seq2, int32_t len);
+int32_t fc_hamming_u16(const uint16_t *seq1, const uint16_t *seq2, int32_t len);
+int32_t fc_hamming_u32(const uint32_t *seq1, const uint32_t *seq2, int32_t len);
+
+int32_t fc_hamming_bounded_u8(const uint8_t *seq1, const uint8_t *seq2,
+                              int32_t len, int32_t k);
+int32_t fc_hamming_bounded_u16(const uint16_t *seq1, const uint16_t *seq2,
+                               int32_t len, int32_t k);
+int32_t fc_hamming_bounded_u32(const uint32_t *seq1, const uint32_t *seq2,
+                               int32_t len, int32_t k);
+
+size_t fc_hamming_search_u8(const uint8_t *query, int32_t len,
+                            const uint8_t *keys, size_t nr, int32_t k,
+                            size_t *matches, int32_t *dists);
+size_t fc_hamming_search_u16(const uint16_t *query, int32_t len,
+                             const uint16_t *keys, size_t nr, int32_t k,
+                             size_t *matches, int32_t *dists);
+size_t fc_hamming_search_u32(const uint32_t *query, int32_t len,
+                             const uint32_t *keys, size_t nr, int32_t k,
+                             size_t *matches, int32_t *dists);
+
+int32_t fc_lcsubstr_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+int32_t fc_lcsubstr_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+int32_t fc_lcsubstr_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lcsubstr_extract_u8(const uint8_t *seq1, int32_t len1,
+                               const uint8_t *seq2, int32_t len2,
+                               const uint8_t **pos);
+int32_t fc_lcsubstr_extract_u16(const uint16_t *seq1, int32_t len1,
+                                const uint16_t *seq2, int32_t len2,
+                                const uint16_t **pos);
+int32_t fc_lcsubstr_extract_u32(const uint32_t *seq1, int32_t len1,
+                                const uint32_t *seq2, int32_t len2,
+                                const uint32_t **pos);
+
+double fc_nlcsubseq_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+double fc_nlcsubseq_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+double fc_nlcsubseq_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+double fc_nlcsubseq_bounded_u8(double max, const uint8_t *seq1, int32_t len1,
+                               const uint8_t *seq2, int32_t len2);
+double fc_nlcsubseq_bounded_u16(double max, const uint16_t *seq1, int32_t len1,
+                                const uint16_t *seq2, int32_t len2);
+double fc_nlcsubseq_bounded_u32(double max, const uint32_t *seq1, int32_t len1,
+                                const uint32_t *seq2, int32_t len2);
+
+#endif
+#line 4 "align.c"
 #line 1 "mem.h"
 #ifndef FC_MEM_H
 #define FC_MEM_H
@@ -267,33 +870,7 @@ void *fc_malloc(size_t size)
 #define fc_free free
 
 #endif
-#line 5 "mem.c"
-
-noreturn void fc_fatal(const char *msg, ...)
-{
-   va_list ap;
-
-   fputs("faconde: ", stderr);
-   va_start(ap, msg);
-   vfprintf(stderr, msg, ap);
-   va_end(ap);
-   putc('\n', stderr);
-   fflush(stderr);
-
-   abort();
-}
-
-void *fc_malloc(size_t size)
-{
-   assert(size);
-   void *mem = malloc(size);
-   if (!mem)
-      fc_fatal("out of memory");
-   return mem;
-}
-#line 1 "metric.c"
-#include <limits.h>
-#include <string.h>
+#line 5 "align.c"
 #line 1 "macro.h"
 #ifndef FC_MACRO_H
 #define FC_MACRO_H
@@ -320,894 +897,6113 @@ void *fc_malloc(size_t size)
    c = tmp;                                                                    \
 } while (0)
 
+/* For the normalization by the longest alignment, the distance between two
+ * sequences and the length of the longest alignment that achieves it are
+ * packed into a single positive value (dist + 1) * scale - len, where
+ * len < scale. Minimizing this value minimizes the distance first, then
+ * maximizes the length, so both are computed with a single recurrence.
+ */
+#define FC_LALIGN_SCALE (1 << 14)
+#define FC_LALIGN_PACK(dist, len, scale) (((dist) + 1) * (scale) - (len))
+#define FC_LALIGN_DIST(v, scale) (((v) - 1) / (scale))
+#define FC_LALIGN_LEN(v, scale) ((FC_LALIGN_DIST(v, scale) + 1) * (scale) - (v))
+
 #endif
-#line 6 "metric.c"
+#line 6 "align.c"
 
-/* Default length of a column in a matrix of edit operations.
- * If one of the sequences to compare is longer than this, or if
- * the edit operations matrix doesn't fit, memory is allocated dynamically.
+/* Subproblems with at most this number of cells are solved with a full
+ * matrix. Those with at most two rows are also, since they can't be split
+ * around a transposition.
  */
-#ifdef NDEBUG
-   #define FC_DEFAULT_COLUMN_LEN 256
-#else
-   #define FC_DEFAULT_COLUMN_LEN 1
-#endif
+#define FC_ALIGN_BASE_CELLS 4096
+
+struct fc_aligner {
+   const char32_t *seq1, *seq2;
+   const char32_t *rev1, *rev2;  /* Same as above, reversed. */
+   int32_t len1, len2;
+   bool transpos;                /* Whether transpositions are allowed. */
+   bool sub;                     /* Whether substitutions are allowed. */
+   int32_t *rows;                /* 6 rows of len2 + 1 cells. */
+   int32_t *matrix;              /* For the subproblems solved directly. */
+   unsigned char *ops;           /* Traceback of the above. */
+   struct fc_edit *script;
+   int32_t nr;
+};
 
-/* Strip common prefixes and suffixes of two sequences.
- * "seq1" must be longer than "seq2", or have the same length than "seq2",
- * for this to be valid.
+static void fc_align_emit(struct fc_aligner *al, enum fc_edit_op op, int32_t len)
+{
+   if (!len)
+      return;
+   if (al->nr && al->script[al->nr - 1].op == op)
+      al->script[al->nr - 1].len += len;
+   else
+      al->script[al->nr++] = (struct fc_edit){.op = op, .len = len};
+}
+
+static bool fc_align_transposed(const char32_t *seq1, int32_t i,
+                                const char32_t *seq2, int32_t j)
+{
+   return seq1[i] == seq2[j - 1] && seq1[i - 1] == seq2[j];
+}
+
+/* Computes the rows of the matrix between two sequences. The last row is put
+ * in rows[2], and the one before it in rows[1].
  */
-#define STRIP(seq1, seq2, len1, len2) do {                                     \
-   assert(len1 >= len2);                                                       \
-   while (len2 && *seq1 == *seq2) {                                            \
-      seq1++;                                                                  \
-      seq2++;                                                                  \
-      len1--;                                                                  \
-      len2--;                                                                  \
-   }                                                                           \
-   while (len2 && seq1[len1 - 1] == seq2[len2 - 1]) {                          \
-      len1--;                                                                  \
-      len2--;                                                                  \
-   }                                                                           \
-} while (0)
+static void fc_align_rows(const struct fc_aligner *al,
+                          const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          int32_t *rows[static 3])
+{
+   int32_t *prev2 = rows[0], *prev = rows[1], *cur = rows[2];
 
-#define TRANSPOSED(seq1, seq2, i, j)                                           \
-   (i > 1 && j > 1 && seq1[i - 2] == seq2[j - 1] && seq1[i - 1] == seq2[j - 2])
+   for (int32_t j = 0; j <= len2; j++)
+      cur[j] = j;
 
-#define IN_RANGE(len) (len >= 0 && len <= FC_MAX_SEQ_LEN)
+   for (int32_t i = 1; i <= len1; i++) {
+      FC_SWAP3(int32_t *, prev2, prev, cur);
+      cur[0] = i;
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t d = FC_MIN(prev[j], cur[j - 1]) + 1;
+         if (seq1[i - 1] == seq2[j - 1])
+            d = FC_MIN(d, prev[j - 1]);
+         else if (al->sub)
+            d = FC_MIN(d, prev[j - 1] + 1);
+         if (al->transpos && i > 1 && j > 1
+             && fc_align_transposed(seq1, i - 1, seq2, j - 1))
+            d = FC_MIN(d, prev2[j - 2] + 1);
+         cur[j] = d;
+      }
+   }
+   rows[0] = prev2;
+   rows[1] = prev;
+   rows[2] = cur;
+}
 
-static_assert(sizeof(size_t) >= sizeof(int32_t), "");
+/* Aligns seq1[i0:i1] with seq2[j0:j1] with a full matrix. */
+static void fc_align_base(struct fc_aligner *al, int32_t i0, int32_t i1,
+                          int32_t j0, int32_t j1)
+{
+   const char32_t *seq1 = &al->seq1[i0], *seq2 = &al->seq2[j0];
+   const int32_t len1 = i1 - i0, len2 = j1 - j0;
+   const int32_t dim = len2 + 1;
+   int32_t *d = al->matrix;
 
-/*******************************************************************************
- * Absolute Levenshtein distance
- ******************************************************************************/
+   for (int32_t j = 0; j <= len2; j++)
+      d[j] = j;
+   for (int32_t i = 1; i <= len1; i++) {
+      int32_t *row = &d[i * dim];
+      row[0] = i;
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t v = FC_MIN(row[j - dim], row[j - 1]) + 1;
+         if (seq1[i - 1] == seq2[j - 1])
+            v = FC_MIN(v, row[j - dim - 1]);
+         else if (al->sub)
+            v = FC_MIN(v, row[j - dim - 1] + 1);
+         if (al->transpos && i > 1 && j > 1
+             && fc_align_transposed(seq1, i - 1, seq2, j - 1))
+            v = FC_MIN(v, row[j - 2 * dim - 2] + 1);
+         row[j] = v;
+      }
+   }
 
-/* Like fc_levenshtein() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold len2 + 1 int32_ts.
+   /* Walk back from the end, preferring matches, then transpositions,
+    * substitutions, deletions, and insertions.
+    */
+   int32_t nr = 0;
+   for (int32_t i = len1, j = len2; i > 0 || j > 0; ) {
+      const int32_t *cell = &d[i * dim + j];
+      enum fc_edit_op op;
+
+      if (i && j && seq1[i - 1] == seq2[j - 1] && *cell == cell[-dim - 1])
+         op = FC_EDIT_MATCH;
+      else if (al->transpos && i > 1 && j > 1
+               && fc_align_transposed(seq1, i - 1, seq2, j - 1)
+               && *cell == cell[-2 * dim - 2] + 1)
+         op = FC_EDIT_TRANSPOSE;
+      else if (al->sub && i && j && *cell == cell[-dim - 1] + 1)
+         op = FC_EDIT_SUB;
+      else if (i && *cell == cell[-dim] + 1)
+         op = FC_EDIT_DEL;
+      else
+         op = FC_EDIT_INS;
+
+      al->ops[nr++] = op;
+      switch (op) {
+      case FC_EDIT_MATCH: case FC_EDIT_SUB:
+         i--, j--;
+         break;
+      case FC_EDIT_TRANSPOSE:
+         i -= 2, j -= 2;
+         break;
+      case FC_EDIT_DEL:
+         i--;
+         break;
+      case FC_EDIT_INS:
+         j--;
+         break;
+      }
+   }
+   while (nr)
+      fc_align_emit(al, al->ops[--nr], 1);
+}
+
+/* Hirschberg's algorithm. The rows of the matrix at the middle of the
+ * subproblem are computed from both ends, and the column where an optimal
+ * path crosses this row is the one that minimizes the sum of both. With
+ * transpositions, a path can also jump over the middle row, which is checked
+ * with the rows that surround it.
  */
-static int32_t fc_levenshtein0(int32_t *column, const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
+static void fc_align0(struct fc_aligner *al, int32_t i0, int32_t i1,
+                      int32_t j0, int32_t j1)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+   const int32_t len1 = i1 - i0, len2 = j1 - j0;
 
-   STRIP(seq1, seq2, len1, len2);
-
-   if (len2 == 0)
-      return len1;
+   if (len1 == 0) {
+      fc_align_emit(al, FC_EDIT_INS, len2);
+      return;
+   }
+   if (len2 == 0) {
+      fc_align_emit(al, FC_EDIT_DEL, len1);
+      return;
+   }
+   if (len1 <= 2 || (int64_t)(len1 + 1) * (len2 + 1) <= FC_ALIGN_BASE_CELLS) {
+      fc_align_base(al, i0, i1, j0, j1);
+      return;
+   }
 
-   for (int32_t j = 1 ; j <= len2; j++)
-      column[j] = j;
+   const int32_t mid = i0 + len1 / 2;
+   const int32_t dim = al->len2 + 1;
+   int32_t *fwd[3] = {al->rows, &al->rows[dim], &al->rows[2 * dim]};
+   int32_t *bwd[3] = {&al->rows[3 * dim], &al->rows[4 * dim], &al->rows[5 * dim]};
 
-   for (int32_t i = 1 ; i <= len1; i++) {
-      *column = i;
-      int32_t last = i - 1;
+   /* fwd[2][k] is the cell (mid, j0 + k), and bwd[2][k] the cell
+    * (mid, j1 - k), as seen from the end.
+    */
+   fc_align_rows(al, &al->seq1[i0], mid - i0, &al->seq2[j0], len2, fwd);
+   fc_align_rows(al, &al->rev1[al->len1 - i1], i1 - mid,
+                 &al->rev2[al->len2 - j1], len2, bwd);
+
+   int32_t split = 0, best = INT32_MAX;
+   for (int32_t k = 0; k <= len2; k++) {
+      const int32_t cost = fwd[2][k] + bwd[2][len2 - k];
+      if (cost < best) {
+         best = cost;
+         split = k;
+      }
+   }
 
-      for (int32_t j = 1; j <= len2; j++) {
-         const int32_t old = column[j];
-         if (seq1[i - 1] == seq2[j - 1])
-            column[j] = last;
-         else {
-            const int32_t ic = column[j - 1] + 1;
-            const int32_t dc = column[j] + 1;
-            const int32_t rc = last + 1;
-            column[j] = FC_MIN3(ic, dc, rc);
+   int32_t jump = -1;
+   if (al->transpos) {
+      for (int32_t k = 1; k < len2; k++) {
+         if (!fc_align_transposed(al->seq1, mid, al->seq2, j0 + k))
+            continue;
+         const int32_t cost = fwd[1][k - 1] + 1 + bwd[1][len2 - k - 1];
+         if (cost < best) {
+            best = cost;
+            jump = k;
          }
-         last = old;
       }
    }
 
-   return column[len2];
+   if (jump >= 0) {
+      fc_align0(al, i0, mid - 1, j0, j0 + jump - 1);
+      fc_align_emit(al, FC_EDIT_TRANSPOSE, 1);
+      fc_align0(al, mid + 1, i1, j0 + jump + 1, j1);
+   } else {
+      fc_align0(al, i0, mid, j0, j0 + split);
+      fc_align0(al, mid, i1, j0 + split, j1);
+   }
 }
 
-int32_t fc_levenshtein(const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
+static void fc_align(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     bool transpos, bool sub,
+                     struct fc_edit *script, int32_t *nr)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
+
+   struct fc_aligner al = {
+      .seq1 = seq1,
+      .seq2 = seq2,
+      .len1 = len1,
+      .len2 = len2,
+      .transpos = transpos,
+      .sub = sub,
+      .script = script,
+   };
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
-   }
+   /* Common prefixes and suffixes are matched. */
+   int32_t prefix = 0;
+   while (prefix < len1 && prefix < len2 && seq1[prefix] == seq2[prefix])
+      prefix++;
+   int32_t suffix = 0;
+   while (suffix < len1 - prefix && suffix < len2 - prefix
+          && seq1[len1 - 1 - suffix] == seq2[len2 - 1 - suffix])
+      suffix++;
+   fc_align_emit(&al, FC_EDIT_MATCH, prefix);
+
+   const size_t dim = len2 + 1;
+   const size_t cells = FC_MAX(FC_ALIGN_BASE_CELLS, 3 * dim);
+   int32_t *buf = fc_malloc((len1 + len2 + 6 * dim + cells) * sizeof *buf
+                            + len1 + len2);
+   char32_t *rev1 = (char32_t *)buf, *rev2 = &rev1[len1];
+   for (int32_t i = 0; i < len1; i++)
+      rev1[i] = seq1[len1 - 1 - i];
+   for (int32_t i = 0; i < len2; i++)
+      rev2[i] = seq2[len2 - 1 - i];
+   al.rev1 = rev1;
+   al.rev2 = rev2;
+   al.rows = &buf[len1 + len2];
+   al.matrix = &al.rows[6 * dim];
+   al.ops = (unsigned char *)&al.matrix[cells];
+
+   fc_align0(&al, prefix, len1 - suffix, prefix, len2 - suffix);
+   fc_align_emit(&al, FC_EDIT_MATCH, suffix);
+
+   fc_free(buf);
+   *nr = al.nr;
+}
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
+static int32_t fc_script_cost(const struct fc_edit *script, int32_t nr)
+{
+   int32_t cost = 0;
 
-   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+   for (int32_t i = 0; i < nr; i++)
+      if (script[i].op != FC_EDIT_MATCH)
+         cost += script[i].len;
+   return cost;
+}
+
+int32_t fc_levenshtein_align(const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, false, true, script, nr);
+   return fc_script_cost(script, *nr);
+}
 
-   int32_t dist = fc_levenshtein0(columnp, seq1, len1, seq2, len2);
+int32_t fc_damerau_align(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2,
+                         struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, true, true, script, nr);
+   return fc_script_cost(script, *nr);
+}
 
-   if (columnp != column)
-      fc_free(columnp);
+int32_t fc_lcsubseq_align(const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, false, false, script, nr);
 
-   return dist;
+   int32_t lcs = 0;
+   for (int32_t i = 0; i < *nr; i++)
+      if (script[i].op == FC_EDIT_MATCH)
+         lcs += script[i].len;
+   return lcs;
 }
+#line 1 "bitpar.c"
+#include <assert.h>
+#include <string.h>
+#line 1 "bitpar.h"
+#ifndef FC_BITPAR_H
+#define FC_BITPAR_H
 
+#include <stdint.h>
+#include <uchar.h>
+#line 1 "elem.h"
+#ifndef FC_ELEM_H
+#define FC_ELEM_H
 
-/*******************************************************************************
- * Normalized Levenshtein distance
- ******************************************************************************/
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
 
-/* Like fc_nlevenshtein() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold len2 + 1 doubles.
+/* Sequences can be made of elements of 1, 2, or 4 bytes. Code that supports
+ * all of them takes sequences as "const void *", together with the size of
+ * their elements. Kernels are written once, as always inlined functions, and
+ * FC_ELEM_DISPATCH() calls them with a constant size, so that they are
+ * compiled once per size, and elements are loaded without any conversion but
+ * a zero extension.
  */
-static double fc_nlevenshtein0(int32_t *column, enum fc_norm_method method,
-                               const char32_t *seq1, int32_t len1,
-                               const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
 
-   if (len2 == 0)
-      return len1 == 0 ? 0.0 : 1.0;
-
-   if (method == FC_NORM_LSEQ)
-      return fc_levenshtein0(column, seq1, len1, seq2, len2) / (double)len1;
+#define FC_ALWAYS_INLINE static inline __attribute__((always_inline))
 
-   assert(method == FC_NORM_LALIGN);
+#define FC_ELEM_DISPATCH(size, func, ...)                                      \
+   ((size) == 1 ? func(__VA_ARGS__, 1)                                         \
+                : (size) == 2 ? func(__VA_ARGS__, 2) : func(__VA_ARGS__, 4))
 
-   int32_t *length = &column[len2 + 1];
+static_assert(sizeof(char32_t) == 4, "");
 
-   for (int32_t j = 1 ; j <= len2; j++)
-      column[j] = length[j] = j;
+/* Returns the element at position "i". */
+FC_ALWAYS_INLINE char32_t fc_elem(const void *seq, int32_t i, int size)
+{
+   switch (size) {
+   case 1:
+      return ((const uint8_t *)seq)[i];
+   case 2:
+      return ((const uint16_t *)seq)[i];
+   default:
+      return ((const char32_t *)seq)[i];
+   }
+}
 
-   for (int32_t i = 1 ; i <= len1; i++) {
-      *column = *length = i;
-      int32_t last = i - 1, llast = i - 1;
+/* Returns a pointer to the element at position "i". */
+FC_ALWAYS_INLINE const void *fc_elem_ptr(const void *seq, int32_t i, int size)
+{
+   return (const char *)seq + (size_t)i * size;
+}
 
-      for (int32_t j = 1; j <= len2; j++) {
+#endif
+#line 8 "bitpar.h"
 
-         const int32_t old = column[j];
-         const int32_t ic = column[j - 1] + 1;
-         const int32_t dc = column[j] + 1;
-         const int32_t rc = last + (seq1[i - 1] != seq2[j - 1]);
-         column[j] = FC_MIN3(ic, dc, rc);
-         last = old;
+/* Number of bits in a word of a bit-vector. */
+#define FC_WORD_BITS 64
 
-         const int32_t lold = length[j];
-         const int32_t lic = ic == column[j] ? length[j - 1] + 1 : 0;
-         const int32_t ldc = dc == column[j] ? length[j] + 1 : 0;
-         const int32_t lrc = rc == column[j] ? llast + 1 : 0;
-         length[j] = FC_MAX3(lic, ldc, lrc);
-         llast = lold;
-      }
-   }
+/* Maximum number of words needed to hold a bit-vector for a sequence. */
+#define FC_MAX_WORDS ((FC_MAX_SEQ_LEN + FC_WORD_BITS - 1) / FC_WORD_BITS)
 
-   return column[len2] / (double)length[len2];
+static inline int32_t fc_popcount(uint64_t x)
+{
+   return __builtin_popcountll(x);
 }
 
-double fc_nlevenshtein(enum fc_norm_method method,
-                       const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+/* Index of the lowest set bit. "x" must not be zero. */
+static inline int32_t fc_ctz(uint64_t x)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   return __builtin_ctzll(x);
+}
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
-   }
+/* Number of hash slots available without dynamic allocation. This is enough
+ * for sequences that fit in a single word.
+ */
+#define FC_PEQ_SLOTS_NR (2 * FC_WORD_BITS)
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 2], *columnp = column;
+struct fc_peq_slot {
+   char32_t c;
+   int32_t row;         /* Row of the masks for "c", or 0 if the slot is free. */
+};
 
-   if (2 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(2 * (len2 + 1) * sizeof *columnp);
+/* Pattern-match masks of a sequence, as used by bit-parallel algorithms.
+ * For each character "c" of the sequence, there is a mask of "words" words
+ * where the bit at position i is set iff seq[i] == c. Since the alphabet is
+ * huge, masks are stored in a contiguous array of rows, and the mapping of
+ * characters to rows is done with an open-addressing hash table. The row 0 is
+ * filled with zeroes, and is used for characters not in the sequence.
+ */
+struct fc_peq {
+   int32_t len;                  /* Length of the sequence. */
+   int32_t words;                /* Number of words per mask. */
+   int32_t rows_nr;              /* Number of distinct characters plus one. */
+   uint32_t mask;                /* Number of slots minus one. */
+   int shift;                    /* For reducing hash values. */
+   struct fc_peq_slot *slots;
+   uint64_t *rows;
+   struct fc_peq_slot slots_buf[FC_PEQ_SLOTS_NR];
+   uint64_t rows_buf[FC_WORD_BITS + 1];
+};
 
-   double dist = fc_nlevenshtein0(columnp, method, seq1, len1, seq2, len2);
+/* Builds the masks of a sequence of elements of "size" bytes. The sequence is
+ * not referenced afterwards. No memory is allocated if the sequence fits in a
+ * single word.
+ */
+void fc_peq_init_elems(struct fc_peq *, const void *seq, int32_t len, int size);
 
-   if (columnp != column)
-      fc_free(columnp);
+/* The two steps of fc_peq_init_elems(). After the first one, characters are
+ * mapped to rows, but the masks are not built yet. The second one must be
+ * called with the same sequence.
+ */
+void fc_peq_init_slots_elems(struct fc_peq *, const void *seq, int32_t len,
+                             int size);
+void fc_peq_init_rows_elems(struct fc_peq *, const void *seq, int size);
 
-   return dist;
+/* Same as the above, for sequences of characters. */
+static inline void fc_peq_init(struct fc_peq *peq, const char32_t *seq,
+                               int32_t len)
+{
+   fc_peq_init_elems(peq, seq, len, sizeof *seq);
 }
 
-/*******************************************************************************
- * Absolute Damerau distance
- ******************************************************************************/
+static inline void fc_peq_init_slots(struct fc_peq *peq, const char32_t *seq,
+                                     int32_t len)
+{
+   fc_peq_init_slots_elems(peq, seq, len, sizeof *seq);
+}
 
-/* Like fc_damerau() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold 3 * (len2 + 1) int32_ts.
+static inline void fc_peq_init_rows(struct fc_peq *peq, const char32_t *seq)
+{
+   fc_peq_init_rows_elems(peq, seq, sizeof *seq);
+}
+
+void fc_peq_fini(struct fc_peq *);
+
+/* Returns the slot of a character, or the free slot where it should be
+ * inserted.
  */
-static int32_t fc_damerau0(int32_t *matrix, const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+static inline struct fc_peq_slot *fc_peq_slot(const struct fc_peq *peq,
+                                              char32_t c)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+   uint32_t i = ((uint32_t)c * UINT32_C(0x9E3779B1)) >> peq->shift;
 
-   STRIP(seq1, seq2, len1, len2);
+   for (;;) {
+      struct fc_peq_slot *slot = &peq->slots[i];
+      if (!slot->row || slot->c == c)
+         return slot;
+      i = (i + 1) & peq->mask;
+   }
+}
 
-   if (len2 == 0)
-      return len1;
+/* Returns the masks of a character. */
+static inline const uint64_t *fc_peq_get(const struct fc_peq *peq, char32_t c)
+{
+   return &peq->rows[fc_peq_slot(peq, c)->row * peq->words];
+}
 
-   int32_t *transpos = matrix;
-   int32_t *previous = &transpos[len2 + 1];
-   int32_t *current = &previous[len2 + 1];
+/* Computes the Levenshtein distance between the sequence a "peq" was built
+ * from and another sequence. This is Myers' algorithm, with Hyyrö's
+ * modifications for computing the global distance instead of doing a search.
+ * See Hyyrö, "A Bit-Vector Algorithm for Computing Levenshtein and
+ * Damerau Edit Distances".
+ */
+int32_t fc_bitpar_levenshtein(const struct fc_peq *, const char32_t *seq,
+                              int32_t len);
 
-   for (int32_t j = 0 ; j <= len2; j++)
-      previous[j] = j;
+/* Same as fc_bitpar_levenshtein(), but for the restricted Damerau distance
+ * (optimal string alignment), as computed by fc_damerau(). This is also due
+ * to Hyyrö.
+ */
+int32_t fc_bitpar_damerau(const struct fc_peq *, const char32_t *seq,
+                          int32_t len);
 
-   for (int32_t i = 1 ; i <= len1; i++) {
-      current[0] = i;
+/* Computes the length of the longest common subsequence between the sequence
+ * a "peq" was built from and another sequence (Allison-Dix, Crochemore et al.,
+ * Hyyrö).
+ */
+int32_t fc_bitpar_lcsubseq(const struct fc_peq *, const char32_t *seq,
+                           int32_t len);
 
-      for (int32_t j = 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
-            current[j] = previous[j - 1];
-         } else {
-            const int32_t ic = current[j - 1] + 1;
-            const int32_t dc = previous[j] + 1;
-            const int32_t rc = previous[j - 1] + 1;
-            current[j] = FC_MIN3(ic, dc, rc);
-
-            if (TRANSPOSED(seq1, seq2, i, j)) {
-               const int32_t tc = transpos[j - 2] + 1;
-               current[j] = FC_MIN(tc, current[j]);
-            }
-         }
-      }
-      FC_SWAP3(int32_t *, transpos, previous, current);
-   }
+/* Same as fc_bitpar_lcsubseq(), but returns -1 as soon as the length of the
+ * longest common subsequence is known to be lower than "min".
+ */
+int32_t fc_bitpar_lcsubseq_bounded(const struct fc_peq *, const char32_t *seq,
+                                   int32_t len, int32_t min);
 
-   return previous[len2];
-}
+/* Same as the above functions, for sequences of elements of "size" bytes. */
+int32_t fc_bitpar_levenshtein_elems(const struct fc_peq *, const void *seq,
+                                    int32_t len, int size);
+int32_t fc_bitpar_damerau_elems(const struct fc_peq *, const void *seq,
+                                int32_t len, int size);
+int32_t fc_bitpar_lcsubseq_bounded_elems(const struct fc_peq *, const void *seq,
+                                         int32_t len, int32_t min, int size);
 
-int32_t fc_damerau(const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+#endif
+#line 4 "bitpar.c"
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
+void fc_peq_init_slots_elems(struct fc_peq *peq, const void *seq, int32_t len,
+                             int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * (uint32_t)len) {
+      slots_nr <<= 1;
+      shift--;
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   peq->len = len;
+   peq->words = len > FC_WORD_BITS ? (len + FC_WORD_BITS - 1) / FC_WORD_BITS : 1;
+   peq->mask = slots_nr - 1;
+   peq->shift = shift;
 
-   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
+   peq->slots = peq->slots_buf;
+   if (slots_nr > FC_ARRAY_SIZE(peq->slots_buf))
+      peq->slots = fc_malloc(slots_nr * sizeof *peq->slots);
+   memset(peq->slots, 0, slots_nr * sizeof *peq->slots);
+
+   /* Assign a row to each distinct character first, so that we know how much
+    * space is needed for the masks.
+    */
+   int32_t rows_nr = 1;
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      struct fc_peq_slot *slot = fc_peq_slot(peq, c);
+      if (!slot->row) {
+         slot->c = c;
+         slot->row = rows_nr++;
+      }
+   }
+   peq->rows_nr = rows_nr;
+   peq->rows = peq->rows_buf;
+}
 
-   int32_t dist = fc_damerau0(columnp, seq1, len1, seq2, len2);
+void fc_peq_init_rows_elems(struct fc_peq *peq, const void *seq, int size)
+{
+   const int32_t len = peq->len;
+   const size_t rows_size = peq->rows_nr * peq->words * sizeof *peq->rows;
+   peq->rows = peq->rows_buf;
+   if (rows_size > sizeof peq->rows_buf)
+      peq->rows = fc_malloc(rows_size);
+   memset(peq->rows, 0, rows_size);
+
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      uint64_t *masks = &peq->rows[fc_peq_slot(peq, c)->row * peq->words];
+      masks[i / FC_WORD_BITS] |= UINT64_C(1) << (i % FC_WORD_BITS);
+   }
+}
 
-   if (columnp != column)
-      fc_free(columnp);
+void fc_peq_init_elems(struct fc_peq *peq, const void *seq, int32_t len, int size)
+{
+   fc_peq_init_slots_elems(peq, seq, len, size);
+   fc_peq_init_rows_elems(peq, seq, size);
+}
 
-   return dist;
+void fc_peq_fini(struct fc_peq *peq)
+{
+   if (peq->slots != peq->slots_buf)
+      fc_free(peq->slots);
+   if (peq->rows != peq->rows_buf)
+      fc_free(peq->rows);
 }
 
 
 /*******************************************************************************
- * Normalized Damerau distance
+ * Levenshtein
  ******************************************************************************/
 
-/* Like fc_ndamerau() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold 6 * (len2 + 1) items.
- */
-static double fc_ndamerau0(int32_t *matrix, enum fc_norm_method method,
-                           const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_bitpar_levenshtein1(const struct fc_peq *peq,
+                                                const void *seq, int32_t len, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = *fc_peq_get(peq, fc_elem(seq, i, size));
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+   }
+   return dist;
+}
 
-   if (len2 == 0)
-      return len1 == 0 ? 0.0 : 1.0;
+/* Same as above, for sequences that don't fit in a single word. Horizontal
+ * deltas are carried from one block to the next.
+ */
+FC_ALWAYS_INLINE int32_t fc_bitpar_levenshteinN(const struct fc_peq *peq,
+                                                const void *seq, int32_t len, int size)
+{
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = 0;
+   }
 
-   if (method == FC_NORM_LSEQ)
-      return (double)fc_damerau0(matrix, seq1, len1, seq2, len2) / len1;
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+      uint64_t hp_carry = 1, hn_carry = 0;
 
-   assert(method == FC_NORM_LALIGN);
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t xv = eqs[w] | vn[w];
+         const uint64_t eq = eqs[w] | hn_carry;
+         const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+         uint64_t hp = vn[w] | ~(xh | vp[w]);
+         uint64_t hn = vp[w] & xh;
 
-   int32_t *ltranspos = matrix;
-   int32_t *lprevious = &ltranspos[len2 + 1];
-   int32_t *lcurrent = &lprevious[len2 + 1];
-   int32_t *transpos = &lcurrent[len2 + 1];
-   int32_t *previous = &transpos[len2 + 1];
-   int32_t *current = &previous[len2 + 1];
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
 
-   for (int32_t j = 0 ; j <= len2; j++)
-      previous[j] = lprevious[j] = j;
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
 
-   for (int32_t i = 1 ; i <= len1; i++) {
-      *current = *lcurrent = i;
+         vp[w] = hn | ~(xv | hp);
+         vn[w] = hp & xv;
+      }
+   }
+   return dist;
+}
 
-      for (int32_t j = 1; j <= len2; j++) {
-         const bool transposed = TRANSPOSED(seq1, seq2, i, j);
+int32_t fc_bitpar_levenshtein_elems(const struct fc_peq *peq, const void *seq,
+                                    int32_t len, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
 
-         const int32_t ic = current[j - 1] + 1;
-         const int32_t dc = previous[j] + 1;
-         const int32_t rc = previous[j - 1] + (seq1[i - 1] != seq2[j - 1]);
-         current[j] = FC_MIN3(ic, dc, rc);
+   if (peq->len == 0)
+      return len;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_levenshtein1, peq, seq, len);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_levenshteinN, peq, seq, len);
+}
 
-         int32_t tc;
-         if (transposed) {
-            tc = transpos[j - 2] + 1;
-            current[j] = FC_MIN(current[j], tc);
-         }
+int32_t fc_bitpar_levenshtein(const struct fc_peq *peq,
+                              const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_levenshtein_elems(peq, seq, len, sizeof *seq);
+}
 
-         const int32_t lic = ic == current[j] ? lcurrent[j - 1] + 1 : 0;
-         const int32_t ldc = dc == current[j] ? lprevious[j] + 1 : 0;
-         const int32_t lrc = rc == current[j] ? lprevious[j - 1] + 1 : 0;
-         lcurrent[j] = FC_MAX3(lic, ldc, lrc);
 
-         if (transposed) {
-            const int32_t ltc = tc == current[j] ? ltranspos[j - 2] + 1 : 0;
-            lcurrent[j] = FC_MAX(lcurrent[j], ltc);
-         }
-      }
+/*******************************************************************************
+ * Damerau
+ ******************************************************************************/
 
-      FC_SWAP3(int32_t *, transpos, previous, current);
-      FC_SWAP3(int32_t *, ltranspos, lprevious, lcurrent);
+/* Transpositions are detected by looking at the masks of the previous
+ * character of "seq", and at the diagonal deltas of the previous column.
+ */
+FC_ALWAYS_INLINE int32_t fc_bitpar_damerau1(const struct fc_peq *peq,
+                                            const void *seq, int32_t len, int size)
+{
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0, d0 = 0, prev_eq = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = *fc_peq_get(peq, fc_elem(seq, i, size));
+      const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+      d0 = (((eq & vp) + vp) ^ vp) | eq | vn | tr;
+      uint64_t hp = vn | ~(d0 | vp);
+      uint64_t hn = d0 & vp;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(d0 | hp);
+      vn = hp & d0;
+      prev_eq = eq;
    }
-
-   return previous[len2] / (double)lprevious[len2];
+   return dist;
 }
 
-double fc_ndamerau(enum fc_norm_method method,
-                   const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_bitpar_damerauN(const struct fc_peq *peq,
+                                            const void *seq, int32_t len, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
-
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   uint64_t d0[FC_MAX_WORDS], prev_eq[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = d0[w] = prev_eq[w] = 0;
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 6], *columnp = column;
-   if (6 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(6 * (len2 + 1) * sizeof *columnp);
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+      uint64_t hp_carry = 1, hn_carry = 0, tr_carry = 0;
 
-   double dist = fc_ndamerau0(columnp, method, seq1, len1, seq2, len2);
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t eq = eqs[w];
+         const uint64_t x = eq | hn_carry;
+         const uint64_t tr = (((~d0[w] & eq) << 1) | tr_carry) & prev_eq[w];
+         tr_carry = (~d0[w] & eq) >> (FC_WORD_BITS - 1);
 
-   if (columnp != column)
-      fc_free(columnp);
+         const uint64_t d = (((x & vp[w]) + vp[w]) ^ vp[w]) | x | vn[w] | tr;
+         uint64_t hp = vn[w] | ~(d | vp[w]);
+         uint64_t hn = d & vp[w];
 
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         vp[w] = hn | ~(d | hp);
+         vn[w] = hp & d;
+         d0[w] = d;
+         prev_eq[w] = eq;
+      }
+   }
+   return dist;
+}
+
+int32_t fc_bitpar_damerau_elems(const struct fc_peq *peq, const void *seq,
+                                int32_t len, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   if (peq->len == 0)
+      return len;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_damerau1, peq, seq, len);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_damerauN, peq, seq, len);
+}
+
+int32_t fc_bitpar_damerau(const struct fc_peq *peq,
+                          const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_damerau_elems(peq, seq, len, sizeof *seq);
+}
+
+
+/*******************************************************************************
+ * Longest common subsequence
+ ******************************************************************************/
+
+/* Bits of "s" are cleared at the positions of the pattern that are part of a
+ * longest common subsequence. See Hyyrö, "Bit-Parallel LCS-length Computation
+ * Revisited".
+ *
+ * Every FC_LCS_CHECK_STEP characters, we check that the current length plus
+ * the number of characters left is at least "min", and give up otherwise.
+ */
+#define FC_LCS_CHECK_STEP 16
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_lcsubseq1(const struct fc_peq *peq,
+                                             const void *seq, int32_t len,
+                                             int32_t min, int size)
+{
+   const uint64_t mask = ~UINT64_C(0) >> (FC_WORD_BITS - peq->len);
+   uint64_t s = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; ) {
+      const int32_t end = FC_MIN(len, i + FC_LCS_CHECK_STEP);
+      for (; i < end; i++) {
+         const uint64_t u = s & *fc_peq_get(peq, fc_elem(seq, i, size));
+         s = (s + u) | (s - u);
+      }
+      if (min > 0 && fc_popcount(~s & mask) + len - i < min)
+         return -1;
+   }
+   return fc_popcount(~s & mask);
+}
+
+static int32_t fc_bitpar_lcsubseqN_count(const struct fc_peq *peq,
+                                         const uint64_t *s)
+{
+   const int32_t words = peq->words;
+   int32_t lcs = 0;
+
+   for (int32_t w = 0; w < words - 1; w++)
+      lcs += fc_popcount(~s[w]);
+
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   return lcs + fc_popcount(~s[words - 1] & (~UINT64_C(0) >> (FC_WORD_BITS - rem)));
+}
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_lcsubseqN(const struct fc_peq *peq,
+                                             const void *seq, int32_t len,
+                                             int32_t min, int size)
+{
+   const int32_t words = peq->words;
+   uint64_t s[FC_MAX_WORDS];
+
+   for (int32_t w = 0; w < words; w++)
+      s[w] = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; ) {
+      const int32_t end = FC_MIN(len, i + FC_LCS_CHECK_STEP);
+      for (; i < end; i++) {
+         const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+         uint64_t carry = 0;
+
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t u = s[w] & eqs[w];
+            const uint64_t sum = s[w] + carry;
+            const uint64_t x = sum + u;
+            carry = (sum < carry) | (x < u);
+            s[w] = x | (s[w] - u);
+         }
+      }
+      if (min > 0 && fc_bitpar_lcsubseqN_count(peq, s) + len - i < min)
+         return -1;
+   }
+   return fc_bitpar_lcsubseqN_count(peq, s);
+}
+
+int32_t fc_bitpar_lcsubseq_bounded_elems(const struct fc_peq *peq, const void *seq,
+                                         int32_t len, int32_t min, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   if (peq->len == 0)
+      return min > 0 ? -1 : 0;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_lcsubseq1, peq, seq, len, min);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_lcsubseqN, peq, seq, len, min);
+}
+
+int32_t fc_bitpar_lcsubseq_bounded(const struct fc_peq *peq,
+                                   const char32_t *seq, int32_t len,
+                                   int32_t min)
+{
+   return fc_bitpar_lcsubseq_bounded_elems(peq, seq, len, min, sizeof *seq);
+}
+
+int32_t fc_bitpar_lcsubseq(const struct fc_peq *peq,
+                           const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_lcsubseq_bounded(peq, seq, len, 0);
+}
+#line 1 "glob.c"
+
+/* Could be refactored to remove recursion altogether. */
+bool fc_glob(const char32_t *pat, const char32_t *str)
+{
+   for (;;) {
+      switch (*pat) {
+      case U'\0':
+         return !*str;
+         break;
+      case U'?':
+         if (!*str++)
+            return false;
+         pat++;
+         break;
+      case U'*':
+         /* Could skip following trailing stars, don't think it's that useful.
+          */
+         if (!*++pat)
+            return true;
+         do {
+            if (fc_glob(pat, str))
+               return true;
+         } while (*str++);
+         return false;
+         break;
+      case U'[': {
+         bool invert = false;
+         pat++;
+         if (*pat == U'^') {
+            invert = true;
+            pat++;
+         }
+         while ((*pat == *str) == invert) {
+            if (!*pat || *pat == U']')
+               return false;
+            pat++;
+         }
+         do {
+            if (!*pat++)
+               return false;
+         } while (*pat != U']');
+         pat++;
+         str++;
+         break;
+      }
+      default:
+         if (*str++ != *pat++)
+            return false;
+         break;
+      }
+   }
+   return false;
+}
+#line 1 "long.c"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The matrix is cut into horizontal strips of FC_LONG_STRIP_LEN rows, and
+ * each strip is computed from left to right with the bit-parallel algorithms,
+ * by tiles of FC_LONG_TILE_LEN columns. A tile depends on the tile at its left,
+ * which is computed by the same thread, and on the tile above it, from which
+ * the carries of each column are passed down. Thus, tiles run in a wavefront:
+ * a thread can start computing a strip as soon as the first tile of the
+ * previous strip is done. Only the masks of the strips being computed, and the
+ * carries of each column, are held in memory.
+ */
+#define FC_LONG_STRIP_LEN 512
+#define FC_LONG_STRIP_WORDS (FC_LONG_STRIP_LEN / FC_WORD_BITS)
+#define FC_LONG_TILE_LEN 1024
+
+/* Vertical state of a strip, carried from one tile to the next. For the
+ * longest common subsequence, "vp" holds the vector "s" of Hyyrö.
+ */
+struct fc_long_strip {
+   uint64_t vp[FC_LONG_STRIP_WORDS];
+   uint64_t vn[FC_LONG_STRIP_WORDS];
+   uint64_t d0[FC_LONG_STRIP_WORDS];
+   uint64_t prev_eq[FC_LONG_STRIP_WORDS];
+};
+
+/* Bits of the carries of a column. */
+enum {
+   FC_LONG_HP = 1,         /* Also the addition carry of fc_lcsubseq_long(). */
+   FC_LONG_HN = 2,
+   FC_LONG_TR = 4,
+};
+
+struct fc_long {
+   enum fc_metric metric;
+   const char32_t *seq1, *seq2;
+   int64_t len1, len2;
+   int64_t strips_nr, tiles_nr;
+   uint8_t *carries;             /* Per column, carries to the next strip. */
+   _Atomic int64_t *done;        /* Per strip, number of tiles computed. */
+   _Atomic int64_t next;         /* Next strip to compute. */
+   _Atomic int64_t sum;          /* Sum of the values of the strips. */
+};
+
+/* Same as fc_bitpar_damerauN(), or fc_bitpar_levenshteinN() if "transpos" is
+ * false, but the carries of the first word come from the strip above.
+ */
+static inline void fc_long_edit_tile(const struct fc_peq *peq,
+                                     struct fc_long_strip *st,
+                                     const char32_t *seq, int64_t len,
+                                     uint8_t *carries, bool transpos)
+{
+   const int32_t words = peq->words;
+
+   for (int64_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq[i]);
+      uint64_t hp_carry = carries[i] & FC_LONG_HP;
+      uint64_t hn_carry = (carries[i] & FC_LONG_HN) != 0;
+      uint64_t tr_carry = (carries[i] & FC_LONG_TR) != 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t eq = eqs[w];
+         const uint64_t x = eq | hn_carry;
+         uint64_t tr = 0;
+         if (transpos) {
+            tr = (((~st->d0[w] & eq) << 1) | tr_carry) & st->prev_eq[w];
+            tr_carry = (~st->d0[w] & eq) >> (FC_WORD_BITS - 1);
+         }
+
+         const uint64_t vp = st->vp[w], vn = st->vn[w];
+         const uint64_t d = (((x & vp) + vp) ^ vp) | x | vn | tr;
+         uint64_t hp = vn | ~(d | vp);
+         uint64_t hn = d & vp;
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         st->vp[w] = hn | ~(d | hp);
+         st->vn[w] = hp & d;
+         if (transpos) {
+            st->d0[w] = d;
+            st->prev_eq[w] = eq;
+         }
+      }
+      carries[i] = hp_carry | hn_carry << 1 | tr_carry << 2;
+   }
+}
+
+/* Same as fc_bitpar_lcsubseqN(). */
+static void fc_long_lcsubseq_tile(const struct fc_peq *peq,
+                                  struct fc_long_strip *st,
+                                  const char32_t *seq, int64_t len,
+                                  uint8_t *carries)
+{
+   const int32_t words = peq->words;
+   uint64_t *s = st->vp;
+
+   for (int64_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq[i]);
+      uint64_t carry = carries[i];
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t u = s[w] & eqs[w];
+         const uint64_t sum = s[w] + carry;
+         const uint64_t x = sum + u;
+         carry = (sum < carry) | (x < u);
+         s[w] = x | (s[w] - u);
+      }
+      carries[i] = carry;
+   }
+}
+
+static void fc_long_wait(_Atomic int64_t *done, int64_t tiles)
+{
+   while (atomic_load_explicit(done, memory_order_acquire) < tiles)
+      sched_yield();
+}
+
+/* Returns the contribution of a strip to the result. For the edit distances,
+ * this is the sum of the vertical deltas of the last column.
+ */
+static int64_t fc_long_strip_value(const struct fc_long *lg,
+                                   const struct fc_peq *peq,
+                                   const struct fc_long_strip *st)
+{
+   const int32_t words = peq->words;
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   int64_t value = 0;
+
+   for (int32_t w = 0; w < words; w++) {
+      const uint64_t mask = w < words - 1 ? ~UINT64_C(0)
+                                          : ~UINT64_C(0) >> (FC_WORD_BITS - rem);
+      if (lg->metric == FC_LCSUBSEQ)
+         value += fc_popcount(~st->vp[w] & mask);
+      else
+         value += fc_popcount(st->vp[w] & mask) - fc_popcount(st->vn[w] & mask);
+   }
+   return value;
+}
+
+static void fc_long_strip(struct fc_long *lg, int64_t strip)
+{
+   const int64_t row = strip * FC_LONG_STRIP_LEN;
+   struct fc_peq peq;
+   fc_peq_init(&peq, &lg->seq1[row], FC_MIN(lg->len1 - row, FC_LONG_STRIP_LEN));
+
+   struct fc_long_strip st;
+   for (int32_t w = 0; w < FC_LONG_STRIP_WORDS; w++) {
+      st.vp[w] = ~UINT64_C(0);
+      st.vn[w] = st.d0[w] = st.prev_eq[w] = 0;
+   }
+
+   for (int64_t tile = 0; tile < lg->tiles_nr; tile++) {
+      if (strip)
+         fc_long_wait(&lg->done[strip - 1], tile + 1);
+
+      const int64_t col = tile * FC_LONG_TILE_LEN;
+      const int64_t len = FC_MIN(lg->len2 - col, FC_LONG_TILE_LEN);
+      switch (lg->metric) {
+      case FC_LEVENSHTEIN:
+         fc_long_edit_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col], false);
+         break;
+      case FC_DAMERAU:
+         fc_long_edit_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col], true);
+         break;
+      default:
+         fc_long_lcsubseq_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col]);
+         break;
+      }
+      atomic_store_explicit(&lg->done[strip], tile + 1, memory_order_release);
+   }
+
+   atomic_fetch_add(&lg->sum, fc_long_strip_value(lg, &peq, &st));
+   fc_peq_fini(&peq);
+}
+
+/* Strips are handed out in order, so that the strip a thread waits for is
+ * always being computed by another thread.
+ */
+static void *fc_long_work(void *arg)
+{
+   struct fc_long *lg = arg;
+   int64_t strip;
+
+   while ((strip = atomic_fetch_add(&lg->next, 1)) < lg->strips_nr)
+      fc_long_strip(lg, strip);
+   return NULL;
+}
+
+static int64_t fc_long(enum fc_metric metric,
+                       const char32_t *seq1, int64_t len1,
+                       const char32_t *seq2, int64_t len2, int threads)
+{
+   assert(len1 >= 0 && len2 >= 0);
+
+   /* The metrics are symmetric. There is more parallelism when the longest
+    * sequence is cut into strips.
+    */
+   if (len1 < len2) {
+      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(int64_t, len1, len2);
+   }
+
+   struct fc_long lg = {
+      .metric = metric,
+      .seq1 = seq1,
+      .seq2 = seq2,
+      .len1 = len1,
+      .len2 = len2,
+      .strips_nr = (len1 + FC_LONG_STRIP_LEN - 1) / FC_LONG_STRIP_LEN,
+      .tiles_nr = (len2 + FC_LONG_TILE_LEN - 1) / FC_LONG_TILE_LEN,
+   };
+   if (!lg.strips_nr)
+      return 0;
+
+   lg.done = fc_malloc(lg.strips_nr * sizeof *lg.done + len2);
+   lg.carries = (uint8_t *)&lg.done[lg.strips_nr];
+   for (int64_t i = 0; i < lg.strips_nr; i++)
+      atomic_init(&lg.done[i], 0);
+   memset(lg.carries, metric == FC_LCSUBSEQ ? 0 : FC_LONG_HP, len2);
+   atomic_init(&lg.next, 0);
+   atomic_init(&lg.sum, 0);
+
+   if (threads <= 0)
+      threads = FC_MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+   threads = FC_MIN(threads, lg.strips_nr);
+
+   /* The calling thread also does its share of the work. If a thread can't be
+    * created, the others do its share.
+    */
+   pthread_t *tids = NULL;
+   int spawned = 0;
+   if (threads > 1) {
+      tids = fc_malloc((threads - 1) * sizeof *tids);
+      while (spawned < threads - 1
+             && !pthread_create(&tids[spawned], NULL, fc_long_work, &lg))
+         spawned++;
+   }
+   fc_long_work(&lg);
+   for (int i = 0; i < spawned; i++)
+      pthread_join(tids[i], NULL);
+
+   fc_free(tids);
+   fc_free(lg.done);
+
+   const int64_t sum = atomic_load(&lg.sum);
+   return metric == FC_LCSUBSEQ ? sum : len2 + sum;
+}
+
+int64_t fc_levenshtein_long(const char32_t *seq1, int64_t len1,
+                            const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_levenshtein(seq1, len1, seq2, len2);
+   return fc_long(FC_LEVENSHTEIN, seq1, len1, seq2, len2, threads);
+}
+
+int64_t fc_damerau_long(const char32_t *seq1, int64_t len1,
+                        const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_damerau(seq1, len1, seq2, len2);
+   return fc_long(FC_DAMERAU, seq1, len1, seq2, len2, threads);
+}
+
+int64_t fc_lcsubseq_long(const char32_t *seq1, int64_t len1,
+                         const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_lcsubseq(seq1, len1, seq2, len2);
+   return fc_long(FC_LCSUBSEQ, seq1, len1, seq2, len2, threads);
+}
+#line 1 "mem.c"
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+noreturn void fc_fatal(const char *msg, ...)
+{
+   va_list ap;
+
+   fputs("faconde: ", stderr);
+   va_start(ap, msg);
+   vfprintf(stderr, msg, ap);
+   va_end(ap);
+   putc('\n', stderr);
+   fflush(stderr);
+
+   abort();
+}
+
+void *fc_malloc(size_t size)
+{
+   assert(size);
+   void *mem = malloc(size);
+   if (!mem)
+      fc_fatal("out of memory");
+   return mem;
+}
+#line 1 "metric.c"
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#line 1 "sam.h"
+#ifndef FC_SAM_H
+#define FC_SAM_H
+
+#include <stdint.h>
+#include <uchar.h>
+
+struct fc_sam_state {
+   int32_t len;         /* Length of the longest string of the state. */
+   int32_t link;        /* Suffix link, or -1 for the root. */
+   int32_t edges;       /* First outgoing edge, or -1. */
+};
+
+struct fc_sam_edge {
+   int32_t from;
+   char32_t c;
+   int32_t to;
+   int32_t next;        /* Next outgoing edge of "from", or -1. */
+};
+
+/* Suffix automaton of a sequence (Blumer et al.). This is the smallest
+ * automaton that recognizes all the substrings of the sequence. It has at most
+ * 2n - 1 states and 3n - 4 edges, and is built in linear time. Since the
+ * alphabet is huge, edges are stored in a contiguous array, and looked up with
+ * an open-addressing hash table keyed on their source state and label.
+ */
+struct fc_sam {
+   int32_t len;                  /* Length of the sequence. */
+   int32_t states_nr;
+   int32_t edges_nr;
+   uint32_t mask;                /* Number of slots minus one. */
+   int shift;                    /* For reducing hash values. */
+   int32_t *slots;               /* Edge index + 1, or 0 if the slot is free. */
+   struct fc_sam_state *states;
+   struct fc_sam_edge *edges;
+};
+
+/* Builds the automaton of a sequence of elements of "size" bytes. The sequence
+ * is not referenced afterwards.
+ */
+void fc_sam_init_elems(struct fc_sam *, const void *seq, int32_t len, int size);
+
+static inline void fc_sam_init(struct fc_sam *sam, const char32_t *seq,
+                               int32_t len)
+{
+   fc_sam_init_elems(sam, seq, len, sizeof *seq);
+}
+
+void fc_sam_fini(struct fc_sam *);
+
+static inline uint32_t fc_sam_hash(const struct fc_sam *sam, int32_t from,
+                                   char32_t c)
+{
+   return (((uint32_t)c ^ ((uint32_t)from * UINT32_C(0x85EBCA6B)))
+           * UINT32_C(0x9E3779B1)) >> sam->shift;
+}
+
+/* Returns the edge leaving a state with a given label, or NULL if there is
+ * none.
+ */
+static inline struct fc_sam_edge *fc_sam_edge(const struct fc_sam *sam,
+                                              int32_t from, char32_t c)
+{
+   uint32_t i = fc_sam_hash(sam, from, c);
+
+   for (;;) {
+      const int32_t e = sam->slots[i];
+      if (!e)
+         return NULL;
+      struct fc_sam_edge *edge = &sam->edges[e - 1];
+      if (edge->from == from && edge->c == c)
+         return edge;
+      i = (i + 1) & sam->mask;
+   }
+}
+
+/* Computes the length of the longest common substring between the sequence
+ * an automaton was built from and another sequence. If "end" is not NULL and
+ * the length is not zero, it is set to the index in "seq" of the last
+ * character of the leftmost longest common substring. "seq" is made of
+ * elements of "size" bytes.
+ */
+int32_t fc_sam_lcsubstr_elems(const struct fc_sam *, const void *seq,
+                              int32_t len, int32_t *end, int size);
+
+static inline int32_t fc_sam_lcsubstr(const struct fc_sam *sam,
+                                      const char32_t *seq, int32_t len,
+                                      int32_t *end)
+{
+   return fc_sam_lcsubstr_elems(sam, seq, len, end, sizeof *seq);
+}
+
+#endif
+#line 10 "metric.c"
+#line 1 "simd.h"
+#ifndef FC_SIMD_H
+#define FC_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <uchar.h>
+
+/* Vectorized kernels are written with the vector extensions of GCC and CLang,
+ * and are compiled for several instruction sets when on x86. The best one is
+ * chosen at runtime. Other compilers use the scalar implementations.
+ */
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5)
+   #define FC_HAVE_SIMD 1
+#endif
+
+/* Minimum length of the shortest sequence for using the vectorized kernels.
+ * Below this, the overhead of the setup is not amortized.
+ */
+#define FC_SIMD_MIN_LEN 16
+
+/* Maximum length of a sequence held in a single vector of characters. */
+#define FC_SIMD_SHORT_LEN 16
+
+#ifdef FC_HAVE_SIMD
+
+/* Same as fc_nlevenshtein() and fc_ndamerau() with FC_NORM_LALIGN, using
+ * anti-diagonal vectorization. "seq1" must be longer than "seq2", or have the
+ * same length. Sequences are made of elements of "size" bytes, which are
+ * remapped to small integers first.
+ */
+double fc_simd_nlevenshtein(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size);
+double fc_simd_ndamerau(const void *seq1, int32_t len1,
+                        const void *seq2, int32_t len2, int size);
+
+/* Same as fc_lcsubstr_extract(), vectorized over the columns of each row. */
+int32_t fc_simd_lcsubstr(const void *seq1, int32_t len1,
+                         const void *seq2, int32_t len2,
+                         const void **pos, int size);
+
+/* Same as fc_lcsubstr_extract(), vectorized over diagonals. One of the
+ * sequences must not be longer than FC_SIMD_SHORT_LEN.
+ */
+int32_t fc_simd_lcsubstr_diagonal(const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2,
+                                  const void **pos, int size);
+
+/* Same as fc_hamming_bounded(). */
+int32_t fc_simd_hamming(const char32_t *seq1, const char32_t *seq2,
+                        int32_t len, int32_t k);
+
+/* Compares "query" to the "nr" keys of length "len" stored contiguously in
+ * "keys", and stores in out[i] the distance to the key "i", as returned by
+ * fc_hamming_bounded().
+ */
+void fc_simd_hamming_scan(const char32_t *query, int32_t len,
+                          const char32_t *keys, size_t nr,
+                          int32_t k, int32_t *out);
+
+/* Implementation of the fc_*_batch() functions. "metric" must be one of
+ * FC_LEVENSHTEIN, FC_DAMERAU, or FC_LCSUBSEQ, and "peq" must have been built
+ * from the query.
+ */
+void fc_simd_batch(enum fc_metric metric, const struct fc_peq *peq,
+                   const char32_t *query, int32_t qlen,
+                   const char32_t *const *cands, const int32_t *lens,
+                   size_t nr, int32_t *out);
+
+#endif
+
+#endif
+#line 11 "metric.c"
+
+/* Default length of a column in a matrix of edit operations.
+ * If one of the sequences to compare is longer than this, or if
+ * the edit operations matrix doesn't fit, memory is allocated dynamically.
+ */
+#ifdef NDEBUG
+   #define FC_DEFAULT_COLUMN_LEN 256
+#else
+   #define FC_DEFAULT_COLUMN_LEN 1
+#endif
+
+/* Strip common prefixes and suffixes of two sequences.
+ * "seq1" must be longer than "seq2", or have the same length than "seq2",
+ * for this to be valid.
+ */
+#define STRIP(seq1, seq2, len1, len2) do {                                     \
+   assert(len1 >= len2);                                                       \
+   while (len2 && *seq1 == *seq2) {                                            \
+      seq1++;                                                                  \
+      seq2++;                                                                  \
+      len1--;                                                                  \
+      len2--;                                                                  \
+   }                                                                           \
+   while (len2 && seq1[len1 - 1] == seq2[len2 - 1]) {                          \
+      len1--;                                                                  \
+      len2--;                                                                  \
+   }                                                                           \
+} while (0)
+
+/* Same as STRIP(), for sequences of elements of "size" bytes. */
+#define STRIP_ELEMS(seq1, seq2, len1, len2, size) do {                         \
+   assert(len1 >= len2);                                                       \
+   int32_t prefix_ = 0;                                                        \
+   while (prefix_ < len2                                                       \
+          && fc_elem(seq1, prefix_, size) == fc_elem(seq2, prefix_, size))     \
+      prefix_++;                                                               \
+   seq1 = fc_elem_ptr(seq1, prefix_, size);                                    \
+   seq2 = fc_elem_ptr(seq2, prefix_, size);                                    \
+   len1 -= prefix_;                                                            \
+   len2 -= prefix_;                                                            \
+   while (len2                                                                 \
+          && fc_elem(seq1, len1 - 1, size) == fc_elem(seq2, len2 - 1, size)) { \
+      len1--;                                                                  \
+      len2--;                                                                  \
+   }                                                                           \
+} while (0)
+
+#define TRANSPOSED(seq1, seq2, i, j)                                           \
+   (i > 1 && j > 1 && seq1[i - 2] == seq2[j - 1] && seq1[i - 1] == seq2[j - 2])
+
+/* Same as TRANSPOSED(), for sequences of elements of "size" bytes. */
+#define TRANSPOSED_ELEMS(seq1, seq2, i, j, size)                               \
+   (i > 1 && j > 1                                                             \
+    && fc_elem(seq1, i - 2, size) == fc_elem(seq2, j - 1, size)                \
+    && fc_elem(seq1, i - 1, size) == fc_elem(seq2, j - 2, size))
+
+#define IN_RANGE(len) (len >= 0 && len <= FC_MAX_SEQ_LEN)
+
+static_assert(sizeof(size_t) >= sizeof(int32_t), "");
+
+/*******************************************************************************
+ * Absolute Levenshtein distance
+ ******************************************************************************/
+
+/* The shortest sequence fits in a single word up to this length, but the
+ * masks of the characters of the other sequence are then computed on the fly
+ * instead of building a "peq", which costs more than the whole comparison of
+ * short words.
+ */
+#define FC_LEV_SHORT_LEN 20
+
+/* Returns the mask of the positions of "c" in "seq", which must fit in a
+ * single word.
+ */
+FC_ALWAYS_INLINE uint64_t fc_short_eq(const void *seq, int32_t len, char32_t c,
+                                      int size)
+{
+   uint64_t eq = 0;
+   for (int32_t j = 0; j < len; j++)
+      eq |= (uint64_t)(fc_elem(seq, j, size) == c) << j;
+   return eq;
+}
+
+FC_ALWAYS_INLINE int32_t fc_levenshtein_short(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(len2 > 0 && len2 <= FC_LEV_SHORT_LEN);
+
+   const uint64_t last = UINT64_C(1) << (len2 - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = len2;
+
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t eq = fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+   }
+   return dist;
+}
+
+FC_ALWAYS_INLINE int32_t fc_levenshtein_body(const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   if (len2 == 0)
+      return len1;
+   if (len2 <= FC_LEV_SHORT_LEN)
+      return fc_levenshtein_short(seq1, len1, seq2, len2, size);
+
+   /* The shortest sequence is used as pattern, so that we need as few words
+    * as possible.
+    */
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
+
+   int32_t dist = fc_bitpar_levenshtein_elems(&peq, seq1, len1, size);
+
+   fc_peq_fini(&peq);
+   return dist;
+}
+
+static int32_t fc_levenshtein_elems(const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_levenshtein_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_levenshtein(const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_levenshtein_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Normalized Levenshtein distance
+ ******************************************************************************/
+
+static_assert(2 * FC_MAX_SEQ_LEN < FC_LALIGN_SCALE, "");
+
+/* Like fc_nlevenshtein() but with a provided buffer for holding the matrix.
+ * "seq1" is also expected to be longer than "seq2", or have the same length.
+ * The provided buffer should be big enough to hold len2 + 1 items.
+ */
+FC_ALWAYS_INLINE double fc_nlevenshtein0_body(int32_t *column,
+                                              enum fc_norm_method method,
+                                              const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+
+   if (len2 == 0)
+      return len1 == 0 ? 0.0 : 1.0;
+
+   if (method == FC_NORM_LSEQ)
+      return fc_levenshtein_elems(seq1, len1, seq2, len2, size) / (double)len1;
+
+   assert(method == FC_NORM_LALIGN);
+
+   /* Distances and alignment lengths are packed together. */
+   const int32_t scale = FC_LALIGN_SCALE;
+
+   for (int32_t j = 0 ; j <= len2; j++)
+      column[j] = FC_LALIGN_PACK(j, j, scale);
+
+   for (int32_t i = 1 ; i <= len1; i++) {
+      int32_t last = *column;
+      *column = FC_LALIGN_PACK(i, i, scale);
+
+      for (int32_t j = 1; j <= len2; j++) {
+         const int32_t old = column[j];
+         const int32_t idc = FC_MIN(column[j - 1], column[j]) + scale;
+         const int32_t rc = last + (fc_elem(seq1, i - 1, size)
+                                    != fc_elem(seq2, j - 1, size)) * scale;
+         column[j] = FC_MIN(idc, rc) - 1;
+         last = old;
+      }
+   }
+
+   return FC_LALIGN_DIST(column[len2], scale)
+        / (double)FC_LALIGN_LEN(column[len2], scale);
+}
+
+static double fc_nlevenshtein0(int32_t *column, enum fc_norm_method method,
+                               const void *seq1, int32_t len1,
+                               const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_nlevenshtein0_body, column, method,
+                           seq1, len1, seq2, len2);
+}
+
+static double fc_nlevenshtein_elems(enum fc_norm_method method,
+                                    const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+#ifdef FC_HAVE_SIMD
+   if (method == FC_NORM_LALIGN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_nlevenshtein(seq1, len1, seq2, len2, size);
+#endif
+
+   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
+
+   if (len2 + 1 > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+
+   double dist = fc_nlevenshtein0(columnp, method, seq1, len1, seq2, len2, size);
+
+   if (columnp != column)
+      fc_free(columnp);
+
+   return dist;
+}
+
+double fc_nlevenshtein(enum fc_norm_method method,
+                       const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2)
+{
+   return fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/*******************************************************************************
+ * Absolute Damerau distance
+ ******************************************************************************/
+
+/* Same as fc_levenshtein_short(), for the Damerau distance. */
+FC_ALWAYS_INLINE int32_t fc_damerau_short(const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
+{
+   assert(len2 > 0 && len2 <= FC_LEV_SHORT_LEN);
+
+   const uint64_t last = UINT64_C(1) << (len2 - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0, d0 = 0, prev_eq = 0;
+   int32_t dist = len2;
+
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t eq = fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+      d0 = (((eq & vp) + vp) ^ vp) | eq | vn | tr;
+      uint64_t hp = vn | ~(d0 | vp);
+      uint64_t hn = d0 & vp;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(d0 | hp);
+      vn = hp & d0;
+      prev_eq = eq;
+   }
+   return dist;
+}
+
+FC_ALWAYS_INLINE int32_t fc_damerau_body(const void *seq1, int32_t len1,
+                                         const void *seq2, int32_t len2,
+                                         int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   if (len2 == 0)
+      return len1;
+   if (len2 <= FC_LEV_SHORT_LEN)
+      return fc_damerau_short(seq1, len1, seq2, len2, size);
+
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
+
+   int32_t dist = fc_bitpar_damerau_elems(&peq, seq1, len1, size);
+
+   fc_peq_fini(&peq);
+   return dist;
+}
+
+static int32_t fc_damerau_elems(const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_damerau_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_damerau(const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_damerau_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Normalized Damerau distance
+ ******************************************************************************/
+
+/* Like fc_ndamerau() but with a provided buffer for holding the matrix.
+ * "seq1" is also expected to be longer than "seq2", or have the same length.
+ * The provided buffer should be big enough to hold 3 * (len2 + 1) items.
+ */
+FC_ALWAYS_INLINE double fc_ndamerau0_body(int32_t *matrix,
+                                          enum fc_norm_method method,
+                                          const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+
+   if (len2 == 0)
+      return len1 == 0 ? 0.0 : 1.0;
+
+   if (method == FC_NORM_LSEQ)
+      return (double)fc_damerau_elems(seq1, len1, seq2, len2, size) / len1;
+
+   assert(method == FC_NORM_LALIGN);
+
+   /* Distances and alignment lengths are packed together. */
+   const int32_t scale = FC_LALIGN_SCALE;
+
+   int32_t *transpos = matrix;
+   int32_t *previous = &transpos[len2 + 1];
+   int32_t *current = &previous[len2 + 1];
+
+   for (int32_t j = 0 ; j <= len2; j++)
+      previous[j] = FC_LALIGN_PACK(j, j, scale);
+
+   for (int32_t i = 1 ; i <= len1; i++) {
+      *current = FC_LALIGN_PACK(i, i, scale);
+
+      for (int32_t j = 1; j <= len2; j++) {
+         const int32_t idc = FC_MIN(current[j - 1], previous[j]) + scale;
+         const int32_t rc = previous[j - 1] + (fc_elem(seq1, i - 1, size)
+                                               != fc_elem(seq2, j - 1, size)) * scale;
+         current[j] = FC_MIN(idc, rc);
+
+         if (TRANSPOSED_ELEMS(seq1, seq2, i, j, size))
+            current[j] = FC_MIN(current[j], transpos[j - 2] + scale);
+         current[j]--;
+      }
+
+      FC_SWAP3(int32_t *, transpos, previous, current);
+   }
+
+   return FC_LALIGN_DIST(previous[len2], scale)
+        / (double)FC_LALIGN_LEN(previous[len2], scale);
+}
+
+static double fc_ndamerau0(int32_t *matrix, enum fc_norm_method method,
+                           const void *seq1, int32_t len1,
+                           const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_ndamerau0_body, matrix, method,
+                           seq1, len1, seq2, len2);
+}
+
+static double fc_ndamerau_elems(enum fc_norm_method method,
+                                const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+#ifdef FC_HAVE_SIMD
+   if (method == FC_NORM_LALIGN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_ndamerau(seq1, len1, seq2, len2, size);
+#endif
+
+   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
+
+   double dist = fc_ndamerau0(columnp, method, seq1, len1, seq2, len2, size);
+
+   if (columnp != column)
+      fc_free(columnp);
+
+   return dist;
+}
+
+double fc_ndamerau(enum fc_norm_method method,
+                   const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_ndamerau_elems(method, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Bounded Levenshtein distance computation
+ ******************************************************************************/
+
+static int32_t fc_lev_bounded0_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 == len2)
+      return memcmp(seq1, seq2, (size_t)len1 * size) != 0;
+   return INT32_MAX;
+}
+
+static int32_t fc_lev_bounded0(const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded0_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+FC_ALWAYS_INLINE int32_t fc_lev_bounded1_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(int32_t, len1, len2);
+      FC_SWAP(const void *, seq1, seq2);
+   }
+
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   return len1;
+}
+
+static int32_t fc_lev_bounded1_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded1_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lev_bounded1(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded1_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/* C adaptation of:
+ * http://writingarchives.sakura.ne.jp/fastcomp/#algorithm
+ * This is both efficient and cheap in implementation complexity.
+ * i, d, r -> insert, delete, replace.
+ */
+FC_ALWAYS_INLINE int32_t fc_lev_bounded2_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   static const char *const models[3][4] = {
+      {"id", "di", "rr", NULL},
+      {"dr", "rd", NULL},
+      {"dd", NULL},
+   };
+   int32_t dist = 3;
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   const int32_t diff = len1 - len2;
+   if (diff > 2)
+      return INT32_MAX;
+   if (len2 == 0)
+      return len1;
+
+   for (const char *const *model = models[diff]; *model; model++) {
+      int32_t i = 0, j = 0, cost = 0;
+
+      while (i < len1 && j < len2) {
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            i++;
+            j++;
+         } else {
+            cost++;
+            if (cost > 2)
+               break;
+            switch ((*model)[cost - 1]) {
+            case 'd':
+               i++;
+               break;
+            case 'i':
+               j++;
+               break;
+            default:
+               i++;
+               j++;
+               break;
+            }
+         }
+      }
+
+      if (cost <= 2) {
+         if (i < len1)
+            cost += len1 - i;
+         else if (j < len2)
+            cost += len2 - j;
+         if (cost < dist)
+            dist = cost;
+      }
+   }
+
+   return dist;
+}
+
+static int32_t fc_lev_bounded2_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded2_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded2_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t, const char32_t *, int32_t) = {
+   fc_lev_bounded0,
+   fc_lev_bounded1,
+   fc_lev_bounded2,
+};
+
+/* Same as fc_lev_bounded, for sequences of elements of "size" bytes. */
+static int32_t (*const fc_lev_bounded_elems[3])(const void *, int32_t,
+                                                const void *, int32_t, int) = {
+   fc_lev_bounded0_elems,
+   fc_lev_bounded1_elems,
+   fc_lev_bounded2_elems,
+};
+
+/* Ukkonen's cut-off: a cell on diagonal d = j - i can't be part of an
+ * alignment of cost <= k unless |d| + |d + len1 - len2| <= k, so only the
+ * corresponding band of each row is computed. Cells out of the band are
+ * considered to hold k + 1.
+ */
+FC_ALWAYS_INLINE int32_t fc_lev_bounded_band(int32_t *column,
+                                             const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int32_t k, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2 && len2 > 0);
+
+   const int32_t diff = len1 - len2;
+   const int32_t lo = -((k + diff) / 2);
+   const int32_t hi = (k - diff) / 2;
+   const int32_t inf = k + 1;
+
+   for (int32_t j = 0; j <= len2; j++)
+      column[j] = j <= hi ? j : inf;
+
+   for (int32_t i = 1; i <= len1; i++) {
+      const int32_t bot = FC_MAX(i + lo, 1);
+      const int32_t top = FC_MIN(i + hi, len2);
+      int32_t last = column[bot - 1];
+      int32_t left = inf;
+      int32_t min = inf;
+
+      if (bot == 1 && i + lo <= 0)
+         left = column[0] = i;
+
+      for (int32_t j = bot; j <= top; j++) {
+         const int32_t old = column[j];
+         if (fc_elem(seq1, i - 1, size) == fc_elem(seq2, j - 1, size)) {
+            column[j] = last;
+         } else {
+            const int32_t ic = left + 1;
+            const int32_t dc = column[j] + 1;
+            const int32_t rc = last + 1;
+            column[j] = FC_MIN3(ic, dc, rc);
+         }
+         if (column[j] < min)
+            min = column[j];
+         left = column[j];
+         last = old;
+      }
+      if (min > k)
+         return INT32_MAX;
+   }
+
+   return column[len2];
+}
+
+FC_ALWAYS_INLINE int32_t fc_lev_bounded_k_body(const void *seq1, int32_t len1,
+                                               const void *seq2, int32_t len2,
+                                               int32_t k, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && k >= 0);
+
+   if (k < (int32_t)FC_ARRAY_SIZE(fc_lev_bounded_elems))
+      return fc_lev_bounded_elems[k](seq1, len1, seq2, len2, size);
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   if (len1 - len2 > k)
+      return INT32_MAX;
+   if (len2 == 0)
+      return len1;
+   /* The distance can't be larger than len1. */
+   if (k > len1)
+      k = len1;
+
+   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
+   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+
+   int32_t dist = fc_lev_bounded_band(columnp, seq1, len1, seq2, len2, k, size);
+
+   if (columnp != column)
+      fc_free(columnp);
+
+   return dist;
+}
+
+static int32_t fc_lev_bounded_k_elems(const void *seq1, int32_t len1,
+                                      const void *seq2, int32_t len2,
+                                      int32_t k, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded_k_body, seq1, len1, seq2, len2,
+                           k);
+}
+
+int32_t fc_lev_bounded_k(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2, int32_t k)
+{
+   return fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Bounded Damerau distance computation
+ ******************************************************************************/
+
+FC_ALWAYS_INLINE int32_t fc_dam_bounded1_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(int32_t, len1, len2);
+      FC_SWAP(const void *, seq1, seq2);
+   }
+
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   if (len1 == 2 && len2 == 2 && TRANSPOSED_ELEMS(seq1, seq2, 2, 2, size))
+      return 1;
+   return len1;
+}
+
+static int32_t fc_dam_bounded1_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_dam_bounded1_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_dam_bounded1(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_dam_bounded1_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/* Same as fc_lev_bounded2(), with additional models involving transpositions
+ * (t).
+ */
+FC_ALWAYS_INLINE int32_t fc_dam_bounded2_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   static const char *const models[3][7] = {
+      {"id", "di", "rr", "rt", "tr", "tt", NULL},
+      {"dr", "rd", "dt", "td", NULL},
+      {"dd", NULL},
+   };
+   int32_t dist = 3;
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   const int32_t diff = len1 - len2;
+   if (diff > 2)
+      return INT32_MAX;
+   if (len2 == 0)
+      return len1;
+
+   for (const char *const *model = models[diff]; *model; model++) {
+      int32_t i = 0, j = 0, cost = 0;
+
+      while (i < len1 && j < len2) {
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            i++;
+            j++;
+            continue;
+         }
+         cost++;
+         if (cost > 2)
+            break;
+         switch ((*model)[cost - 1]) {
+         case 'd':
+            i++;
+            break;
+         case 'i':
+            j++;
+            break;
+         case 't':
+            if (i + 1 < len1 && j + 1 < len2
+                && TRANSPOSED_ELEMS(seq1, seq2, i + 2, j + 2, size)) {
+               i += 2;
+               j += 2;
+            } else {
+               /* Not applicable, give up on this model. */
+               cost = 3;
+               i = len1;
+            }
+            break;
+         default:
+            i++;
+            j++;
+            break;
+         }
+      }
+
+      if (cost <= 2) {
+         if (i < len1)
+            cost += len1 - i;
+         else if (j < len2)
+            cost += len2 - j;
+         if (cost < dist)
+            dist = cost;
+      }
+   }
+
+   return dist;
+}
+
+static int32_t fc_dam_bounded2_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_dam_bounded2_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_dam_bounded2(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_dam_bounded2_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+int32_t (*const fc_dam_bounded[3])(const char32_t *, int32_t, const char32_t *, int32_t) = {
+   fc_lev_bounded0,
+   fc_dam_bounded1,
+   fc_dam_bounded2,
+};
+
+/* Same as fc_dam_bounded, for sequences of elements of "size" bytes. */
+static int32_t (*const fc_dam_bounded_elems[3])(const void *, int32_t,
+                                                const void *, int32_t, int) = {
+   fc_lev_bounded0_elems,
+   fc_dam_bounded1_elems,
+   fc_dam_bounded2_elems,
+};
+
+
+/*******************************************************************************
+ * Bounded normalized distances
+ ******************************************************************************/
+
+/* Returns the largest distance "n" such that n / (double)len <= max, or -1
+ * if there is none. The division is the one done by the unbounded functions,
+ * so that both give the same results.
+ */
+static int32_t fc_budget(double max, int32_t len)
+{
+   if (max < 0)
+      return -1;
+   if (max >= 1)
+      return len;
+
+   int32_t n = (int32_t)(max * len);
+   while (n < len && (n + 1) / (double)len <= max)
+      n++;
+   while (n >= 0 && n / (double)len > max)
+      n--;
+   return n;
+}
+
+/* Computes the distance and the alignment length packed together (see
+ * FC_LALIGN_PACK()), considering only the cells of the matrix that can be on
+ * a path of cost at most "k", as fc_lev_bounded_band() does. Returns
+ * INT32_MAX as soon as all the cells of a row have a distance larger than
+ * "k". The provided buffer should be big enough to hold 3 * (len2 + 1) items.
+ */
+FC_ALWAYS_INLINE int32_t fc_lalign_band_body(int32_t *matrix, bool transpos,
+                                             const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int32_t k, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2 && len2 > 0);
+   assert(len1 - len2 <= k);
+
+   const int32_t scale = FC_LALIGN_SCALE;
+   const int32_t diff = len1 - len2;
+   const int32_t lo = -((k + diff) / 2);
+   const int32_t hi = (k - diff) / 2;
+   const int32_t inf = INT32_MAX / 2;
+
+   int32_t *transposed = matrix;
+   int32_t *previous = &transposed[len2 + 1];
+   int32_t *current = &previous[len2 + 1];
+
+   for (int32_t j = 0; j <= len2; j++)
+      previous[j] = j <= hi ? FC_LALIGN_PACK(j, j, scale) : inf;
+
+   for (int32_t i = 1; i <= len1; i++) {
+      const int32_t bot = FC_MAX(i + lo, 1);
+      const int32_t top = FC_MIN(i + hi, len2);
+
+      /* Cells just outside of the band are read by the next row. */
+      current[0] = i + lo <= 0 ? FC_LALIGN_PACK(i, i, scale) : inf;
+      if (bot > 1)
+         current[bot - 1] = inf;
+      if (top < len2)
+         current[top + 1] = inf;
+
+      int32_t min = current[0];
+      for (int32_t j = bot; j <= top; j++) {
+         const int32_t idc = FC_MIN(current[j - 1], previous[j]) + scale;
+         const int32_t rc = previous[j - 1] + (fc_elem(seq1, i - 1, size)
+                                               != fc_elem(seq2, j - 1, size)) * scale;
+         int32_t v = FC_MIN(idc, rc);
+         if (transpos && TRANSPOSED_ELEMS(seq1, seq2, i, j, size))
+            v = FC_MIN(v, transposed[j - 2] + scale);
+         current[j] = --v;
+         if (v < min)
+            min = v;
+      }
+      if (FC_LALIGN_DIST(min, scale) > k)
+         return INT32_MAX;
+
+      FC_SWAP3(int32_t *, transposed, previous, current);
+   }
+
+   return previous[len2];
+}
+
+static int32_t fc_lalign_band(int32_t *matrix, bool transpos,
+                              const void *seq1, int32_t len1,
+                              const void *seq2, int32_t len2,
+                              int32_t k, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lalign_band_body, matrix, transpos,
+                           seq1, len1, seq2, len2, k);
+}
+
+/* Band computations are only worth it if the band is narrow, otherwise the
+ * bit-parallel or vectorized algorithms are faster.
+ */
+#define FC_NARROW_BAND(k, len2) (4 * (k) < (len2))
+
+/* Wrapper for fc_lalign_band(). Returns INT32_MAX if the distance is larger
+ * than "k".
+ */
+static int32_t fc_lalign_bounded(bool transpos, const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int32_t k,
+                                 int size)
+{
+   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
+
+   int32_t v = fc_lalign_band(columnp, transpos, seq1, len1, seq2, len2, k, size);
+   if (v != INT32_MAX && FC_LALIGN_DIST(v, FC_LALIGN_SCALE) > k)
+      v = INT32_MAX;
+
+   if (columnp != column)
+      fc_free(columnp);
+   return v;
+}
+
+static double fc_nbounded(bool transpos, enum fc_norm_method method, double max,
+                          const void *seq1, int32_t len1,
+                          const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   if (len2 == 0) {
+      const double dist = len1 == 0 ? 0.0 : 1.0;
+      return dist <= max ? dist : HUGE_VAL;
+   }
+
+   double dist;
+   if (method == FC_NORM_LSEQ) {
+      /* The distance is at least the length difference. */
+      const int32_t k = fc_budget(max, len1);
+      if (len1 - len2 > k)
+         return HUGE_VAL;
+
+      int32_t d;
+      if (!transpos)
+         d = FC_NARROW_BAND(k, len2)
+           ? fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, size)
+           : fc_levenshtein_elems(seq1, len1, seq2, len2, size);
+      else if (k < (int32_t)FC_ARRAY_SIZE(fc_dam_bounded_elems))
+         d = fc_dam_bounded_elems[k](seq1, len1, seq2, len2, size);
+      else if (FC_NARROW_BAND(k, len2))
+         d = FC_LALIGN_DIST(fc_lalign_bounded(true, seq1, len1, seq2, len2, k, size),
+                            FC_LALIGN_SCALE);
+      else
+         d = fc_damerau_elems(seq1, len1, seq2, len2, size);
+      if (d > k)
+         return HUGE_VAL;
+      dist = d / (double)len1;
+   } else {
+      assert(method == FC_NORM_LALIGN);
+      /* The alignment length is at most len1 + len2. */
+      const int32_t k = fc_budget(max, len1 + len2);
+      if (len1 - len2 > k)
+         return HUGE_VAL;
+      if (FC_NARROW_BAND(k, len2)) {
+         const int32_t v = fc_lalign_bounded(transpos, seq1, len1, seq2, len2, k,
+                                             size);
+         if (v == INT32_MAX)
+            return HUGE_VAL;
+         dist = FC_LALIGN_DIST(v, FC_LALIGN_SCALE)
+              / (double)FC_LALIGN_LEN(v, FC_LALIGN_SCALE);
+      } else if (transpos)
+         dist = fc_ndamerau_elems(method, seq1, len1, seq2, len2, size);
+      else
+         dist = fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, size);
+   }
+   return dist <= max ? dist : HUGE_VAL;
+}
+
+double fc_nlevenshtein_bounded(enum fc_norm_method method, double max,
+                               const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2)
+{
+   return fc_nbounded(false, method, max, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+double fc_ndamerau_bounded(enum fc_norm_method method, double max,
+                           const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2)
+{
+   return fc_nbounded(true, method, max, seq1, len1, seq2, len2, sizeof *seq1);
+
+}
+
+
+/*******************************************************************************
+ * Longest common substring
+ ******************************************************************************/
+
+FC_ALWAYS_INLINE int32_t fc_lcsubstr0_body(int32_t *column,
+                                           const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           const void **pos, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   memset(column, 0, len2 * sizeof *column);
+
+   int32_t max_len = 0;
+   int32_t my_pos = INT32_MAX;
+
+   for (int32_t i = 0; i < len1; i++) {
+      int32_t last = 0;
+      for (int32_t j = 0; j < len2; j++) {
+         const int32_t old = column[j];
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            column[j] = last + 1;
+            if (max_len < column[j]) {
+               max_len = column[j];
+               my_pos = i;
+            }
+         } else {
+            column[j] = 0;
+         }
+         last = old;
+      }
+   }
+
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? my_pos - max_len + 1 : len1, size);
+   return max_len;
+}
+
+static int32_t fc_lcsubstr0(int32_t *column, const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, const void **pos,
+                            int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lcsubstr0_body, column, seq1, len1,
+                           seq2, len2, pos);
+}
+
+static int32_t fc_lcsubstr_sam(const struct fc_sam *sam,
+                               const void *seq1, int32_t len1,
+                               const void **pos, int size)
+{
+   int32_t end = 0;
+   const int32_t max_len = fc_sam_lcsubstr_elems(sam, seq1, len1, &end, size);
+
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
+}
+
+/* Above this length, a suffix automaton is built from "seq2" and walked with
+ * "seq1", in linear time, instead of computing the whole matrix. The
+ * vectorized kernel is fast enough to win up to fairly long sequences.
+ */
+#ifdef FC_HAVE_SIMD
+   #define FC_LCSUBSTR_SAM_MIN_LEN 1500
+#else
+   #define FC_LCSUBSTR_SAM_MIN_LEN 32
+#endif
+
+static int32_t fc_lcsubstr_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2,
+                                 const void **pos, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 >= FC_LCSUBSTR_SAM_MIN_LEN && len2 >= FC_LCSUBSTR_SAM_MIN_LEN) {
+      struct fc_sam sam;
+      fc_sam_init_elems(&sam, seq2, len2, size);
+      const int32_t max_len = fc_lcsubstr_sam(&sam, seq1, len1, pos, size);
+      fc_sam_fini(&sam);
+      return max_len;
+   }
+
+#ifdef FC_HAVE_SIMD
+   /* The diagonal kernel wastes lanes if the shortest sequence doesn't fill
+    * most of a vector.
+    */
+   const int32_t shortest = FC_MIN(len1, len2);
+   if (shortest >= FC_SIMD_SHORT_LEN / 2 && shortest <= FC_SIMD_SHORT_LEN)
+      return fc_simd_lcsubstr_diagonal(seq1, len1, seq2, len2, pos, size);
+   if (len1 >= FC_SIMD_MIN_LEN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_lcsubstr(seq1, len1, seq2, len2, pos, size);
+#endif
+
+   /* We don't swap the sequences here to not mess up the value assigned to
+    * the pointer *pos. This might result in a larger allocation.
+    */
+   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
+   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc(len2 * sizeof *columnp);
+
+   int32_t dist = fc_lcsubstr0(columnp, seq1, len1, seq2, len2, pos, size);
+
+   if (columnp != column)
+      fc_free(columnp);
+
+   return dist;
+}
+
+int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            const char32_t **pos)
+{
+   const void *start;
+   const int32_t max_len = fc_lcsubstr_elems(seq1, len1, seq2, len2,
+                                             pos ? &start : NULL, sizeof *seq1);
+   if (pos)
+      *pos = start;
+   return max_len;
+}
+
+int32_t fc_lcsubstr(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_lcsubstr_elems(seq1, len1, seq2, len2, NULL, sizeof *seq1);
+}
+
+void fc_lcsubstr_index_init(struct fc_lcsubstr_index *idx,
+                            const char32_t *ref, int32_t len)
+{
+   assert(IN_RANGE(len));
+
+   idx->sam = fc_malloc(sizeof *idx->sam);
+   fc_sam_init(idx->sam, ref, len);
+}
+
+void fc_lcsubstr_index_fini(struct fc_lcsubstr_index *idx)
+{
+   fc_sam_fini(idx->sam);
+   fc_free(idx->sam);
+}
+
+int32_t fc_lcsubstr_index_query(const struct fc_lcsubstr_index *idx,
+                                const char32_t *seq, int32_t len,
+                                const char32_t **pos)
+{
+   assert(len >= 0);
+
+   const void *start;
+   const int32_t max_len = fc_lcsubstr_sam(idx->sam, seq, len,
+                                           pos ? &start : NULL, sizeof *seq);
+   if (pos)
+      *pos = start;
+   return max_len;
+}
+
+
+/*******************************************************************************
+ * Longest common subsequence
+ ******************************************************************************/
+
+/* Below this length of "seq2", the bit-parallel algorithm only needs a few
+ * words per character, and is always faster than the sparse one.
+ */
+#define FC_SPARSE_MIN_LEN 256
+
+/* Estimated cost of processing a match with the sparse algorithm, relative to
+ * the cost of processing a word with the bit-parallel one, per step of binary
+ * search.
+ */
+#define FC_SPARSE_MATCH_COST 2
+
+/* Positions of each character of "seq" are gathered in lists, stored one after
+ * the other in "pos". ends[id] is the end of the list of the character whose
+ * masks are at the row "id" of "peq", and the list starts where the one of the
+ * previous row ends. "ends" must have room for rows_nr + 1 items, and must
+ * hold the number of positions of each row "id" at ends[id + 1], as set by
+ * fc_sparse_count().
+ */
+static void fc_sparse_count(const struct fc_peq *peq, const void *seq,
+                            int32_t len, int size, int32_t *ends)
+{
+   memset(ends, 0, (peq->rows_nr + 1) * sizeof *ends);
+   for (int32_t j = 0; j < len; j++)
+      ends[fc_peq_slot(peq, fc_elem(seq, j, size))->row + 1]++;
+}
+
+static void fc_sparse_lists(const struct fc_peq *peq, const void *seq,
+                            int32_t len, int size, int32_t *ends, int32_t *pos)
+{
+   for (int32_t id = 1; id <= peq->rows_nr; id++)
+      ends[id] += ends[id - 1];
+   for (int32_t j = 0; j < len; j++)
+      pos[ends[fc_peq_slot(peq, fc_elem(seq, j, size))->row]++] = j;
+}
+
+/* Whether the sparse algorithm is estimated to be faster than the
+ * bit-parallel one, given the number of matching pairs.
+ */
+static bool fc_sparse_faster(int64_t matches, int32_t len1, int32_t len2)
+{
+   int32_t log2 = 1;
+   while ((1 << log2) < len2)
+      log2++;
+   const int32_t words = (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   return matches * log2 * FC_SPARSE_MATCH_COST < (int64_t)len1 * words;
+}
+
+/* Hunt-Szymanski algorithm, which only looks at the pairs of matching
+ * characters, in O((r + n) log n) time, where "r" is the number of matches.
+ * thresh[k] is the smallest position in "seq2" where a common subsequence of
+ * length k + 1 can end. Matches of each character of "seq1", whose rows are
+ * given in "ids1", are processed from right to left, so that each can only
+ * extend subsequences that end before it. "thresh" must have room for len2
+ * items.
+ */
+static int32_t fc_sparse_run(const int32_t *ends, const int32_t *pos,
+                             const int32_t *ids1, int32_t len1, int32_t *thresh)
+{
+   int32_t lcs = 0;
+   for (int32_t i = 0; i < len1; i++) {
+      const int32_t id = ids1[i];
+      const int32_t first = id ? ends[id - 1] : 0;
+
+      for (int32_t p = ends[id] - 1; p >= first; p--) {
+         const int32_t j = pos[p];
+         int32_t lo = 0, hi = lcs;
+         while (lo < hi) {
+            const int32_t mid = (lo + hi) >> 1;
+            if (thresh[mid] < j)
+               lo = mid + 1;
+            else
+               hi = mid;
+         }
+         thresh[lo] = j;
+         if (lo == lcs)
+            lcs++;
+      }
+   }
+   return lcs;
+}
+
+/* Returns -1 if the bit-parallel algorithm is estimated to be faster, after
+ * having built the masks of "peq", which must have been initialized with
+ * fc_peq_init_slots().
+ */
+static int32_t fc_sparse_lcsubseq(struct fc_peq *peq,
+                                  const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2, int size)
+{
+   const int32_t rows_nr = peq->rows_nr;
+   int32_t *ids1 = fc_malloc((len1 + rows_nr + 1 + 2 * len2) * sizeof *ids1);
+   int32_t *ends = &ids1[len1];
+   int32_t *pos = &ends[rows_nr + 1];
+   int32_t *thresh = &pos[len2];
+
+   fc_sparse_count(peq, seq2, len2, size, ends);
+
+   int64_t matches = 0;
+   for (int32_t i = 0; i < len1; i++) {
+      ids1[i] = fc_peq_slot(peq, fc_elem(seq1, i, size))->row;
+      matches += ends[ids1[i] + 1];
+   }
+   if (!fc_sparse_faster(matches, len1, len2)) {
+      fc_free(ids1);
+      fc_peq_init_rows_elems(peq, seq2, size);
+      return -1;
+   }
+
+   fc_sparse_lists(peq, seq2, len2, size, ends, pos);
+   const int32_t lcs = fc_sparse_run(ends, pos, ids1, len1, thresh);
+
+   fc_free(ids1);
+   return lcs;
+}
+
+/* Same as FC_LEV_SHORT_LEN, for the longest common subsequence, whose loop
+ * is cheaper, so that the masks are worth hashing from shorter lengths.
+ */
+#define FC_LCS_SHORT_LEN 16
+
+FC_ALWAYS_INLINE int32_t fc_lcsubseq_short(const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           int size)
+{
+   assert(len2 > 0 && len2 <= FC_LCS_SHORT_LEN);
+
+   uint64_t s = ~UINT64_C(0);
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t u = s & fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      s = (s + u) | (s - u);
+   }
+   return fc_popcount(~s & (~UINT64_C(0) >> (FC_WORD_BITS - len2)));
+}
+
+FC_ALWAYS_INLINE int32_t fc_lcsubseq_body(const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   /* Common prefixes and suffixes are necessarily part of a longest common
+    * subsequence.
+    */
+   const int32_t orig_len2 = len2;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   const int32_t stripped = orig_len2 - len2;
+
+   if (len2 == 0)
+      return stripped;
+   if (len2 <= FC_LCS_SHORT_LEN)
+      return stripped + fc_lcsubseq_short(seq1, len1, seq2, len2, size);
+
+   struct fc_peq peq;
+   int32_t lcs = -1;
+
+   if (len2 >= FC_SPARSE_MIN_LEN) {
+      fc_peq_init_slots_elems(&peq, seq2, len2, size);
+      lcs = fc_sparse_lcsubseq(&peq, seq1, len1, seq2, len2, size);
+   } else {
+      fc_peq_init_elems(&peq, seq2, len2, size);
+   }
+   if (lcs < 0)
+      lcs = fc_bitpar_lcsubseq_bounded_elems(&peq, seq1, len1, 0, size);
+
+   fc_peq_fini(&peq);
+   return stripped + lcs;
+}
+
+static int32_t fc_lcsubseq_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lcsubseq_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_lcsubseq_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+static double fc_nlcsubseq_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 == 0 && len2 == 0)
+      return 1.;
+
+   const int32_t lcs = fc_lcsubseq_elems(seq1, len1, seq2, len2, size);
+   return 1. - (2. * lcs) / (double)(len1 + len2);
+}
+
+double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_nlcsubseq_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+FC_ALWAYS_INLINE double fc_nlcsubseq_bounded_body(double max,
+                                                  const void *seq1, int32_t len1,
+                                                  const void *seq2, int32_t len2,
+                                                  int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 == 0 && len2 == 0)
+      return 1. <= max ? 1. : HUGE_VAL;
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   /* Find the shortest subsequence length that gives a distance within the
+    * bound. The subsequence can't be longer than the shortest sequence.
+    */
+   const double total = len1 + len2;
+   if (max < 0 || 1. - (2. * len2) / total > max)
+      return HUGE_VAL;
+   int32_t min = max >= 1 ? 0 : (int32_t)((1. - max) * total / 2.);
+   while (min > 0 && 1. - (2. * (min - 1)) / total <= max)
+      min--;
+   while (1. - (2. * min) / total > max)
+      min++;
+
+   const int32_t orig_len2 = len2;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   const int32_t stripped = orig_len2 - len2;
+
+   int32_t lcs = stripped;
+   if (len2) {
+      struct fc_peq peq;
+      fc_peq_init_elems(&peq, seq2, len2, size);
+      const int32_t ret = fc_bitpar_lcsubseq_bounded_elems(&peq, seq1, len1,
+                                                           min - stripped, size);
+      fc_peq_fini(&peq);
+      if (ret < 0)
+         return HUGE_VAL;
+      lcs += ret;
+   }
+   if (lcs < min)
+      return HUGE_VAL;
+   return 1. - (2. * lcs) / total;
+}
+
+static double fc_nlcsubseq_bounded_elems(double max,
+                                         const void *seq1, int32_t len1,
+                                         const void *seq2, int32_t len2,
+                                         int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_nlcsubseq_bounded_body, max,
+                           seq1, len1, seq2, len2);
+}
+
+double fc_nlcsubseq_bounded(double max, const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2)
+{
+   return fc_nlcsubseq_bounded_elems(max, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Jaro
+ ******************************************************************************/
+
+/* Jaro distance, given the number of matching characters and the number of
+ * half-transpositions between them.
+ */
+static double fc_jaro_dist(int32_t matches, int32_t transpos,
+                           int32_t len1, int32_t len2)
+{
+   if (!matches)
+      return len1 || len2 ? 1. : 0.;
+
+   transpos >>= 1;
+   return 1. - (1. / 3. * (  matches / (double)len1
+                           + matches / (double)len2
+                           + (matches - transpos) / (double)matches));
+}
+
+/* Characters of "seq1" and "seq2" that are matched are flagged in bit-vectors.
+ * The first character of "seq2" in the window of a character of "seq1" that is
+ * equal to it and not matched yet is found by masking the pattern-match mask
+ * of this character with the complement of the flags and the window, and
+ * isolating the lowest set bit. Transpositions are then counted by walking
+ * the set bits of both flag vectors in parallel.
+ *
+ * If fewer than "min_matches" characters match, HUGE_VAL is returned as soon
+ * as this is known, and transpositions are not counted.
+ */
+FC_ALWAYS_INLINE double fc_jaro0_body(const struct fc_peq *peq,
+                                      const void *seq1, int32_t len1,
+                                      const void *seq2, int32_t len2,
+                                      int32_t min_matches, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && peq->len == len2);
+
+   if (len1 == 0 || len2 == 0)
+      return min_matches > 0 ? HUGE_VAL : fc_jaro_dist(0, 0, len1, len2);
+
+   const int32_t words1 = (len1 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   const int32_t words2 = (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   uint64_t matched1[FC_MAX_WORDS], matched2[FC_MAX_WORDS];
+
+   memset(matched1, 0, words1 * sizeof *matched1);
+   memset(matched2, 0, words2 * sizeof *matched2);
+
+   int32_t window = (FC_MAX(len1, len2) >> 1) - 1;
+   if (window < 0)
+      window = 0;
+
+   int32_t matches = 0;
+   const int32_t end1 = FC_MIN(len1, len2 + window);
+
+   for (int32_t i = 0; i < end1; i++) {
+      if (matches + end1 - i < min_matches)
+         return HUGE_VAL;
+
+      const int32_t bot = FC_MAX(i - window, 0);
+      const int32_t top = FC_MIN(i + window + 1, len2) - 1;
+      const int32_t first = bot / FC_WORD_BITS, last = top / FC_WORD_BITS;
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq1, i, size));
+
+      for (int32_t w = first; w <= last; w++) {
+         uint64_t m = eqs[w] & ~matched2[w];
+         if (w == first)
+            m &= ~UINT64_C(0) << (bot % FC_WORD_BITS);
+         if (w == last)
+            m &= ~UINT64_C(0) >> (FC_WORD_BITS - 1 - top % FC_WORD_BITS);
+         if (m) {
+            matched2[w] |= m & -m;
+            matched1[i / FC_WORD_BITS] |= UINT64_C(1) << (i % FC_WORD_BITS);
+            matches++;
+            break;
+         }
+      }
+   }
+   if (matches < min_matches)
+      return HUGE_VAL;
+   if (!matches)
+      return fc_jaro_dist(0, 0, len1, len2);
+
+   int32_t transpos = 0, w2 = 0;
+   uint64_t m2 = matched2[0];
+
+   for (int32_t w1 = 0; w1 < words1; w1++) {
+      for (uint64_t m1 = matched1[w1]; m1; m1 &= m1 - 1) {
+         while (!m2)
+            m2 = matched2[++w2];
+         const int32_t i = w1 * FC_WORD_BITS + fc_ctz(m1);
+         const int32_t j = w2 * FC_WORD_BITS + fc_ctz(m2);
+         transpos += fc_elem(seq1, i, size) != fc_elem(seq2, j, size);
+         m2 &= m2 - 1;
+      }
+   }
+   return fc_jaro_dist(matches, transpos, len1, len2);
+}
+
+static double fc_jaro0(const struct fc_peq *peq, const void *seq1, int32_t len1,
+                       const void *seq2, int32_t len2, int32_t min_matches,
+                       int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_jaro0_body, peq, seq1, len1, seq2, len2,
+                           min_matches);
+}
+
+/* Below this length, building the pattern-match masks costs more than it
+ * saves, and windows are scanned directly.
+ */
+#define FC_JARO_PEQ_MIN_LEN 16
+
+FC_ALWAYS_INLINE double fc_jaro_short_body(const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           int32_t min_matches, int size)
+{
+   assert(len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN);
+
+   int32_t window = (FC_MAX(len1, len2) >> 1) - 1;
+   if (window < 0)
+      window = 0;
+
+   uint32_t matched1 = 0, matched2 = 0;
+   int32_t matches = 0;
+
+   for (int32_t i = 0; i < len1; i++) {
+      if (matches + len1 - i < min_matches)
+         return HUGE_VAL;
+
+      const int32_t bot = FC_MAX(i - window, 0);
+      const int32_t top = FC_MIN(i + window + 1, len2);
+
+      for (int32_t j = bot; j < top; j++) {
+         if (!(matched2 >> j & 1)
+             && fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            matched1 |= UINT32_C(1) << i;
+            matched2 |= UINT32_C(1) << j;
+            matches++;
+            break;
+         }
+      }
+   }
+   if (matches < min_matches)
+      return HUGE_VAL;
+
+   int32_t transpos = 0;
+   for (; matched1; matched1 &= matched1 - 1, matched2 &= matched2 - 1)
+      transpos += fc_elem(seq1, fc_ctz(matched1), size)
+                  != fc_elem(seq2, fc_ctz(matched2), size);
+
+   return fc_jaro_dist(matches, transpos, len1, len2);
+}
+
+static double fc_jaro_short(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2,
+                            int32_t min_matches, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_jaro_short_body, seq1, len1, seq2, len2,
+                           min_matches);
+}
+
+static double fc_jaro_bounded0(const void *seq1, int32_t len1,
+                               const void *seq2, int32_t len2,
+                               int32_t min_matches, int size)
+{
+   if (len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+      return fc_jaro_short(seq1, len1, seq2, len2, min_matches, size);
+
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
+
+   double dist = fc_jaro0(&peq, seq1, len1, seq2, len2, min_matches, size);
+
+   fc_peq_fini(&peq);
+   return dist;
+}
+
+static double fc_jaro_elems(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   return fc_jaro_bounded0(seq1, len1, seq2, len2, 0, size);
+}
+
+double fc_jaro(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_jaro_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/* Factor by which the Jaro distance is multiplied to obtain the Jaro-Winkler
+ * distance.
+ */
+static double fc_winkler_factor(const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2,
+                                double prefix_scale, int32_t max_prefix,
+                                int size)
+{
+   assert(prefix_scale >= 0 && max_prefix >= 0 && prefix_scale * max_prefix <= 1);
+
+   const int32_t max = FC_MIN(max_prefix, FC_MIN(len1, len2));
+   int32_t prefix = 0;
+
+   while (prefix < max
+          && fc_elem(seq1, prefix, size) == fc_elem(seq2, prefix, size))
+      prefix++;
+   return 1. - prefix * prefix_scale;
+}
+
+static double fc_jaro_winkler_elems(const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2,
+                                    double prefix_scale, int32_t max_prefix,
+                                    int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   const double factor = fc_winkler_factor(seq1, len1, seq2, len2,
+                                           prefix_scale, max_prefix, size);
+   return factor * fc_jaro_elems(seq1, len1, seq2, len2, size);
+}
+
+double fc_jaro_winkler(const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2,
+                       double prefix_scale, int32_t max_prefix)
+{
+   return fc_jaro_winkler_elems(seq1, len1, seq2, len2, prefix_scale,
+                                max_prefix, sizeof *seq1);
+}
+
+/* Whether "matches" characters can give a Jaro-Winkler distance that is not
+ * larger than "max".
+ */
+static bool fc_jaro_winkler_within(int32_t matches, double factor,
+                                   int32_t len1, int32_t len2, double max)
+{
+   return factor * fc_jaro_dist(matches, 0, len1, len2) <= max;
+}
+
+/* The Jaro distance can't be lower than when all matching characters are in
+ * order, and it decreases with the number of matches, so we look for the
+ * smallest number of matches that could give a distance within the bound.
+ * If this is larger than the shortest sequence, the pair is rejected without
+ * looking at it. Otherwise, matching stops as soon as not enough characters
+ * remain, and transpositions are only counted if enough characters matched.
+ */
+static double fc_jaro_winkler_bounded_elems(const void *seq1, int32_t len1,
+                                            const void *seq2, int32_t len2,
+                                            double prefix_scale,
+                                            int32_t max_prefix, double max,
+                                            int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   const double factor = fc_winkler_factor(seq1, len1, seq2, len2,
+                                           prefix_scale, max_prefix, size);
+
+   /* Smallest number of matches giving a distance within the bound. */
+   const int32_t len = FC_MIN(len1, len2);
+   if (!fc_jaro_winkler_within(len, factor, len1, len2, max))
+      return HUGE_VAL;
+
+   int32_t min = 0;
+   if (len && factor > 0) {
+      const double sim = 3. * (1. - max / factor) - 1.;
+      if (sim > 0)
+         min = FC_MIN((int32_t)(sim * len1 * len2 / (len1 + len2)), len);
+   }
+   while (min > 0 && fc_jaro_winkler_within(min - 1, factor, len1, len2, max))
+      min--;
+   while (!fc_jaro_winkler_within(min, factor, len1, len2, max))
+      min++;
+
+   const double dist = fc_jaro_bounded0(seq1, len1, seq2, len2, min, size);
+   if (dist == HUGE_VAL)
+      return HUGE_VAL;
+   return factor * dist <= max ? factor * dist : HUGE_VAL;
+}
+
+double fc_jaro_winkler_bounded(const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2,
+                               double prefix_scale, int32_t max_prefix,
+                               double max)
+{
+   return fc_jaro_winkler_bounded_elems(seq1, len1, seq2, len2, prefix_scale,
+                                        max_prefix, max, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Weighted distances
+ ******************************************************************************/
+
+struct fc_sub_slot {
+   char32_t c1, c2;
+   int32_t cost;        /* Negative if the slot is free. */
+};
+
+/* A character replaced by some substitution of the table, with a Bloom filter
+ * of the characters that replace it, so that most cells of a row don't need
+ * a lookup.
+ */
+struct fc_sub_first {
+   char32_t c1;
+   uint64_t seconds;    /* Zero if the slot is free. */
+};
+
+/* Open-addressing hash tables of the substitutions with a specific cost, and
+ * of the characters they replace. Both have the same number of slots.
+ */
+struct fc_sub_table {
+   uint32_t mask;       /* Number of slots minus one. */
+   int shift;           /* For reducing hash values. */
+   struct fc_sub_first *firsts;
+   struct fc_sub_slot *slots;
+};
+
+static inline uint64_t fc_sub_bit(char32_t c)
+{
+   return UINT64_C(1) << (((uint32_t)c * UINT32_C(0x9E3779B1)) >> 26);
+}
+
+/* Returns the slot of a character, or the free slot where it should be
+ * inserted.
+ */
+static inline struct fc_sub_first *fc_sub_first(const struct fc_sub_table *table,
+                                                char32_t c1)
+{
+   uint32_t i = ((uint32_t)c1 * UINT32_C(0x9E3779B1)) >> table->shift;
+
+   for (;;) {
+      struct fc_sub_first *first = &table->firsts[i];
+      if (!first->seconds || first->c1 == c1)
+         return first;
+      i = (i + 1) & table->mask;
+   }
+}
+
+/* Same as above, for a pair. */
+static inline struct fc_sub_slot *fc_sub_slot(const struct fc_sub_table *table,
+                                              char32_t c1, char32_t c2)
+{
+   const uint32_t h = ((uint32_t)c1 * UINT32_C(0x9E3779B1)) ^ (uint32_t)c2;
+   uint32_t i = (h * UINT32_C(0x85EBCA77)) >> table->shift;
+
+   for (;;) {
+      struct fc_sub_slot *slot = &table->slots[i];
+      if (slot->cost < 0 || (slot->c1 == c1 && slot->c2 == c2))
+         return slot;
+      i = (i + 1) & table->mask;
+   }
+}
+
+/* Returns the Bloom filter of the characters that replace "c1" with a specific
+ * cost, which is zero if there are none, or if there is no table.
+ */
+static inline uint64_t fc_sub_seconds(const struct fc_costs *costs, char32_t c1)
+{
+   return costs->table ? fc_sub_first(costs->table, c1)->seconds : 0;
+}
+
+/* Returns the cost of substituting "c2" for "c1", which must differ.
+ * "seconds" is the result of fc_sub_seconds() for "c1".
+ */
+static inline int32_t fc_sub_cost(const struct fc_costs *costs, uint64_t seconds,
+                                  char32_t c1, char32_t c2)
+{
+   if (seconds & fc_sub_bit(c2)) {
+      const struct fc_sub_slot *slot = fc_sub_slot(costs->table, c1, c2);
+      if (slot->cost >= 0)
+         return slot->cost;
+   }
+   return costs->sub;
+}
+
+void fc_costs_init(struct fc_costs *costs, int32_t ins, int32_t del,
+                   int32_t sub, int32_t transpose,
+                   const struct fc_sub_cost *subs, size_t nr)
+{
+   assert(ins >= 0 && ins <= FC_MAX_COST && del >= 0 && del <= FC_MAX_COST);
+   assert(sub >= 0 && sub <= FC_MAX_COST);
+   assert(transpose >= 0 && transpose <= FC_MAX_COST);
+   assert(nr <= INT32_MAX / 2);
+
+   costs->ins = ins;
+   costs->del = del;
+   costs->sub = sub;
+   costs->transpose = transpose;
+   costs->table = NULL;
+   if (!nr)
+      return;
+
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * nr) {
+      slots_nr <<= 1;
+      shift--;
+   }
+
+   /* Slots are allocated together with the table. */
+   struct fc_sub_table *table = fc_malloc(sizeof *table
+                                          + slots_nr * sizeof *table->firsts
+                                          + slots_nr * sizeof *table->slots);
+   table->mask = slots_nr - 1;
+   table->shift = shift;
+   table->firsts = (struct fc_sub_first *)&table[1];
+   table->slots = (struct fc_sub_slot *)&table->firsts[slots_nr];
+   for (uint32_t i = 0; i < slots_nr; i++) {
+      table->firsts[i].seconds = 0;
+      table->slots[i].cost = -1;
+   }
+
+   for (size_t i = 0; i < nr; i++) {
+      assert(subs[i].cost >= 0 && subs[i].cost <= FC_MAX_COST);
+      struct fc_sub_slot *slot = fc_sub_slot(table, subs[i].c1, subs[i].c2);
+      *slot = (struct fc_sub_slot){subs[i].c1, subs[i].c2, subs[i].cost};
+      struct fc_sub_first *first = fc_sub_first(table, subs[i].c1);
+      first->c1 = subs[i].c1;
+      first->seconds |= fc_sub_bit(subs[i].c2);
+   }
+   costs->table = table;
+}
+
+void fc_costs_fini(struct fc_costs *costs)
+{
+   fc_free(costs->table);
+}
+
+/* Lower bound of the distance, from the difference of lengths. */
+static int32_t fc_costs_min(const struct fc_costs *costs,
+                            int32_t len1, int32_t len2)
+{
+   return len1 > len2 ? (len1 - len2) * costs->del : (len2 - len1) * costs->ins;
+}
+
+/* Computes the matrix row by row, the rows being as long as "seq2", which is
+ * not necessarily the shortest sequence, since insertions and deletions can
+ * cost differently. "table" tells whether costs->table must be looked up.
+ * Returns INT32_MAX as soon as no cell of the next rows can be within "max".
+ * Transpositions jump over a row, so this depends on the last two rows.
+ * The provided buffer should be big enough to hold 3 * (len2 + 1) items.
+ */
+FC_ALWAYS_INLINE int32_t fc_wdistance0(int32_t *matrix,
+                                       const struct fc_costs *costs,
+                                       const char32_t *seq1, int32_t len1,
+                                       const char32_t *seq2, int32_t len2,
+                                       int32_t max, bool transpos, bool table)
+{
+   const int32_t ins = costs->ins, del = costs->del, sub = costs->sub;
+
+   int32_t *transp = matrix;
+   int32_t *previous = &transp[len2 + 1];
+   int32_t *current = &previous[len2 + 1];
+
+   for (int32_t j = 0; j <= len2; j++)
+      previous[j] = j * ins;
+
+   int32_t previous_min = 0;
+   for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = seq1[i - 1];
+      const uint64_t seconds = table ? fc_sub_seconds(costs, c) : 0;
+      int32_t min = *current = i * del;
+
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t v = FC_MIN(current[j - 1] + ins, previous[j] + del);
+         if (c == seq2[j - 1]) {
+            v = FC_MIN(v, previous[j - 1]);
+         } else {
+            const int32_t sc = table ? fc_sub_cost(costs, seconds, c, seq2[j - 1]) : sub;
+            v = FC_MIN(v, previous[j - 1] + sc);
+            if (transpos && TRANSPOSED(seq1, seq2, i, j))
+               v = FC_MIN(v, transp[j - 2] + costs->transpose);
+         }
+         current[j] = v;
+         min = FC_MIN(min, v);
+      }
+      if (min > max && (!transpos || previous_min + costs->transpose > max))
+         return INT32_MAX;
+      previous_min = min;
+
+      if (transpos)
+         FC_SWAP3(int32_t *, transp, previous, current);
+      else
+         FC_SWAP(int32_t *, previous, current);
+   }
+   return previous[len2];
+}
+
+static int32_t fc_wdistance_const(int32_t *matrix, const struct fc_costs *costs,
+                                  const char32_t *seq1, int32_t len1,
+                                  const char32_t *seq2, int32_t len2,
+                                  int32_t max, bool transpos)
+{
+   if (transpos)
+      return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, true, false);
+   return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, false, false);
+}
+
+static int32_t fc_wdistance_table(int32_t *matrix, const struct fc_costs *costs,
+                                  const char32_t *seq1, int32_t len1,
+                                  const char32_t *seq2, int32_t len2,
+                                  int32_t max, bool transpos)
+{
+   if (transpos)
+      return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, true, true);
+   return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, false, true);
+}
+
+/* When all operations have the same cost "w", the distance is "w" times the
+ * unit-cost one, which is computed with the usual functions. A transposition
+ * that costs as much as two substitutions is never useful.
+ */
+static int32_t fc_wdistance_uniform(int32_t w, const char32_t *seq1, int32_t len1,
+                                    const char32_t *seq2, int32_t len2,
+                                    int32_t max, bool transpos)
+{
+   if (w == 0)
+      return 0;
+
+   const int32_t k = max / w;
+   int32_t dist;
+   if (!transpos) {
+      dist = k < len1 + len2 ? fc_lev_bounded_k(seq1, len1, seq2, len2, k)
+                             : fc_levenshtein(seq1, len1, seq2, len2);
+   } else if (k < (int32_t)FC_ARRAY_SIZE(fc_dam_bounded)) {
+      dist = fc_dam_bounded[k](seq1, len1, seq2, len2);
+   } else {
+      dist = fc_damerau(seq1, len1, seq2, len2);
+   }
+   return dist > k ? INT32_MAX : dist * w;
+}
+
+static int32_t fc_wdistance(const struct fc_costs *costs,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            int32_t max, bool transpos)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && max >= 0);
+
+   const int32_t w = costs->sub;
+   if (!costs->table && costs->ins == w && costs->del == w) {
+      if (!transpos || costs->transpose == w)
+         return fc_wdistance_uniform(w, seq1, len1, seq2, len2, max, transpos);
+      if (costs->transpose >= 2 * w)
+         return fc_wdistance_uniform(w, seq1, len1, seq2, len2, max, false);
+   }
+
+   /* Matching characters cost nothing, and insertions and deletions cost the
+    * same whatever the character, so the common prefix and suffix can be
+    * skipped as usual.
+    */
+   while (len1 && len2 && *seq1 == *seq2) {
+      seq1++;
+      seq2++;
+      len1--;
+      len2--;
+   }
+   while (len1 && len2 && seq1[len1 - 1] == seq2[len2 - 1]) {
+      len1--;
+      len2--;
+   }
+
+   if (fc_costs_min(costs, len1, len2) > max)
+      return INT32_MAX;
+   if (len1 == 0 || len2 == 0)
+      return fc_costs_min(costs, len1, len2);
+
+   int32_t matrix[FC_DEFAULT_COLUMN_LEN * 3], *matrixp = matrix;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(matrix))
+      matrixp = fc_malloc(3 * (len2 + 1) * sizeof *matrixp);
+
+   int32_t dist;
+   if (costs->table)
+      dist = fc_wdistance_table(matrixp, costs, seq1, len1, seq2, len2, max, transpos);
+   else
+      dist = fc_wdistance_const(matrixp, costs, seq1, len1, seq2, len2, max, transpos);
+
+   if (matrixp != matrix)
+      fc_free(matrixp);
+
+   return dist > max ? INT32_MAX : dist;
+}
+
+int32_t fc_wlevenshtein(const struct fc_costs *costs,
+                        const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, INT32_MAX, false);
+}
+
+int32_t fc_wdamerau(const struct fc_costs *costs,
+                    const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, INT32_MAX, true);
+}
+
+int32_t fc_wlevenshtein_bounded(const struct fc_costs *costs,
+                                const char32_t *seq1, int32_t len1,
+                                const char32_t *seq2, int32_t len2, int32_t max)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, max, false);
+}
+
+int32_t fc_wdamerau_bounded(const struct fc_costs *costs,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2, int32_t max)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, max, true);
+}
+
+
+/*******************************************************************************
+ * Memoized string metrics.
+ ******************************************************************************/
+
+static void memo_calloc(struct fc_memo *ctx, size_t max_len, size_t mat_size)
+{
+   ctx->seq2 = fc_malloc(max_len * sizeof *ctx->seq2 + mat_size);
+   ctx->matrix = ctx->seq2 + max_len;
+   memset(ctx->matrix, 0, mat_size);
+}
+
+void fc_memo_init(struct fc_memo *ctx, enum fc_metric metric, int32_t max_len,
+                  int32_t max_dist)
+{
+   assert(IN_RANGE(max_len));
+
+   ctx->mdim = max_len + 1;
+   ctx->max_dist = max_dist;
+
+   ctx->seq1 = NULL;
+   ctx->len1 = 0;
+   ctx->elem_size = sizeof(char32_t);
+   ctx->costs = NULL;
+
+   switch (metric) {
+
+   case FC_LEVENSHTEIN: case FC_DAMERAU: {
+      if (metric == FC_LEVENSHTEIN)
+         ctx->compute = fc_memo_levenshtein;
+      else
+         ctx->compute = fc_memo_damerau;
+      /* Full matrix. */
+      ctx->seq2 = fc_malloc(max_len * sizeof *ctx->seq2 + sizeof(int32_t[ctx->mdim][ctx->mdim]));
+      ctx->matrix = ctx->seq2 + max_len;
+      fc_memo_set_costs(ctx, NULL);
+      break;
+   }
+   case FC_LCSUBSTR: {
+      ctx->compute = fc_memo_lcsubstr;
+      /* We add one additional column on the right of the matrix for storing
+       * the length of the longest common substring found so far, for each row.
+       * This is necessary because the last row doesn't necessarily contain it.
+       */
+      memo_calloc(ctx, max_len, sizeof(int32_t[ctx->mdim + 1][ctx->mdim]));
+      break;
+   }
+   case FC_LCSUBSEQ: {
+      ctx->compute = fc_memo_lcsubseq;
+      /* Full matrix. */
+      memo_calloc(ctx, max_len, sizeof(int32_t[ctx->mdim][ctx->mdim]));
+      break;
+   }
+   default: {
+      fc_fatal("invalid metric: %d", metric);
+   }
+   }
+   
+   (void)fc_memo_compute;
+}
+
+enum fc_metric fc_memo_metric(const struct fc_memo *ctx)
+{
+   int32_t (*const funcs[])(struct fc_memo *, const char32_t *, int32_t) = {
+   #define _(metric, METRIC) [FC_##METRIC] = fc_memo_##metric,
+      _(levenshtein, LEVENSHTEIN)
+      _(damerau, DAMERAU)
+      _(lcsubstr, LCSUBSTR)
+      _(lcsubseq, LCSUBSEQ)
+   #undef _
+   };
+
+   for (size_t i = 0; i < FC_ARRAY_SIZE(funcs); i++)
+      if (funcs[i] == ctx->compute)
+         return i;
+
+   fc_fatal("object not properly initialized");
+}
+
+static void fc_memo_set_ref_elems(struct fc_memo *ctx, const void *seq1,
+                                  int32_t len1, int size)
+{
+   ctx->seq1 = seq1;
+   ctx->len1 = len1;
+   ctx->len2 = 0;
+   ctx->elem_size = size;
+}
+
+void fc_memo_set_ref(struct fc_memo *ctx,
+                            const char32_t *seq1, int32_t len1)
+{
+   fc_memo_set_ref_elems(ctx, seq1, len1, sizeof *seq1);
+}
+
+void fc_memo_set_costs(struct fc_memo *ctx, const struct fc_costs *costs)
+{
+   assert(ctx->compute == fc_memo_levenshtein || ctx->compute == fc_memo_damerau);
+
+   ctx->costs = costs;
+   /* The first row and column depend on the costs, and the rest of the matrix
+    * must be recomputed.
+    */
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+   for (int32_t i = 0; i < ctx->mdim; i++)
+      matrix[i][0] = costs ? i * costs->del : i;
+   for (int32_t j = 1; j < ctx->mdim; j++)
+      matrix[0][j] = costs ? j * costs->ins : j;
+   ctx->len2 = 0;
+}
+
+/* Returns the length of the common prefix of "seq2" and of the previous
+ * sequence.
+ */
+FC_ALWAYS_INLINE int32_t fc_memo_skip(const struct fc_memo *ctx,
+                                      const void *seq2, int32_t len2, int size)
+{
+   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
+   while (skip < min_len2
+          && fc_elem(ctx->seq2, skip, size) == fc_elem(seq2, skip, size))
+      skip++;
+   return skip;
+}
+
+/* Replaces the previous sequence with "seq2", past their common prefix. */
+FC_ALWAYS_INLINE void fc_memo_save(struct fc_memo *ctx, const void *seq2,
+                                   int32_t len2, int32_t skip, int size)
+{
+   memcpy((char *)ctx->seq2 + (size_t)skip * size, fc_elem_ptr(seq2, skip, size),
+          (size_t)(len2 - skip) * size);
+   ctx->len2 = len2;
+}
+
+FC_ALWAYS_INLINE int32_t fc_memo_lcsubstr_body(struct fc_memo *ctx,
+                                               const void *seq2, int32_t len2,
+                                               int size)
+{
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
+
+   const void *seq1 = ctx->seq1;
+   const int32_t len1 = ctx->len1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+   const int32_t max_lens = ctx->mdim;
+
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
+   fc_memo_save(ctx, seq2, len2, skip, size);
+
+   int32_t max_len = matrix[max_lens][skip];
+   for (int32_t i = skip + 1; i <= len2; i++) {
+      const char32_t c = fc_elem(seq2, i - 1, size);
+      for (int32_t j = 1; j <= len1; j++) {
+         if (fc_elem(seq1, j - 1, size) == c) {
+            int32_t up_left = matrix[i - 1][j - 1] + 1;
+            matrix[i][j] = up_left;
+            if (max_len < up_left)
+               max_len = up_left;
+         } else {
+            matrix[i][j] = 0;
+         }
+      }
+      matrix[max_lens][i] = max_len;
+   }
+
+   return max_len;
+}
+
+int32_t fc_memo_lcsubstr(struct fc_memo *ctx, const char32_t *seq2, int32_t len2)
+{
+   assert(ctx->compute == fc_memo_lcsubstr);
+   return fc_memo_lcsubstr_body(ctx, seq2, len2, sizeof *seq2);
+}
+
+FC_ALWAYS_INLINE int32_t fc_memo_lcsubseq_body(struct fc_memo *ctx,
+                                               const void *seq2, int32_t len2,
+                                               int size)
+{
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
+
+   const void *seq1 = ctx->seq1;
+   const int32_t len1 = ctx->len1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
+   fc_memo_save(ctx, seq2, len2, skip, size);
+
+   for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = fc_elem(seq1, i - 1, size);
+      for (int32_t j = skip + 1; j <= len2; j++) {
+         if (c == fc_elem(seq2, j - 1, size)) {
+            matrix[i][j] = matrix[i - 1][j - 1] + 1;
+         } else {
+            const int32_t fst = matrix[i][j - 1];
+            const int32_t snd = matrix[i - 1][j];
+            matrix[i][j] = FC_MAX(fst, snd);
+         }
+      }
+   }
+   return matrix[len1][len2];
+}
+
+int32_t fc_memo_lcsubseq(struct fc_memo *ctx,
+                            const char32_t *seq2, int32_t len2)
+{
+   assert(ctx->compute == fc_memo_lcsubseq);
+   return fc_memo_lcsubseq_body(ctx, seq2, len2, sizeof *seq2);
+}
+
+/* Computes the cells of the row "i" of the matrix past "skip", with the costs
+ * of ctx->costs. "c" is the character of the reference sequence for this row.
+ */
+FC_ALWAYS_INLINE void fc_memo_wrow(struct fc_memo *ctx, const void *seq2,
+                                   int32_t len2, int32_t skip, int32_t i,
+                                   char32_t c, bool transpos, int size)
+{
+   const struct fc_costs *costs = ctx->costs;
+   const void *seq1 = ctx->seq1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+   const uint64_t seconds = fc_sub_seconds(costs, c);
+
+   for (int32_t j = skip + 1; j <= len2; j++) {
+      const char32_t d = fc_elem(seq2, j - 1, size);
+      int32_t v = FC_MIN(matrix[i][j - 1] + costs->ins,
+                         matrix[i - 1][j] + costs->del);
+      if (c == d) {
+         v = FC_MIN(v, matrix[i - 1][j - 1]);
+      } else {
+         v = FC_MIN(v, matrix[i - 1][j - 1] + fc_sub_cost(costs, seconds, c, d));
+         if (transpos && i > 1 && j > 1
+             && fc_elem(seq1, i - 2, size) == d
+             && c == fc_elem(seq2, j - 2, size))
+            v = FC_MIN(v, matrix[i - 2][j - 2] + costs->transpose);
+      }
+      matrix[i][j] = v;
+   }
+}
+
+/* "costs" is either NULL, for unit costs, or ctx->costs. */
+FC_ALWAYS_INLINE int32_t fc_memo_distance(struct fc_memo *ctx,
+                                          const void *seq2, int32_t len2,
+                                          bool transpos,
+                                          const struct fc_costs *costs,
+                                          int size)
+{
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
+
+   const void *seq1 = ctx->seq1;
+   const int32_t len1 = ctx->len1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+
+   if (costs ? fc_costs_min(costs, len1, len2) > ctx->max_dist
+             : abs(len1 - len2) > ctx->max_dist)
+      return INT32_MAX;
+
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
+
+   if (skip) {
+      /* We could make this check after computing each row, and possibly break
+       * from the loop early if we detect that the distance can't be <= than
+       * the maximum allowed distance.
+       *
+       * Contrary to intuition, it turns out that this is generally slower than
+       * simply going on until the sequences are exhausted. This holds at least
+       * for short strings, which we expect to have to deal with here.
+       *
+       * Probably the slowdown is due to the additional bookkeeping needed to
+       * keep track of the maximum distance found so far, which involves one
+       * more check per matrix cell.
+       */
+      int32_t min = INT32_MAX;
+      for (int32_t i = 0; i <= len1; i++) {
+         int32_t val = matrix[i][skip];
+         /* With weights, a transposition can cost less than the cells of the
+          * column it jumps over.
+          */
+         if (costs && transpos)
+            val = FC_MIN(val, matrix[i][skip - 1] + costs->transpose);
+         if (val < min)
+            min = val;
+      }
+      if (min > ctx->max_dist)
+         return INT32_MAX;
+   }
+   fc_memo_save(ctx, seq2, len2, skip, size);
+
+   for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = fc_elem(seq1, i - 1, size);
+      if (costs) {
+         fc_memo_wrow(ctx, seq2, len2, skip, i, c, transpos, size);
+         continue;
+      }
+      for (int32_t j = skip + 1; j <= len2; j++) {
+         if (c == fc_elem(seq2, j - 1, size)) {
+            matrix[i][j] = matrix[i - 1][j - 1];
+         } else {
+            int32_t ic = matrix[i][j - 1] + 1;
+            int32_t dc = matrix[i - 1][j] + 1;
+            int32_t rc = matrix[i - 1][j - 1] + 1;
+            matrix[i][j] = FC_MIN3(ic, dc, rc);
+            if (transpos && i > 1 && j > 1
+                && fc_elem(seq1, i - 2, size) == fc_elem(seq2, j - 1, size)
+                && c == fc_elem(seq2, j - 2, size)) {
+               ic = matrix[i][j];
+               int32_t tc = matrix[i - 2][j - 2] + 1;
+               matrix[i][j] = FC_MIN(ic, tc);
+            }
+         }
+      }
+   }
+   return matrix[len1][len2];
+}
+
+int32_t fc_memo_levenshtein(struct fc_memo *ctx,
+                                   const char32_t *seq2, int32_t len2)
+{
+   assert(ctx->compute == fc_memo_levenshtein);
+   if (ctx->costs)
+      return fc_memo_distance(ctx, seq2, len2, false, ctx->costs, sizeof *seq2);
+   return fc_memo_distance(ctx, seq2, len2, false, NULL, sizeof *seq2);
+}
+
+int32_t fc_memo_damerau(struct fc_memo *ctx,
+                               const char32_t *seq2, int32_t len2)
+{
+   assert(ctx->compute == fc_memo_damerau);
+   if (ctx->costs)
+      return fc_memo_distance(ctx, seq2, len2, true, ctx->costs, sizeof *seq2);
+   return fc_memo_distance(ctx, seq2, len2, true, NULL, sizeof *seq2);
+}
+
+void fc_memo_fini(struct fc_memo *ctx)
+{
+   fc_free(ctx->seq2);
+}
+
+/*******************************************************************************
+ * Batch computation
+ ******************************************************************************/
+
+/* Maximum length of the query for using the vectorized kernels. Above this,
+ * comparing each candidate to the query with a bit-parallel algorithm is
+ * faster.
+ */
+#define FC_BATCH_MAX_QUERY_LEN FC_WORD_BITS
+
+static void fc_batch(enum fc_metric metric,
+                     int32_t (*func)(const struct fc_peq *, const char32_t *,
+                                     int32_t),
+                     const char32_t *query, int32_t qlen,
+                     const char32_t *const *cands, const int32_t *lens,
+                     size_t nr, int32_t *out)
+{
+   struct fc_peq peq;
+   fc_peq_init(&peq, query, qlen);
+
+#ifdef FC_HAVE_SIMD
+   if (qlen <= FC_BATCH_MAX_QUERY_LEN) {
+      fc_simd_batch(metric, &peq, query, qlen, cands, lens, nr, out);
+      fc_peq_fini(&peq);
+      return;
+   }
+#else
+   (void)metric;
+#endif
+   for (size_t i = 0; i < nr; i++)
+      out[i] = func(&peq, cands[i], lens[i]);
+   fc_peq_fini(&peq);
+}
+
+void fc_levenshtein_batch(const char32_t *query, int32_t qlen,
+                          const char32_t *const *cands, const int32_t *lens,
+                          size_t nr, int32_t *out)
+{
+   fc_batch(FC_LEVENSHTEIN, fc_bitpar_levenshtein, query, qlen, cands, lens, nr, out);
+}
+
+void fc_damerau_batch(const char32_t *query, int32_t qlen,
+                      const char32_t *const *cands, const int32_t *lens,
+                      size_t nr, int32_t *out)
+{
+   fc_batch(FC_DAMERAU, fc_bitpar_damerau, query, qlen, cands, lens, nr, out);
+}
+
+void fc_lcsubseq_batch(const char32_t *query, int32_t qlen,
+                       const char32_t *const *cands, const int32_t *lens,
+                       size_t nr, int32_t *out)
+{
+   fc_batch(FC_LCSUBSEQ, fc_bitpar_lcsubseq, query, qlen, cands, lens, nr, out);
+}
+
+
+/*******************************************************************************
+ * Multiple metrics
+ ******************************************************************************/
+
+#define FC_MULTI_BITPAR (FC_MULTI_LEVENSHTEIN | FC_MULTI_DAMERAU | FC_MULTI_LCSUBSEQ)
+
+/* Sets the requested distances from the vertical deltas of the last column, and
+ * the length of the longest common subsequence from the vector "s".
+ */
+static void fc_multi_finish(const struct fc_peq *peq, int32_t len2, unsigned mask,
+                            const uint64_t *vp, const uint64_t *vn,
+                            const uint64_t *dvp, const uint64_t *dvn,
+                            const uint64_t *s, struct fc_multi *out)
+{
+   int32_t lev = len2, dam = len2, lcs = 0;
+
+   for (int32_t w = 0; w < peq->words; w++) {
+      const int32_t rem = peq->len - w * FC_WORD_BITS;
+      const uint64_t valid = rem >= FC_WORD_BITS ? ~UINT64_C(0)
+                                                 : ~UINT64_C(0) >> (FC_WORD_BITS - rem);
+      lev += fc_popcount(vp[w] & valid) - fc_popcount(vn[w] & valid);
+      dam += fc_popcount(dvp[w] & valid) - fc_popcount(dvn[w] & valid);
+      lcs += fc_popcount(~s[w] & valid);
+   }
+   if (mask & FC_MULTI_LEVENSHTEIN)
+      out->levenshtein = lev;
+   if (mask & FC_MULTI_DAMERAU)
+      out->damerau = dam;
+   if (mask & FC_MULTI_LCSUBSEQ)
+      out->lcsubseq = lcs;
+}
+
+/* Fused version of fc_bitpar_levenshtein1(), fc_bitpar_damerau1(), and
+ * fc_bitpar_lcsubseq1(), with "seq1" as pattern. The longest common substring
+ * is computed from the set bits of the masks: the run of matches that ends at
+ * the cell (i, j) extends the one that ends at (i - 1, j - 1) if this cell is
+ * a match, which is checked with the masks of the previous character. The
+ * length of the run is stored for each diagonal in "diags", which must have
+ * room for len1 + len2 items.
+ */
+static void fc_multi_sweep1(const struct fc_peq *peq, const char32_t *seq2,
+                            int32_t len2, unsigned mask, int32_t *diags,
+                            struct fc_multi *out)
+{
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   uint64_t dvp = ~UINT64_C(0), dvn = 0, d0 = 0, prev_eq = 0;
+   uint64_t s = ~UINT64_C(0);
+   int32_t lcsubstr = 0;
+
+   for (int32_t j = 0; j < len2; j++) {
+      const uint64_t eq = *fc_peq_get(peq, seq2[j]);
+
+      if (mask & FC_MULTI_LEVENSHTEIN) {
+         const uint64_t xv = eq | vn;
+         const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+         const uint64_t hp = (vn | ~(xh | vp)) << 1 | 1;
+         const uint64_t hn = (vp & xh) << 1;
+         vp = hn | ~(xv | hp);
+         vn = hp & xv;
+      }
+      if (mask & FC_MULTI_DAMERAU) {
+         const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+         d0 = (((eq & dvp) + dvp) ^ dvp) | eq | dvn | tr;
+         const uint64_t hp = (dvn | ~(d0 | dvp)) << 1 | 1;
+         const uint64_t hn = (d0 & dvp) << 1;
+         dvp = hn | ~(d0 | hp);
+         dvn = hp & d0;
+      }
+      if (mask & FC_MULTI_LCSUBSEQ) {
+         const uint64_t u = s & eq;
+         s = (s + u) | (s - u);
+      }
+      if (mask & FC_MULTI_LCSUBSTR) {
+         for (uint64_t m = eq; m; m &= m - 1) {
+            const int32_t i = fc_ctz(m);
+            int32_t *run = &diags[len2 + i - j];
+            *run = prev_eq << 1 >> i & 1 ? *run + 1 : 1;
+            lcsubstr = FC_MAX(lcsubstr, *run);
+         }
+      }
+      prev_eq = eq;
+   }
+
+   fc_multi_finish(peq, len2, mask, &vp, &vn, &dvp, &dvn, &s, out);
+   if (mask & FC_MULTI_LCSUBSTR)
+      out->lcsubstr = lcsubstr;
+}
+
+/* Same as above, for patterns that don't fit in a single word. The metrics
+ * are updated one after the other for each character of "seq2", so that the
+ * inner loops stay as tight as in the separate functions.
+ */
+static void fc_multi_sweepN(const struct fc_peq *peq, const char32_t *seq2,
+                            int32_t len2, unsigned mask, struct fc_multi *out)
+{
+   const int32_t words = peq->words;
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   uint64_t dvp[FC_MAX_WORDS], dvn[FC_MAX_WORDS], d0[FC_MAX_WORDS];
+   uint64_t s[FC_MAX_WORDS];
+   const uint64_t *prev_eqs = peq->rows;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = dvp[w] = s[w] = ~UINT64_C(0);
+      vn[w] = dvn[w] = d0[w] = 0;
+   }
+
+   for (int32_t j = 0; j < len2; j++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq2[j]);
+
+      if (mask & FC_MULTI_LEVENSHTEIN) {
+         uint64_t hp_carry = 1, hn_carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t xv = eqs[w] | vn[w];
+            const uint64_t eq = eqs[w] | hn_carry;
+            const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+            uint64_t hp = vn[w] | ~(xh | vp[w]);
+            uint64_t hn = vp[w] & xh;
+
+            const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+            const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_out;
+            hn_carry = hn_out;
+
+            vp[w] = hn | ~(xv | hp);
+            vn[w] = hp & xv;
+         }
+      }
+      if (mask & FC_MULTI_DAMERAU) {
+         uint64_t hp_carry = 1, hn_carry = 0, tr_carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t eq = eqs[w];
+            const uint64_t x = eq | hn_carry;
+            const uint64_t tr = (((~d0[w] & eq) << 1) | tr_carry) & prev_eqs[w];
+            tr_carry = (~d0[w] & eq) >> (FC_WORD_BITS - 1);
+
+            const uint64_t d = (((x & dvp[w]) + dvp[w]) ^ dvp[w]) | x | dvn[w] | tr;
+            uint64_t hp = dvn[w] | ~(d | dvp[w]);
+            uint64_t hn = d & dvp[w];
+
+            const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+            const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_out;
+            hn_carry = hn_out;
+
+            dvp[w] = hn | ~(d | hp);
+            dvn[w] = hp & d;
+            d0[w] = d;
+         }
+      }
+      if (mask & FC_MULTI_LCSUBSEQ) {
+         uint64_t carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t u = s[w] & eqs[w];
+            const uint64_t sum = s[w] + carry;
+            const uint64_t x = sum + u;
+            carry = (sum < carry) | (x < u);
+            s[w] = x | (s[w] - u);
+         }
+      }
+      prev_eqs = eqs;
+   }
+
+   fc_multi_finish(peq, len2, mask, vp, vn, dvp, dvn, s, out);
+}
+
+/* "peq" holds the masks of "seq1". */
+static void fc_multi_metric0(const struct fc_peq *peq,
+                             const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             unsigned mask, int32_t *diags, struct fc_multi *out)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && peq->len == len1);
+
+   if (len1 == 0 || len2 == 0) {
+      if (mask & FC_MULTI_LEVENSHTEIN)
+         out->levenshtein = len1 + len2;
+      if (mask & FC_MULTI_DAMERAU)
+         out->damerau = len1 + len2;
+      if (mask & FC_MULTI_LCSUBSTR)
+         out->lcsubstr = 0;
+      if (mask & FC_MULTI_LCSUBSEQ)
+         out->lcsubseq = 0;
+   } else if (peq->words == 1) {
+      if (mask & (FC_MULTI_BITPAR | FC_MULTI_LCSUBSTR))
+         fc_multi_sweep1(peq, seq2, len2, mask, diags, out);
+   } else {
+      if (mask & FC_MULTI_BITPAR)
+         fc_multi_sweepN(peq, seq2, len2, mask, out);
+      /* Scanning the set bits of the masks is slower than the vectorized
+       * kernels on long sequences.
+       */
+      if (mask & FC_MULTI_LCSUBSTR)
+         out->lcsubstr = fc_lcsubstr(seq1, len1, seq2, len2);
+   }
+
+   /* The Jaro distance is symmetric, so the masks of "seq1" can be used for
+    * matching the characters of "seq2".
+    */
+   if (mask & FC_MULTI_JARO) {
+      if (len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+         out->jaro = fc_jaro_short(seq1, len1, seq2, len2, 0, sizeof *seq1);
+      else
+         out->jaro = fc_jaro0(peq, seq2, len2, seq1, len1, 0, sizeof *seq1);
+   }
+}
+
+/* Room needed in "diags" for comparing sequences of the given lengths. */
+#define FC_MULTI_DIAGS(mask, len1, len2)                                       \
+   ((mask) & FC_MULTI_LCSUBSTR && (len1) <= FC_WORD_BITS ? (len1) + (len2) : 0)
+
+void fc_multi_metric(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     unsigned mask, struct fc_multi *out)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   /* All the metrics are symmetric, and the shortest sequence needs the
+    * fewest words.
+    */
+   if (len1 > len2) {
+      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   struct fc_peq peq;
+   fc_peq_init(&peq, seq1, len1);
+
+   int32_t diags[FC_DEFAULT_COLUMN_LEN], *diagsp = diags;
+   if (FC_MULTI_DIAGS(mask, len1, len2) > (int32_t)FC_ARRAY_SIZE(diags))
+      diagsp = fc_malloc((len1 + len2) * sizeof *diagsp);
+
+   fc_multi_metric0(&peq, seq1, len1, seq2, len2, mask, diagsp, out);
+
+   if (diagsp != diags)
+      fc_free(diagsp);
+   fc_peq_fini(&peq);
+}
+
+void fc_multi_metric_batch(const char32_t *query, int32_t qlen,
+                           const char32_t *const *cands, const int32_t *lens,
+                           size_t nr, unsigned mask, struct fc_multi *out)
+{
+   assert(IN_RANGE(qlen));
+
+   struct fc_peq peq;
+   fc_peq_init(&peq, query, qlen);
+
+   int32_t max_len = 0;
+   for (size_t i = 0; i < nr; i++)
+      max_len = FC_MAX(max_len, lens[i]);
+
+   int32_t diags[FC_DEFAULT_COLUMN_LEN], *diagsp = diags;
+   if (FC_MULTI_DIAGS(mask, qlen, max_len) > (int32_t)FC_ARRAY_SIZE(diags))
+      diagsp = fc_malloc((qlen + max_len) * sizeof *diagsp);
+
+   for (size_t i = 0; i < nr; i++)
+      fc_multi_metric0(&peq, query, qlen, cands[i], lens[i], mask, diagsp, &out[i]);
+
+   if (diagsp != diags)
+      fc_free(diagsp);
+   fc_peq_fini(&peq);
+}
+
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* The vectorized kernels compare characters, so they are only used for
+ * sequences of 4 bytes elements. Others would have to be widened first, which
+ * costs as much as comparing them.
+ */
+FC_ALWAYS_INLINE int32_t fc_hamming0_body(const void *seq1, const void *seq2,
+                                          int32_t len, int32_t k, int size)
+{
+   assert(len >= 0);
+
+#ifdef FC_HAVE_SIMD
+   if (size == sizeof(char32_t) && len >= FC_SIMD_SHORT_LEN)
+      return fc_simd_hamming(seq1, seq2, len, k);
+#endif
+   int32_t dist = 0;
+   for (int32_t i = 0; i < len; i++)
+      if (fc_elem(seq1, i, size) != fc_elem(seq2, i, size) && ++dist > k)
+         break;
+   return dist;
+}
+
+static int32_t fc_hamming0(const void *seq1, const void *seq2,
+                           int32_t len, int32_t k, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_hamming0_body, seq1, seq2, len, k);
+}
+
+int32_t fc_hamming(const char32_t *seq1, const char32_t *seq2, int32_t len)
+{
+   return fc_hamming0(seq1, seq2, len, len, sizeof *seq1);
+}
+
+int32_t fc_hamming_bounded(const char32_t *seq1, const char32_t *seq2,
+                           int32_t len, int32_t k)
+{
+   return fc_hamming0(seq1, seq2, len, k, sizeof *seq1);
+}
+
+/* Stores in out[i] the distance between "query" and the key "i", as
+ * fc_hamming_bounded() does.
+ */
+static void fc_hamming_scan(const void *query, int32_t len,
+                            const void *keys, size_t nr, int32_t k,
+                            int32_t *out, int size)
+{
+#ifdef FC_HAVE_SIMD
+   if (size == sizeof(char32_t)) {
+      fc_simd_hamming_scan(query, len, keys, nr, k, out);
+      return;
+   }
+#endif
+   const size_t key_size = (size_t)len * size;
+   for (size_t i = 0; i < nr; i++)
+      out[i] = fc_hamming0(query, (const char *)keys + i * key_size, len, k, size);
+}
+
+/* Number of keys compared at once by fc_hamming_search(). */
+#define FC_HAMMING_SCAN_LEN 256
+
+static size_t fc_hamming_search_elems(const void *query, int32_t len,
+                                      const void *keys, size_t nr, int32_t k,
+                                      size_t *matches, int32_t *dists, int size)
+{
+   assert(len >= 0);
+
+   int32_t out[FC_HAMMING_SCAN_LEN];
+   size_t found = 0;
+
+   for (size_t i = 0; i < nr; i += FC_HAMMING_SCAN_LEN) {
+      const size_t cnt = FC_MIN(nr - i, FC_HAMMING_SCAN_LEN);
+      const char *group = (const char *)keys + i * len * size;
+      fc_hamming_scan(query, len, group, cnt, k, out, size);
+      for (size_t j = 0; j < cnt; j++) {
+         if (out[j] > k)
+            continue;
+         matches[found] = i + j;
+         if (dists)
+            dists[found] = out[j];
+         found++;
+      }
+   }
+   return found;
+}
+
+size_t fc_hamming_search(const char32_t *query, int32_t len,
+                         const char32_t *keys, size_t nr, int32_t k,
+                         size_t *matches, int32_t *dists)
+{
+   return fc_hamming_search_elems(query, len, keys, nr, k, matches, dists,
+                                  sizeof *query);
+}
+
+
+/*******************************************************************************
+ * Compiled queries
+ ******************************************************************************/
+
+struct fc_profile {
+   struct fc_peq peq;
+   int32_t *ends;          /* Lists of positions, for the sparse algorithm. */
+   int32_t *pos;
+   int32_t len;
+   char32_t seq[];
+};
+
+void fc_query_init(struct fc_query *q, const char32_t *seq, int32_t len)
+{
+   assert(IN_RANGE(len));
+
+   struct fc_profile *prof = fc_malloc(sizeof *prof + len * sizeof *prof->seq);
+   memcpy(prof->seq, seq, len * sizeof *seq);
+   prof->len = len;
+   fc_peq_init(&prof->peq, seq, len);
+
+   prof->ends = prof->pos = NULL;
+   if (len >= FC_SPARSE_MIN_LEN) {
+      const int32_t rows_nr = prof->peq.rows_nr;
+      prof->ends = fc_malloc((rows_nr + 1 + len) * sizeof *prof->ends);
+      prof->pos = &prof->ends[rows_nr + 1];
+      fc_sparse_count(&prof->peq, seq, len, sizeof *seq, prof->ends);
+      fc_sparse_lists(&prof->peq, seq, len, sizeof *seq, prof->ends, prof->pos);
+   }
+   q->profile = prof;
+}
+
+void fc_query_fini(struct fc_query *q)
+{
+   fc_peq_fini(&q->profile->peq);
+   fc_free(q->profile->ends);
+   fc_free(q->profile);
+}
+
+/* The masks of the query are used unless the compared sequence needs fewer
+ * words, in which case building its own masks is cheaper.
+ */
+static bool fc_query_fits(const struct fc_profile *prof, int32_t len2)
+{
+   return (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS >= prof->peq.words;
+}
+
+#define _(name)                                                                \
+int32_t fc_query_##name(const struct fc_query *q,                              \
+                        const char32_t *seq2, int32_t len2)                    \
+{                                                                              \
+   assert(IN_RANGE(len2));                                                     \
+                                                                               \
+   const struct fc_profile *prof = q->profile;                                 \
+   if (prof->len == 0 || len2 == 0)                                            \
+      return prof->len + len2;                                                 \
+   if (!fc_query_fits(prof, len2))                                             \
+      return fc_##name(prof->seq, prof->len, seq2, len2);                      \
+   return fc_bitpar_##name(&prof->peq, seq2, len2);                            \
+}
+_(levenshtein)
+_(damerau)
+#undef _
+
+int32_t fc_query_lcsubseq(const struct fc_query *q,
+                          const char32_t *seq2, int32_t len2)
+{
+   assert(IN_RANGE(len2));
+
+   const struct fc_profile *prof = q->profile;
+   if (prof->len == 0 || len2 == 0)
+      return 0;
+   if (!fc_query_fits(prof, len2))
+      return fc_lcsubseq(prof->seq, prof->len, seq2, len2);
+   if (!prof->ends)
+      return fc_bitpar_lcsubseq(&prof->peq, seq2, len2);
+
+   /* The lists of positions of the query are ready, so the sparse algorithm
+    * only needs the rows of the characters of "seq2".
+    */
+   const int32_t *ends = prof->ends;
+   int32_t *ids2 = fc_malloc((len2 + prof->len) * sizeof *ids2);
+   int64_t matches = 0;
+   for (int32_t i = 0; i < len2; i++) {
+      const int32_t id = fc_peq_slot(&prof->peq, seq2[i])->row;
+      ids2[i] = id;
+      matches += ends[id] - (id ? ends[id - 1] : 0);
+   }
+
+   int32_t lcs;
+   if (fc_sparse_faster(matches, len2, prof->len))
+      lcs = fc_sparse_run(ends, prof->pos, ids2, len2, &ids2[len2]);
+   else
+      lcs = fc_bitpar_lcsubseq(&prof->peq, seq2, len2);
+
+   fc_free(ids2);
+   return lcs;
+}
+
+double fc_query_jaro(const struct fc_query *q, const char32_t *seq2, int32_t len2)
+{
+   assert(IN_RANGE(len2));
+
+   const struct fc_profile *prof = q->profile;
+   if (prof->len < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+      return fc_jaro_short(prof->seq, prof->len, seq2, len2, 0, sizeof *seq2);
+
+   /* The Jaro distance is symmetric, so the masks of the query can be used
+    * for matching the characters of "seq2".
+    */
+   return fc_jaro0(&prof->peq, seq2, len2, prof->seq, prof->len, 0, sizeof *seq2);
+}
+
+
+/*******************************************************************************
+ * Other element types
+ ******************************************************************************/
+
+#define _(S, T)                                                                \
+int32_t fc_levenshtein_##S(const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2)                        \
+{                                                                              \
+   return fc_levenshtein_elems(seq1, len1, seq2, len2, sizeof(T));             \
+}                                                                              \
+                                                                               \
+int32_t fc_damerau_##S(const T *seq1, int32_t len1,                            \
+                       const T *seq2, int32_t len2)                            \
+{                                                                              \
+   return fc_damerau_elems(seq1, len1, seq2, len2, sizeof(T));                 \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubseq_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_lcsubseq_elems(seq1, len1, seq2, len2, sizeof(T));                \
+}                                                                              \
+                                                                               \
+double fc_jaro_##S(const T *seq1, int32_t len1,                                \
+                   const T *seq2, int32_t len2)                                \
+{                                                                              \
+   return fc_jaro_elems(seq1, len1, seq2, len2, sizeof(T));                    \
+}                                                                              \
+                                                                               \
+double fc_nlevenshtein_##S(enum fc_norm_method method,                         \
+                           const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2)                        \
+{                                                                              \
+   return fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, sizeof(T));    \
+}                                                                              \
+                                                                               \
+double fc_ndamerau_##S(enum fc_norm_method method,                             \
+                       const T *seq1, int32_t len1,                            \
+                       const T *seq2, int32_t len2)                            \
+{                                                                              \
+   return fc_ndamerau_elems(method, seq1, len1, seq2, len2, sizeof(T));        \
+}                                                                              \
+                                                                               \
+double fc_nlevenshtein_bounded_##S(enum fc_norm_method method, double max,     \
+                                   const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2)                \
+{                                                                              \
+   return fc_nbounded(false, method, max, seq1, len1, seq2, len2, sizeof(T));  \
+}                                                                              \
+                                                                               \
+double fc_ndamerau_bounded_##S(enum fc_norm_method method, double max,         \
+                               const T *seq1, int32_t len1,                    \
+                               const T *seq2, int32_t len2)                    \
+{                                                                              \
+   return fc_nbounded(true, method, max, seq1, len1, seq2, len2, sizeof(T));   \
+}                                                                              \
+                                                                               \
+static int32_t fc_lev_bounded0_##S(const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2)                \
+{                                                                              \
+   return fc_lev_bounded0_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_lev_bounded1_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_lev_bounded1_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_lev_bounded2_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_lev_bounded2_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t (*const fc_lev_bounded_##S[3])(const T *, int32_t,                     \
+                                       const T *, int32_t) = {                 \
+   fc_lev_bounded0_##S,                                                        \
+   fc_lev_bounded1_##S,                                                        \
+   fc_lev_bounded2_##S,                                                        \
+};                                                                             \
+                                                                               \
+int32_t fc_lev_bounded_k_##S(const T *seq1, int32_t len1,                      \
+                             const T *seq2, int32_t len2, int32_t k)           \
+{                                                                              \
+   return fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, sizeof(T));        \
+}                                                                              \
+                                                                               \
+int32_t fc_dam_bounded1_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_dam_bounded1_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_dam_bounded2_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_dam_bounded2_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t (*const fc_dam_bounded_##S[3])(const T *, int32_t,                     \
+                                       const T *, int32_t) = {                 \
+   fc_lev_bounded0_##S,                                                        \
+   fc_dam_bounded1_##S,                                                        \
+   fc_dam_bounded2_##S,                                                        \
+};                                                                             \
+                                                                               \
+double fc_jaro_winkler_##S(const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2,                        \
+                           double prefix_scale, int32_t max_prefix)            \
+{                                                                              \
+   return fc_jaro_winkler_elems(seq1, len1, seq2, len2, prefix_scale,          \
+                                max_prefix, sizeof(T));                        \
+}                                                                              \
+                                                                               \
+double fc_jaro_winkler_bounded_##S(const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2,                \
+                                   double prefix_scale, int32_t max_prefix,    \
+                                   double max)                                 \
+{                                                                              \
+   return fc_jaro_winkler_bounded_elems(seq1, len1, seq2, len2, prefix_scale,  \
+                                        max_prefix, max, sizeof(T));           \
+}                                                                              \
+                                                                               \
+int32_t fc_hamming_##S(const T *seq1, const T *seq2, int32_t len)              \
+{                                                                              \
+   return fc_hamming0(seq1, seq2, len, len, sizeof(T));                        \
+}                                                                              \
+                                                                               \
+int32_t fc_hamming_bounded_##S(const T *seq1, const T *seq2,                   \
+                               int32_t len, int32_t k)                         \
+{                                                                              \
+   return fc_hamming0(seq1, seq2, len, k, sizeof(T));                          \
+}                                                                              \
+                                                                               \
+size_t fc_hamming_search_##S(const T *query, int32_t len,                      \
+                             const T *keys, size_t nr, int32_t k,              \
+                             size_t *matches, int32_t *dists)                  \
+{                                                                              \
+   return fc_hamming_search_elems(query, len, keys, nr, k, matches, dists,     \
+                                  sizeof(T));                                  \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubstr_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_lcsubstr_elems(seq1, len1, seq2, len2, NULL, sizeof(T));          \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubstr_extract_##S(const T *seq1, int32_t len1,                   \
+                                const T *seq2, int32_t len2, const T **pos)    \
+{                                                                              \
+   const void *start;                                                          \
+   const int32_t max_len = fc_lcsubstr_elems(seq1, len1, seq2, len2,           \
+                                             pos ? &start : NULL, sizeof(T));  \
+   if (pos)                                                                    \
+      *pos = start;                                                            \
+   return max_len;                                                             \
+}                                                                              \
+                                                                               \
+double fc_nlcsubseq_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_nlcsubseq_elems(seq1, len1, seq2, len2, sizeof(T));               \
+}                                                                              \
+                                                                               \
+double fc_nlcsubseq_bounded_##S(double max, const T *seq1, int32_t len1,       \
+                                const T *seq2, int32_t len2)                   \
+{                                                                              \
+   return fc_nlcsubseq_bounded_elems(max, seq1, len1, seq2, len2, sizeof(T));  \
+}                                                                              \
+                                                                               \
+void fc_memo_set_ref_##S(struct fc_memo *ctx, const T *seq1, int32_t len1)     \
+{                                                                              \
+   fc_memo_set_ref_elems(ctx, seq1, len1, sizeof(T));                          \
+}                                                                              \
+                                                                               \
+int32_t fc_memo_compute_##S(struct fc_memo *ctx, const T *seq2, int32_t len2)  \
+{                                                                              \
+   if (ctx->compute == fc_memo_levenshtein)                                    \
+      return fc_memo_distance(ctx, seq2, len2, false, ctx->costs, sizeof(T));  \
+   if (ctx->compute == fc_memo_damerau)                                        \
+      return fc_memo_distance(ctx, seq2, len2, true, ctx->costs, sizeof(T));   \
+   if (ctx->compute == fc_memo_lcsubstr)                                       \
+      return fc_memo_lcsubstr_body(ctx, seq2, len2, sizeof(T));                \
+   return fc_memo_lcsubseq_body(ctx, seq2, len2, sizeof(T));                   \
+}
+_(u8, uint8_t)
+_(u16, uint16_t)
+_(u32, uint32_t)
+#undef _
+#line 1 "packed.c"
+#include <assert.h>
+#include <string.h>
+
+/* Largest alphabet of a packed sequence. */
+#define FC_PACKED_MAX_SYMS (1 << 4)
+
+/* Pattern-match masks of a packed sequence, as in struct fc_peq. Since the
+ * alphabet is small, the row of a symbol is the symbol itself, and characters
+ * of the compared sequence don't need to be looked up in a hash table.
+ */
+struct fc_packed_peq {
+   int32_t len;
+   int32_t words;
+   uint64_t rows[FC_PACKED_MAX_SYMS * FC_MAX_WORDS];
+};
+
+/* Returns the symbol at position "i" of a packed sequence. Since the number of
+ * bits per symbol divides the size of a word, symbols never straddle words.
+ */
+static inline uint64_t fc_packed_get(const uint64_t *seq, int32_t i, int bits)
+{
+   const int32_t pos = i * bits;
+   return seq[pos / FC_WORD_BITS] >> (pos % FC_WORD_BITS)
+          & ((UINT64_C(1) << bits) - 1);
+}
+
+/* Gathers the lowest bit of each field of "bits" bits of a word into the low
+ * bits of the result. The other bits of the fields must be cleared.
+ */
+static uint64_t fc_packed_compress(uint64_t m, int bits)
+{
+   if (bits == 2) {
+      m = (m | m >> 1) & UINT64_C(0x3333333333333333);
+      m = (m | m >> 2) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+      m = (m | m >> 4) & UINT64_C(0x00FF00FF00FF00FF);
+      m = (m | m >> 8) & UINT64_C(0x0000FFFF0000FFFF);
+      return (m | m >> 16) & UINT64_C(0x00000000FFFFFFFF);
+   }
+   m = (m | m >> 3) & UINT64_C(0x0303030303030303);
+   m = (m | m >> 6) & UINT64_C(0x000F000F000F000F);
+   m = (m | m >> 12) & UINT64_C(0x000000FF000000FF);
+   return (m | m >> 24) & UINT64_C(0x000000000000FFFF);
+}
+
+/* Returns the "bits" bits of a packed sequence of "words" words that start at
+ * the bit "pos". The bits past the end of the sequence are garbage.
+ */
+static inline uint64_t fc_packed_window(const uint64_t *seq, int32_t words,
+                                        int64_t pos)
+{
+   const int32_t w = pos / FC_WORD_BITS, shift = pos % FC_WORD_BITS;
+   uint64_t x = seq[w] >> shift;
+   if (shift && w + 1 < words)
+      x |= seq[w + 1] << (FC_WORD_BITS - shift);
+   return x;
+}
+
+/* Same as STRIP in metric.c, for packed sequences. Symbols are compared a
+ * word at a time. Returns the length of the common prefix, which is where
+ * both sequences start afterwards.
+ */
+static int32_t fc_packed_strip(int bits, const uint64_t *seq1, int32_t *len1p,
+                               const uint64_t *seq2, int32_t *len2p)
+{
+   const int32_t syms = FC_WORD_BITS / bits;
+   const int32_t len1 = *len1p, len2 = *len2p, len = FC_MIN(len1, len2);
+   const int32_t words1 = FC_PACKED_WORDS(len1, bits);
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+
+   /* Both prefixes are aligned on words. */
+   int32_t prefix = 0, w = 0;
+   for (; prefix < len; prefix += syms, w++) {
+      const uint64_t x = seq1[w] ^ seq2[w];
+      if (x) {
+         prefix += fc_ctz(x) / bits;
+         break;
+      }
+   }
+   prefix = FC_MIN(prefix, len);
+
+   /* Suffixes are not, so they are compared by windows ending at their last
+    * symbol. The bits before the start of a sequence are zeroes, and the
+    * suffix can't be longer than what is left after the prefix anyway.
+    */
+   int32_t suffix = 0;
+   while (suffix < len - prefix) {
+      const int64_t end1 = (int64_t)(len1 - suffix) * bits;
+      const int64_t end2 = (int64_t)(len2 - suffix) * bits;
+      const uint64_t x1 = end1 >= FC_WORD_BITS
+         ? fc_packed_window(seq1, words1, end1 - FC_WORD_BITS)
+         : seq1[0] << (FC_WORD_BITS - end1);
+      const uint64_t x2 = end2 >= FC_WORD_BITS
+         ? fc_packed_window(seq2, words2, end2 - FC_WORD_BITS)
+         : seq2[0] << (FC_WORD_BITS - end2);
+      if (x1 != x2) {
+         suffix += __builtin_clzll(x1 ^ x2) / bits;
+         break;
+      }
+      suffix += syms;
+   }
+   suffix = FC_MIN(suffix, len - prefix);
+
+   *len1p = len1 - prefix - suffix;
+   *len2p = len2 - prefix - suffix;
+   return prefix;
+}
+
+/* Builds the masks of the "len" symbols of a packed sequence of "seq_words"
+ * words that start at "start". The masks are computed a packed word at a time.
+ * After a xor with a symbol repeated in each field, the fields that are zero
+ * are the positions of this symbol, and their bits only have to be gathered.
+ */
+static void fc_packed_peq_init(struct fc_packed_peq *peq, int bits,
+                               const uint64_t *seq, int32_t seq_words,
+                               int32_t start, int32_t len)
+{
+   const int32_t syms = FC_WORD_BITS / bits;
+   const uint64_t low = bits == 2 ? UINT64_C(0x5555555555555555)
+                                  : UINT64_C(0x1111111111111111);
+   const int32_t words = (len + FC_WORD_BITS - 1) / FC_WORD_BITS;
+
+   peq->len = len;
+   peq->words = words;
+   memset(peq->rows, 0, (words << bits) * sizeof *peq->rows);
+
+   for (int32_t i = 0; i * syms < len; i++) {
+      const int32_t pos = i * syms;
+      const uint64_t valid = len - pos < syms ? (UINT64_C(1) << (len - pos)) - 1
+                                              : ~UINT64_C(0);
+      const uint64_t chunk = fc_packed_window(seq, seq_words,
+                                              (int64_t)(start + pos) * bits);
+      for (int c = 0; c < 1 << bits; c++) {
+         uint64_t x = chunk ^ (c * low);
+         x |= x >> 1;
+         if (bits == 4)
+            x |= x >> 2;
+         const uint64_t m = fc_packed_compress(~x & low, bits) & valid;
+         peq->rows[c * words + pos / FC_WORD_BITS] |= m << (pos % FC_WORD_BITS);
+      }
+   }
+}
+
+bool fc_pack(int bits, const char32_t *alphabet,
+             const char32_t *seq, int32_t len, uint64_t *packed)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len >= 0);
+
+   /* ASCII characters are mapped with a table. */
+   uint8_t ascii[128];
+   memset(ascii, UINT8_MAX, sizeof ascii);
+   int32_t nr = 0;
+   for (; alphabet[nr]; nr++)
+      if (alphabet[nr] < FC_ARRAY_SIZE(ascii))
+         ascii[alphabet[nr]] = nr;
+   assert(nr <= 1 << bits);
+
+   memset(packed, 0, FC_PACKED_WORDS(len, bits) * sizeof *packed);
+   for (int32_t i = 0; i < len; i++) {
+      uint64_t sym;
+      if (seq[i] < FC_ARRAY_SIZE(ascii)) {
+         sym = ascii[seq[i]];
+      } else {
+         sym = 0;
+         while (sym < (uint64_t)nr && alphabet[sym] != seq[i])
+            sym++;
+      }
+      if (sym >= (uint64_t)nr)
+         return false;
+      packed[i * bits / FC_WORD_BITS] |= sym << (i * bits % FC_WORD_BITS);
+   }
+   return true;
+}
+
+
+/*******************************************************************************
+ * Levenshtein
+ ******************************************************************************/
+
+/* Same as fc_bitpar_levenshtein1(). */
+static int32_t fc_packed_levenshtein1(const struct fc_packed_peq *peq, int bits,
+                                      const uint64_t *seq, int32_t start,
+                                      int32_t len)
+{
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = peq->rows[fc_packed_get(seq, start + i, bits)];
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+   }
+   return dist;
+}
+
+/* Same as fc_bitpar_levenshteinN(). */
+static int32_t fc_packed_levenshteinN(const struct fc_packed_peq *peq, int bits,
+                                      const uint64_t *seq, int32_t start,
+                                      int32_t len)
+{
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = 0;
+   }
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t sym = fc_packed_get(seq, start + i, bits);
+      const uint64_t *eqs = &peq->rows[sym * words];
+      uint64_t hp_carry = 1, hn_carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t xv = eqs[w] | vn[w];
+         const uint64_t eq = eqs[w] | hn_carry;
+         const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+         uint64_t hp = vn[w] | ~(xh | vp[w]);
+         uint64_t hn = vp[w] & xh;
+
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         vp[w] = hn | ~(xv | hp);
+         vn[w] = hp & xv;
+      }
+   }
    return dist;
 }
 
+int32_t fc_levenshtein_packed(int bits, const uint64_t *seq1, int32_t len1,
+                              const uint64_t *seq2, int32_t len2)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
+
+   if (len1 < len2) {
+      FC_SWAP(const uint64_t *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+   const int32_t start = fc_packed_strip(bits, seq1, &len1, seq2, &len2);
+   if (len2 == 0)
+      return len1;
+
+   /* The shortest sequence is used as pattern. */
+   struct fc_packed_peq peq;
+   fc_packed_peq_init(&peq, bits, seq2, words2, start, len2);
+   if (peq.words == 1)
+      return fc_packed_levenshtein1(&peq, bits, seq1, start, len1);
+   return fc_packed_levenshteinN(&peq, bits, seq1, start, len1);
+}
+
 
 /*******************************************************************************
- * Bounded Levenshtein distance computation
+ * Longest common subsequence
  ******************************************************************************/
 
-static int32_t fc_lev_bounded0(const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
+/* Same as fc_bitpar_lcsubseq1(). */
+static int32_t fc_packed_lcsubseq1(const struct fc_packed_peq *peq, int bits,
+                                   const uint64_t *seq, int32_t start,
+                                   int32_t len)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   const uint64_t mask = ~UINT64_C(0) >> (FC_WORD_BITS - peq->len);
+   uint64_t s = ~UINT64_C(0);
 
-   if (len1 == len2)
-      return memcmp(seq1, seq2, len1 * sizeof *seq1) != 0;
-   return INT32_MAX;
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t u = s & peq->rows[fc_packed_get(seq, start + i, bits)];
+      s = (s + u) | (s - u);
+   }
+   return fc_popcount(~s & mask);
 }
 
-int32_t fc_lev_bounded1(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+/* Same as fc_bitpar_lcsubseqN(). */
+static int32_t fc_packed_lcsubseqN(const struct fc_packed_peq *peq, int bits,
+                                   const uint64_t *seq, int32_t start,
+                                   int32_t len)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   const int32_t words = peq->words;
+   uint64_t s[FC_MAX_WORDS];
+
+   for (int32_t w = 0; w < words; w++)
+      s[w] = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t sym = fc_packed_get(seq, start + i, bits);
+      const uint64_t *eqs = &peq->rows[sym * words];
+      uint64_t carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t u = s[w] & eqs[w];
+         const uint64_t sum = s[w] + carry;
+         const uint64_t x = sum + u;
+         carry = (sum < carry) | (x < u);
+         s[w] = x | (s[w] - u);
+      }
+   }
+
+   int32_t lcs = 0;
+   for (int32_t w = 0; w < words - 1; w++)
+      lcs += fc_popcount(~s[w]);
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   return lcs + fc_popcount(~s[words - 1] & (~UINT64_C(0) >> (FC_WORD_BITS - rem)));
+}
+
+int32_t fc_lcsubseq_packed(int bits, const uint64_t *seq1, int32_t len1,
+                           const uint64_t *seq2, int32_t len2)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
 
    if (len1 < len2) {
+      FC_SWAP(const uint64_t *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
-      FC_SWAP(const char32_t *, seq1, seq2);
    }
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+   const int32_t orig_len2 = len2;
+   const int32_t start = fc_packed_strip(bits, seq1, &len1, seq2, &len2);
+   const int32_t stripped = orig_len2 - len2;
+   if (len2 == 0)
+      return stripped;
 
-   STRIP(seq1, seq2, len1, len2);
-   return len1;
+   struct fc_packed_peq peq;
+   fc_packed_peq_init(&peq, bits, seq2, words2, start, len2);
+   if (peq.words == 1)
+      return stripped + fc_packed_lcsubseq1(&peq, bits, seq1, start, len1);
+   return stripped + fc_packed_lcsubseqN(&peq, bits, seq1, start, len1);
 }
+#line 1 "rle.c"
+#include <assert.h>
+#include <string.h>
 
-/* C adaptation of:
- * http://writingarchives.sakura.ne.jp/fastcomp/#algorithm
- * This is both efficient and cheap in implementation complexity.
- * i, d, r -> insert, delete, replace.
+/* The matrix is cut into blocks, one per pair of runs, and only the last row
+ * and the last column of each block are computed, in time linear in their
+ * length. See Arbell, Landau and Mitchell, "Edit Distance of Run-Length
+ * Encoded Strings".
+ *
+ * In a block whose runs have the same character, a cell has the same value as
+ * the cell on its upper-left diagonal, since values of adjacent cells differ
+ * by at most one. In a block whose runs differ, every move costs one, so the
+ * value of a cell is the minimum, over the cells of the row above the block
+ * and of the column before it, of their value plus their Chebyshev distance
+ * to the cell.
  */
-int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+
+struct fc_rle_scratch {
+   int32_t *prefix;     /* prefix[i] = min(across[k] - k) for k <= i. */
+   int32_t *suffix;     /* suffix[i] = min(across[k]) for k >= i. */
+   int32_t *window;     /* Indexes of a monotone queue over "along". */
+};
+
+/* Computes an edge of a block whose runs differ: either its last row, with
+ * "along" the row above the block and "across" the column before it, or its
+ * last column, with the roles swapped. Both start with the top-left corner
+ * of the block. "along" has n + 1 cells, and "across" m + 1, so the edge is at
+ * distance "m" from "along". Sets out[t] for t in [1, n].
+ */
+static void fc_rle_mismatch_edge(const int32_t *along, int32_t n,
+                                 const int32_t *across, int32_t m,
+                                 struct fc_rle_scratch *sc, int32_t *out)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   int32_t *prefix = sc->prefix, *suffix = sc->suffix, *window = sc->window;
 
-   static const char *const models[3][4] = {
-      {"id", "di", "rr", NULL},
-      {"dr", "rd", NULL},
-      {"dd", NULL},
-   };
-   int32_t dist = 3;
+   prefix[0] = across[0];
+   for (int32_t k = 1; k <= m; k++)
+      prefix[k] = FC_MIN(prefix[k - 1], across[k] - k);
+   suffix[m] = across[m];
+   for (int32_t k = m - 1; k >= 0; k--)
+      suffix[k] = FC_MIN(suffix[k + 1], across[k]);
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
-   }
-   STRIP(seq1, seq2, len1, len2);
+   /* Cells of "along" within distance "m" are in a sliding window, and
+    * farther ones in a running minimum.
+    */
+   int32_t head = 0, tail = 0, far = INT32_MAX;
+   window[tail++] = 0;
+   for (int32_t t = 1; t <= n; t++) {
+      while (tail > head && along[window[tail - 1]] >= along[t])
+         tail--;
+      window[tail++] = t;
+      if (t - m - 1 >= 0) {
+         far = FC_MIN(far, along[t - m - 1] - (t - m - 1));
+         if (window[head] < t - m)
+            head++;
+      }
 
-   const int32_t diff = len1 - len2;
-   if (diff > 2)
-      return INT32_MAX;
-   if (len2 == 0)
-      return len1;
+      int32_t v = m + along[window[head]];
+      if (far != INT32_MAX)
+         v = FC_MIN(v, t + far);
+      if (m - t >= 0)
+         v = FC_MIN(v, m + prefix[m - t]);
+      v = FC_MIN(v, t + suffix[FC_MAX(0, m - t + 1)]);
+      out[t] = v;
+   }
+}
 
-   for (const char *const *model = models[diff]; *model; model++) {
-      int32_t i = 0, j = 0, cost = 0;
+/* Same as above, for a block whose runs have the same character. */
+static void fc_rle_match_edge(const int32_t *along, int32_t n,
+                              const int32_t *across, int32_t m, int32_t *out)
+{
+   for (int32_t t = 1; t <= n; t++)
+      out[t] = t >= m ? along[t - m] : across[m - t];
+}
 
-      while (i < len1 && j < len2) {
-         if (seq1[i] == seq2[j]) {
-            i++;
-            j++;
-         } else {
-            cost++;
-            if (cost > 2)
-               break;
-            switch ((*model)[cost - 1]) {
-            case 'd':
-               i++;
-               break;
-            case 'i':
-               j++;
-               break;
-            default:
-               i++;
-               j++;
-               break;
-            }
-         }
-      }
+static int64_t fc_rle_len(const struct fc_run *runs, int32_t nr, int32_t *max_run)
+{
+   int64_t len = 0;
 
-      if (cost <= 2) {
-         if (i < len1)
-            cost += len1 - i;
-         else if (j < len2)
-            cost += len2 - j;
-         if (cost < dist)
-            dist = cost;
-      }
+   *max_run = 0;
+   for (int32_t i = 0; i < nr; i++) {
+      assert(runs[i].len > 0);
+      len += runs[i].len;
+      *max_run = FC_MAX(*max_run, runs[i].len);
    }
+   return len;
+}
 
-   return dist;
+int32_t fc_rle_encode(const char32_t *seq, int32_t len, struct fc_run *runs)
+{
+   int32_t nr = 0;
+
+   for (int32_t i = 0; i < len; i++) {
+      if (nr && runs[nr - 1].c == seq[i])
+         runs[nr - 1].len++;
+      else
+         runs[nr++] = (struct fc_run){.c = seq[i], .len = 1};
+   }
+   return nr;
 }
 
-int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t, const char32_t *, int32_t) = {
-   fc_lev_bounded0,
-   fc_lev_bounded1,
-   fc_lev_bounded2,
-};
+/* Cost of a block relative to a cell of its edges. */
+#define FC_RLE_BLOCK_COST 10
 
+/* Computing a cell of the edges of a block costs about as much as a word of a
+ * column with the bit-parallel algorithm, which processes 64 cells at once, so
+ * runs must be long for the edges to be worth it. Otherwise, the sequences are
+ * decoded.
+ */
+static bool fc_rle_worth(int64_t nr1, int64_t len1, int64_t nr2, int64_t len2)
+{
+   const int64_t rle_cost = nr1 * len2 + nr2 * len1 + FC_RLE_BLOCK_COST * nr1 * nr2;
+   const int64_t bitpar_cost = FC_MAX(len1, len2)
+                               * ((FC_MIN(len1, len2) + FC_WORD_BITS - 1) / FC_WORD_BITS);
+   return rle_cost < bitpar_cost;
+}
 
-/*******************************************************************************
- * Longest common substring
- ******************************************************************************/
+static char32_t *fc_rle_decode(const struct fc_run *runs, int32_t nr, char32_t *seq)
+{
+   for (int32_t i = 0; i < nr; i++)
+      for (int32_t k = 0; k < runs[i].len; k++)
+         *seq++ = runs[i].c;
+   return seq;
+}
 
-static int32_t fc_lcsubstr0(int32_t *column, const char32_t *seq1, int32_t len1,
-                        const char32_t *seq2, int32_t len2, const char32_t **pos)
+int32_t fc_levenshtein_rle(const struct fc_run *runs1, int32_t nr1,
+                           const struct fc_run *runs2, int32_t nr2)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   assert(nr1 >= 0 && nr2 >= 0);
 
-   memset(column, 0, len2 * sizeof *column);
+   int32_t max1, max2;
+   int64_t len1 = fc_rle_len(runs1, nr1, &max1);
+   int64_t len2 = fc_rle_len(runs2, nr2, &max2);
+   assert(len1 <= INT32_MAX && len2 <= INT32_MAX);
 
-   int32_t max_len = 0;
-   int32_t my_pos = INT32_MAX;
+   /* The row is as long as the second sequence, so use the shortest one. */
+   if (len1 < len2) {
+      FC_SWAP(const struct fc_run *, runs1, runs2);
+      FC_SWAP(int32_t, nr1, nr2);
+      FC_SWAP(int64_t, len1, len2);
+      FC_SWAP(int32_t, max1, max2);
+   }
+   if (len2 == 0)
+      return len1;
 
-   for (int32_t i = 0; i < len1; i++) {
-      int32_t last = 0;
-      for (int32_t j = 0; j < len2; j++) {
-         const int32_t old = column[j];
-         if (seq1[i] == seq2[j]) {
-            column[j] = last + 1;
-            if (max_len < column[j]) {
-               max_len = column[j];
-               my_pos = i;
-            }
+   if (!fc_rle_worth(nr1, len1, nr2, len2)) {
+      char32_t *seq1 = fc_malloc((len1 + len2) * sizeof *seq1);
+      char32_t *seq2 = fc_rle_decode(runs1, nr1, seq1);
+      fc_rle_decode(runs2, nr2, seq2);
+      const int32_t dist = fc_levenshtein_long(seq1, len1, seq2, len2, 1);
+      fc_free(seq1);
+      return dist;
+   }
+
+   const int32_t max = FC_MAX(max1, max2) + 1;
+   int32_t *row = fc_malloc((len2 + 1 + 2 * (max1 + 1) + (max2 + 1) + 3 * max)
+                            * sizeof *row);
+   int32_t *left = &row[len2 + 1], *right = &left[max1 + 1];
+   int32_t *top = &right[max1 + 1];
+   struct fc_rle_scratch sc = {
+      .prefix = &top[max2 + 1],
+      .suffix = &top[max2 + 1 + max],
+      .window = &top[max2 + 1 + 2 * max],
+   };
+
+   for (int32_t c = 0; c <= len2; c++)
+      row[c] = c;
+
+   /* The matrix is computed by strips of rows, one per run of "runs1". The
+    * last row of a strip is computed in "row", block by block. The last
+    * column of a block is the first one of the next block.
+    */
+   int32_t x0 = 0;
+   for (int32_t i = 0; i < nr1; i++) {
+      const int32_t h = runs1[i].len;
+      for (int32_t x = 0; x <= h; x++)
+         left[x] = x0 + x;
+
+      int32_t c0 = 0;
+      for (int32_t j = 0; j < nr2; j++) {
+         const int32_t w = runs2[j].len;
+         top[0] = left[0];
+         memcpy(&top[1], &row[c0 + 1], w * sizeof *top);
+
+         if (runs1[i].c == runs2[j].c) {
+            fc_rle_match_edge(top, w, left, h, &row[c0]);
+            fc_rle_match_edge(left, h, top, w, right);
          } else {
-            column[j] = 0;
+            fc_rle_mismatch_edge(top, w, left, h, &sc, &row[c0]);
+            fc_rle_mismatch_edge(left, h, top, w, &sc, right);
          }
-         last = old;
+         right[0] = top[w];
+         FC_SWAP(int32_t *, left, right);
+         c0 += w;
       }
+      x0 += h;
+      row[0] = x0;
    }
 
-   if (pos)
-      *pos = max_len ? &seq1[my_pos - max_len + 1] : &seq1[len1];
-   return max_len;
+   const int32_t dist = row[len2];
+   fc_free(row);
+   return dist;
 }
+#line 1 "sam.c"
+#include <assert.h>
+#include <string.h>
 
-int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
-                            const char32_t *seq2, int32_t len2,
-                            const char32_t **pos)
+static int32_t fc_sam_add_state(struct fc_sam *sam, int32_t len, int32_t link)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
-
-   /* We don't swap the sequences here to not mess up the value assigned to
-    * the pointer *pos. This might result in a larger allocation.
-    */
-   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
-   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(len2 * sizeof *columnp);
+   const int32_t s = sam->states_nr++;
+   sam->states[s] = (struct fc_sam_state){.len = len, .link = link, .edges = -1};
+   return s;
+}
 
-   int32_t dist = fc_lcsubstr0(columnp, seq1, len1, seq2, len2, pos);
+static void fc_sam_add_edge(struct fc_sam *sam, int32_t from, char32_t c,
+                            int32_t to)
+{
+   uint32_t i = fc_sam_hash(sam, from, c);
+   while (sam->slots[i])
+      i = (i + 1) & sam->mask;
+
+   const int32_t e = sam->edges_nr++;
+   sam->edges[e] = (struct fc_sam_edge){
+      .from = from,
+      .c = c,
+      .to = to,
+      .next = sam->states[from].edges,
+   };
+   sam->states[from].edges = e;
+   sam->slots[i] = e + 1;
+}
 
-   if (columnp != column)
-      fc_free(columnp);
+static void fc_sam_extend(struct fc_sam *sam, int32_t *last, char32_t c)
+{
+   struct fc_sam_state *states = sam->states;
+   const int32_t cur = fc_sam_add_state(sam, states[*last].len + 1, 0);
+   int32_t p = *last;
+   const struct fc_sam_edge *edge = NULL;
+
+   while (p >= 0 && !(edge = fc_sam_edge(sam, p, c))) {
+      fc_sam_add_edge(sam, p, c, cur);
+      p = states[p].link;
+   }
+   *last = cur;
+   if (p < 0)
+      return;
+
+   const int32_t q = edge->to;
+   if (states[p].len + 1 == states[q].len) {
+      states[cur].link = q;
+      return;
+   }
 
-   return dist;
+   /* Split the state "q", so that the strings of length len(p) + 1 it holds
+    * get their own state.
+    */
+   const int32_t clone = fc_sam_add_state(sam, states[p].len + 1, states[q].link);
+   for (int32_t e = states[q].edges; e >= 0; e = sam->edges[e].next)
+      fc_sam_add_edge(sam, clone, sam->edges[e].c, sam->edges[e].to);
+
+   struct fc_sam_edge *redirect;
+   while (p >= 0 && (redirect = fc_sam_edge(sam, p, c)) && redirect->to == q) {
+      redirect->to = clone;
+      p = states[p].link;
+   }
+   states[q].link = states[cur].link = clone;
 }
 
-int32_t fc_lcsubstr(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+void fc_sam_init_elems(struct fc_sam *sam, const void *seq, int32_t len,
+                       int size)
 {
-   return fc_lcsubstr_extract(seq1, len1, seq2, len2, NULL);
-}
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
 
+   const int32_t max_states = 2 * len + 1;
+   const int32_t max_edges = 3 * len + 1;
 
-/*******************************************************************************
- * Longest common subsequence
- ******************************************************************************/
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * (uint32_t)max_edges) {
+      slots_nr <<= 1;
+      shift--;
+   }
 
-static int32_t fc_lcsubseq0(int32_t *column, const char32_t *seq1, int32_t len1,
-                        const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+   sam->len = len;
+   sam->states_nr = sam->edges_nr = 0;
+   sam->mask = slots_nr - 1;
+   sam->shift = shift;
 
-   if (len2 == 0)
-      return 0;
+   sam->states = fc_malloc(max_states * sizeof *sam->states
+                           + max_edges * sizeof *sam->edges
+                           + slots_nr * sizeof *sam->slots);
+   sam->edges = (struct fc_sam_edge *)&sam->states[max_states];
+   sam->slots = (int32_t *)&sam->edges[max_edges];
+   memset(sam->slots, 0, slots_nr * sizeof *sam->slots);
 
-   memset(column, 0, (len2 + 1) * sizeof *column);
+   int32_t last = fc_sam_add_state(sam, 0, -1);
+   for (int32_t i = 0; i < len; i++)
+      fc_sam_extend(sam, &last, fc_elem(seq, i, size));
 
-   for (int32_t i = 1; i <= len1; i++) {
-      int32_t last = 0;
-      for (int32_t j = 1; j <= len2; j++) {
-         const int32_t old = column[j];
-         if (seq1[i - 1] == seq2[j - 1])
-            column[j] = last + 1;
-         else if (column[j] < column[j - 1])
-            column[j] = column[j - 1];
-         last = old;
-      }
-   }
+   assert(sam->states_nr <= max_states && sam->edges_nr <= max_edges);
+}
 
-   return column[len2];
+void fc_sam_fini(struct fc_sam *sam)
+{
+   fc_free(sam->states);
 }
 
-int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+/* Walks the automaton with "seq", following suffix links on mismatches. After
+ * each character, "match" is the length of the longest suffix of the prefix
+ * of "seq" read so far that is a substring of the other sequence.
+ */
+int32_t fc_sam_lcsubstr_elems(const struct fc_sam *sam, const void *seq,
+                              int32_t len, int32_t *end, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   assert(len >= 0);
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
+   const struct fc_sam_state *states = sam->states;
+   int32_t state = 0, match = 0;
+   int32_t max_len = 0;
+
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      const struct fc_sam_edge *edge;
+      while (!(edge = fc_sam_edge(sam, state, c)) && state) {
+         state = states[state].link;
+         match = states[state].len;
+      }
+      if (edge) {
+         state = edge->to;
+         match++;
+      } else {
+         match = 0;
+      }
+      if (max_len < match) {
+         max_len = match;
+         if (end)
+            *end = i;
+      }
    }
+   return max_len;
+}
+#line 1 "simd.c"
+#include <assert.h>
+#include <string.h>
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
-   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+#ifdef FC_HAVE_SIMD
+
+/* Number of cells processed per vector. Values stored in cells are at most
+ * len1 + len2, plus the number of anti-diagonals for garbage cells past the
+ * end of a diagonal, so 16 bits are always enough.
+ */
+#define LANES 32
 
-   int32_t res = fc_lcsubseq0(columnp, seq1, len1, seq2, len2);
+static_assert(4 * FC_MAX_SEQ_LEN < INT16_MAX, "");
 
-   if (columnp != column)
-      fc_free(columnp);
+typedef int16_t fc_vec __attribute__((vector_size(LANES * sizeof(int16_t))));
 
-   return res;
-}
+#define VLOAD(v, p) memcpy(&(v), (p), sizeof(v))
+#define VSTORE(p, v) memcpy((p), &(v), sizeof(v))
 
-double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+/* Lane-wise selection. "m" must hold -1 or 0 in each lane. The result has the
+ * type of "a", even if "m" has a different signedness.
+ */
+#define VSEL(m, a, b) ((__typeof__(a))(((m) & (a)) | (~(m) & (b))))
+#define VMIN(a, b) VSEL((a) < (b), a, b)
+#define VMAX(a, b) VSEL((a) > (b), a, b)
+
+/* Defines a function "name" that calls "name##_body" compiled for the best
+ * instruction set supported by the CPU. The body must be always inlined for
+ * this to work.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+   #define FC_DISPATCH(ret, name, params, args)                                \
+   __attribute__((target("avx512f,avx512bw")))                                 \
+   static ret name##_avx512 params { return name##_body args; }                \
+   __attribute__((target("avx2")))                                             \
+   static ret name##_avx2 params { return name##_body args; }                  \
+   ret name params                                                             \
+   {                                                                           \
+      if (__builtin_cpu_supports("avx512bw"))                                  \
+         return name##_avx512 args;                                            \
+      if (__builtin_cpu_supports("avx2"))                                      \
+         return name##_avx2 args;                                              \
+      return name##_body args;                                                 \
+   }
+#else
+   #define FC_DISPATCH(ret, name, params, args)                                \
+   ret name params { return name##_body args; }
+#endif
+
+/* Maps the characters of the sequences to small integers, so that they fit in
+ * 16-bit lanes. Characters of "seq2" are numbered from 1, and characters of
+ * "seq1" that don't appear in "seq2" are mapped to 0. "seq2" is reversed, for
+ * anti-diagonals to be contiguous in memory. Both arrays are padded with LANES
+ * values that don't match anything.
+ */
+static void fc_simd_remap(int16_t *ids1, const void *seq1, int32_t len1,
+                          int16_t *ids2, const void *seq2, int32_t len2,
+                          bool reverse, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
 
-   if (len1 == 0 && len2 == 0)
-      return 1.;
+   for (int32_t i = 0; i < len1; i++)
+      ids1[i] = fc_peq_slot(&peq, fc_elem(seq1, i, size))->row;
+   for (int32_t i = len1; i < len1 + LANES; i++)
+      ids1[i] = 0;
 
-   const int32_t lcs = fc_lcsubseq(seq1, len1, seq2, len2);
-   return 1. - (2. * lcs) / (double)(len1 + len2);
+   for (int32_t i = 0; i < len2; i++) {
+      const int32_t id = fc_peq_slot(&peq, fc_elem(seq2, i, size))->row;
+      ids2[reverse ? len2 - 1 - i : i] = id;
+   }
+   for (int32_t i = len2; i < len2 + LANES; i++)
+      ids2[i] = -1;
+
+   fc_peq_fini(&peq);
 }
 
 
 /*******************************************************************************
- * Jaro
+ * Normalized Levenshtein and Damerau, by longest alignment
  ******************************************************************************/
 
-/* Could be made to use less space by allocating an array of chars, (like
- * Winkler_1994.c does) and only allocating the space needed to hold the longest
- * sequence. Sequences would be made distinguishable by the use of a special
- * mask. But it's not worth it. Better stay consistent with the rest of the
- * implementation and allocate an array of int32_ts. Also, the space overhead is
- * negligible anyway (in comparison to the metrics that use a full matrix), and
- * the maximum length of a sequence is expected to be low.
+/* Cell (i, j) of the matrix is stored at index i of the array of the
+ * anti-diagonal i + j. Its neighbours are then at index i - 1 (up) and i
+ * (left) of the previous anti-diagonal, and at index i - 1 of the one before
+ * (diagonal). Cells on a given anti-diagonal don't depend on each other, so
+ * they can be computed in parallel. "rb" is the reversed version of "seq2".
  */
-static double fc_jaro0(int32_t *matched1, const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE double fc_simd_nlevenshtein_kernel_body(const int16_t *a, int32_t len1,
+                                                         const int16_t *rb, int32_t len2,
+                                                         int16_t *buf)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   const int32_t size = len1 + 1 + LANES;
+   int16_t *d0 = buf, *d1 = &d0[size], *d2 = &d1[size];
+   int16_t *l0 = &d2[size], *l1 = &l0[size], *l2 = &l1[size];
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_vec ud, ld, dd, ul, ll, dl, va, vb;
+         VLOAD(ud, &d1[i - 1]);
+         VLOAD(ld, &d1[i]);
+         VLOAD(dd, &d2[i - 1]);
+         VLOAD(ul, &l1[i - 1]);
+         VLOAD(ll, &l1[i]);
+         VLOAD(dl, &l2[i - 1]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+
+         const fc_vec ic = ld + 1;
+         const fc_vec dc = ud + 1;
+         const fc_vec rc = dd + 1 + (va == vb);
+         fc_vec d = VMIN(dc, rc);
+         d = VMIN(ic, d);
+
+         const fc_vec lic = (ic == d) & (ll + 1);
+         const fc_vec ldc = (dc == d) & (ul + 1);
+         const fc_vec lrc = (rc == d) & (dl + 1);
+         fc_vec l = VMAX(lic, ldc);
+         l = VMAX(l, lrc);
+
+         VSTORE(&d0[i], d);
+         VSTORE(&l0[i], l);
+      }
+      /* The last vector might have overwritten the first column. */
+      if (k <= len2)
+         d0[0] = l0[0] = k;
+      if (k <= len1)
+         d0[k] = l0[k] = k;
+
+      FC_SWAP3(int16_t *, d2, d1, d0);
+      FC_SWAP3(int16_t *, l2, l1, l0);
+   }
 
-   memset(matched1, 0, (len1 + len2) * sizeof *matched1);
+   return d1[len1] / (double)l1[len1];
+}
 
-   int32_t window = (FC_MAX(len1, len2) >> 1) - 1;
-   if (window < 0)
-      window = 0;
+FC_DISPATCH(double, fc_simd_nlevenshtein_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+/* Same as above, with transpositions. These are found on the anti-diagonal
+ * i + j - 4, at index i - 2, so we need two more anti-diagonals, and one
+ * padding cell at the beginning of each array.
+ */
+FC_ALWAYS_INLINE double fc_simd_ndamerau_kernel_body(const int16_t *a, int32_t len1,
+                                                     const int16_t *rb, int32_t len2,
+                                                     int16_t *buf)
+{
+   const int32_t size = len1 + 2 + LANES;
+   int16_t *d[5], *l[5];
+
+   for (int32_t n = 0; n < 5; n++) {
+      d[n] = &buf[(2 * n) * size + 1];
+      l[n] = &buf[(2 * n + 1) * size + 1];
+   }
+
+   const fc_vec none = {0};
+   const fc_vec inf = none + INT16_MAX;
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+      int16_t *d0 = d[0], *d1 = d[1], *d2 = d[2], *d4 = d[4];
+      int16_t *l0 = l[0], *l1 = l[1], *l2 = l[2], *l4 = l[4];
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_vec ud, ld, dd, td, ul, ll, dl, tl, va, vb, ta, tb;
+         VLOAD(ud, &d1[i - 1]);
+         VLOAD(ld, &d1[i]);
+         VLOAD(dd, &d2[i - 1]);
+         VLOAD(td, &d4[i - 2]);
+         VLOAD(ul, &l1[i - 1]);
+         VLOAD(ll, &l1[i]);
+         VLOAD(dl, &l2[i - 1]);
+         VLOAD(tl, &l4[i - 2]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+         VLOAD(ta, &a[i - 2]);
+         VLOAD(tb, &rb[len2 - k + i + 1]);
+
+         const fc_vec transposed = (ta == vb) & (va == tb);
+         const fc_vec ic = ld + 1;
+         const fc_vec dc = ud + 1;
+         const fc_vec rc = dd + 1 + (va == vb);
+         const fc_vec tc = VSEL(transposed, td + 1, inf);
+         fc_vec dist = VMIN(dc, rc);
+         dist = VMIN(ic, dist);
+         dist = VMIN(tc, dist);
+
+         const fc_vec lic = (ic == dist) & (ll + 1);
+         const fc_vec ldc = (dc == dist) & (ul + 1);
+         const fc_vec lrc = (rc == dist) & (dl + 1);
+         const fc_vec ltc = (tc == dist) & (tl + 1);
+         fc_vec len = VMAX(lic, ldc);
+         len = VMAX(len, lrc);
+         len = VMAX(len, ltc);
+
+         VSTORE(&d0[i], dist);
+         VSTORE(&l0[i], len);
+      }
+      if (k <= len2)
+         d0[0] = l0[0] = k;
+      if (k <= len1)
+         d0[k] = l0[k] = k;
+
+      for (int32_t n = 4; n > 0; n--) {
+         FC_SWAP(int16_t *, d[n], d[n - 1]);
+         FC_SWAP(int16_t *, l[n], l[n - 1]);
+      }
+   }
+
+   return d[1][len1] / (double)l[1][len1];
+}
 
-   int32_t matches = 0;
-   int32_t *matched2 = &matched1[len1];
+FC_DISPATCH(double, fc_simd_ndamerau_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
 
-   for (int32_t i = 0; i < len1; i++) {
-      int32_t bot = i - window;
-      if (bot < 0)
-         bot = 0;
-      int32_t top = i + window + 1;
-      if (top > len2)
-         top = len2;
+/* When the sequences are short enough, distances and alignment lengths are
+ * packed together (see FC_LALIGN_PACK()), so that a single recurrence is
+ * computed instead of two. Packed values are unsigned, so that garbage cells
+ * past the end of an anti-diagonal can wrap around. These are never read by
+ * valid cells. len1 + len2 must be lower than FC_LALIGN16_MAX_LEN, so that
+ * intermediate values don't overflow.
+ */
+typedef uint16_t fc_uvec __attribute__((vector_size(LANES * sizeof(uint16_t))));
 
-      for (int32_t j = bot; j < top; j++) {
-         if (!matched2[j] && seq1[i] == seq2[j]) {
-            matched1[i] = matched2[j] = 1;
-            matches++;
-            break;
-         }
+#define FC_LALIGN16_SCALE 256
+#define FC_LALIGN16_MAX_LEN 240
+
+static_assert((FC_LALIGN16_MAX_LEN + 2) * FC_LALIGN16_SCALE <= UINT16_MAX, "");
+
+FC_ALWAYS_INLINE double fc_simd_nlevenshtein_packed_body(const int16_t *a, int32_t len1,
+                                                         const int16_t *rb, int32_t len2,
+                                                         int16_t *buf)
+{
+   const int32_t size = len1 + 1 + LANES;
+   const uint16_t scale = FC_LALIGN16_SCALE;
+   uint16_t *d0 = (uint16_t *)buf, *d1 = &d0[size], *d2 = &d1[size];
+
+   d1[0] = FC_LALIGN_PACK(0, 0, scale);
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_uvec up, left, diag;
+         fc_vec va, vb;
+         VLOAD(up, &d1[i - 1]);
+         VLOAD(left, &d1[i]);
+         VLOAD(diag, &d2[i - 1]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+
+         const fc_uvec idc = VMIN(up, left) + scale;
+         const fc_uvec rc = diag + ((fc_uvec)(va != vb) & scale);
+         const fc_uvec v = VMIN(idc, rc) - 1;
+         VSTORE(&d0[i], v);
       }
+      if (k <= len2)
+         d0[0] = FC_LALIGN_PACK(k, k, scale);
+      if (k <= len1)
+         d0[k] = FC_LALIGN_PACK(k, k, scale);
+
+      FC_SWAP3(uint16_t *, d2, d1, d0);
    }
-   if (!matches)
-      return 0.;
 
-   int32_t transpos = 0, k = 0;
+   return FC_LALIGN_DIST(d1[len1], scale) / (double)FC_LALIGN_LEN(d1[len1], scale);
+}
 
-   for (int32_t i = 0; i < len1; i++) {
-      if (matched1[i]) {
-         int32_t j;
-         for (j = k; j < len2; j++) {
-            if (matched2[j]) {
-               k = j + 1;
-               break;
-            }
-         }
-         if (seq1[i] != seq2[j])
-            transpos++;
+FC_DISPATCH(double, fc_simd_nlevenshtein_packed,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+FC_ALWAYS_INLINE double fc_simd_ndamerau_packed_body(const int16_t *a, int32_t len1,
+                                                     const int16_t *rb, int32_t len2,
+                                                     int16_t *buf)
+{
+   const int32_t size = len1 + 2 + LANES;
+   const uint16_t scale = FC_LALIGN16_SCALE;
+   uint16_t *d[5];
+
+   for (int32_t n = 0; n < 5; n++)
+      d[n] = (uint16_t *)&buf[n * size + 1];
+   d[1][0] = FC_LALIGN_PACK(0, 0, scale);
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+      uint16_t *d0 = d[0], *d1 = d[1], *d2 = d[2], *d4 = d[4];
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_uvec up, left, diag, tr;
+         fc_vec va, vb, ta, tb;
+         VLOAD(up, &d1[i - 1]);
+         VLOAD(left, &d1[i]);
+         VLOAD(diag, &d2[i - 1]);
+         VLOAD(tr, &d4[i - 2]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+         VLOAD(ta, &a[i - 2]);
+         VLOAD(tb, &rb[len2 - k + i + 1]);
+
+         /* Lanes without a transposition are set to the maximum value. */
+         const fc_uvec transposed = (fc_uvec)((ta == vb) & (va == tb));
+         const fc_uvec tc = (tr + scale) | ~transposed;
+         const fc_uvec idc = VMIN(up, left) + scale;
+         const fc_uvec rc = diag + ((fc_uvec)(va != vb) & scale);
+         fc_uvec v = VMIN(idc, rc);
+         v = VMIN(v, tc) - 1;
+         VSTORE(&d0[i], v);
       }
+      if (k <= len2)
+         d0[0] = FC_LALIGN_PACK(k, k, scale);
+      if (k <= len1)
+         d0[k] = FC_LALIGN_PACK(k, k, scale);
+
+      for (int32_t n = 4; n > 0; n--)
+         FC_SWAP(uint16_t *, d[n], d[n - 1]);
    }
 
-   transpos >>= 1;
-   return 1. - (1. / 3. * (  matches / (double)len1
-                           + matches / (double)len2
-                           + (matches - transpos) / (double)matches));
+   return FC_LALIGN_DIST(d[1][len1], scale) / (double)FC_LALIGN_LEN(d[1][len1], scale);
 }
 
-double fc_jaro(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+FC_DISPATCH(double, fc_simd_ndamerau_packed,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
 
-   int32_t buf[FC_DEFAULT_COLUMN_LEN * 2], *bufp = buf;
+/* Remaps the sequences and allocates the anti-diagonals. "a" has one padding
+ * value at the beginning, for transpositions.
+ */
+static double fc_simd_normalized(double (*kernel)(const int16_t *, int32_t,
+                                                  const int16_t *, int32_t,
+                                                  int16_t *),
+                                 int32_t diagonals,
+                                 const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
+{
+   assert(len1 >= len2 && len2 > 0);
 
-   if (len1 + len2 > (int32_t)FC_ARRAY_SIZE(buf))
-      bufp = fc_malloc((len1 + len2) * sizeof *bufp);
+   const size_t diag_size = len1 + 2 + LANES;
+   const size_t total = (len1 + 1 + LANES) + (len2 + LANES) + diagonals * diag_size;
+   int16_t *a = fc_malloc(total * sizeof *a);
+   int16_t *rb = &a[len1 + 1 + LANES];
+   int16_t *buf = &rb[len2 + LANES];
 
-   double dist = fc_jaro0(bufp, seq1, len1, seq2, len2);
+   a[0] = 0;
+   fc_simd_remap(&a[1], seq1, len1, rb, seq2, len2, true, size);
+   memset(buf, 0, diagonals * diag_size * sizeof *buf);
 
-   if (bufp != buf)
-      fc_free(bufp);
+   double dist = kernel(&a[1], len1, rb, len2, buf);
 
+   fc_free(a);
    return dist;
 }
 
-
-/*******************************************************************************
- * Memoized string metrics.
- ******************************************************************************/
-
-static void memo_calloc(struct fc_memo *ctx, size_t max_len, size_t mat_size)
+double fc_simd_nlevenshtein(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size)
 {
-   ctx->seq2 = fc_malloc(max_len * sizeof *ctx->seq2 + mat_size);
-   ctx->matrix = ctx->seq2 + max_len;
-   memset(ctx->matrix, 0, mat_size);
+   if (len1 + len2 < FC_LALIGN16_MAX_LEN)
+      return fc_simd_normalized(fc_simd_nlevenshtein_packed, 3,
+                                seq1, len1, seq2, len2, size);
+   return fc_simd_normalized(fc_simd_nlevenshtein_kernel, 6,
+                             seq1, len1, seq2, len2, size);
 }
 
-void fc_memo_init(struct fc_memo *ctx, enum fc_metric metric, int32_t max_len,
-                  int32_t max_dist)
+double fc_simd_ndamerau(const void *seq1, int32_t len1,
+                        const void *seq2, int32_t len2, int size)
 {
-   assert(IN_RANGE(max_len));
+   if (len1 + len2 < FC_LALIGN16_MAX_LEN)
+      return fc_simd_normalized(fc_simd_ndamerau_packed, 5,
+                                seq1, len1, seq2, len2, size);
+   return fc_simd_normalized(fc_simd_ndamerau_kernel, 10,
+                             seq1, len1, seq2, len2, size);
+}
 
-   ctx->mdim = max_len + 1;
-   ctx->max_dist = max_dist;
 
-   ctx->seq1 = NULL;
-   ctx->len1 = 0;
+/*******************************************************************************
+ * Longest common substring
+ ******************************************************************************/
 
-   switch (metric) {
+/* A cell only depends on its diagonal neighbour, so there is no need for
+ * anti-diagonals: a whole row can be computed in parallel from the previous
+ * one. Rows are offset by one, so that the cell at index 0 is always zero.
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_lcsubstr_kernel_body(const int16_t *a, int32_t len1,
+                                                      const int16_t *b, int32_t len2,
+                                                      int16_t *buf, int32_t *pos)
+{
+   int16_t *prev = buf, *cur = &buf[len2 + 1 + LANES];
+   int32_t max_len = 0;
 
-   case FC_LEVENSHTEIN: case FC_DAMERAU: {
-      if (metric == FC_LEVENSHTEIN)
-         ctx->compute = fc_memo_levenshtein;
-      else
-         ctx->compute = fc_memo_damerau;
-      /* Full matrix. */
-      ctx->seq2 = fc_malloc(max_len * sizeof *ctx->seq2 + sizeof(int32_t[ctx->mdim][ctx->mdim]));
-      ctx->matrix = ctx->seq2 + max_len;
-      int32_t (*matrix)[ctx->mdim] = ctx->matrix;
-      for (int32_t i = 0; i < ctx->mdim; i++)
-         matrix[i][0] = i;
-      for (int32_t j = 1; j < ctx->mdim; j++)
-         matrix[0][j] = j;
-      break;
-   }
-   case FC_LCSUBSTR: {
-      ctx->compute = fc_memo_lcsubstr;
-      /* We add one additional column on the right of the matrix for storing
-       * the length of the longest common substring found so far, for each row.
-       * This is necessary because the last row doesn't necessarily contain it.
+   for (int32_t i = 0; i < len1; i++) {
+      const fc_vec none = {0};
+      const fc_vec c = none + a[i];
+      fc_vec row_max = none;
+
+      for (int32_t j = 0; j < len2; j += LANES) {
+         fc_vec up_left, vb;
+         VLOAD(up_left, &prev[j]);
+         VLOAD(vb, &b[j]);
+         const fc_vec v = (c == vb) & (up_left + 1);
+         VSTORE(&cur[j + 1], v);
+         row_max = VMAX(row_max, v);
+      }
+
+      /* Check quickly if a longer substring was found before looking for its
+       * length.
        */
-      memo_calloc(ctx, max_len, sizeof(int32_t[ctx->mdim + 1][ctx->mdim]));
-      break;
-   }
-   case FC_LCSUBSEQ: {
-      ctx->compute = fc_memo_lcsubseq;
-      /* Full matrix. */
-      memo_calloc(ctx, max_len, sizeof(int32_t[ctx->mdim][ctx->mdim]));
-      break;
-   }
-   default: {
-      fc_fatal("invalid metric: %d", metric);
-   }
+      const fc_vec longer = row_max > (int16_t)max_len;
+      uint64_t any[sizeof longer / sizeof(uint64_t)], found = 0;
+      memcpy(any, &longer, sizeof any);
+      for (size_t n = 0; n < FC_ARRAY_SIZE(any); n++)
+         found |= any[n];
+      if (found) {
+         for (int32_t n = 0; n < LANES; n++)
+            if (max_len < row_max[n])
+               max_len = row_max[n];
+         *pos = i;
+      }
+      FC_SWAP(int16_t *, prev, cur);
    }
-   
-   (void)fc_memo_compute;
+   return max_len;
 }
 
-enum fc_metric fc_memo_metric(const struct fc_memo *ctx)
+FC_DISPATCH(int32_t, fc_simd_lcsubstr_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *b, int32_t len2, int16_t *buf, int32_t *pos),
+            (a, len1, b, len2, buf, pos))
+
+int32_t fc_simd_lcsubstr(const void *seq1, int32_t len1,
+                         const void *seq2, int32_t len2,
+                         const void **pos, int size)
 {
-   int32_t (*const funcs[])(struct fc_memo *, const char32_t *, int32_t) = {
-   #define _(metric, METRIC) [FC_##METRIC] = fc_memo_##metric,
-      _(levenshtein, LEVENSHTEIN)
-      _(damerau, DAMERAU)
-      _(lcsubstr, LCSUBSTR)
-      _(lcsubseq, LCSUBSEQ)
-   #undef _
-   };
+   assert(len1 > 0 && len2 > 0);
 
-   for (size_t i = 0; i < FC_ARRAY_SIZE(funcs); i++)
-      if (funcs[i] == ctx->compute)
-         return i;
+   const size_t row_size = len2 + 1 + LANES;
+   const size_t total = (len1 + LANES) + (len2 + LANES) + 2 * row_size;
+   int16_t *a = fc_malloc(total * sizeof *a);
+   int16_t *b = &a[len1 + LANES];
+   int16_t *buf = &b[len2 + LANES];
 
-   fc_fatal("object not properly initialized");
-}
+   fc_simd_remap(a, seq1, len1, b, seq2, len2, false, size);
+   memset(buf, 0, 2 * row_size * sizeof *buf);
 
-void fc_memo_set_ref(struct fc_memo *ctx,
-                            const char32_t *seq1, int32_t len1)
-{
-   ctx->seq1 = seq1;
-   ctx->len1 = len1;
-   ctx->len2 = 0;
+   int32_t end = 0;
+   int32_t max_len = fc_simd_lcsubstr_kernel(a, len1, b, len2, buf, &end);
+
+   fc_free(a);
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
 }
 
-int32_t fc_memo_lcsubstr(struct fc_memo *ctx, const char32_t *seq2, int32_t len2)
-{
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->compute == fc_memo_lcsubstr);
+/* Same size as fc_vec, for comparing characters without remapping them. */
+typedef char32_t fc_cvec __attribute__((vector_size(sizeof(fc_vec))));
+typedef int32_t fc_cmask __attribute__((vector_size(sizeof(fc_vec))));
 
-   const char32_t *seq1 = ctx->seq1;
-   const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
-   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
-   const int32_t max_lens = ctx->mdim;
+static_assert(FC_ARRAY_SIZE((fc_cvec){0}) == FC_SIMD_SHORT_LEN, "");
 
-   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
-      skip++;
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
-   ctx->len2 = len2;
+/* Diagonals of the matrix are compared at once: "x" is held in a vector, and
+ * compared to a window of "y" for each shift. The matches are converted to a
+ * bit-mask, where the longest run of set bits is found by shifting and masking
+ * it until it is empty. The last non-empty mask holds the first position of
+ * the runs that are as long as possible, so we get the leftmost one on the
+ * diagonal with a count of trailing zeros. Among diagonals, the run that ends
+ * first in "seq1" wins ties, which is "x" or "y" depending on "swapped".
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_lcsubstr_short_body(const char32_t *x, int32_t lenx,
+                                                     const char32_t *ypad, int32_t leny,
+                                                     bool swapped, int32_t *end)
+{
+   const int32_t nx = FC_SIMD_SHORT_LEN;
+   const uint32_t xbits = (UINT32_C(1) << lenx) - 1;
+   fc_cvec vx = {0};
+   int32_t max_len = 0;
 
-   int32_t max_len = matrix[max_lens][skip];
-   for (int32_t i = skip + 1; i <= len2; i++) {
-      for (int32_t j = 1; j <= len1; j++) {
-         if (seq1[j - 1] == seq2[i - 1]) {
-            int32_t up_left = matrix[i - 1][j - 1] + 1;
-            matrix[i][j] = up_left;
-            if (max_len < up_left)
-               max_len = up_left;
-         } else {
-            matrix[i][j] = 0;
-         }
+   memcpy(&vx, x, lenx * sizeof *x);
+
+   /* Lane n is compared with y[n + shift]. */
+   for (int32_t shift = 1 - lenx; shift < leny; shift++) {
+      fc_cvec vy;
+      VLOAD(vy, &ypad[nx + shift]);
+      const fc_cmask eq = (fc_cmask)(vx == vy);
+
+      uint32_t m = 0;
+      for (int32_t n = 0; n < nx; n++)
+         m |= (uint32_t)(eq[n] & 1) << n;
+
+      /* Discard lanes out of "x" or "y". */
+      m &= xbits;
+      if (shift < 0)
+         m &= UINT32_MAX << -shift;
+      if (leny - shift < nx)
+         m &= (UINT32_C(1) << (leny - shift)) - 1;
+
+      if (!m || fc_popcount(m) < max_len)
+         continue;
+
+      uint32_t starts = m;
+      int32_t run = 0;
+      while (m) {
+         starts = m;
+         m &= m >> 1;
+         run++;
+      }
+      const int32_t xend = fc_ctz(starts) + run - 1;
+      const int32_t seq1_end = swapped ? xend + shift : xend;
+      if (run > max_len || (run == max_len && seq1_end < *end)) {
+         max_len = run;
+         *end = seq1_end;
       }
-      matrix[max_lens][i] = max_len;
    }
-
    return max_len;
 }
 
-int32_t fc_memo_lcsubseq(struct fc_memo *ctx,
-                            const char32_t *seq2, int32_t len2)
+FC_DISPATCH(int32_t, fc_simd_lcsubstr_short,
+            (const char32_t *x, int32_t lenx, const char32_t *ypad, int32_t leny, bool swapped, int32_t *end),
+            (x, lenx, ypad, leny, swapped, end))
+
+/* Copies "len" elements of "size" bytes to "dst", as characters. */
+static void fc_simd_widen(char32_t *dst, const void *src, int32_t len, int size)
 {
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->compute == fc_memo_lcsubseq);
+   if (size == sizeof *dst) {
+      memcpy(dst, src, len * sizeof *dst);
+      return;
+   }
+   for (int32_t i = 0; i < len; i++)
+      dst[i] = fc_elem(src, i, size);
+}
 
-   const char32_t *seq1 = ctx->seq1;
-   const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
-   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+int32_t fc_simd_lcsubstr_diagonal(const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2,
+                                  const void **pos, int size)
+{
+   assert(len1 > 0 && len2 > 0);
+   assert(len1 <= FC_SIMD_SHORT_LEN || len2 <= FC_SIMD_SHORT_LEN);
 
-   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
-      skip++;
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
-   ctx->len2 = len2;
+   /* Put the shortest sequence in the vector. */
+   const bool swapped = len1 > FC_SIMD_SHORT_LEN;
+   const void *x = swapped ? seq2 : seq1, *y = swapped ? seq1 : seq2;
+   const int32_t lenx = swapped ? len2 : len1, leny = swapped ? len1 : len2;
 
-   for (int32_t i = 1; i <= len1; i++) {
-      for (int32_t j = skip + 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
-            matrix[i][j] = matrix[i - 1][j - 1] + 1;
-         } else {
-            const int32_t fst = matrix[i][j - 1];
-            const int32_t snd = matrix[i - 1][j];
-            matrix[i][j] = FC_MAX(fst, snd);
-         }
-      }
-   }
-   return matrix[len1][len2];
+   /* Both sequences are compared as characters. "y" is padded on both sides,
+    * so that windows never go out of bounds.
+    */
+   char32_t xbuf[FC_SIMD_SHORT_LEN];
+   fc_simd_widen(xbuf, x, lenx, size);
+
+   char32_t buf[4 * FC_SIMD_SHORT_LEN], *ypad = buf;
+   const size_t pad_len = leny + 2 * FC_SIMD_SHORT_LEN;
+   if (pad_len > FC_ARRAY_SIZE(buf))
+      ypad = fc_malloc(pad_len * sizeof *ypad);
+   memset(ypad, 0, FC_SIMD_SHORT_LEN * sizeof *ypad);
+   fc_simd_widen(&ypad[FC_SIMD_SHORT_LEN], y, leny, size);
+   memset(&ypad[FC_SIMD_SHORT_LEN + leny], 0, FC_SIMD_SHORT_LEN * sizeof *ypad);
+
+   int32_t end = 0;
+   const int32_t max_len = fc_simd_lcsubstr_short(xbuf, lenx, ypad, leny, swapped, &end);
+
+   if (ypad != buf)
+      fc_free(ypad);
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
 }
 
-static int32_t fc_memo_distance(struct fc_memo *ctx,
-                                const char32_t *seq2, int32_t len2,
-                                bool transpos)
-{
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim);
 
-   const char32_t *seq1 = ctx->seq1;
-   const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
-   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
 
-   if (abs(len1 - len2) > ctx->max_dist)
-      return INT32_MAX;
+/*******************************************************************************
+ * Batch computation
+ ******************************************************************************/
 
-   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
-      skip++;
+/* Same size as fc_vec, with twice as many lanes. */
+typedef int8_t fc_vec8 __attribute__((vector_size(2 * LANES * sizeof(int8_t))));
 
-   if (skip) {
-      /* We could make this check after computing each row, and possibly break
-       * from the loop early if we detect that the distance can't be <= than
-       * the maximum allowed distance.
-       *
-       * Contrary to intuition, it turns out that this is generally slower than
-       * simply going on until the sequences are exhausted. This holds at least
-       * for short strings, which we expect to have to deal with here.
-       *
-       * Probably the slowdown is due to the additional bookkeeping needed to
-       * keep track of the maximum distance found so far, which involves one
-       * more check per matrix cell.
-       */
-      int32_t min = INT32_MAX;
-      for (int32_t i = 0; i <= len1; i++) {
-         const int32_t val = matrix[i][skip];
-         if (val < min)
-            min = val;
-      }
-      if (min > ctx->max_dist)
-         return INT32_MAX;
+/* Largest value that fits in the lanes of a fc_vec8. Used when both the query
+ * and the candidates are shorter than this.
+ */
+#define FC_BATCH8_MAX_LEN (INT8_MAX - 1)
+
+/* Candidates are compared to the query by groups, one candidate per lane, so
+ * that there is no dependency between lanes. The characters of the candidates
+ * of a group are interleaved in "chars", and "lens" holds their lengths (or -1
+ * for unused lanes). The matrix is filled column by column, a column
+ * corresponding to a position in the candidates, and its value for a given
+ * candidate is saved in "res" when the end of this candidate is reached.
+ * "cols" must hold 3 * (qlen + 1) vectors.
+ */
+#define _(T, V)                                                                \
+FC_ALWAYS_INLINE void fc_simd_levenshtein_batch_##T##_body(                    \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   const V zero = {0};                                                         \
+   V vlens, vres;                                                              \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++) {                                       \
+      const V v = zero + (T)i;                                                 \
+      VSTORE(&cols[i * n], v);                                                 \
+   }                                                                           \
+   VLOAD(vlens, lens);                                                         \
+   vres = (vlens == 0) & (zero + (T)qlen);                                     \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, diag, left = zero + (T)j;                                           \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+      VLOAD(diag, &cols[0]);                                                   \
+      VSTORE(&cols[0], left);                                                  \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up;                                                                 \
+         VLOAD(up, &cols[i * n]);                                              \
+         const V ic = VMIN(up, left) + 1;                                      \
+         const V rc = diag + 1 + (c == q[i - 1]);                              \
+         left = VMIN(ic, rc);                                                  \
+         VSTORE(&cols[i * n], left);                                           \
+         diag = up;                                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_ALWAYS_INLINE void fc_simd_damerau_batch_##T##_body(                        \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   T *prev2 = cols, *prev = &prev2[(qlen + 1) * n], *cur = &prev[(qlen + 1) * n]; \
+   const V zero = {0};                                                         \
+   V vlens, vres, cprev = zero;                                                \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++) {                                       \
+      const V v = zero + (T)i;                                                 \
+      VSTORE(&prev[i * n], v);                                                 \
+   }                                                                           \
+   VLOAD(vlens, lens);                                                         \
+   vres = (vlens == 0) & (zero + (T)qlen);                                     \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, left = zero + (T)j;                                                 \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+      VSTORE(&cur[0], left);                                                   \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up, diag;                                                           \
+         VLOAD(up, &prev[i * n]);                                              \
+         VLOAD(diag, &prev[(i - 1) * n]);                                      \
+         const V ic = VMIN(up, left) + 1;                                      \
+         const V rc = diag + 1 + (c == q[i - 1]);                              \
+         left = VMIN(ic, rc);                                                  \
+         if (i > 1 && j > 1) {                                                 \
+            V tc;                                                              \
+            VLOAD(tc, &prev2[(i - 2) * n]);                                    \
+            const V transposed = (c == q[i - 2]) & (cprev == q[i - 1]);        \
+            tc = VSEL(transposed, tc + 1, left);                               \
+            left = VMIN(left, tc);                                             \
+         }                                                                     \
+         VSTORE(&cur[i * n], left);                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+      cprev = c;                                                               \
+      FC_SWAP3(T *, prev2, prev, cur);                                         \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_ALWAYS_INLINE void fc_simd_lcsubseq_batch_##T##_body(                       \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   const V zero = {0};                                                         \
+   V vlens, vres = zero;                                                       \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++)                                         \
+      VSTORE(&cols[i * n], zero);                                              \
+   VLOAD(vlens, lens);                                                         \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, diag = zero, left = zero;                                           \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up;                                                                 \
+         VLOAD(up, &cols[i * n]);                                              \
+         const V mc = VMAX(up, left);                                          \
+         left = VSEL(c == q[i - 1], diag + 1, mc);                             \
+         VSTORE(&cols[i * n], left);                                           \
+         diag = up;                                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_DISPATCH(void, fc_simd_levenshtein_batch_##T,                               \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))                        \
+FC_DISPATCH(void, fc_simd_damerau_batch_##T,                                   \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))                        \
+FC_DISPATCH(void, fc_simd_lcsubseq_batch_##T,                                  \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))
+_(int8_t, fc_vec8)
+_(int16_t, fc_vec)
+#undef _
+
+/* Fills a group of candidates, and runs the kernel on it. Returns the number
+ * of candidates processed.
+ */
+#define _(T)                                                                   \
+static size_t fc_simd_batch_group_##T(enum fc_metric metric,                  \
+                                      const struct fc_peq *peq,               \
+                                      const int16_t *latin1,                  \
+                                      const T *q, int32_t qlen,               \
+                                      const char32_t *const *cands,           \
+                                      const int32_t *lens, size_t nr,         \
+                                      int32_t max_len, T *buf, int32_t *out)  \
+{                                                                              \
+   const int32_t n = sizeof(fc_vec) / sizeof(T);                               \
+   T glens[sizeof(fc_vec) / sizeof(T)], res[sizeof(fc_vec) / sizeof(T)];       \
+   T *chars = buf, *cols = &chars[max_len * n];                                \
+                                                                               \
+   if (nr > (size_t)n)                                                         \
+      nr = n;                                                                  \
+   for (int32_t k = 0; k < n; k++)                                             \
+      glens[k] = k < (int32_t)nr ? lens[k] : -1;                               \
+   memset(chars, 0, max_len * n * sizeof *chars);                              \
+   for (int32_t k = 0; k < (int32_t)nr; k++)                                   \
+      for (int32_t j = 0; j < lens[k]; j++) {                                  \
+         const char32_t c = cands[k][j];                                       \
+         chars[j * n + k] = c < 256 ? latin1[c] : fc_peq_slot(peq, c)->row;    \
+      }                                                                        \
+                                                                               \
+   switch (metric) {                                                           \
+   case FC_LEVENSHTEIN:                                                        \
+      fc_simd_levenshtein_batch_##T(q, qlen, chars, glens, max_len, cols, res); \
+      break;                                                                   \
+   case FC_DAMERAU:                                                            \
+      fc_simd_damerau_batch_##T(q, qlen, chars, glens, max_len, cols, res);    \
+      break;                                                                   \
+   default:                                                                    \
+      assert(metric == FC_LCSUBSEQ);                                           \
+      fc_simd_lcsubseq_batch_##T(q, qlen, chars, glens, max_len, cols, res);   \
+      break;                                                                   \
+   }                                                                           \
+   for (int32_t k = 0; k < (int32_t)nr; k++)                                   \
+      out[k] = res[k];                                                         \
+   return nr;                                                                  \
+}
+_(int8_t)
+_(int16_t)
+#undef _
+
+/* Above this query length, wide lanes are slower than bit-parallelism. */
+#define FC_BATCH16_MAX_QUERY_LEN 32
+
+static size_t fc_simd_batch_group_bitpar(enum fc_metric metric,
+                                         const struct fc_peq *peq,
+                                         const char32_t *const *cands,
+                                         const int32_t *lens, size_t nr,
+                                         int32_t *out)
+{
+   int32_t (*func)(const struct fc_peq *, const char32_t *, int32_t);
+
+   switch (metric) {
+   case FC_LEVENSHTEIN:
+      func = fc_bitpar_levenshtein;
+      break;
+   case FC_DAMERAU:
+      func = fc_bitpar_damerau;
+      break;
+   default:
+      assert(metric == FC_LCSUBSEQ);
+      func = fc_bitpar_lcsubseq;
+      break;
    }
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
-   ctx->len2 = len2;
+   if (nr > sizeof(fc_vec) / sizeof(int16_t))
+      nr = sizeof(fc_vec) / sizeof(int16_t);
+   for (size_t k = 0; k < nr; k++)
+      out[k] = func(peq, cands[k], lens[k]);
+   return nr;
+}
 
-   for (int32_t i = 1; i <= len1; i++) {
-      for (int32_t j = skip + 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
-            matrix[i][j] = matrix[i - 1][j - 1];
-         } else {
-            int32_t ic = matrix[i][j - 1] + 1;
-            int32_t dc = matrix[i - 1][j] + 1;
-            int32_t rc = matrix[i - 1][j - 1] + 1;
-            matrix[i][j] = FC_MIN3(ic, dc, rc);
-            if (transpos && TRANSPOSED(seq1, seq2, i, j)) {
-               ic = matrix[i][j];
-               int32_t tc = matrix[i - 2][j - 2] + 1;
-               matrix[i][j] = FC_MIN(ic, tc);
-            }
-         }
-      }
+void fc_simd_batch(enum fc_metric metric, const struct fc_peq *peq,
+                   const char32_t *query, int32_t qlen,
+                   const char32_t *const *cands, const int32_t *lens,
+                   size_t nr, int32_t *out)
+{
+   int32_t max_len = 0;
+   for (size_t k = 0; k < nr; k++)
+      if (max_len < lens[k])
+         max_len = lens[k];
+
+   const size_t size = (max_len + 3 * (qlen + 1)) * sizeof(fc_vec);
+   void *buf = fc_malloc(size + qlen * (sizeof(int16_t) + sizeof(int8_t)));
+   int16_t *q16 = (int16_t *)((char *)buf + size);
+   int8_t *q8 = (int8_t *)&q16[qlen];
+
+   /* Query characters are numbered from 1, and characters of the candidates
+    * that don't appear in the query are mapped to 0. Latin-1 characters are
+    * mapped with a table, which is much cheaper than a lookup in "peq".
+    */
+   int16_t latin1[256];
+   for (int32_t c = 0; c < 256; c++)
+      latin1[c] = fc_peq_slot(peq, c)->row;
+   for (int32_t i = 0; i < qlen; i++)
+      q8[i] = q16[i] = fc_peq_slot(peq, query[i])->row;
+
+   const int32_t n8 = sizeof(fc_vec) / sizeof(int8_t);
+   for (size_t k = 0; k < nr; ) {
+      int32_t group_len = 0;
+      for (size_t g = k; g < k + n8 && g < nr; g++)
+         if (group_len < lens[g])
+            group_len = lens[g];
+
+      if (qlen <= FC_BATCH8_MAX_LEN && group_len <= FC_BATCH8_MAX_LEN)
+         k += fc_simd_batch_group_int8_t(metric, peq, latin1, q8, qlen, &cands[k],
+                                         &lens[k], nr - k, group_len, buf, &out[k]);
+      else if (qlen <= FC_BATCH16_MAX_QUERY_LEN)
+         k += fc_simd_batch_group_int16_t(metric, peq, latin1, q16, qlen, &cands[k],
+                                          &lens[k], nr - k, group_len, buf, &out[k]);
+      else
+         k += fc_simd_batch_group_bitpar(metric, peq, &cands[k], &lens[k],
+                                         nr - k, &out[k]);
    }
-   return matrix[len1][len2];
+
+   fc_free(buf);
 }
 
-int32_t fc_memo_levenshtein(struct fc_memo *ctx,
-                                   const char32_t *seq2, int32_t len2)
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* Number of characters per vector. */
+#define FC_HAMMING_LANES ((int32_t)FC_ARRAY_SIZE((fc_cvec){0}))
+
+/* Sums the lanes of a vector of mismatches, which hold -1 or 0. */
+FC_ALWAYS_INLINE int32_t fc_simd_mismatches(const fc_cmask *ne)
 {
-   assert(ctx->compute == fc_memo_levenshtein);
-   return fc_memo_distance(ctx, seq2, len2, false);
+   int32_t dist = 0;
+
+   for (int32_t n = 0; n < FC_HAMMING_LANES; n++)
+      dist -= (*ne)[n];
+   return dist;
 }
 
-int32_t fc_memo_damerau(struct fc_memo *ctx,
-                               const char32_t *seq2, int32_t len2)
+/* Characters are compared one vector at a time, and mismatches are
+ * accumulated in the lanes of a vector. If the distance is bounded, the lanes
+ * are summed after each vector, so that we can stop early, since most keys
+ * compared in a search differ early. The tail is compared character by
+ * character.
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_hamming_body(const char32_t *seq1,
+                                              const char32_t *seq2,
+                                              int32_t len, int32_t k)
 {
-   assert(ctx->compute == fc_memo_damerau);
-   return fc_memo_distance(ctx, seq2, len2, true);
+   const int32_t n = FC_HAMMING_LANES;
+   const bool bounded = k < len;
+   fc_cmask acc = {0};
+   int32_t i = 0;
+
+   for (; i + n <= len; i += n) {
+      fc_cvec v1, v2;
+      VLOAD(v1, &seq1[i]);
+      VLOAD(v2, &seq2[i]);
+      acc += (fc_cmask)(v1 != v2);
+      if (bounded && fc_simd_mismatches(&acc) > k)
+         return fc_simd_mismatches(&acc);
+   }
+
+   int32_t dist = fc_simd_mismatches(&acc);
+   for (; i < len; i++)
+      dist += seq1[i] != seq2[i];
+   return dist;
 }
 
-void fc_memo_fini(struct fc_memo *ctx)
+FC_DISPATCH(int32_t, fc_simd_hamming,
+            (const char32_t *seq1, const char32_t *seq2, int32_t len, int32_t k),
+            (seq1, seq2, len, k))
+
+/* Keys that fit in a vector are compared to the query with a single load,
+ * which is masked to the length of the keys. It can read past the end of a
+ * key, but not past the end of the array, so the last keys are copied.
+ */
+FC_ALWAYS_INLINE void fc_simd_hamming_scan_body(const char32_t *query, int32_t len,
+                                                const char32_t *keys, size_t nr,
+                                                int32_t k, int32_t *out)
 {
-   fc_free(ctx->seq2);
+   const int32_t n = FC_HAMMING_LANES;
+   size_t i = 0;
+
+   if (len > n) {
+      for (; i < nr; i++)
+         out[i] = fc_simd_hamming_body(query, &keys[i * len], len, k);
+      return;
+   }
+
+   fc_cvec vq = {0};
+   fc_cmask valid;
+   memcpy(&vq, query, len * sizeof *query);
+   for (int32_t lane = 0; lane < n; lane++)
+      valid[lane] = lane < len ? -1 : 0;
+
+   for (; i < nr && (nr - i) * len >= (size_t)n; i++) {
+      fc_cvec vk;
+      VLOAD(vk, &keys[i * len]);
+      const fc_cmask ne = (fc_cmask)(vq != vk) & valid;
+      out[i] = fc_simd_mismatches(&ne);
+   }
+   for (; i < nr; i++) {
+      fc_cvec vk = {0};
+      memcpy(&vk, &keys[i * len], len * sizeof *keys);
+      const fc_cmask ne = (fc_cmask)(vq != vk);
+      out[i] = fc_simd_mismatches(&ne);
+   }
 }
+
+FC_DISPATCH(void, fc_simd_hamming_scan,
+            (const char32_t *query, int32_t len, const char32_t *keys, size_t nr, int32_t k, int32_t *out),
+            (query, len, keys, nr, k, out))
+
+#endif
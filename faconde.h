@@ -3,6 +3,7 @@
 
 #define FC_VERSION "0.1"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <uchar.h>
@@ -70,6 +71,20 @@ double fc_ndamerau(enum fc_norm_method method,
                    const char32_t *seq1, int32_t len1,
                    const char32_t *seq2, int32_t len2);
 
+/* Same as fc_nlevenshtein() and fc_ndamerau(), but give up as soon as the
+ * distance is known to be larger than "max". The exact distance is returned if
+ * it is lower than or equal to "max", and a value larger than "max"
+ * otherwise. This is much faster when most sequences are far apart, because
+ * pairs whose length difference is too large are rejected immediately, and
+ * only a band of the matrix around the diagonal is computed.
+ */
+double fc_nlevenshtein_bounded(enum fc_norm_method method, double max,
+                               const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2);
+double fc_ndamerau_bounded(enum fc_norm_method method, double max,
+                           const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2);
+
 /* Computes the distance between the provided sequences upto a maximum value
  * of 1. If the distance between the sequences is larger than that, a value
  * larger than 1 is returned.
@@ -87,6 +102,30 @@ int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
 extern int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t,
                                           const char32_t *, int32_t);
 
+/* Same as the above functions, but for an arbitrary maximum distance "k".
+ * Only a band of k + 1 diagonals (at most) of the matrix is computed, and
+ * computation stops as soon as no cell of the band holds a value <= k. If the
+ * distance between the sequences is larger than "k", a value larger than "k"
+ * is returned. For k <= 2, the relevant function in fc_lev_bounded is used.
+ */
+int32_t fc_lev_bounded_k(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2, int32_t k);
+
+/* Same as fc_lev_bounded1() and fc_lev_bounded2(), but for the Damerau
+ * distance, as computed by fc_damerau().
+ */
+int32_t fc_dam_bounded1(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+
+int32_t fc_dam_bounded2(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+
+/* Table of pointers to the above functions.
+ * The function at index 0 is the same as in fc_lev_bounded.
+ */
+extern int32_t (*const fc_dam_bounded[3])(const char32_t *, int32_t,
+                                          const char32_t *, int32_t);
+
 /* Computes the Jaro distance between two sequences.
  * Contrary to the canonical implementation, this returns 0 for identity, and
  * 1 to indicate absolute difference, instead of the reverse.
@@ -94,6 +133,56 @@ extern int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t,
 double fc_jaro(const char32_t *seq1, int32_t len1,
                const char32_t *seq2, int32_t len2);
 
+/* Computes the Jaro-Winkler distance between two sequences. This is the Jaro
+ * distance multiplied by (1 - l * prefix_scale), where "l" is the length of the
+ * common prefix of the sequences, up to "max_prefix" characters. The usual
+ * values are 0.1 and 4. The product of "prefix_scale" and "max_prefix" must
+ * not exceed 1. The bonus is applied whatever the Jaro distance is.
+ */
+double fc_jaro_winkler(const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2,
+                       double prefix_scale, int32_t max_prefix);
+
+/* Same as fc_jaro_winkler(), but returns a value larger than "max" if the
+ * distance is larger than "max". Pairs that can't be within the bound are
+ * rejected from their lengths or from their number of matching characters,
+ * without computing the distance.
+ */
+double fc_jaro_winkler_bounded(const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2,
+                               double prefix_scale, int32_t max_prefix,
+                               double max);
+
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* Computes the Hamming distance between two sequences of length "len", which
+ * is the number of positions at which their characters differ. Characters are
+ * compared several at a time with SIMD instructions. There is no limit on the
+ * length of the sequences.
+ */
+int32_t fc_hamming(const char32_t *seq1, const char32_t *seq2, int32_t len);
+
+/* Same as fc_hamming(), but returns a value larger than "k" as soon as the
+ * distance is known to be larger than "k".
+ */
+int32_t fc_hamming_bounded(const char32_t *seq1, const char32_t *seq2,
+                           int32_t len, int32_t k);
+
+/* Compares a query of length "len" to "nr" keys of the same length, stored one
+ * after the other in "keys", so that the key "i" starts at keys[i * len]. The
+ * indexes of the keys whose distance to the query is at most "k" are written
+ * in increasing order to "matches", and their distances to "dists", if it is
+ * not NULL. Both must have room for "nr" values. Returns the number of matching
+ * keys. Keys that fit in a vector are compared to the query with a single
+ * vector comparison.
+ */
+size_t fc_hamming_search(const char32_t *query, int32_t len,
+                         const char32_t *keys, size_t nr, int32_t k,
+                         size_t *matches, int32_t *dists);
+
 
 /*******************************************************************************
  * Longest Common Substring and Subsequence
@@ -112,6 +201,33 @@ int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
                             const char32_t *seq2, int32_t len2,
                             const char32_t **pos);
 
+/* Index of a reference sequence, for comparing it to many sequences with
+ * fc_lcsubstr_index_query(). This is a suffix automaton of the reference
+ * sequence, built in linear time, so that each query only takes time linear
+ * in the length of the compared sequence. Contrary to fc_memo, the space used
+ * is linear in the length of the reference sequence, and the compared
+ * sequences can have any length.
+ */
+struct fc_sam;
+
+struct fc_lcsubstr_index {
+   struct fc_sam *sam;     /* Suffix automaton of the reference sequence. */
+};
+
+/* Initializer. The reference sequence is not referenced afterwards. */
+void fc_lcsubstr_index_init(struct fc_lcsubstr_index *,
+                            const char32_t *ref, int32_t len);
+
+/* Destructor. */
+void fc_lcsubstr_index_fini(struct fc_lcsubstr_index *);
+
+/* Same as fc_lcsubstr_extract(seq, len, ref, ref_len, pos), where "ref" is
+ * the reference sequence of the index.
+ */
+int32_t fc_lcsubstr_index_query(const struct fc_lcsubstr_index *,
+                                const char32_t *seq, int32_t len,
+                                const char32_t **pos);
+
 /* Computes the length of the longest common subsequence between two
  * sequences.
  */
@@ -122,6 +238,218 @@ int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1,
 double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
                     const char32_t *seq2, int32_t len2);
 
+/* Same as fc_nlcsubseq(), but returns a value larger than "max" as soon as the
+ * result is known to be larger than "max".
+ */
+double fc_nlcsubseq_bounded(double max, const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Alignment
+ ******************************************************************************/
+
+/* Edit operations. They transform the first sequence into the second one.
+ * FC_EDIT_MATCH      Copy a character that is the same in both sequences.
+ * FC_EDIT_SUB        Replace a character of the first sequence with one of
+ *                    the second sequence.
+ * FC_EDIT_INS        Insert a character of the second sequence.
+ * FC_EDIT_DEL        Delete a character of the first sequence.
+ * FC_EDIT_TRANSPOSE  Swap two adjacent characters of the first sequence.
+ */
+enum fc_edit_op {
+   FC_EDIT_MATCH,
+   FC_EDIT_SUB,
+   FC_EDIT_INS,
+   FC_EDIT_DEL,
+   FC_EDIT_TRANSPOSE,
+};
+
+/* A run of identical operations. For FC_EDIT_TRANSPOSE, "len" is the number of
+ * transpositions, which span 2 * len characters in both sequences.
+ */
+struct fc_edit {
+   enum fc_edit_op op;
+   int32_t len;
+};
+
+/* Maximum number of runs in the script of two sequences. */
+#define FC_EDIT_SCRIPT_MAX(len1, len2) ((len1) + (len2))
+
+/* Computes the Levenshtein distance between two sequences, together with an
+ * edit script that achieves it. The script is written to "script", which must
+ * have room for FC_EDIT_SCRIPT_MAX(len1, len2) runs, and its number of runs
+ * to "nr". Consecutive runs always have distinct operations. This uses
+ * Hirschberg's algorithm, so the space needed is linear in the length of the
+ * sequences, while the running time is about twice that of a matrix
+ * computation.
+ */
+int32_t fc_levenshtein_align(const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             struct fc_edit *script, int32_t *nr);
+
+/* Same as fc_levenshtein_align(), but for the distance computed by
+ * fc_damerau(). The script can include transpositions.
+ */
+int32_t fc_damerau_align(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2,
+                         struct fc_edit *script, int32_t *nr);
+
+/* Computes the length of the longest common subsequence between two sequences,
+ * together with an alignment that achieves it. The script only includes
+ * matches, insertions, and deletions. The matched characters form a longest
+ * common subsequence.
+ */
+int32_t fc_lcsubseq_align(const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          struct fc_edit *script, int32_t *nr);
+
+
+/*******************************************************************************
+ * Long sequences
+ ******************************************************************************/
+
+/* Same as fc_levenshtein(), fc_damerau(), and fc_lcsubseq(), but for
+ * sequences of any length. The matrix is cut into tiles, which are computed in
+ * a wavefront by "threads" threads, or by as many threads as there are CPUs if
+ * "threads" is not positive. The space used is linear in the length of the
+ * sequences. If both sequences are not longer than FC_MAX_SEQ_LEN, this is the
+ * same as calling the corresponding function.
+ */
+int64_t fc_levenshtein_long(const char32_t *seq1, int64_t len1,
+                            const char32_t *seq2, int64_t len2, int threads);
+int64_t fc_damerau_long(const char32_t *seq1, int64_t len1,
+                        const char32_t *seq2, int64_t len2, int threads);
+int64_t fc_lcsubseq_long(const char32_t *seq1, int64_t len1,
+                         const char32_t *seq2, int64_t len2, int threads);
+
+
+/*******************************************************************************
+ * Packed sequences
+ ******************************************************************************/
+
+/* Sequences over a small alphabet, such as nucleotides, can be packed with
+ * "bits" bits per symbol, which must be 2 for up to 4 symbols, or 4 for up to
+ * 16 symbols. The symbol at position "i" is held in the word
+ * (i * bits) / 64, starting at the bit (i * bits) % 64. The pattern-match
+ * masks of the bit-parallel algorithms are computed on whole packed words, and
+ * symbols are mapped to masks without any lookup, so this is faster than
+ * comparing the unpacked sequences, and takes 16 or 8 times less memory.
+ */
+
+/* Number of words of a packed sequence of length "len". */
+#define FC_PACKED_WORDS(len, bits) (((int64_t)(len) * (bits) + 63) / 64)
+
+/* Packs a sequence into "packed", which must have room for
+ * FC_PACKED_WORDS(len, bits) words. Each character is replaced with its index
+ * in "alphabet", which is a NUL-terminated string of at most 1 << bits
+ * characters. Returns false if a character of "seq" is not in "alphabet".
+ */
+bool fc_pack(int bits, const char32_t *alphabet,
+             const char32_t *seq, int32_t len, uint64_t *packed);
+
+/* Same as fc_levenshtein() and fc_lcsubseq(), for two sequences packed with
+ * the same number of bits and the same alphabet. Their lengths must not
+ * exceed FC_MAX_SEQ_LEN.
+ */
+int32_t fc_levenshtein_packed(int bits, const uint64_t *seq1, int32_t len1,
+                              const uint64_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_packed(int bits, const uint64_t *seq1, int32_t len1,
+                           const uint64_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Run-length encoded sequences
+ ******************************************************************************/
+
+/* A run of "len" times the character "c". "len" must be positive. */
+struct fc_run {
+   char32_t c;
+   int32_t len;
+};
+
+/* Encodes a sequence as runs, which are written to "runs". It must have room
+ * for "len" runs. Returns the number of runs.
+ */
+int32_t fc_rle_encode(const char32_t *seq, int32_t len, struct fc_run *runs);
+
+/* Same as fc_levenshtein(), for two run-length encoded sequences. Adjacent
+ * runs can have the same character. The matrix is cut into blocks, one per
+ * pair of runs, and only the edges of the blocks are computed, so the running
+ * time is proportional to nr1 * len2 + nr2 * len1, where "len1" and "len2" are
+ * the lengths of the decoded sequences, and the space to the shortest one.
+ * When runs are too short for this to be faster than the bit-parallel
+ * algorithm, the sequences are decoded instead. They can be longer than
+ * FC_MAX_SEQ_LEN, but must fit in an int32_t.
+ */
+int32_t fc_levenshtein_rle(const struct fc_run *runs1, int32_t nr1,
+                           const struct fc_run *runs2, int32_t nr2);
+
+
+/*******************************************************************************
+ * Weighted distances
+ ******************************************************************************/
+
+/* Maximum cost of an edit operation. */
+#define FC_MAX_COST (1 << 16)
+
+/* Cost of substituting "c2" for "c1". */
+struct fc_sub_cost {
+   char32_t c1, c2;
+   int32_t cost;
+};
+
+struct fc_sub_table;
+
+/* Costs of edit operations, for weighted distances. Matches cost nothing.
+ * Costs must be between 0 and FC_MAX_COST.
+ */
+struct fc_costs {
+   int32_t ins;                  /* Insertion of a character of "seq2". */
+   int32_t del;                  /* Deletion of a character of "seq1". */
+   int32_t sub;                  /* Default substitution cost. */
+   int32_t transpose;            /* For the Damerau distance. */
+   struct fc_sub_table *table;   /* Specific substitution costs, or NULL. */
+};
+
+/* Initializer. "subs" holds "nr" substitutions whose cost differs from "sub",
+ * such as those of adjacent keys, or of characters confused by OCR. It is
+ * copied into a hash table, and can be NULL if "nr" is zero. Pairs are not
+ * symmetric: both (a, b) and (b, a) must be given if needed. If a pair appears
+ * several times, the last one wins.
+ */
+void fc_costs_init(struct fc_costs *, int32_t ins, int32_t del,
+                   int32_t sub, int32_t transpose,
+                   const struct fc_sub_cost *subs, size_t nr);
+
+/* Destructor. */
+void fc_costs_fini(struct fc_costs *);
+
+/* Same as fc_levenshtein() and fc_damerau(), with the given costs. When all
+ * operations cost the same, without specific substitution costs, the
+ * unit-cost functions are used, and their result scaled. Otherwise, the
+ * matrix is computed one cell at a time, with a kernel specialized for
+ * whether there is a substitution table, so it is much slower.
+ */
+int32_t fc_wlevenshtein(const struct fc_costs *,
+                        const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2);
+int32_t fc_wdamerau(const struct fc_costs *,
+                    const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2);
+
+/* Same as the above, but if the distance is larger than "max", computation
+ * stops as soon as this is known, and INT32_MAX is returned.
+ */
+int32_t fc_wlevenshtein_bounded(const struct fc_costs *,
+                                const char32_t *seq1, int32_t len1,
+                                const char32_t *seq2, int32_t len2,
+                                int32_t max);
+int32_t fc_wdamerau_bounded(const struct fc_costs *,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            int32_t max);
+
 
 /*******************************************************************************
  * Memoized string metrics.
@@ -140,11 +468,13 @@ struct fc_memo {
    int32_t (*compute)(struct fc_memo *, const char32_t *, int32_t);
    void *matrix;           /* Similarity matrix. */
    int32_t mdim;           /* Matrix dimension. */
-   const char32_t *seq1;   /* Reference sequence. */
+   const void *seq1;       /* Reference sequence. */
    int32_t len1;           /* Length of the reference sequence. */
    char32_t *seq2;         /* Previous sequence seen. */
    int32_t len2;           /* Length of this sequence. */
    int32_t max_dist;       /* Maximum allowed distance (for Levenshtein). */
+   int elem_size;          /* Size of the elements of the sequences. */
+   const struct fc_costs *costs; /* Costs of edit operations, or NULL. */
 };
 
 /* Initializer.
@@ -172,6 +502,13 @@ enum fc_metric fc_memo_metric(const struct fc_memo *);
  */
 void fc_memo_set_ref(struct fc_memo *, const char32_t *seq1, int32_t len1);
 
+/* Sets the costs of edit operations, for the Levenshtein and Damerau
+ * distances, which are then computed as by fc_wlevenshtein() and
+ * fc_wdamerau(), and "max_dist" is expressed in the same unit as costs. They
+ * are not copied internally. Passing NULL restores unit costs.
+ */
+void fc_memo_set_costs(struct fc_memo *, const struct fc_costs *);
+
 /* Compares the reference sequence to a new one. */
 static inline int32_t fc_memo_compute(struct fc_memo *m,
                                       const char32_t *seq2, int32_t len2)
@@ -187,4 +524,325 @@ int32_t fc_memo_damerau(struct fc_memo *, const char32_t *, int32_t);
 int32_t fc_memo_lcsubstr(struct fc_memo *, const char32_t *, int32_t);
 int32_t fc_memo_lcsubseq(struct fc_memo *, const char32_t *, int32_t);
 
+/* Same as fc_memo_set_ref() and fc_memo_compute(), for sequences of other
+ * element types (see below). The compared sequences must have the same type as
+ * the reference sequence.
+ */
+void fc_memo_set_ref_u8(struct fc_memo *, const uint8_t *seq1, int32_t len1);
+void fc_memo_set_ref_u16(struct fc_memo *, const uint16_t *seq1, int32_t len1);
+void fc_memo_set_ref_u32(struct fc_memo *, const uint32_t *seq1, int32_t len1);
+int32_t fc_memo_compute_u8(struct fc_memo *, const uint8_t *seq2, int32_t len2);
+int32_t fc_memo_compute_u16(struct fc_memo *, const uint16_t *seq2, int32_t len2);
+int32_t fc_memo_compute_u32(struct fc_memo *, const uint32_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Batch computation.
+ ******************************************************************************/
+
+/* Compares a query sequence to "nr" candidate sequences.
+ * The candidates are given in "cands", and their lengths in "lens". The result
+ * of the comparison of the query with cands[i] is stored in out[i]. This is
+ * the same as calling the corresponding function for each candidate in turn,
+ * but much faster on short sequences, because several candidates are compared
+ * to the query simultaneously with SIMD instructions.
+ */
+void fc_levenshtein_batch(const char32_t *query, int32_t qlen,
+                          const char32_t *const *cands, const int32_t *lens,
+                          size_t nr, int32_t *out);
+void fc_damerau_batch(const char32_t *query, int32_t qlen,
+                      const char32_t *const *cands, const int32_t *lens,
+                      size_t nr, int32_t *out);
+void fc_lcsubseq_batch(const char32_t *query, int32_t qlen,
+                       const char32_t *const *cands, const int32_t *lens,
+                       size_t nr, int32_t *out);
+
+
+/*******************************************************************************
+ * Multiple metrics
+ ******************************************************************************/
+
+/* Metrics that can be requested from fc_multi_metric(). */
+enum {
+   FC_MULTI_LEVENSHTEIN = 1 << FC_LEVENSHTEIN,
+   FC_MULTI_DAMERAU = 1 << FC_DAMERAU,
+   FC_MULTI_LCSUBSTR = 1 << FC_LCSUBSTR,
+   FC_MULTI_LCSUBSEQ = 1 << FC_LCSUBSEQ,
+   FC_MULTI_JARO = 1 << FC_METRIC_NR,
+
+   FC_MULTI_ALL = (1 << (FC_METRIC_NR + 1)) - 1,
+};
+
+/* Results of fc_multi_metric(). Each field holds the value returned by the
+ * function of the same name.
+ */
+struct fc_multi {
+   int32_t levenshtein;
+   int32_t damerau;
+   int32_t lcsubstr;
+   int32_t lcsubseq;
+   double jaro;
+};
+
+/* Computes the metrics whose flags are set in "mask" between two sequences,
+ * and stores them in "out". The other fields of "out" are left untouched.
+ * This is faster than calling each function in turn, because the
+ * pattern-match masks of "seq1" are built once, and all the metrics but Jaro
+ * are computed in a single pass over "seq2", with a single lookup of the masks
+ * of each character.
+ */
+void fc_multi_metric(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     unsigned mask, struct fc_multi *out);
+
+/* Same as fc_multi_metric(), for a query and "nr" candidates, in the same way
+ * as fc_levenshtein_batch(). The masks of the query are built once.
+ */
+void fc_multi_metric_batch(const char32_t *query, int32_t qlen,
+                           const char32_t *const *cands, const int32_t *lens,
+                           size_t nr, unsigned mask, struct fc_multi *out);
+
+
+/*******************************************************************************
+ * Compiled queries
+ ******************************************************************************/
+
+/* A query sequence, prepared for being compared to many sequences. Its
+ * pattern-match masks, and, for long sequences, the lists of the positions of
+ * its characters, are built once, instead of at each comparison. Contrary to
+ * fc_memo, there is no limit on the length of the compared sequences but
+ * FC_MAX_SEQ_LEN, and no previous sequence to share a prefix with.
+ */
+struct fc_profile;
+
+struct fc_query {
+   struct fc_profile *profile;   /* Masks and copy of the query. */
+};
+
+/* Initializer. The query sequence is copied. */
+void fc_query_init(struct fc_query *, const char32_t *seq, int32_t len);
+
+/* Destructor. */
+void fc_query_fini(struct fc_query *);
+
+/* Same as fc_levenshtein(seq1, len1, seq2, len2), etc., where "seq1" is the
+ * query sequence. When "seq2" is much shorter than the query, its own masks
+ * are built instead, as the standard functions do.
+ */
+int32_t fc_query_levenshtein(const struct fc_query *,
+                             const char32_t *seq2, int32_t len2);
+int32_t fc_query_damerau(const struct fc_query *,
+                         const char32_t *seq2, int32_t len2);
+int32_t fc_query_lcsubseq(const struct fc_query *,
+                          const char32_t *seq2, int32_t len2);
+double fc_query_jaro(const struct fc_query *,
+                     const char32_t *seq2, int32_t len2);
+
+
+/*******************************************************************************
+ * Other element types
+ ******************************************************************************/
+
+/* Same as fc_levenshtein(), fc_damerau(), fc_lcsubseq(), and fc_jaro(), for
+ * sequences of bytes (such as Latin-1 text) or of 16 or 32 bits integers (such
+ * as token identifiers), which are compared without being converted to
+ * char32_t first. The kernels are compiled for each element type.
+ */
+int32_t fc_levenshtein_u8(const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2);
+int32_t fc_levenshtein_u16(const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2);
+int32_t fc_levenshtein_u32(const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2);
+
+int32_t fc_damerau_u8(const uint8_t *seq1, int32_t len1,
+                      const uint8_t *seq2, int32_t len2);
+int32_t fc_damerau_u16(const uint16_t *seq1, int32_t len1,
+                       const uint16_t *seq2, int32_t len2);
+int32_t fc_damerau_u32(const uint32_t *seq1, int32_t len1,
+                       const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lcsubseq_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+int32_t fc_lcsubseq_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+double fc_jaro_u8(const uint8_t *seq1, int32_t len1,
+                  const uint8_t *seq2, int32_t len2);
+double fc_jaro_u16(const uint16_t *seq1, int32_t len1,
+                   const uint16_t *seq2, int32_t len2);
+double fc_jaro_u32(const uint32_t *seq1, int32_t len1,
+                   const uint32_t *seq2, int32_t len2);
+
+/* Same as the functions of the same name without a suffix, for the same
+ * element types. The vectorized Hamming kernels compare 4 bytes characters, so
+ * the Hamming distances of narrower elements are computed one element at a
+ * time.
+ */
+double fc_nlevenshtein_u8(enum fc_norm_method method,
+                          const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2);
+double fc_nlevenshtein_u16(enum fc_norm_method method,
+                           const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2);
+double fc_nlevenshtein_u32(enum fc_norm_method method,
+                           const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2);
+
+double fc_ndamerau_u8(enum fc_norm_method method,
+                      const uint8_t *seq1, int32_t len1,
+                      const uint8_t *seq2, int32_t len2);
+double fc_ndamerau_u16(enum fc_norm_method method,
+                       const uint16_t *seq1, int32_t len1,
+                       const uint16_t *seq2, int32_t len2);
+double fc_ndamerau_u32(enum fc_norm_method method,
+                       const uint32_t *seq1, int32_t len1,
+                       const uint32_t *seq2, int32_t len2);
+
+double fc_nlevenshtein_bounded_u8(enum fc_norm_method method, double max,
+                                  const uint8_t *seq1, int32_t len1,
+                                  const uint8_t *seq2, int32_t len2);
+double fc_nlevenshtein_bounded_u16(enum fc_norm_method method, double max,
+                                   const uint16_t *seq1, int32_t len1,
+                                   const uint16_t *seq2, int32_t len2);
+double fc_nlevenshtein_bounded_u32(enum fc_norm_method method, double max,
+                                   const uint32_t *seq1, int32_t len1,
+                                   const uint32_t *seq2, int32_t len2);
+
+double fc_ndamerau_bounded_u8(enum fc_norm_method method, double max,
+                              const uint8_t *seq1, int32_t len1,
+                              const uint8_t *seq2, int32_t len2);
+double fc_ndamerau_bounded_u16(enum fc_norm_method method, double max,
+                               const uint16_t *seq1, int32_t len1,
+                               const uint16_t *seq2, int32_t len2);
+double fc_ndamerau_bounded_u32(enum fc_norm_method method, double max,
+                               const uint32_t *seq1, int32_t len1,
+                               const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lev_bounded1_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_lev_bounded1_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_lev_bounded1_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lev_bounded2_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_lev_bounded2_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_lev_bounded2_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+extern int32_t (*const fc_lev_bounded_u8[3])(const uint8_t *, int32_t,
+                                             const uint8_t *, int32_t);
+extern int32_t (*const fc_lev_bounded_u16[3])(const uint16_t *, int32_t,
+                                              const uint16_t *, int32_t);
+extern int32_t (*const fc_lev_bounded_u32[3])(const uint32_t *, int32_t,
+                                              const uint32_t *, int32_t);
+
+int32_t fc_lev_bounded_k_u8(const uint8_t *seq1, int32_t len1,
+                            const uint8_t *seq2, int32_t len2, int32_t k);
+int32_t fc_lev_bounded_k_u16(const uint16_t *seq1, int32_t len1,
+                             const uint16_t *seq2, int32_t len2, int32_t k);
+int32_t fc_lev_bounded_k_u32(const uint32_t *seq1, int32_t len1,
+                             const uint32_t *seq2, int32_t len2, int32_t k);
+
+int32_t fc_dam_bounded1_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_dam_bounded1_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_dam_bounded1_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+int32_t fc_dam_bounded2_u8(const uint8_t *seq1, int32_t len1,
+                           const uint8_t *seq2, int32_t len2);
+int32_t fc_dam_bounded2_u16(const uint16_t *seq1, int32_t len1,
+                            const uint16_t *seq2, int32_t len2);
+int32_t fc_dam_bounded2_u32(const uint32_t *seq1, int32_t len1,
+                            const uint32_t *seq2, int32_t len2);
+
+extern int32_t (*const fc_dam_bounded_u8[3])(const uint8_t *, int32_t,
+                                             const uint8_t *, int32_t);
+extern int32_t (*const fc_dam_bounded_u16[3])(const uint16_t *, int32_t,
+                                              const uint16_t *, int32_t);
+extern int32_t (*const fc_dam_bounded_u32[3])(const uint32_t *, int32_t,
+                                              const uint32_t *, int32_t);
+
+double fc_jaro_winkler_u8(const uint8_t *seq1, int32_t len1,
+                          const uint8_t *seq2, int32_t len2,
+                          double prefix_scale, int32_t max_prefix);
+double fc_jaro_winkler_u16(const uint16_t *seq1, int32_t len1,
+                           const uint16_t *seq2, int32_t len2,
+                           double prefix_scale, int32_t max_prefix);
+double fc_jaro_winkler_u32(const uint32_t *seq1, int32_t len1,
+                           const uint32_t *seq2, int32_t len2,
+                           double prefix_scale, int32_t max_prefix);
+
+double fc_jaro_winkler_bounded_u8(const uint8_t *seq1, int32_t len1,
+                                  const uint8_t *seq2, int32_t len2,
+                                  double prefix_scale, int32_t max_prefix,
+                                  double max);
+double fc_jaro_winkler_bounded_u16(const uint16_t *seq1, int32_t len1,
+                                   const uint16_t *seq2, int32_t len2,
+                                   double prefix_scale, int32_t max_prefix,
+                                   double max);
+double fc_jaro_winkler_bounded_u32(const uint32_t *seq1, int32_t len1,
+                                   const uint32_t *seq2, int32_t len2,
+                                   double prefix_scale, int32_t max_prefix,
+                                   double max);
+
+int32_t fc_hamming_u8(const uint8_t *seq1, const uint8_t *seq2, int32_t len);
+int32_t fc_hamming_u16(const uint16_t *seq1, const uint16_t *seq2, int32_t len);
+int32_t fc_hamming_u32(const uint32_t *seq1, const uint32_t *seq2, int32_t len);
+
+int32_t fc_hamming_bounded_u8(const uint8_t *seq1, const uint8_t *seq2,
+                              int32_t len, int32_t k);
+int32_t fc_hamming_bounded_u16(const uint16_t *seq1, const uint16_t *seq2,
+                               int32_t len, int32_t k);
+int32_t fc_hamming_bounded_u32(const uint32_t *seq1, const uint32_t *seq2,
+                               int32_t len, int32_t k);
+
+size_t fc_hamming_search_u8(const uint8_t *query, int32_t len,
+                            const uint8_t *keys, size_t nr, int32_t k,
+                            size_t *matches, int32_t *dists);
+size_t fc_hamming_search_u16(const uint16_t *query, int32_t len,
+                             const uint16_t *keys, size_t nr, int32_t k,
+                             size_t *matches, int32_t *dists);
+size_t fc_hamming_search_u32(const uint32_t *query, int32_t len,
+                             const uint32_t *keys, size_t nr, int32_t k,
+                             size_t *matches, int32_t *dists);
+
+int32_t fc_lcsubstr_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+int32_t fc_lcsubstr_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+int32_t fc_lcsubstr_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+int32_t fc_lcsubstr_extract_u8(const uint8_t *seq1, int32_t len1,
+                               const uint8_t *seq2, int32_t len2,
+                               const uint8_t **pos);
+int32_t fc_lcsubstr_extract_u16(const uint16_t *seq1, int32_t len1,
+                                const uint16_t *seq2, int32_t len2,
+                                const uint16_t **pos);
+int32_t fc_lcsubstr_extract_u32(const uint32_t *seq1, int32_t len1,
+                                const uint32_t *seq2, int32_t len2,
+                                const uint32_t **pos);
+
+double fc_nlcsubseq_u8(const uint8_t *seq1, int32_t len1,
+                       const uint8_t *seq2, int32_t len2);
+double fc_nlcsubseq_u16(const uint16_t *seq1, int32_t len1,
+                        const uint16_t *seq2, int32_t len2);
+double fc_nlcsubseq_u32(const uint32_t *seq1, int32_t len1,
+                        const uint32_t *seq2, int32_t len2);
+
+double fc_nlcsubseq_bounded_u8(double max, const uint8_t *seq1, int32_t len1,
+                               const uint8_t *seq2, int32_t len2);
+double fc_nlcsubseq_bounded_u16(double max, const uint16_t *seq1, int32_t len1,
+                                const uint16_t *seq2, int32_t len2);
+double fc_nlcsubseq_bounded_u32(double max, const uint32_t *seq1, int32_t len1,
+                                const uint32_t *seq2, int32_t len2);
+
 #endif
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include "../src/api.h"
@@ -26,6 +27,8 @@ static void luaL_setfuncs (lua_State *L, const luaL_Reg *l, int nup) {
 
 #define luaL_newlib(L,l)   (luaL_newlibtable(L,l), luaL_setfuncs(L,l,0))
 
+#define lua_rawlen lua_objlen
+
 #endif
 /* End compatibility code. */
 
@@ -70,6 +73,33 @@ static int fc_lua_glob(lua_State *lua)
    return 1;
 }
 
+static int fc_lua_fold(lua_State *lua)
+{
+   static const char *const fold_methods[] = {"case", "accents", "all", NULL};
+   static const int folds[] = {
+      FC_FOLD_CASE, FC_FOLD_ACCENTS, FC_FOLD_CASE | FC_FOLD_ACCENTS,
+   };
+
+   size_t len;
+   const void *str = luaL_checklstring(lua, 1, &len);
+   const int fold = folds[luaL_checkoption(lua, 2, "all", fold_methods)];
+
+   /* Room for the decoded string, followed by the encoded one, which takes at
+    * most 4 bytes per character.
+    */
+   char32_t buf[SEQ_BUF_SIZE], *bufp = buf;
+   if (2 * len + 2 > SEQ_BUF_SIZE)
+      bufp = fc_malloc((2 * len + 2) * sizeof *bufp);
+
+   const size_t ulen = fc_utf8_decode_fold(bufp, str, len, fold);
+   len = fc_utf8_encode((void *)&bufp[ulen + 1], bufp, ulen);
+   lua_pushlstring(lua, (void *)&bufp[ulen + 1], len);
+
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
 static int fc_lua_lcsubstr_extract(lua_State *lua)
 {
    int32_t len1, len2;
@@ -123,8 +153,29 @@ _(lcsubseq)
 static int fc_lua_lev_bounded(lua_State *lua)
 {
    lua_Integer max = luaL_optinteger(lua, 3, MAX_LEV_DIST);
-   luaL_argcheck(lua, 3, max >= 0 && max <= MAX_LEV_DIST, "out of bound");
-   return fc_dist_common_int(lua, fc_lev_bounded[max]);
+   luaL_argcheck(lua, max >= 0, 3, "out of bound");
+   if (max <= MAX_LEV_DIST)
+      return fc_dist_common_int(lua, fc_lev_bounded[max]);
+   if (max > FC_MAX_SEQ_LEN)
+      max = FC_MAX_SEQ_LEN;
+
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   lua_pushinteger(lua, fc_lev_bounded_k(bufp, len1, &bufp[len1 + 1], len2, max));
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+#define MAX_DAM_DIST (lua_Integer)(FC_ARRAY_SIZE(fc_dam_bounded) - 1)
+
+static int fc_lua_dam_bounded(lua_State *lua)
+{
+   lua_Integer max = luaL_optinteger(lua, 3, MAX_DAM_DIST);
+   luaL_argcheck(lua, max >= 0 && max <= MAX_DAM_DIST, 3, "out of bound");
+   return fc_dist_common_int(lua, fc_dam_bounded[max]);
 }
 
 #define _(name)                                                                \
@@ -169,10 +220,612 @@ _(nlevenshtein)
 _(ndamerau)
 #undef _
 
+/* name(str1, str2, max[, method]) */
+static int fc_bounded_common(lua_State *lua, enum fc_norm_method method,
+                             double (*func)(enum fc_norm_method, double,
+                                            const char32_t *, int32_t,
+                                            const char32_t *, int32_t))
+{
+   const double max = luaL_checknumber(lua, 3);
+
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   lua_pushnumber(lua, func(method, max, bufp, len1, &bufp[len1 + 1], len2));
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name##_bounded(lua_State *lua)                             \
+{                                                                              \
+   return fc_bounded_common(lua, norm_method(lua, 4), fc_##name##_bounded);    \
+}
+_(nlevenshtein)
+_(ndamerau)
+#undef _
+
+static double fc_lua_nlcsubseq_bounded0(enum fc_norm_method method, double max,
+                                        const char32_t *seq1, int32_t len1,
+                                        const char32_t *seq2, int32_t len2)
+{
+   (void)method;
+   return fc_nlcsubseq_bounded(max, seq1, len1, seq2, len2);
+}
+
+static int fc_lua_nlcsubseq_bounded(lua_State *lua)
+{
+   return fc_bounded_common(lua, FC_NORM_LSEQ, fc_lua_nlcsubseq_bounded0);
+}
+
+/* jaro_winkler(str1, str2[, prefix_scale[, max_prefix]])
+ * jaro_winkler_bounded(str1, str2, max[, prefix_scale[, max_prefix]])
+ */
+static int fc_jaro_winkler_common(lua_State *lua, bool bounded)
+{
+   const int arg = bounded ? 4 : 3;
+   const double max = bounded ? luaL_checknumber(lua, 3) : 0;
+   const double prefix_scale = luaL_optnumber(lua, arg, 0.1);
+   const lua_Integer max_prefix = luaL_optinteger(lua, arg + 1, 4);
+   luaL_argcheck(lua, prefix_scale >= 0, arg, "out of bound");
+   luaL_argcheck(lua, max_prefix >= 0 && prefix_scale * max_prefix <= 1,
+                 arg + 1, "out of bound");
+
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+   const char32_t *seq2 = &bufp[len1 + 1];
+
+   if (bounded)
+      lua_pushnumber(lua, fc_jaro_winkler_bounded(bufp, len1, seq2, len2,
+                                                  prefix_scale, max_prefix, max));
+   else
+      lua_pushnumber(lua, fc_jaro_winkler(bufp, len1, seq2, len2,
+                                          prefix_scale, max_prefix));
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+static int fc_lua_jaro_winkler(lua_State *lua)
+{
+   return fc_jaro_winkler_common(lua, false);
+}
+
+static int fc_lua_jaro_winkler_bounded(lua_State *lua)
+{
+   return fc_jaro_winkler_common(lua, true);
+}
+
+/* Arguments of the batch functions name(query, candidates, ...). */
+struct batch {
+   const char32_t *query;
+   int32_t qlen;
+   const char32_t **cands;
+   int32_t *lens;
+   size_t nr;
+   void *out;              /* Room for "nr" results. */
+};
+
+static void fetch_batch(lua_State *lua, struct batch *b, size_t out_size)
+{
+   size_t qlen;
+   const void *query = luaL_checklstring(lua, 1, &qlen);
+   luaL_argcheck(lua, qlen <= FC_MAX_SEQ_LEN, 1, "sequence too long");
+   luaL_checktype(lua, 2, LUA_TTABLE);
+   const size_t nr = lua_rawlen(lua, 2);
+
+   /* Check the candidates before allocating anything, since we can't recover
+    * memory after an error is raised.
+    */
+   size_t total = qlen;
+   for (size_t i = 0; i < nr; i++) {
+      size_t len;
+      lua_rawgeti(lua, 2, i + 1);
+      if (lua_type(lua, -1) != LUA_TSTRING)
+         luaL_argerror(lua, 2, "candidates must be strings");
+      lua_tolstring(lua, -1, &len);
+      luaL_argcheck(lua, len <= FC_MAX_SEQ_LEN, 2, "sequence too long");
+      total += len;
+      lua_pop(lua, 1);
+   }
+
+   /* The decoder writes a terminator after the last candidate. */
+   b->cands = fc_malloc(nr * (sizeof *b->cands + out_size + sizeof *b->lens)
+                        + (total + 1) * sizeof(char32_t));
+   b->out = &b->cands[nr];
+   b->lens = (int32_t *)((char *)b->out + nr * out_size);
+   char32_t *bufp = (char32_t *)&b->lens[nr];
+   b->nr = nr;
+
+   b->query = bufp;
+   b->qlen = fc_utf8_decode(bufp, query, qlen);
+   char32_t *seq = &bufp[b->qlen];
+   for (size_t i = 0; i < nr; i++) {
+      size_t slen;
+      lua_rawgeti(lua, 2, i + 1);
+      const void *str = lua_tolstring(lua, -1, &slen);
+      b->cands[i] = seq;
+      b->lens[i] = fc_utf8_decode(seq, str, slen);
+      seq += b->lens[i];
+      lua_pop(lua, 1);
+   }
+}
+
+/* name(query, candidates) */
+static int fc_batch_common(lua_State *lua,
+            void (*func)(const char32_t *, int32_t, const char32_t *const *,
+                         const int32_t *, size_t, int32_t *))
+{
+   struct batch b;
+   fetch_batch(lua, &b, sizeof(int32_t));
+   int32_t *out = b.out;
+
+   func(b.query, b.qlen, b.cands, b.lens, b.nr, out);
+
+   lua_createtable(lua, b.nr, 0);
+   for (size_t i = 0; i < b.nr; i++) {
+      lua_pushinteger(lua, out[i]);
+      lua_rawseti(lua, -2, i + 1);
+   }
+   fc_free(b.cands);
+   return 1;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name##_batch(lua_State *lua)                               \
+{                                                                              \
+   return fc_batch_common(lua, fc_##name##_batch);                             \
+}
+_(levenshtein)
+_(damerau)
+_(lcsubseq)
+#undef _
+
+/* name(str1, str2) -> value, {{op, len}, ...} */
+static int fc_align_common(lua_State *lua,
+            int32_t (*func)(const char32_t *, int32_t, const char32_t *, int32_t,
+                            struct fc_edit *, int32_t *))
+{
+   static const char *const ops[] = {
+      [FC_EDIT_MATCH] = "match",
+      [FC_EDIT_SUB] = "sub",
+      [FC_EDIT_INS] = "ins",
+      [FC_EDIT_DEL] = "del",
+      [FC_EDIT_TRANSPOSE] = "transpose",
+   };
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   struct fc_edit *script = fc_malloc(FC_EDIT_SCRIPT_MAX(len1, len2) * sizeof *script);
+   int32_t nr;
+   lua_pushinteger(lua, func(bufp, len1, &bufp[len1 + 1], len2, script, &nr));
+
+   lua_createtable(lua, nr, 0);
+   for (int32_t i = 0; i < nr; i++) {
+      lua_createtable(lua, 2, 0);
+      lua_pushstring(lua, ops[script[i].op]);
+      lua_rawseti(lua, -2, 1);
+      lua_pushinteger(lua, script[i].len);
+      lua_rawseti(lua, -2, 2);
+      lua_rawseti(lua, -2, i + 1);
+   }
+   fc_free(script);
+   if (bufp != buf)
+      fc_free(bufp);
+   return 2;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name##_align(lua_State *lua)                               \
+{                                                                              \
+   return fc_align_common(lua, fc_##name##_align);                             \
+}
+_(levenshtein)
+_(damerau)
+_(lcsubseq)
+#undef _
+
+static unsigned multi_mask(lua_State *lua, int index)
+{
+   static const char *const metrics[] = {
+      [FC_LEVENSHTEIN] = "levenshtein",
+      [FC_DAMERAU] = "damerau",
+      [FC_LCSUBSTR] = "lcsubstr",
+      [FC_LCSUBSEQ] = "lcsubseq",
+      [FC_METRIC_NR] = "jaro",
+   };
+   if (lua_isnoneornil(lua, index))
+      return FC_MULTI_ALL;
+   luaL_checktype(lua, index, LUA_TTABLE);
+
+   unsigned mask = 0;
+   for (size_t i = 1; i <= lua_rawlen(lua, index); i++) {
+      lua_rawgeti(lua, index, i);
+      const char *name = lua_tostring(lua, -1);
+      size_t m = 0;
+      while (m < FC_ARRAY_SIZE(metrics) && !(name && !strcmp(name, metrics[m])))
+         m++;
+      luaL_argcheck(lua, m < FC_ARRAY_SIZE(metrics), index, "invalid metric");
+      mask |= 1u << m;
+      lua_pop(lua, 1);
+   }
+   return mask;
+}
+
+static void push_multi(lua_State *lua, unsigned mask, const struct fc_multi *ret)
+{
+   lua_createtable(lua, 0, 5);
+#define _(name, flag, LT)                                                      \
+   if (mask & FC_MULTI_##flag) {                                               \
+      lua_push##LT(lua, ret->name);                                            \
+      lua_setfield(lua, -2, #name);                                            \
+   }
+   _(levenshtein, LEVENSHTEIN, integer)
+   _(damerau, DAMERAU, integer)
+   _(lcsubstr, LCSUBSTR, integer)
+   _(lcsubseq, LCSUBSEQ, integer)
+   _(jaro, JARO, number)
+#undef _
+}
+
+/* multi_metric(str1, str2[, metrics]) */
+static int fc_lua_multi_metric(lua_State *lua)
+{
+   const unsigned mask = multi_mask(lua, 3);
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   struct fc_multi ret;
+   fc_multi_metric(bufp, len1, &bufp[len1 + 1], len2, mask, &ret);
+   push_multi(lua, mask, &ret);
+
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+/* multi_metric_batch(query, candidates[, metrics]) */
+static int fc_lua_multi_metric_batch(lua_State *lua)
+{
+   const unsigned mask = multi_mask(lua, 3);
+   struct batch b;
+   fetch_batch(lua, &b, sizeof(struct fc_multi));
+   struct fc_multi *out = b.out;
+
+   fc_multi_metric_batch(b.query, b.qlen, b.cands, b.lens, b.nr, mask, out);
+
+   lua_createtable(lua, b.nr, 0);
+   for (size_t i = 0; i < b.nr; i++) {
+      push_multi(lua, mask, &out[i]);
+      lua_rawseti(lua, -2, i + 1);
+   }
+   fc_free(b.cands);
+   return 1;
+}
+
+/* hamming(str1, str2), hamming_bounded(str1, str2, k) */
+static int fc_hamming_common(lua_State *lua, bool bounded)
+{
+   lua_Integer k = 0;
+   if (bounded) {
+      k = luaL_checkinteger(lua, 3);
+      luaL_argcheck(lua, k >= 0, 3, "out of bound");
+      if (k > FC_MAX_SEQ_LEN)
+         k = FC_MAX_SEQ_LEN;
+   }
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   if (len1 == len2) {
+      const char32_t *seq2 = &bufp[len1 + 1];
+      lua_pushinteger(lua, bounded ? fc_hamming_bounded(bufp, seq2, len1, k)
+                                   : fc_hamming(bufp, seq2, len1));
+   }
+   if (bufp != buf)
+      fc_free(bufp);
+   luaL_argcheck(lua, len1 == len2, 2, "sequences must have the same length");
+   return 1;
+}
+
+static int fc_lua_hamming(lua_State *lua)
+{
+   return fc_hamming_common(lua, false);
+}
+
+static int fc_lua_hamming_bounded(lua_State *lua)
+{
+   return fc_hamming_common(lua, true);
+}
+
+/* hamming_search(query, keys, k) -> {index, ...}, {dist, ...} */
+static int fc_lua_hamming_search(lua_State *lua)
+{
+   const lua_Integer k = luaL_checkinteger(lua, 3);
+   luaL_argcheck(lua, k >= 0, 3, "out of bound");
+   struct batch b;
+   fetch_batch(lua, &b, sizeof(size_t) + sizeof(int32_t));
+   size_t *matches = b.out;
+   int32_t *dists = (int32_t *)&matches[b.nr];
+
+   bool valid = true;
+   for (size_t i = 0; i < b.nr; i++)
+      valid &= b.lens[i] == b.qlen;
+   if (!valid) {
+      fc_free(b.cands);
+      luaL_argerror(lua, 2, "keys must have the same length as the query");
+   }
+
+   /* The keys are decoded one after the other, just after the query. */
+   const size_t found = fc_hamming_search(b.query, b.qlen, &b.query[b.qlen],
+                                          b.nr, FC_MIN(k, FC_MAX_SEQ_LEN),
+                                          matches, dists);
+   lua_createtable(lua, found, 0);
+   lua_createtable(lua, found, 0);
+   for (size_t i = 0; i < found; i++) {
+      lua_pushinteger(lua, matches[i] + 1);
+      lua_rawseti(lua, -3, i + 1);
+      lua_pushinteger(lua, dists[i]);
+      lua_rawseti(lua, -2, i + 1);
+   }
+   fc_free(b.cands);
+   return 2;
+}
+
+/* name(str1, str2, alphabet) */
+static int fc_packed_common(lua_State *lua,
+            int32_t (*func)(int, const uint64_t *, int32_t, const uint64_t *,
+                            int32_t))
+{
+   size_t alen;
+   const void *astr = luaL_checklstring(lua, 3, &alen);
+   char32_t alphabet[16 * 4 + 1];
+   luaL_argcheck(lua, alen < FC_ARRAY_SIZE(alphabet), 3, "alphabet too large");
+   const int32_t symbols = fc_utf8_decode(alphabet, astr, alen);
+   luaL_argcheck(lua, symbols <= 16, 3, "alphabet too large");
+   alphabet[symbols] = 0;
+   const int bits = symbols <= 4 ? 2 : 4;
+
+   int32_t len1, len2;
+   char32_t buf[SEQ_BUF_SIZE];
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);
+
+   const int64_t words1 = FC_PACKED_WORDS(len1, bits);
+   uint64_t *seq1 = fc_malloc((words1 + FC_PACKED_WORDS(len2, bits)) * sizeof *seq1);
+   uint64_t *seq2 = &seq1[words1];
+   const bool packed = fc_pack(bits, alphabet, bufp, len1, seq1)
+                       && fc_pack(bits, alphabet, &bufp[len1 + 1], len2, seq2);
+   if (packed)
+      lua_pushinteger(lua, func(bits, seq1, len1, seq2, len2));
+
+   fc_free(seq1);
+   if (bufp != buf)
+      fc_free(bufp);
+   luaL_argcheck(lua, packed, 3, "character not in alphabet");
+   return 1;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name##_packed(lua_State *lua)                              \
+{                                                                              \
+   return fc_packed_common(lua, fc_##name##_packed);                           \
+}
+_(levenshtein)
+_(lcsubseq)
+#undef _
+
+/* name(str1, str2[, threads]) */
+static int fc_long_common(lua_State *lua,
+            int64_t (*func)(const char32_t *, int64_t, const char32_t *, int64_t,
+                            int))
+{
+   size_t len1, len2;
+   const void *str1 = luaL_checklstring(lua, 1, &len1);
+   const void *str2 = luaL_checklstring(lua, 2, &len2);
+   const int threads = luaL_optinteger(lua, 3, 0);
+
+   char32_t *seq1 = fc_malloc((len1 + len2 + 2) * sizeof *seq1);
+   const int64_t nr1 = fc_utf8_decode(seq1, str1, len1);
+   char32_t *seq2 = &seq1[nr1 + 1];
+   const int64_t nr2 = fc_utf8_decode(seq2, str2, len2);
+
+   lua_pushinteger(lua, func(seq1, nr1, seq2, nr2, threads));
+   fc_free(seq1);
+   return 1;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name##_long(lua_State *lua)                                \
+{                                                                              \
+   return fc_long_common(lua, fc_##name##_long);                               \
+}
+_(levenshtein)
+_(damerau)
+_(lcsubseq)
+#undef _
+
+/* Decodes a table {{char, len}, ...}. Returns NULL if it is malformed. */
+static struct fc_run *fetch_runs(lua_State *lua, int index, int32_t *nr)
+{
+   luaL_checktype(lua, index, LUA_TTABLE);
+   *nr = lua_rawlen(lua, index);
+   struct fc_run *runs = fc_malloc((*nr + 1) * sizeof *runs);
+
+   for (int32_t i = 0; i < *nr; i++) {
+      lua_rawgeti(lua, index, i + 1);
+      lua_rawgeti(lua, -1, 1);
+      lua_rawgeti(lua, -2, 2);
+      size_t len;
+      const void *str = lua_type(lua, -2) == LUA_TSTRING
+                        ? lua_tolstring(lua, -2, &len) : NULL;
+      char32_t c[5];
+      const bool valid = str && len <= 4 && fc_utf8_decode(c, str, len) == 1
+                         && lua_type(lua, -1) == LUA_TNUMBER
+                         && lua_tointeger(lua, -1) > 0;
+      if (valid)
+         runs[i] = (struct fc_run){.c = c[0], .len = lua_tointeger(lua, -1)};
+      lua_pop(lua, 3);
+      if (!valid) {
+         fc_free(runs);
+         return NULL;
+      }
+   }
+   return runs;
+}
+
+/* levenshtein_rle(runs1, runs2) */
+static int fc_lua_levenshtein_rle(lua_State *lua)
+{
+   int32_t nr1, nr2;
+   struct fc_run *runs1 = fetch_runs(lua, 1, &nr1);
+   luaL_argcheck(lua, runs1, 1, "invalid runs");
+   struct fc_run *runs2 = fetch_runs(lua, 2, &nr2);
+   if (!runs2)
+      fc_free(runs1);
+   luaL_argcheck(lua, runs2, 2, "invalid runs");
+
+   lua_pushinteger(lua, fc_levenshtein_rle(runs1, nr1, runs2, nr2));
+   fc_free(runs1);
+   fc_free(runs2);
+   return 1;
+}
+
+#define FC_COSTS_MT "faconde.costs"
+
+struct fc_lua_costs {
+   struct fc_costs costs;
+   bool ready;
+};
+
+/* Returns the cost at the top of the stack, or 1 if it is nil, and pops it.
+ * Returns -1 if it is not valid.
+ */
+static int32_t pop_cost(lua_State *lua)
+{
+   lua_Integer cost = 1;
+   if (!lua_isnil(lua, -1)) {
+      cost = lua_type(lua, -1) == LUA_TNUMBER ? lua_tointeger(lua, -1) : -1;
+      if (cost > FC_MAX_COST)
+         cost = -1;
+   }
+   lua_pop(lua, 1);
+   return cost;
+}
+
+static bool to_char(lua_State *lua, int index, char32_t *c)
+{
+   size_t len;
+   const void *str = lua_type(lua, index) == LUA_TSTRING
+                     ? lua_tolstring(lua, index, &len) : NULL;
+   char32_t buf[5];
+   if (!str || len > 4 || fc_utf8_decode(buf, str, len) != 1)
+      return false;
+   *c = buf[0];
+   return true;
+}
+
+/* Fetches the array {{c1, c2, cost}, ...} at the top of the stack. */
+static struct fc_sub_cost *fetch_subs(lua_State *lua, int32_t *nr)
+{
+   *nr = lua_rawlen(lua, -1);
+   struct fc_sub_cost *subs = fc_malloc((*nr + 1) * sizeof *subs);
+
+   for (int32_t i = 0; i < *nr; i++) {
+      lua_rawgeti(lua, -1, i + 1);
+      lua_rawgeti(lua, -1, 1);
+      lua_rawgeti(lua, -2, 2);
+      const bool valid = to_char(lua, -2, &subs[i].c1)
+                         && to_char(lua, -1, &subs[i].c2);
+      lua_pop(lua, 2);
+      lua_rawgeti(lua, -1, 3);
+      const bool has_cost = !lua_isnil(lua, -1);
+      subs[i].cost = pop_cost(lua);
+      lua_pop(lua, 1);
+      if (!valid || !has_cost || subs[i].cost < 0) {
+         fc_free(subs);
+         return NULL;
+      }
+   }
+   return subs;
+}
+
+/* costs{ins = 1, del = 1, sub = 1, transpose = 1, subs = {{c1, c2, cost}, ...}} */
+static int fc_lua_costs_init(lua_State *lua)
+{
+   luaL_checktype(lua, 1, LUA_TTABLE);
+
+   int32_t costs[4];
+   const char *const names[] = {"ins", "del", "sub", "transpose"};
+   for (int i = 0; i < 4; i++) {
+      lua_getfield(lua, 1, names[i]);
+      costs[i] = pop_cost(lua);
+      luaL_argcheck(lua, costs[i] >= 0, 1, "invalid cost");
+   }
+
+   struct fc_lua_costs *c = lua_newuserdata(lua, sizeof *c);
+   c->ready = false;
+   luaL_getmetatable(lua, FC_COSTS_MT);
+   lua_setmetatable(lua, -2);
+
+   int32_t nr = 0;
+   struct fc_sub_cost *subs = NULL;
+   lua_getfield(lua, 1, "subs");
+   if (!lua_isnil(lua, -1)) {
+      luaL_argcheck(lua, lua_type(lua, -1) == LUA_TTABLE, 1, "invalid substitutions");
+      subs = fetch_subs(lua, &nr);
+      luaL_argcheck(lua, subs, 1, "invalid substitutions");
+   }
+   lua_pop(lua, 1);
+
+   fc_costs_init(&c->costs, costs[0], costs[1], costs[2], costs[3], subs, nr);
+   c->ready = true;
+   fc_free(subs);
+   return 1;
+}
+
+static int fc_lua_costs_fini(lua_State *lua)
+{
+   struct fc_lua_costs *c = luaL_checkudata(lua, 1, FC_COSTS_MT);
+   if (c->ready) {
+      fc_costs_fini(&c->costs);
+      c->ready = false;
+   }
+   return 0;
+}
+
+#define _(name)                                                                \
+static int fc_lua_##name(lua_State *lua)                                       \
+{                                                                              \
+   const struct fc_lua_costs *c = luaL_checkudata(lua, 3, FC_COSTS_MT);        \
+   lua_Integer max = luaL_optinteger(lua, 4, INT32_MAX);                       \
+   luaL_argcheck(lua, max >= 0, 4, "out of range");                            \
+   if (max > INT32_MAX)                                                        \
+      max = INT32_MAX;                                                         \
+                                                                               \
+   int32_t len1, len2;                                                         \
+   char32_t buf[SEQ_BUF_SIZE];                                                 \
+   char32_t *bufp = fetch_sequences(lua, buf, &len1, &len2);                   \
+                                                                               \
+   lua_pushinteger(lua, fc_##name##_bounded(&c->costs, bufp, len1,             \
+                                            &bufp[len1 + 1], len2, max));      \
+   if (bufp != buf)                                                            \
+      fc_free(bufp);                                                           \
+   return 1;                                                                   \
+}
+_(wlevenshtein)
+_(wdamerau)
+#undef _
+
 #define FC_MEMO_MT "faconde.memo"
 
 struct fc_lua_memo {
    struct fc_memo memo;
+   int costs_ref;          /* Reference to the costs, if any. */
    char32_t *seq1;
    char32_t seq2[];
 };
@@ -191,10 +844,11 @@ static int fc_lua_memo_init(lua_State *lua)
    lua_Integer max_len = luaL_checkinteger(lua, 2);
    luaL_argcheck(lua, 2, max_len >= 0 && max_len <= FC_MAX_SEQ_LEN, "out of range");
 
-   lua_Integer max_dist = luaL_optinteger(lua, 3, FC_MAX_SEQ_LEN);
+   /* Weighted distances can be larger than FC_MAX_SEQ_LEN. */
+   lua_Integer max_dist = luaL_optinteger(lua, 3, INT32_MAX);
    luaL_argcheck(lua, 3, max_dist >= 0, "out of range");
-   if (max_dist > FC_MAX_SEQ_LEN)
-      max_dist = FC_MAX_SEQ_LEN;
+   if (max_dist > INT32_MAX)
+      max_dist = INT32_MAX;
 
    /* We don't know yet the length of the longest reference sequence, so we
     * must choose the longest possible one.
@@ -204,6 +858,7 @@ static int fc_lua_memo_init(lua_State *lua)
 
    fc_memo_init(&m->memo, metric, max_len, max_dist);
    m->seq1 = &m->seq2[max_len + 1];
+   m->costs_ref = LUA_NOREF;
 
    luaL_getmetatable(lua, FC_MEMO_MT);
    lua_setmetatable(lua, -2);
@@ -243,17 +898,194 @@ static int fc_lua_memo_compute(lua_State *lua)
    return 1;
 }
 
+/* set_costs([costs]) */
+static int fc_lua_memo_set_costs(lua_State *lua)
+{
+   struct fc_lua_memo *m = luaL_checkudata(lua, 1, FC_MEMO_MT);
+   const enum fc_metric metric = fc_memo_metric(&m->memo);
+   if (metric != FC_LEVENSHTEIN && metric != FC_DAMERAU)
+      return luaL_error(lua, "costs only apply to levenshtein and damerau");
+   const struct fc_lua_costs *c = lua_isnoneornil(lua, 2)
+                                  ? NULL : luaL_checkudata(lua, 2, FC_COSTS_MT);
+
+   /* The costs are not copied, so they must be kept alive. */
+   luaL_unref(lua, LUA_REGISTRYINDEX, m->costs_ref);
+   m->costs_ref = LUA_NOREF;
+   if (c) {
+      lua_pushvalue(lua, 2);
+      m->costs_ref = luaL_ref(lua, LUA_REGISTRYINDEX);
+   }
+   fc_memo_set_costs(&m->memo, c ? &c->costs : NULL);
+   return 0;
+}
+
 static int fc_lua_memo_fini(lua_State *lua)
 {
    struct fc_lua_memo *m = luaL_checkudata(lua, 1, FC_MEMO_MT);
+   luaL_unref(lua, LUA_REGISTRYINDEX, m->costs_ref);
    fc_memo_fini(&m->memo);
    return 0;
 }
 
+#define FC_LCSUBSTR_INDEX_MT "faconde.lcsubstr_index"
+
+struct fc_lua_lcsubstr_index {
+   struct fc_lcsubstr_index index;
+   bool ready;
+};
+
+/* lcsubstr_index(ref) */
+static int fc_lua_lcsubstr_index_init(lua_State *lua)
+{
+   size_t len;
+   const void *str = luaL_checklstring(lua, 1, &len);
+   luaL_argcheck(lua, len <= FC_MAX_SEQ_LEN, 1, "sequence too long");
+
+   struct fc_lua_lcsubstr_index *idx = lua_newuserdata(lua, sizeof *idx);
+   idx->ready = false;
+   luaL_getmetatable(lua, FC_LCSUBSTR_INDEX_MT);
+   lua_setmetatable(lua, -2);
+
+   char32_t buf[SEQ_BUF_SIZE], *bufp = buf;
+   if (len + 1 > SEQ_BUF_SIZE)
+      bufp = fc_malloc((len + 1) * sizeof *bufp);
+
+   fc_lcsubstr_index_init(&idx->index, bufp, fc_utf8_decode(bufp, str, len));
+   idx->ready = true;
+
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+/* Returns the length of the longest common substring, and, if "extract" is
+ * true, pushes the substring itself instead.
+ */
+static int fc_lcsubstr_index_common(lua_State *lua, bool extract)
+{
+   struct fc_lua_lcsubstr_index *idx = luaL_checkudata(lua, 1, FC_LCSUBSTR_INDEX_MT);
+   size_t len;
+   const void *str = luaL_checklstring(lua, 2, &len);
+
+   /* Room for the decoded sequence, followed by the encoded substring. */
+   char32_t buf[SEQ_BUF_SIZE], *bufp = buf;
+   if (2 * len > SEQ_BUF_SIZE)
+      bufp = fc_malloc(2 * len * sizeof *bufp);
+
+   const int32_t seq_len = fc_utf8_decode(bufp, str, len);
+   const char32_t *substr;
+   int32_t ret = fc_lcsubstr_index_query(&idx->index, bufp, seq_len, &substr);
+
+   if (extract) {
+      ret = fc_utf8_encode((void *)&bufp[len], substr, ret);
+      lua_pushlstring(lua, (void *)&bufp[len], ret);
+   } else {
+      lua_pushinteger(lua, ret);
+   }
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+static int fc_lua_lcsubstr_index_lcsubstr(lua_State *lua)
+{
+   return fc_lcsubstr_index_common(lua, false);
+}
+
+static int fc_lua_lcsubstr_index_lcsubstr_extract(lua_State *lua)
+{
+   return fc_lcsubstr_index_common(lua, true);
+}
+
+static int fc_lua_lcsubstr_index_fini(lua_State *lua)
+{
+   struct fc_lua_lcsubstr_index *idx = luaL_checkudata(lua, 1, FC_LCSUBSTR_INDEX_MT);
+   if (idx->ready) {
+      fc_lcsubstr_index_fini(&idx->index);
+      idx->ready = false;
+   }
+   return 0;
+}
+
+#define FC_QUERY_MT "faconde.query"
+
+struct fc_lua_query {
+   struct fc_query query;
+   bool ready;
+};
+
+/* query(str) */
+static int fc_lua_query_init(lua_State *lua)
+{
+   size_t len;
+   const void *str = luaL_checklstring(lua, 1, &len);
+   luaL_argcheck(lua, len <= FC_MAX_SEQ_LEN, 1, "sequence too long");
+
+   struct fc_lua_query *q = lua_newuserdata(lua, sizeof *q);
+   q->ready = false;
+   luaL_getmetatable(lua, FC_QUERY_MT);
+   lua_setmetatable(lua, -2);
+
+   char32_t buf[SEQ_BUF_SIZE], *bufp = buf;
+   if (len + 1 > SEQ_BUF_SIZE)
+      bufp = fc_malloc((len + 1) * sizeof *bufp);
+
+   fc_query_init(&q->query, bufp, fc_utf8_decode(bufp, str, len));
+   q->ready = true;
+
+   if (bufp != buf)
+      fc_free(bufp);
+   return 1;
+}
+
+#define _(T, LT)                                                               \
+static int fc_query_common_##T(lua_State *lua,                                 \
+            T (*func)(const struct fc_query *, const char32_t *, int32_t))     \
+{                                                                              \
+   struct fc_lua_query *q = luaL_checkudata(lua, 1, FC_QUERY_MT);              \
+   size_t len;                                                                 \
+   const void *str = luaL_checklstring(lua, 2, &len);                          \
+   luaL_argcheck(lua, len <= FC_MAX_SEQ_LEN, 2, "sequence too long");          \
+                                                                               \
+   char32_t buf[SEQ_BUF_SIZE], *bufp = buf;                                    \
+   if (len + 1 > SEQ_BUF_SIZE)                                                 \
+      bufp = fc_malloc((len + 1) * sizeof *bufp);                              \
+                                                                               \
+   lua_push##LT(lua, func(&q->query, bufp, fc_utf8_decode(bufp, str, len)));   \
+   if (bufp != buf)                                                            \
+      fc_free(bufp);                                                           \
+   return 1;                                                                   \
+}
+_(int32_t, integer)
+_(double, number)
+#undef _
+
+#define _(name, T)                                                             \
+static int fc_lua_query_##name(lua_State *lua)                                 \
+{                                                                              \
+   return fc_query_common_##T(lua, fc_query_##name);                           \
+}
+_(levenshtein, int32_t)
+_(damerau, int32_t)
+_(lcsubseq, int32_t)
+_(jaro, double)
+#undef _
+
+static int fc_lua_query_fini(lua_State *lua)
+{
+   struct fc_lua_query *q = luaL_checkudata(lua, 1, FC_QUERY_MT);
+   if (q->ready) {
+      fc_query_fini(&q->query);
+      q->ready = false;
+   }
+   return 0;
+}
+
 int luaopen_faconde(lua_State *lua)
 {
    const luaL_Reg memo_methods[] = {
       {"set_ref", fc_lua_memo_set_ref},
+      {"set_costs", fc_lua_memo_set_costs},
       {"compute", fc_lua_memo_compute},
       {"__gc", fc_lua_memo_fini},
       {NULL, NULL},
@@ -263,20 +1095,80 @@ int luaopen_faconde(lua_State *lua)
    lua_setfield(lua, -2, "__index");
    luaL_setfuncs(lua, memo_methods, 0);
 
+   const luaL_Reg lcsubstr_index_methods[] = {
+      {"lcsubstr", fc_lua_lcsubstr_index_lcsubstr},
+      {"lcsubstr_extract", fc_lua_lcsubstr_index_lcsubstr_extract},
+      {"__gc", fc_lua_lcsubstr_index_fini},
+      {NULL, NULL},
+   };
+   luaL_newmetatable(lua, FC_LCSUBSTR_INDEX_MT);
+   lua_pushvalue(lua, -1);
+   lua_setfield(lua, -2, "__index");
+   luaL_setfuncs(lua, lcsubstr_index_methods, 0);
+
+   const luaL_Reg query_methods[] = {
+      {"levenshtein", fc_lua_query_levenshtein},
+      {"damerau", fc_lua_query_damerau},
+      {"lcsubseq", fc_lua_query_lcsubseq},
+      {"jaro", fc_lua_query_jaro},
+      {"__gc", fc_lua_query_fini},
+      {NULL, NULL},
+   };
+   luaL_newmetatable(lua, FC_QUERY_MT);
+   lua_pushvalue(lua, -1);
+   lua_setfield(lua, -2, "__index");
+   luaL_setfuncs(lua, query_methods, 0);
+
+   const luaL_Reg costs_methods[] = {
+      {"__gc", fc_lua_costs_fini},
+      {NULL, NULL},
+   };
+   luaL_newmetatable(lua, FC_COSTS_MT);
+   luaL_setfuncs(lua, costs_methods, 0);
+
    const luaL_Reg lib[] = {
       {"memo", fc_lua_memo_init},
+      {"lcsubstr_index", fc_lua_lcsubstr_index_init},
+      {"query", fc_lua_query_init},
+      {"costs", fc_lua_costs_init},
    #define _(name) {#name, fc_lua_##name},
       _(glob)
+      _(fold)
       _(levenshtein)
       _(lev_bounded)
+      _(dam_bounded)
       _(damerau)
       _(lcsubstr)
       _(lcsubseq)
       _(jaro)
+      _(jaro_winkler)
+      _(jaro_winkler_bounded)
       _(nlcsubseq)
       _(nlevenshtein)
       _(ndamerau)
+      _(nlevenshtein_bounded)
+      _(ndamerau_bounded)
+      _(nlcsubseq_bounded)
       _(lcsubstr_extract)
+      _(levenshtein_batch)
+      _(damerau_batch)
+      _(lcsubseq_batch)
+      _(levenshtein_align)
+      _(damerau_align)
+      _(lcsubseq_align)
+      _(levenshtein_long)
+      _(damerau_long)
+      _(lcsubseq_long)
+      _(multi_metric)
+      _(multi_metric_batch)
+      _(hamming)
+      _(hamming_bounded)
+      _(hamming_search)
+      _(levenshtein_packed)
+      _(lcsubseq_packed)
+      _(levenshtein_rle)
+      _(wlevenshtein)
+      _(wdamerau)
    #undef _
       {NULL, NULL},
    };
@@ -0,0 +1,298 @@
+#include <assert.h>
+#include <string.h>
+#include "api.h"
+#include "mem.h"
+#include "macro.h"
+
+/* Subproblems with at most this number of cells are solved with a full
+ * matrix. Those with at most two rows are also, since they can't be split
+ * around a transposition.
+ */
+#define FC_ALIGN_BASE_CELLS 4096
+
+struct fc_aligner {
+   const char32_t *seq1, *seq2;
+   const char32_t *rev1, *rev2;  /* Same as above, reversed. */
+   int32_t len1, len2;
+   bool transpos;                /* Whether transpositions are allowed. */
+   bool sub;                     /* Whether substitutions are allowed. */
+   int32_t *rows;                /* 6 rows of len2 + 1 cells. */
+   int32_t *matrix;              /* For the subproblems solved directly. */
+   unsigned char *ops;           /* Traceback of the above. */
+   struct fc_edit *script;
+   int32_t nr;
+};
+
+static void fc_align_emit(struct fc_aligner *al, enum fc_edit_op op, int32_t len)
+{
+   if (!len)
+      return;
+   if (al->nr && al->script[al->nr - 1].op == op)
+      al->script[al->nr - 1].len += len;
+   else
+      al->script[al->nr++] = (struct fc_edit){.op = op, .len = len};
+}
+
+static bool fc_align_transposed(const char32_t *seq1, int32_t i,
+                                const char32_t *seq2, int32_t j)
+{
+   return seq1[i] == seq2[j - 1] && seq1[i - 1] == seq2[j];
+}
+
+/* Computes the rows of the matrix between two sequences. The last row is put
+ * in rows[2], and the one before it in rows[1].
+ */
+static void fc_align_rows(const struct fc_aligner *al,
+                          const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          int32_t *rows[static 3])
+{
+   int32_t *prev2 = rows[0], *prev = rows[1], *cur = rows[2];
+
+   for (int32_t j = 0; j <= len2; j++)
+      cur[j] = j;
+
+   for (int32_t i = 1; i <= len1; i++) {
+      FC_SWAP3(int32_t *, prev2, prev, cur);
+      cur[0] = i;
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t d = FC_MIN(prev[j], cur[j - 1]) + 1;
+         if (seq1[i - 1] == seq2[j - 1])
+            d = FC_MIN(d, prev[j - 1]);
+         else if (al->sub)
+            d = FC_MIN(d, prev[j - 1] + 1);
+         if (al->transpos && i > 1 && j > 1
+             && fc_align_transposed(seq1, i - 1, seq2, j - 1))
+            d = FC_MIN(d, prev2[j - 2] + 1);
+         cur[j] = d;
+      }
+   }
+   rows[0] = prev2;
+   rows[1] = prev;
+   rows[2] = cur;
+}
+
+/* Aligns seq1[i0:i1] with seq2[j0:j1] with a full matrix. */
+static void fc_align_base(struct fc_aligner *al, int32_t i0, int32_t i1,
+                          int32_t j0, int32_t j1)
+{
+   const char32_t *seq1 = &al->seq1[i0], *seq2 = &al->seq2[j0];
+   const int32_t len1 = i1 - i0, len2 = j1 - j0;
+   const int32_t dim = len2 + 1;
+   int32_t *d = al->matrix;
+
+   for (int32_t j = 0; j <= len2; j++)
+      d[j] = j;
+   for (int32_t i = 1; i <= len1; i++) {
+      int32_t *row = &d[i * dim];
+      row[0] = i;
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t v = FC_MIN(row[j - dim], row[j - 1]) + 1;
+         if (seq1[i - 1] == seq2[j - 1])
+            v = FC_MIN(v, row[j - dim - 1]);
+         else if (al->sub)
+            v = FC_MIN(v, row[j - dim - 1] + 1);
+         if (al->transpos && i > 1 && j > 1
+             && fc_align_transposed(seq1, i - 1, seq2, j - 1))
+            v = FC_MIN(v, row[j - 2 * dim - 2] + 1);
+         row[j] = v;
+      }
+   }
+
+   /* Walk back from the end, preferring matches, then transpositions,
+    * substitutions, deletions, and insertions.
+    */
+   int32_t nr = 0;
+   for (int32_t i = len1, j = len2; i > 0 || j > 0; ) {
+      const int32_t *cell = &d[i * dim + j];
+      enum fc_edit_op op;
+
+      if (i && j && seq1[i - 1] == seq2[j - 1] && *cell == cell[-dim - 1])
+         op = FC_EDIT_MATCH;
+      else if (al->transpos && i > 1 && j > 1
+               && fc_align_transposed(seq1, i - 1, seq2, j - 1)
+               && *cell == cell[-2 * dim - 2] + 1)
+         op = FC_EDIT_TRANSPOSE;
+      else if (al->sub && i && j && *cell == cell[-dim - 1] + 1)
+         op = FC_EDIT_SUB;
+      else if (i && *cell == cell[-dim] + 1)
+         op = FC_EDIT_DEL;
+      else
+         op = FC_EDIT_INS;
+
+      al->ops[nr++] = op;
+      switch (op) {
+      case FC_EDIT_MATCH: case FC_EDIT_SUB:
+         i--, j--;
+         break;
+      case FC_EDIT_TRANSPOSE:
+         i -= 2, j -= 2;
+         break;
+      case FC_EDIT_DEL:
+         i--;
+         break;
+      case FC_EDIT_INS:
+         j--;
+         break;
+      }
+   }
+   while (nr)
+      fc_align_emit(al, al->ops[--nr], 1);
+}
+
+/* Hirschberg's algorithm. The rows of the matrix at the middle of the
+ * subproblem are computed from both ends, and the column where an optimal
+ * path crosses this row is the one that minimizes the sum of both. With
+ * transpositions, a path can also jump over the middle row, which is checked
+ * with the rows that surround it.
+ */
+static void fc_align0(struct fc_aligner *al, int32_t i0, int32_t i1,
+                      int32_t j0, int32_t j1)
+{
+   const int32_t len1 = i1 - i0, len2 = j1 - j0;
+
+   if (len1 == 0) {
+      fc_align_emit(al, FC_EDIT_INS, len2);
+      return;
+   }
+   if (len2 == 0) {
+      fc_align_emit(al, FC_EDIT_DEL, len1);
+      return;
+   }
+   if (len1 <= 2 || (int64_t)(len1 + 1) * (len2 + 1) <= FC_ALIGN_BASE_CELLS) {
+      fc_align_base(al, i0, i1, j0, j1);
+      return;
+   }
+
+   const int32_t mid = i0 + len1 / 2;
+   const int32_t dim = al->len2 + 1;
+   int32_t *fwd[3] = {al->rows, &al->rows[dim], &al->rows[2 * dim]};
+   int32_t *bwd[3] = {&al->rows[3 * dim], &al->rows[4 * dim], &al->rows[5 * dim]};
+
+   /* fwd[2][k] is the cell (mid, j0 + k), and bwd[2][k] the cell
+    * (mid, j1 - k), as seen from the end.
+    */
+   fc_align_rows(al, &al->seq1[i0], mid - i0, &al->seq2[j0], len2, fwd);
+   fc_align_rows(al, &al->rev1[al->len1 - i1], i1 - mid,
+                 &al->rev2[al->len2 - j1], len2, bwd);
+
+   int32_t split = 0, best = INT32_MAX;
+   for (int32_t k = 0; k <= len2; k++) {
+      const int32_t cost = fwd[2][k] + bwd[2][len2 - k];
+      if (cost < best) {
+         best = cost;
+         split = k;
+      }
+   }
+
+   int32_t jump = -1;
+   if (al->transpos) {
+      for (int32_t k = 1; k < len2; k++) {
+         if (!fc_align_transposed(al->seq1, mid, al->seq2, j0 + k))
+            continue;
+         const int32_t cost = fwd[1][k - 1] + 1 + bwd[1][len2 - k - 1];
+         if (cost < best) {
+            best = cost;
+            jump = k;
+         }
+      }
+   }
+
+   if (jump >= 0) {
+      fc_align0(al, i0, mid - 1, j0, j0 + jump - 1);
+      fc_align_emit(al, FC_EDIT_TRANSPOSE, 1);
+      fc_align0(al, mid + 1, i1, j0 + jump + 1, j1);
+   } else {
+      fc_align0(al, i0, mid, j0, j0 + split);
+      fc_align0(al, mid, i1, j0 + split, j1);
+   }
+}
+
+static void fc_align(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     bool transpos, bool sub,
+                     struct fc_edit *script, int32_t *nr)
+{
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
+
+   struct fc_aligner al = {
+      .seq1 = seq1,
+      .seq2 = seq2,
+      .len1 = len1,
+      .len2 = len2,
+      .transpos = transpos,
+      .sub = sub,
+      .script = script,
+   };
+
+   /* Common prefixes and suffixes are matched. */
+   int32_t prefix = 0;
+   while (prefix < len1 && prefix < len2 && seq1[prefix] == seq2[prefix])
+      prefix++;
+   int32_t suffix = 0;
+   while (suffix < len1 - prefix && suffix < len2 - prefix
+          && seq1[len1 - 1 - suffix] == seq2[len2 - 1 - suffix])
+      suffix++;
+   fc_align_emit(&al, FC_EDIT_MATCH, prefix);
+
+   const size_t dim = len2 + 1;
+   const size_t cells = FC_MAX(FC_ALIGN_BASE_CELLS, 3 * dim);
+   int32_t *buf = fc_malloc((len1 + len2 + 6 * dim + cells) * sizeof *buf
+                            + len1 + len2);
+   char32_t *rev1 = (char32_t *)buf, *rev2 = &rev1[len1];
+   for (int32_t i = 0; i < len1; i++)
+      rev1[i] = seq1[len1 - 1 - i];
+   for (int32_t i = 0; i < len2; i++)
+      rev2[i] = seq2[len2 - 1 - i];
+   al.rev1 = rev1;
+   al.rev2 = rev2;
+   al.rows = &buf[len1 + len2];
+   al.matrix = &al.rows[6 * dim];
+   al.ops = (unsigned char *)&al.matrix[cells];
+
+   fc_align0(&al, prefix, len1 - suffix, prefix, len2 - suffix);
+   fc_align_emit(&al, FC_EDIT_MATCH, suffix);
+
+   fc_free(buf);
+   *nr = al.nr;
+}
+
+static int32_t fc_script_cost(const struct fc_edit *script, int32_t nr)
+{
+   int32_t cost = 0;
+
+   for (int32_t i = 0; i < nr; i++)
+      if (script[i].op != FC_EDIT_MATCH)
+         cost += script[i].len;
+   return cost;
+}
+
+int32_t fc_levenshtein_align(const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, false, true, script, nr);
+   return fc_script_cost(script, *nr);
+}
+
+int32_t fc_damerau_align(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2,
+                         struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, true, true, script, nr);
+   return fc_script_cost(script, *nr);
+}
+
+int32_t fc_lcsubseq_align(const char32_t *seq1, int32_t len1,
+                          const char32_t *seq2, int32_t len2,
+                          struct fc_edit *script, int32_t *nr)
+{
+   fc_align(seq1, len1, seq2, len2, false, false, script, nr);
+
+   int32_t lcs = 0;
+   for (int32_t i = 0; i < *nr; i++)
+      if (script[i].op == FC_EDIT_MATCH)
+         lcs += script[i].len;
+   return lcs;
+}
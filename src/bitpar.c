@@ -0,0 +1,370 @@
+#include <assert.h>
+#include <string.h>
+#include "bitpar.h"
+#include "mem.h"
+#include "macro.h"
+
+void fc_peq_init_slots_elems(struct fc_peq *peq, const void *seq, int32_t len,
+                             int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * (uint32_t)len) {
+      slots_nr <<= 1;
+      shift--;
+   }
+
+   peq->len = len;
+   peq->words = len > FC_WORD_BITS ? (len + FC_WORD_BITS - 1) / FC_WORD_BITS : 1;
+   peq->mask = slots_nr - 1;
+   peq->shift = shift;
+
+   peq->slots = peq->slots_buf;
+   if (slots_nr > FC_ARRAY_SIZE(peq->slots_buf))
+      peq->slots = fc_malloc(slots_nr * sizeof *peq->slots);
+   memset(peq->slots, 0, slots_nr * sizeof *peq->slots);
+
+   /* Assign a row to each distinct character first, so that we know how much
+    * space is needed for the masks.
+    */
+   int32_t rows_nr = 1;
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      struct fc_peq_slot *slot = fc_peq_slot(peq, c);
+      if (!slot->row) {
+         slot->c = c;
+         slot->row = rows_nr++;
+      }
+   }
+   peq->rows_nr = rows_nr;
+   peq->rows = peq->rows_buf;
+}
+
+void fc_peq_init_rows_elems(struct fc_peq *peq, const void *seq, int size)
+{
+   const int32_t len = peq->len;
+   const size_t rows_size = peq->rows_nr * peq->words * sizeof *peq->rows;
+   peq->rows = peq->rows_buf;
+   if (rows_size > sizeof peq->rows_buf)
+      peq->rows = fc_malloc(rows_size);
+   memset(peq->rows, 0, rows_size);
+
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      uint64_t *masks = &peq->rows[fc_peq_slot(peq, c)->row * peq->words];
+      masks[i / FC_WORD_BITS] |= UINT64_C(1) << (i % FC_WORD_BITS);
+   }
+}
+
+void fc_peq_init_elems(struct fc_peq *peq, const void *seq, int32_t len, int size)
+{
+   fc_peq_init_slots_elems(peq, seq, len, size);
+   fc_peq_init_rows_elems(peq, seq, size);
+}
+
+void fc_peq_fini(struct fc_peq *peq)
+{
+   if (peq->slots != peq->slots_buf)
+      fc_free(peq->slots);
+   if (peq->rows != peq->rows_buf)
+      fc_free(peq->rows);
+}
+
+
+/*******************************************************************************
+ * Levenshtein
+ ******************************************************************************/
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_levenshtein1(const struct fc_peq *peq,
+                                                const void *seq, int32_t len, int size)
+{
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = *fc_peq_get(peq, fc_elem(seq, i, size));
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+   }
+   return dist;
+}
+
+/* Same as above, for sequences that don't fit in a single word. Horizontal
+ * deltas are carried from one block to the next.
+ */
+FC_ALWAYS_INLINE int32_t fc_bitpar_levenshteinN(const struct fc_peq *peq,
+                                                const void *seq, int32_t len, int size)
+{
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = 0;
+   }
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+      uint64_t hp_carry = 1, hn_carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t xv = eqs[w] | vn[w];
+         const uint64_t eq = eqs[w] | hn_carry;
+         const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+         uint64_t hp = vn[w] | ~(xh | vp[w]);
+         uint64_t hn = vp[w] & xh;
+
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         vp[w] = hn | ~(xv | hp);
+         vn[w] = hp & xv;
+      }
+   }
+   return dist;
+}
+
+int32_t fc_bitpar_levenshtein_elems(const struct fc_peq *peq, const void *seq,
+                                    int32_t len, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   if (peq->len == 0)
+      return len;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_levenshtein1, peq, seq, len);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_levenshteinN, peq, seq, len);
+}
+
+int32_t fc_bitpar_levenshtein(const struct fc_peq *peq,
+                              const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_levenshtein_elems(peq, seq, len, sizeof *seq);
+}
+
+
+/*******************************************************************************
+ * Damerau
+ ******************************************************************************/
+
+/* Transpositions are detected by looking at the masks of the previous
+ * character of "seq", and at the diagonal deltas of the previous column.
+ */
+FC_ALWAYS_INLINE int32_t fc_bitpar_damerau1(const struct fc_peq *peq,
+                                            const void *seq, int32_t len, int size)
+{
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0, d0 = 0, prev_eq = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = *fc_peq_get(peq, fc_elem(seq, i, size));
+      const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+      d0 = (((eq & vp) + vp) ^ vp) | eq | vn | tr;
+      uint64_t hp = vn | ~(d0 | vp);
+      uint64_t hn = d0 & vp;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(d0 | hp);
+      vn = hp & d0;
+      prev_eq = eq;
+   }
+   return dist;
+}
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_damerauN(const struct fc_peq *peq,
+                                            const void *seq, int32_t len, int size)
+{
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   uint64_t d0[FC_MAX_WORDS], prev_eq[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = d0[w] = prev_eq[w] = 0;
+   }
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+      uint64_t hp_carry = 1, hn_carry = 0, tr_carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t eq = eqs[w];
+         const uint64_t x = eq | hn_carry;
+         const uint64_t tr = (((~d0[w] & eq) << 1) | tr_carry) & prev_eq[w];
+         tr_carry = (~d0[w] & eq) >> (FC_WORD_BITS - 1);
+
+         const uint64_t d = (((x & vp[w]) + vp[w]) ^ vp[w]) | x | vn[w] | tr;
+         uint64_t hp = vn[w] | ~(d | vp[w]);
+         uint64_t hn = d & vp[w];
+
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         vp[w] = hn | ~(d | hp);
+         vn[w] = hp & d;
+         d0[w] = d;
+         prev_eq[w] = eq;
+      }
+   }
+   return dist;
+}
+
+int32_t fc_bitpar_damerau_elems(const struct fc_peq *peq, const void *seq,
+                                int32_t len, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   if (peq->len == 0)
+      return len;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_damerau1, peq, seq, len);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_damerauN, peq, seq, len);
+}
+
+int32_t fc_bitpar_damerau(const struct fc_peq *peq,
+                          const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_damerau_elems(peq, seq, len, sizeof *seq);
+}
+
+
+/*******************************************************************************
+ * Longest common subsequence
+ ******************************************************************************/
+
+/* Bits of "s" are cleared at the positions of the pattern that are part of a
+ * longest common subsequence. See Hyyrö, "Bit-Parallel LCS-length Computation
+ * Revisited".
+ *
+ * Every FC_LCS_CHECK_STEP characters, we check that the current length plus
+ * the number of characters left is at least "min", and give up otherwise.
+ */
+#define FC_LCS_CHECK_STEP 16
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_lcsubseq1(const struct fc_peq *peq,
+                                             const void *seq, int32_t len,
+                                             int32_t min, int size)
+{
+   const uint64_t mask = ~UINT64_C(0) >> (FC_WORD_BITS - peq->len);
+   uint64_t s = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; ) {
+      const int32_t end = FC_MIN(len, i + FC_LCS_CHECK_STEP);
+      for (; i < end; i++) {
+         const uint64_t u = s & *fc_peq_get(peq, fc_elem(seq, i, size));
+         s = (s + u) | (s - u);
+      }
+      if (min > 0 && fc_popcount(~s & mask) + len - i < min)
+         return -1;
+   }
+   return fc_popcount(~s & mask);
+}
+
+static int32_t fc_bitpar_lcsubseqN_count(const struct fc_peq *peq,
+                                         const uint64_t *s)
+{
+   const int32_t words = peq->words;
+   int32_t lcs = 0;
+
+   for (int32_t w = 0; w < words - 1; w++)
+      lcs += fc_popcount(~s[w]);
+
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   return lcs + fc_popcount(~s[words - 1] & (~UINT64_C(0) >> (FC_WORD_BITS - rem)));
+}
+
+FC_ALWAYS_INLINE int32_t fc_bitpar_lcsubseqN(const struct fc_peq *peq,
+                                             const void *seq, int32_t len,
+                                             int32_t min, int size)
+{
+   const int32_t words = peq->words;
+   uint64_t s[FC_MAX_WORDS];
+
+   for (int32_t w = 0; w < words; w++)
+      s[w] = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; ) {
+      const int32_t end = FC_MIN(len, i + FC_LCS_CHECK_STEP);
+      for (; i < end; i++) {
+         const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq, i, size));
+         uint64_t carry = 0;
+
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t u = s[w] & eqs[w];
+            const uint64_t sum = s[w] + carry;
+            const uint64_t x = sum + u;
+            carry = (sum < carry) | (x < u);
+            s[w] = x | (s[w] - u);
+         }
+      }
+      if (min > 0 && fc_bitpar_lcsubseqN_count(peq, s) + len - i < min)
+         return -1;
+   }
+   return fc_bitpar_lcsubseqN_count(peq, s);
+}
+
+int32_t fc_bitpar_lcsubseq_bounded_elems(const struct fc_peq *peq, const void *seq,
+                                         int32_t len, int32_t min, int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   if (peq->len == 0)
+      return min > 0 ? -1 : 0;
+   if (peq->words == 1)
+      return FC_ELEM_DISPATCH(size, fc_bitpar_lcsubseq1, peq, seq, len, min);
+   return FC_ELEM_DISPATCH(size, fc_bitpar_lcsubseqN, peq, seq, len, min);
+}
+
+int32_t fc_bitpar_lcsubseq_bounded(const struct fc_peq *peq,
+                                   const char32_t *seq, int32_t len,
+                                   int32_t min)
+{
+   return fc_bitpar_lcsubseq_bounded_elems(peq, seq, len, min, sizeof *seq);
+}
+
+int32_t fc_bitpar_lcsubseq(const struct fc_peq *peq,
+                           const char32_t *seq, int32_t len)
+{
+   return fc_bitpar_lcsubseq_bounded(peq, seq, len, 0);
+}
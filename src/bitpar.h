@@ -0,0 +1,148 @@
+#ifndef FC_BITPAR_H
+#define FC_BITPAR_H
+
+#include <stdint.h>
+#include <uchar.h>
+#include "api.h"
+#include "elem.h"
+
+/* Number of bits in a word of a bit-vector. */
+#define FC_WORD_BITS 64
+
+/* Maximum number of words needed to hold a bit-vector for a sequence. */
+#define FC_MAX_WORDS ((FC_MAX_SEQ_LEN + FC_WORD_BITS - 1) / FC_WORD_BITS)
+
+static inline int32_t fc_popcount(uint64_t x)
+{
+   return __builtin_popcountll(x);
+}
+
+/* Index of the lowest set bit. "x" must not be zero. */
+static inline int32_t fc_ctz(uint64_t x)
+{
+   return __builtin_ctzll(x);
+}
+
+/* Number of hash slots available without dynamic allocation. This is enough
+ * for sequences that fit in a single word.
+ */
+#define FC_PEQ_SLOTS_NR (2 * FC_WORD_BITS)
+
+struct fc_peq_slot {
+   char32_t c;
+   int32_t row;         /* Row of the masks for "c", or 0 if the slot is free. */
+};
+
+/* Pattern-match masks of a sequence, as used by bit-parallel algorithms.
+ * For each character "c" of the sequence, there is a mask of "words" words
+ * where the bit at position i is set iff seq[i] == c. Since the alphabet is
+ * huge, masks are stored in a contiguous array of rows, and the mapping of
+ * characters to rows is done with an open-addressing hash table. The row 0 is
+ * filled with zeroes, and is used for characters not in the sequence.
+ */
+struct fc_peq {
+   int32_t len;                  /* Length of the sequence. */
+   int32_t words;                /* Number of words per mask. */
+   int32_t rows_nr;              /* Number of distinct characters plus one. */
+   uint32_t mask;                /* Number of slots minus one. */
+   int shift;                    /* For reducing hash values. */
+   struct fc_peq_slot *slots;
+   uint64_t *rows;
+   struct fc_peq_slot slots_buf[FC_PEQ_SLOTS_NR];
+   uint64_t rows_buf[FC_WORD_BITS + 1];
+};
+
+/* Builds the masks of a sequence of elements of "size" bytes. The sequence is
+ * not referenced afterwards. No memory is allocated if the sequence fits in a
+ * single word.
+ */
+void fc_peq_init_elems(struct fc_peq *, const void *seq, int32_t len, int size);
+
+/* The two steps of fc_peq_init_elems(). After the first one, characters are
+ * mapped to rows, but the masks are not built yet. The second one must be
+ * called with the same sequence.
+ */
+void fc_peq_init_slots_elems(struct fc_peq *, const void *seq, int32_t len,
+                             int size);
+void fc_peq_init_rows_elems(struct fc_peq *, const void *seq, int size);
+
+/* Same as the above, for sequences of characters. */
+static inline void fc_peq_init(struct fc_peq *peq, const char32_t *seq,
+                               int32_t len)
+{
+   fc_peq_init_elems(peq, seq, len, sizeof *seq);
+}
+
+static inline void fc_peq_init_slots(struct fc_peq *peq, const char32_t *seq,
+                                     int32_t len)
+{
+   fc_peq_init_slots_elems(peq, seq, len, sizeof *seq);
+}
+
+static inline void fc_peq_init_rows(struct fc_peq *peq, const char32_t *seq)
+{
+   fc_peq_init_rows_elems(peq, seq, sizeof *seq);
+}
+
+void fc_peq_fini(struct fc_peq *);
+
+/* Returns the slot of a character, or the free slot where it should be
+ * inserted.
+ */
+static inline struct fc_peq_slot *fc_peq_slot(const struct fc_peq *peq,
+                                              char32_t c)
+{
+   uint32_t i = ((uint32_t)c * UINT32_C(0x9E3779B1)) >> peq->shift;
+
+   for (;;) {
+      struct fc_peq_slot *slot = &peq->slots[i];
+      if (!slot->row || slot->c == c)
+         return slot;
+      i = (i + 1) & peq->mask;
+   }
+}
+
+/* Returns the masks of a character. */
+static inline const uint64_t *fc_peq_get(const struct fc_peq *peq, char32_t c)
+{
+   return &peq->rows[fc_peq_slot(peq, c)->row * peq->words];
+}
+
+/* Computes the Levenshtein distance between the sequence a "peq" was built
+ * from and another sequence. This is Myers' algorithm, with Hyyrö's
+ * modifications for computing the global distance instead of doing a search.
+ * See Hyyrö, "A Bit-Vector Algorithm for Computing Levenshtein and
+ * Damerau Edit Distances".
+ */
+int32_t fc_bitpar_levenshtein(const struct fc_peq *, const char32_t *seq,
+                              int32_t len);
+
+/* Same as fc_bitpar_levenshtein(), but for the restricted Damerau distance
+ * (optimal string alignment), as computed by fc_damerau(). This is also due
+ * to Hyyrö.
+ */
+int32_t fc_bitpar_damerau(const struct fc_peq *, const char32_t *seq,
+                          int32_t len);
+
+/* Computes the length of the longest common subsequence between the sequence
+ * a "peq" was built from and another sequence (Allison-Dix, Crochemore et al.,
+ * Hyyrö).
+ */
+int32_t fc_bitpar_lcsubseq(const struct fc_peq *, const char32_t *seq,
+                           int32_t len);
+
+/* Same as fc_bitpar_lcsubseq(), but returns -1 as soon as the length of the
+ * longest common subsequence is known to be lower than "min".
+ */
+int32_t fc_bitpar_lcsubseq_bounded(const struct fc_peq *, const char32_t *seq,
+                                   int32_t len, int32_t min);
+
+/* Same as the above functions, for sequences of elements of "size" bytes. */
+int32_t fc_bitpar_levenshtein_elems(const struct fc_peq *, const void *seq,
+                                    int32_t len, int size);
+int32_t fc_bitpar_damerau_elems(const struct fc_peq *, const void *seq,
+                                int32_t len, int size);
+int32_t fc_bitpar_lcsubseq_bounded_elems(const struct fc_peq *, const void *seq,
+                                         int32_t len, int32_t min, int size);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FC_ELEM_H
+#define FC_ELEM_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
+
+/* Sequences can be made of elements of 1, 2, or 4 bytes. Code that supports
+ * all of them takes sequences as "const void *", together with the size of
+ * their elements. Kernels are written once, as always inlined functions, and
+ * FC_ELEM_DISPATCH() calls them with a constant size, so that they are
+ * compiled once per size, and elements are loaded without any conversion but
+ * a zero extension.
+ */
+
+#define FC_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+#define FC_ELEM_DISPATCH(size, func, ...)                                      \
+   ((size) == 1 ? func(__VA_ARGS__, 1)                                         \
+                : (size) == 2 ? func(__VA_ARGS__, 2) : func(__VA_ARGS__, 4))
+
+static_assert(sizeof(char32_t) == 4, "");
+
+/* Returns the element at position "i". */
+FC_ALWAYS_INLINE char32_t fc_elem(const void *seq, int32_t i, int size)
+{
+   switch (size) {
+   case 1:
+      return ((const uint8_t *)seq)[i];
+   case 2:
+      return ((const uint16_t *)seq)[i];
+   default:
+      return ((const char32_t *)seq)[i];
+   }
+}
+
+/* Returns a pointer to the element at position "i". */
+FC_ALWAYS_INLINE const void *fc_elem_ptr(const void *seq, int32_t i, int size)
+{
+   return (const char *)seq + (size_t)i * size;
+}
+
+#endif
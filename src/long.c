@@ -0,0 +1,284 @@
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include "api.h"
+#include "bitpar.h"
+#include "mem.h"
+#include "macro.h"
+
+/* The matrix is cut into horizontal strips of FC_LONG_STRIP_LEN rows, and
+ * each strip is computed from left to right with the bit-parallel algorithms,
+ * by tiles of FC_LONG_TILE_LEN columns. A tile depends on the tile at its left,
+ * which is computed by the same thread, and on the tile above it, from which
+ * the carries of each column are passed down. Thus, tiles run in a wavefront:
+ * a thread can start computing a strip as soon as the first tile of the
+ * previous strip is done. Only the masks of the strips being computed, and the
+ * carries of each column, are held in memory.
+ */
+#define FC_LONG_STRIP_LEN 512
+#define FC_LONG_STRIP_WORDS (FC_LONG_STRIP_LEN / FC_WORD_BITS)
+#define FC_LONG_TILE_LEN 1024
+
+/* Vertical state of a strip, carried from one tile to the next. For the
+ * longest common subsequence, "vp" holds the vector "s" of Hyyrö.
+ */
+struct fc_long_strip {
+   uint64_t vp[FC_LONG_STRIP_WORDS];
+   uint64_t vn[FC_LONG_STRIP_WORDS];
+   uint64_t d0[FC_LONG_STRIP_WORDS];
+   uint64_t prev_eq[FC_LONG_STRIP_WORDS];
+};
+
+/* Bits of the carries of a column. */
+enum {
+   FC_LONG_HP = 1,         /* Also the addition carry of fc_lcsubseq_long(). */
+   FC_LONG_HN = 2,
+   FC_LONG_TR = 4,
+};
+
+struct fc_long {
+   enum fc_metric metric;
+   const char32_t *seq1, *seq2;
+   int64_t len1, len2;
+   int64_t strips_nr, tiles_nr;
+   uint8_t *carries;             /* Per column, carries to the next strip. */
+   _Atomic int64_t *done;        /* Per strip, number of tiles computed. */
+   _Atomic int64_t next;         /* Next strip to compute. */
+   _Atomic int64_t sum;          /* Sum of the values of the strips. */
+};
+
+/* Same as fc_bitpar_damerauN(), or fc_bitpar_levenshteinN() if "transpos" is
+ * false, but the carries of the first word come from the strip above.
+ */
+static inline void fc_long_edit_tile(const struct fc_peq *peq,
+                                     struct fc_long_strip *st,
+                                     const char32_t *seq, int64_t len,
+                                     uint8_t *carries, bool transpos)
+{
+   const int32_t words = peq->words;
+
+   for (int64_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq[i]);
+      uint64_t hp_carry = carries[i] & FC_LONG_HP;
+      uint64_t hn_carry = (carries[i] & FC_LONG_HN) != 0;
+      uint64_t tr_carry = (carries[i] & FC_LONG_TR) != 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t eq = eqs[w];
+         const uint64_t x = eq | hn_carry;
+         uint64_t tr = 0;
+         if (transpos) {
+            tr = (((~st->d0[w] & eq) << 1) | tr_carry) & st->prev_eq[w];
+            tr_carry = (~st->d0[w] & eq) >> (FC_WORD_BITS - 1);
+         }
+
+         const uint64_t vp = st->vp[w], vn = st->vn[w];
+         const uint64_t d = (((x & vp) + vp) ^ vp) | x | vn | tr;
+         uint64_t hp = vn | ~(d | vp);
+         uint64_t hn = d & vp;
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         st->vp[w] = hn | ~(d | hp);
+         st->vn[w] = hp & d;
+         if (transpos) {
+            st->d0[w] = d;
+            st->prev_eq[w] = eq;
+         }
+      }
+      carries[i] = hp_carry | hn_carry << 1 | tr_carry << 2;
+   }
+}
+
+/* Same as fc_bitpar_lcsubseqN(). */
+static void fc_long_lcsubseq_tile(const struct fc_peq *peq,
+                                  struct fc_long_strip *st,
+                                  const char32_t *seq, int64_t len,
+                                  uint8_t *carries)
+{
+   const int32_t words = peq->words;
+   uint64_t *s = st->vp;
+
+   for (int64_t i = 0; i < len; i++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq[i]);
+      uint64_t carry = carries[i];
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t u = s[w] & eqs[w];
+         const uint64_t sum = s[w] + carry;
+         const uint64_t x = sum + u;
+         carry = (sum < carry) | (x < u);
+         s[w] = x | (s[w] - u);
+      }
+      carries[i] = carry;
+   }
+}
+
+static void fc_long_wait(_Atomic int64_t *done, int64_t tiles)
+{
+   while (atomic_load_explicit(done, memory_order_acquire) < tiles)
+      sched_yield();
+}
+
+/* Returns the contribution of a strip to the result. For the edit distances,
+ * this is the sum of the vertical deltas of the last column.
+ */
+static int64_t fc_long_strip_value(const struct fc_long *lg,
+                                   const struct fc_peq *peq,
+                                   const struct fc_long_strip *st)
+{
+   const int32_t words = peq->words;
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   int64_t value = 0;
+
+   for (int32_t w = 0; w < words; w++) {
+      const uint64_t mask = w < words - 1 ? ~UINT64_C(0)
+                                          : ~UINT64_C(0) >> (FC_WORD_BITS - rem);
+      if (lg->metric == FC_LCSUBSEQ)
+         value += fc_popcount(~st->vp[w] & mask);
+      else
+         value += fc_popcount(st->vp[w] & mask) - fc_popcount(st->vn[w] & mask);
+   }
+   return value;
+}
+
+static void fc_long_strip(struct fc_long *lg, int64_t strip)
+{
+   const int64_t row = strip * FC_LONG_STRIP_LEN;
+   struct fc_peq peq;
+   fc_peq_init(&peq, &lg->seq1[row], FC_MIN(lg->len1 - row, FC_LONG_STRIP_LEN));
+
+   struct fc_long_strip st;
+   for (int32_t w = 0; w < FC_LONG_STRIP_WORDS; w++) {
+      st.vp[w] = ~UINT64_C(0);
+      st.vn[w] = st.d0[w] = st.prev_eq[w] = 0;
+   }
+
+   for (int64_t tile = 0; tile < lg->tiles_nr; tile++) {
+      if (strip)
+         fc_long_wait(&lg->done[strip - 1], tile + 1);
+
+      const int64_t col = tile * FC_LONG_TILE_LEN;
+      const int64_t len = FC_MIN(lg->len2 - col, FC_LONG_TILE_LEN);
+      switch (lg->metric) {
+      case FC_LEVENSHTEIN:
+         fc_long_edit_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col], false);
+         break;
+      case FC_DAMERAU:
+         fc_long_edit_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col], true);
+         break;
+      default:
+         fc_long_lcsubseq_tile(&peq, &st, &lg->seq2[col], len, &lg->carries[col]);
+         break;
+      }
+      atomic_store_explicit(&lg->done[strip], tile + 1, memory_order_release);
+   }
+
+   atomic_fetch_add(&lg->sum, fc_long_strip_value(lg, &peq, &st));
+   fc_peq_fini(&peq);
+}
+
+/* Strips are handed out in order, so that the strip a thread waits for is
+ * always being computed by another thread.
+ */
+static void *fc_long_work(void *arg)
+{
+   struct fc_long *lg = arg;
+   int64_t strip;
+
+   while ((strip = atomic_fetch_add(&lg->next, 1)) < lg->strips_nr)
+      fc_long_strip(lg, strip);
+   return NULL;
+}
+
+static int64_t fc_long(enum fc_metric metric,
+                       const char32_t *seq1, int64_t len1,
+                       const char32_t *seq2, int64_t len2, int threads)
+{
+   assert(len1 >= 0 && len2 >= 0);
+
+   /* The metrics are symmetric. There is more parallelism when the longest
+    * sequence is cut into strips.
+    */
+   if (len1 < len2) {
+      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(int64_t, len1, len2);
+   }
+
+   struct fc_long lg = {
+      .metric = metric,
+      .seq1 = seq1,
+      .seq2 = seq2,
+      .len1 = len1,
+      .len2 = len2,
+      .strips_nr = (len1 + FC_LONG_STRIP_LEN - 1) / FC_LONG_STRIP_LEN,
+      .tiles_nr = (len2 + FC_LONG_TILE_LEN - 1) / FC_LONG_TILE_LEN,
+   };
+   if (!lg.strips_nr)
+      return 0;
+
+   lg.done = fc_malloc(lg.strips_nr * sizeof *lg.done + len2);
+   lg.carries = (uint8_t *)&lg.done[lg.strips_nr];
+   for (int64_t i = 0; i < lg.strips_nr; i++)
+      atomic_init(&lg.done[i], 0);
+   memset(lg.carries, metric == FC_LCSUBSEQ ? 0 : FC_LONG_HP, len2);
+   atomic_init(&lg.next, 0);
+   atomic_init(&lg.sum, 0);
+
+   if (threads <= 0)
+      threads = FC_MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+   threads = FC_MIN(threads, lg.strips_nr);
+
+   /* The calling thread also does its share of the work. If a thread can't be
+    * created, the others do its share.
+    */
+   pthread_t *tids = NULL;
+   int spawned = 0;
+   if (threads > 1) {
+      tids = fc_malloc((threads - 1) * sizeof *tids);
+      while (spawned < threads - 1
+             && !pthread_create(&tids[spawned], NULL, fc_long_work, &lg))
+         spawned++;
+   }
+   fc_long_work(&lg);
+   for (int i = 0; i < spawned; i++)
+      pthread_join(tids[i], NULL);
+
+   fc_free(tids);
+   fc_free(lg.done);
+
+   const int64_t sum = atomic_load(&lg.sum);
+   return metric == FC_LCSUBSEQ ? sum : len2 + sum;
+}
+
+int64_t fc_levenshtein_long(const char32_t *seq1, int64_t len1,
+                            const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_levenshtein(seq1, len1, seq2, len2);
+   return fc_long(FC_LEVENSHTEIN, seq1, len1, seq2, len2, threads);
+}
+
+int64_t fc_damerau_long(const char32_t *seq1, int64_t len1,
+                        const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_damerau(seq1, len1, seq2, len2);
+   return fc_long(FC_DAMERAU, seq1, len1, seq2, len2, threads);
+}
+
+int64_t fc_lcsubseq_long(const char32_t *seq1, int64_t len1,
+                         const char32_t *seq2, int64_t len2, int threads)
+{
+   if (len1 <= FC_MAX_SEQ_LEN && len2 <= FC_MAX_SEQ_LEN)
+      return fc_lcsubseq(seq1, len1, seq2, len2);
+   return fc_long(FC_LCSUBSEQ, seq1, len1, seq2, len2, threads);
+}
@@ -23,4 +23,15 @@
    c = tmp;                                                                    \
 } while (0)
 
+/* For the normalization by the longest alignment, the distance between two
+ * sequences and the length of the longest alignment that achieves it are
+ * packed into a single positive value (dist + 1) * scale - len, where
+ * len < scale. Minimizing this value minimizes the distance first, then
+ * maximizes the length, so both are computed with a single recurrence.
+ */
+#define FC_LALIGN_SCALE (1 << 14)
+#define FC_LALIGN_PACK(dist, len, scale) (((dist) + 1) * (scale) - (len))
+#define FC_LALIGN_DIST(v, scale) (((v) - 1) / (scale))
+#define FC_LALIGN_LEN(v, scale) ((FC_LALIGN_DIST(v, scale) + 1) * (scale) - (v))
+
 #endif
@@ -1,8 +1,13 @@
 #include <limits.h>
+#include <math.h>
 #include <string.h>
 #include "api.h"
 #include "mem.h"
 #include "macro.h"
+#include "bitpar.h"
+#include "elem.h"
+#include "sam.h"
+#include "simd.h"
 
 /* Default length of a column in a matrix of edit operations.
  * If one of the sequences to compare is longer than this, or if
@@ -32,9 +37,33 @@
    }                                                                           \
 } while (0)
 
+/* Same as STRIP(), for sequences of elements of "size" bytes. */
+#define STRIP_ELEMS(seq1, seq2, len1, len2, size) do {                         \
+   assert(len1 >= len2);                                                       \
+   int32_t prefix_ = 0;                                                        \
+   while (prefix_ < len2                                                       \
+          && fc_elem(seq1, prefix_, size) == fc_elem(seq2, prefix_, size))     \
+      prefix_++;                                                               \
+   seq1 = fc_elem_ptr(seq1, prefix_, size);                                    \
+   seq2 = fc_elem_ptr(seq2, prefix_, size);                                    \
+   len1 -= prefix_;                                                            \
+   len2 -= prefix_;                                                            \
+   while (len2                                                                 \
+          && fc_elem(seq1, len1 - 1, size) == fc_elem(seq2, len2 - 1, size)) { \
+      len1--;                                                                  \
+      len2--;                                                                  \
+   }                                                                           \
+} while (0)
+
 #define TRANSPOSED(seq1, seq2, i, j)                                           \
    (i > 1 && j > 1 && seq1[i - 2] == seq2[j - 1] && seq1[i - 1] == seq2[j - 2])
 
+/* Same as TRANSPOSED(), for sequences of elements of "size" bytes. */
+#define TRANSPOSED_ELEMS(seq1, seq2, i, j, size)                               \
+   (i > 1 && j > 1                                                             \
+    && fc_elem(seq1, i - 2, size) == fc_elem(seq2, j - 1, size)                \
+    && fc_elem(seq1, i - 1, size) == fc_elem(seq2, j - 2, size))
+
 #define IN_RANGE(len) (len >= 0 && len <= FC_MAX_SEQ_LEN)
 
 static_assert(sizeof(size_t) >= sizeof(int32_t), "");
@@ -43,79 +72,111 @@ static_assert(sizeof(size_t) >= sizeof(int32_t), "");
  * Absolute Levenshtein distance
  ******************************************************************************/
 
-/* Like fc_levenshtein() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold len2 + 1 int32_ts.
+/* The shortest sequence fits in a single word up to this length, but the
+ * masks of the characters of the other sequence are then computed on the fly
+ * instead of building a "peq", which costs more than the whole comparison of
+ * short words.
  */
-static int32_t fc_levenshtein0(int32_t *column, const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
-
-   STRIP(seq1, seq2, len1, len2);
+#define FC_LEV_SHORT_LEN 20
 
-   if (len2 == 0)
-      return len1;
+/* Returns the mask of the positions of "c" in "seq", which must fit in a
+ * single word.
+ */
+FC_ALWAYS_INLINE uint64_t fc_short_eq(const void *seq, int32_t len, char32_t c,
+                                      int size)
+{
+   uint64_t eq = 0;
+   for (int32_t j = 0; j < len; j++)
+      eq |= (uint64_t)(fc_elem(seq, j, size) == c) << j;
+   return eq;
+}
 
-   for (int32_t j = 1 ; j <= len2; j++)
-      column[j] = j;
+FC_ALWAYS_INLINE int32_t fc_levenshtein_short(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(len2 > 0 && len2 <= FC_LEV_SHORT_LEN);
 
-   for (int32_t i = 1 ; i <= len1; i++) {
-      *column = i;
-      int32_t last = i - 1;
+   const uint64_t last = UINT64_C(1) << (len2 - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = len2;
 
-      for (int32_t j = 1; j <= len2; j++) {
-         const int32_t old = column[j];
-         if (seq1[i - 1] == seq2[j - 1])
-            column[j] = last;
-         else {
-            const int32_t ic = column[j - 1] + 1;
-            const int32_t dc = column[j] + 1;
-            const int32_t rc = last + 1;
-            column[j] = FC_MIN3(ic, dc, rc);
-         }
-         last = old;
-      }
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t eq = fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
    }
-
-   return column[len2];
+   return dist;
 }
 
-int32_t fc_levenshtein(const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_levenshtein_body(const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
 
-   if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+   if (len2 == 0)
+      return len1;
+   if (len2 <= FC_LEV_SHORT_LEN)
+      return fc_levenshtein_short(seq1, len1, seq2, len2, size);
 
-   int32_t dist = fc_levenshtein0(columnp, seq1, len1, seq2, len2);
+   /* The shortest sequence is used as pattern, so that we need as few words
+    * as possible.
+    */
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
 
-   if (columnp != column)
-      fc_free(columnp);
+   int32_t dist = fc_bitpar_levenshtein_elems(&peq, seq1, len1, size);
 
+   fc_peq_fini(&peq);
    return dist;
 }
 
+static int32_t fc_levenshtein_elems(const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_levenshtein_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_levenshtein(const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_levenshtein_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 
 /*******************************************************************************
  * Normalized Levenshtein distance
  ******************************************************************************/
 
+static_assert(2 * FC_MAX_SEQ_LEN < FC_LALIGN_SCALE, "");
+
 /* Like fc_nlevenshtein() but with a provided buffer for holding the matrix.
  * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold len2 + 1 doubles.
+ * The provided buffer should be big enough to hold len2 + 1 items.
  */
-static double fc_nlevenshtein0(int32_t *column, enum fc_norm_method method,
-                               const char32_t *seq1, int32_t len1,
-                               const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE double fc_nlevenshtein0_body(int32_t *column,
+                                              enum fc_norm_method method,
+                                              const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
 
@@ -123,57 +184,64 @@ static double fc_nlevenshtein0(int32_t *column, enum fc_norm_method method,
       return len1 == 0 ? 0.0 : 1.0;
 
    if (method == FC_NORM_LSEQ)
-      return fc_levenshtein0(column, seq1, len1, seq2, len2) / (double)len1;
+      return fc_levenshtein_elems(seq1, len1, seq2, len2, size) / (double)len1;
 
    assert(method == FC_NORM_LALIGN);
 
-   int32_t *length = &column[len2 + 1];
+   /* Distances and alignment lengths are packed together. */
+   const int32_t scale = FC_LALIGN_SCALE;
 
-   for (int32_t j = 1 ; j <= len2; j++)
-      column[j] = length[j] = j;
+   for (int32_t j = 0 ; j <= len2; j++)
+      column[j] = FC_LALIGN_PACK(j, j, scale);
 
    for (int32_t i = 1 ; i <= len1; i++) {
-      *column = *length = i;
-      int32_t last = i - 1, llast = i - 1;
+      int32_t last = *column;
+      *column = FC_LALIGN_PACK(i, i, scale);
 
       for (int32_t j = 1; j <= len2; j++) {
-
          const int32_t old = column[j];
-         const int32_t ic = column[j - 1] + 1;
-         const int32_t dc = column[j] + 1;
-         const int32_t rc = last + (seq1[i - 1] != seq2[j - 1]);
-         column[j] = FC_MIN3(ic, dc, rc);
+         const int32_t idc = FC_MIN(column[j - 1], column[j]) + scale;
+         const int32_t rc = last + (fc_elem(seq1, i - 1, size)
+                                    != fc_elem(seq2, j - 1, size)) * scale;
+         column[j] = FC_MIN(idc, rc) - 1;
          last = old;
-
-         const int32_t lold = length[j];
-         const int32_t lic = ic == column[j] ? length[j - 1] + 1 : 0;
-         const int32_t ldc = dc == column[j] ? length[j] + 1 : 0;
-         const int32_t lrc = rc == column[j] ? llast + 1 : 0;
-         length[j] = FC_MAX3(lic, ldc, lrc);
-         llast = lold;
       }
    }
 
-   return column[len2] / (double)length[len2];
+   return FC_LALIGN_DIST(column[len2], scale)
+        / (double)FC_LALIGN_LEN(column[len2], scale);
 }
 
-double fc_nlevenshtein(enum fc_norm_method method,
-                       const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+static double fc_nlevenshtein0(int32_t *column, enum fc_norm_method method,
+                               const void *seq1, int32_t len1,
+                               const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_nlevenshtein0_body, column, method,
+                           seq1, len1, seq2, len2);
+}
+
+static double fc_nlevenshtein_elems(enum fc_norm_method method,
+                                    const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2, int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 2], *columnp = column;
+#ifdef FC_HAVE_SIMD
+   if (method == FC_NORM_LALIGN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_nlevenshtein(seq1, len1, seq2, len2, size);
+#endif
+
+   int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
 
-   if (2 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(2 * (len2 + 1) * sizeof *columnp);
+   if (len2 + 1 > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
 
-   double dist = fc_nlevenshtein0(columnp, method, seq1, len1, seq2, len2);
+   double dist = fc_nlevenshtein0(columnp, method, seq1, len1, seq2, len2, size);
 
    if (columnp != column)
       fc_free(columnp);
@@ -181,78 +249,86 @@ double fc_nlevenshtein(enum fc_norm_method method,
    return dist;
 }
 
+double fc_nlevenshtein(enum fc_norm_method method,
+                       const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2)
+{
+   return fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 /*******************************************************************************
  * Absolute Damerau distance
  ******************************************************************************/
 
-/* Like fc_damerau() but with a provided buffer for holding the matrix.
- * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold 3 * (len2 + 1) int32_ts.
- */
-static int32_t fc_damerau0(int32_t *matrix, const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+/* Same as fc_levenshtein_short(), for the Damerau distance. */
+FC_ALWAYS_INLINE int32_t fc_damerau_short(const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
+   assert(len2 > 0 && len2 <= FC_LEV_SHORT_LEN);
 
-   STRIP(seq1, seq2, len1, len2);
+   const uint64_t last = UINT64_C(1) << (len2 - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0, d0 = 0, prev_eq = 0;
+   int32_t dist = len2;
 
-   if (len2 == 0)
-      return len1;
-
-   int32_t *transpos = matrix;
-   int32_t *previous = &transpos[len2 + 1];
-   int32_t *current = &previous[len2 + 1];
-
-   for (int32_t j = 0 ; j <= len2; j++)
-      previous[j] = j;
-
-   for (int32_t i = 1 ; i <= len1; i++) {
-      current[0] = i;
-
-      for (int32_t j = 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
-            current[j] = previous[j - 1];
-         } else {
-            const int32_t ic = current[j - 1] + 1;
-            const int32_t dc = previous[j] + 1;
-            const int32_t rc = previous[j - 1] + 1;
-            current[j] = FC_MIN3(ic, dc, rc);
-
-            if (TRANSPOSED(seq1, seq2, i, j)) {
-               const int32_t tc = transpos[j - 2] + 1;
-               current[j] = FC_MIN(tc, current[j]);
-            }
-         }
-      }
-      FC_SWAP3(int32_t *, transpos, previous, current);
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t eq = fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+      d0 = (((eq & vp) + vp) ^ vp) | eq | vn | tr;
+      uint64_t hp = vn | ~(d0 | vp);
+      uint64_t hn = d0 & vp;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(d0 | hp);
+      vn = hp & d0;
+      prev_eq = eq;
    }
-
-   return previous[len2];
+   return dist;
 }
 
-int32_t fc_damerau(const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_damerau_body(const void *seq1, int32_t len1,
+                                         const void *seq2, int32_t len2,
+                                         int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
 
-   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
+   if (len2 == 0)
+      return len1;
+   if (len2 <= FC_LEV_SHORT_LEN)
+      return fc_damerau_short(seq1, len1, seq2, len2, size);
 
-   int32_t dist = fc_damerau0(columnp, seq1, len1, seq2, len2);
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
 
-   if (columnp != column)
-      fc_free(columnp);
+   int32_t dist = fc_bitpar_damerau_elems(&peq, seq1, len1, size);
 
+   fc_peq_fini(&peq);
    return dist;
 }
 
+static int32_t fc_damerau_elems(const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_damerau_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_damerau(const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_damerau_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 
 /*******************************************************************************
  * Normalized Damerau distance
@@ -260,11 +336,13 @@ int32_t fc_damerau(const char32_t *seq1, int32_t len1,
 
 /* Like fc_ndamerau() but with a provided buffer for holding the matrix.
  * "seq1" is also expected to be longer than "seq2", or have the same length.
- * The provided buffer should be big enough to hold 6 * (len2 + 1) items.
+ * The provided buffer should be big enough to hold 3 * (len2 + 1) items.
  */
-static double fc_ndamerau0(int32_t *matrix, enum fc_norm_method method,
-                           const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE double fc_ndamerau0_body(int32_t *matrix,
+                                          enum fc_norm_method method,
+                                          const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
 
@@ -272,71 +350,70 @@ static double fc_ndamerau0(int32_t *matrix, enum fc_norm_method method,
       return len1 == 0 ? 0.0 : 1.0;
 
    if (method == FC_NORM_LSEQ)
-      return (double)fc_damerau0(matrix, seq1, len1, seq2, len2) / len1;
+      return (double)fc_damerau_elems(seq1, len1, seq2, len2, size) / len1;
 
    assert(method == FC_NORM_LALIGN);
 
-   int32_t *ltranspos = matrix;
-   int32_t *lprevious = &ltranspos[len2 + 1];
-   int32_t *lcurrent = &lprevious[len2 + 1];
-   int32_t *transpos = &lcurrent[len2 + 1];
+   /* Distances and alignment lengths are packed together. */
+   const int32_t scale = FC_LALIGN_SCALE;
+
+   int32_t *transpos = matrix;
    int32_t *previous = &transpos[len2 + 1];
    int32_t *current = &previous[len2 + 1];
 
    for (int32_t j = 0 ; j <= len2; j++)
-      previous[j] = lprevious[j] = j;
+      previous[j] = FC_LALIGN_PACK(j, j, scale);
 
    for (int32_t i = 1 ; i <= len1; i++) {
-      *current = *lcurrent = i;
+      *current = FC_LALIGN_PACK(i, i, scale);
 
       for (int32_t j = 1; j <= len2; j++) {
-         const bool transposed = TRANSPOSED(seq1, seq2, i, j);
-
-         const int32_t ic = current[j - 1] + 1;
-         const int32_t dc = previous[j] + 1;
-         const int32_t rc = previous[j - 1] + (seq1[i - 1] != seq2[j - 1]);
-         current[j] = FC_MIN3(ic, dc, rc);
-
-         int32_t tc;
-         if (transposed) {
-            tc = transpos[j - 2] + 1;
-            current[j] = FC_MIN(current[j], tc);
-         }
-
-         const int32_t lic = ic == current[j] ? lcurrent[j - 1] + 1 : 0;
-         const int32_t ldc = dc == current[j] ? lprevious[j] + 1 : 0;
-         const int32_t lrc = rc == current[j] ? lprevious[j - 1] + 1 : 0;
-         lcurrent[j] = FC_MAX3(lic, ldc, lrc);
-
-         if (transposed) {
-            const int32_t ltc = tc == current[j] ? ltranspos[j - 2] + 1 : 0;
-            lcurrent[j] = FC_MAX(lcurrent[j], ltc);
-         }
+         const int32_t idc = FC_MIN(current[j - 1], previous[j]) + scale;
+         const int32_t rc = previous[j - 1] + (fc_elem(seq1, i - 1, size)
+                                               != fc_elem(seq2, j - 1, size)) * scale;
+         current[j] = FC_MIN(idc, rc);
+
+         if (TRANSPOSED_ELEMS(seq1, seq2, i, j, size))
+            current[j] = FC_MIN(current[j], transpos[j - 2] + scale);
+         current[j]--;
       }
 
       FC_SWAP3(int32_t *, transpos, previous, current);
-      FC_SWAP3(int32_t *, ltranspos, lprevious, lcurrent);
    }
 
-   return previous[len2] / (double)lprevious[len2];
+   return FC_LALIGN_DIST(previous[len2], scale)
+        / (double)FC_LALIGN_LEN(previous[len2], scale);
 }
 
-double fc_ndamerau(enum fc_norm_method method,
-                   const char32_t *seq1, int32_t len1,
-                   const char32_t *seq2, int32_t len2)
+static double fc_ndamerau0(int32_t *matrix, enum fc_norm_method method,
+                           const void *seq1, int32_t len1,
+                           const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_ndamerau0_body, matrix, method,
+                           seq1, len1, seq2, len2);
+}
+
+static double fc_ndamerau_elems(enum fc_norm_method method,
+                                const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2, int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
    }
 
-   int32_t column[FC_DEFAULT_COLUMN_LEN * 6], *columnp = column;
-   if (6 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(6 * (len2 + 1) * sizeof *columnp);
+#ifdef FC_HAVE_SIMD
+   if (method == FC_NORM_LALIGN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_ndamerau(seq1, len1, seq2, len2, size);
+#endif
+
+   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
 
-   double dist = fc_ndamerau0(columnp, method, seq1, len1, seq2, len2);
+   double dist = fc_ndamerau0(columnp, method, seq1, len1, seq2, len2, size);
 
    if (columnp != column)
       fc_free(columnp);
@@ -344,42 +421,69 @@ double fc_ndamerau(enum fc_norm_method method,
    return dist;
 }
 
+double fc_ndamerau(enum fc_norm_method method,
+                   const char32_t *seq1, int32_t len1,
+                   const char32_t *seq2, int32_t len2)
+{
+   return fc_ndamerau_elems(method, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 
 /*******************************************************************************
  * Bounded Levenshtein distance computation
  ******************************************************************************/
 
-static int32_t fc_lev_bounded0(const char32_t *seq1, int32_t len1,
-                           const char32_t *seq2, int32_t len2)
+static int32_t fc_lev_bounded0_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 == len2)
-      return memcmp(seq1, seq2, len1 * sizeof *seq1) != 0;
+      return memcmp(seq1, seq2, (size_t)len1 * size) != 0;
    return INT32_MAX;
 }
 
-int32_t fc_lev_bounded1(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+static int32_t fc_lev_bounded0(const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded0_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+FC_ALWAYS_INLINE int32_t fc_lev_bounded1_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 < len2) {
       FC_SWAP(int32_t, len1, len2);
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
    }
 
-   STRIP(seq1, seq2, len1, len2);
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
    return len1;
 }
 
+static int32_t fc_lev_bounded1_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded1_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lev_bounded1(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded1_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 /* C adaptation of:
  * http://writingarchives.sakura.ne.jp/fastcomp/#algorithm
  * This is both efficient and cheap in implementation complexity.
  * i, d, r -> insert, delete, replace.
  */
-int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_lev_bounded2_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
@@ -391,10 +495,10 @@ int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
    int32_t dist = 3;
 
    if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(const void *, seq1, seq2);
       FC_SWAP(int32_t, len1, len2);
    }
-   STRIP(seq1, seq2, len1, len2);
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
 
    const int32_t diff = len1 - len2;
    if (diff > 2)
@@ -406,7 +510,7 @@ int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
       int32_t i = 0, j = 0, cost = 0;
 
       while (i < len1 && j < len2) {
-         if (seq1[i] == seq2[j]) {
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
             i++;
             j++;
          } else {
@@ -441,63 +545,112 @@ int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
    return dist;
 }
 
+static int32_t fc_lev_bounded2_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded2_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lev_bounded2(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_lev_bounded2_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 int32_t (*const fc_lev_bounded[3])(const char32_t *, int32_t, const char32_t *, int32_t) = {
    fc_lev_bounded0,
    fc_lev_bounded1,
    fc_lev_bounded2,
 };
 
+/* Same as fc_lev_bounded, for sequences of elements of "size" bytes. */
+static int32_t (*const fc_lev_bounded_elems[3])(const void *, int32_t,
+                                                const void *, int32_t, int) = {
+   fc_lev_bounded0_elems,
+   fc_lev_bounded1_elems,
+   fc_lev_bounded2_elems,
+};
 
-/*******************************************************************************
- * Longest common substring
- ******************************************************************************/
-
-static int32_t fc_lcsubstr0(int32_t *column, const char32_t *seq1, int32_t len1,
-                        const char32_t *seq2, int32_t len2, const char32_t **pos)
+/* Ukkonen's cut-off: a cell on diagonal d = j - i can't be part of an
+ * alignment of cost <= k unless |d| + |d + len1 - len2| <= k, so only the
+ * corresponding band of each row is computed. Cells out of the band are
+ * considered to hold k + 1.
+ */
+FC_ALWAYS_INLINE int32_t fc_lev_bounded_band(int32_t *column,
+                                             const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int32_t k, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2 && len2 > 0);
 
-   memset(column, 0, len2 * sizeof *column);
+   const int32_t diff = len1 - len2;
+   const int32_t lo = -((k + diff) / 2);
+   const int32_t hi = (k - diff) / 2;
+   const int32_t inf = k + 1;
 
-   int32_t max_len = 0;
-   int32_t my_pos = INT32_MAX;
+   for (int32_t j = 0; j <= len2; j++)
+      column[j] = j <= hi ? j : inf;
 
-   for (int32_t i = 0; i < len1; i++) {
-      int32_t last = 0;
-      for (int32_t j = 0; j < len2; j++) {
+   for (int32_t i = 1; i <= len1; i++) {
+      const int32_t bot = FC_MAX(i + lo, 1);
+      const int32_t top = FC_MIN(i + hi, len2);
+      int32_t last = column[bot - 1];
+      int32_t left = inf;
+      int32_t min = inf;
+
+      if (bot == 1 && i + lo <= 0)
+         left = column[0] = i;
+
+      for (int32_t j = bot; j <= top; j++) {
          const int32_t old = column[j];
-         if (seq1[i] == seq2[j]) {
-            column[j] = last + 1;
-            if (max_len < column[j]) {
-               max_len = column[j];
-               my_pos = i;
-            }
+         if (fc_elem(seq1, i - 1, size) == fc_elem(seq2, j - 1, size)) {
+            column[j] = last;
          } else {
-            column[j] = 0;
+            const int32_t ic = left + 1;
+            const int32_t dc = column[j] + 1;
+            const int32_t rc = last + 1;
+            column[j] = FC_MIN3(ic, dc, rc);
          }
+         if (column[j] < min)
+            min = column[j];
+         left = column[j];
          last = old;
       }
+      if (min > k)
+         return INT32_MAX;
    }
 
-   if (pos)
-      *pos = max_len ? &seq1[my_pos - max_len + 1] : &seq1[len1];
-   return max_len;
+   return column[len2];
 }
 
-int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
-                            const char32_t *seq2, int32_t len2,
-                            const char32_t **pos)
+FC_ALWAYS_INLINE int32_t fc_lev_bounded_k_body(const void *seq1, int32_t len1,
+                                               const void *seq2, int32_t len2,
+                                               int32_t k, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && k >= 0);
+
+   if (k < (int32_t)FC_ARRAY_SIZE(fc_lev_bounded_elems))
+      return fc_lev_bounded_elems[k](seq1, len1, seq2, len2, size);
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   if (len1 - len2 > k)
+      return INT32_MAX;
+   if (len2 == 0)
+      return len1;
+   /* The distance can't be larger than len1. */
+   if (k > len1)
+      k = len1;
 
-   /* We don't swap the sequences here to not mess up the value assigned to
-    * the pointer *pos. This might result in a larger allocation.
-    */
    int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
    if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc(len2 * sizeof *columnp);
+      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
 
-   int32_t dist = fc_lcsubstr0(columnp, seq1, len1, seq2, len2, pos);
+   int32_t dist = fc_lev_bounded_band(columnp, seq1, len1, seq2, len2, k, size);
 
    if (columnp != column)
       fc_free(columnp);
@@ -505,157 +658,1379 @@ int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
    return dist;
 }
 
-int32_t fc_lcsubstr(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+static int32_t fc_lev_bounded_k_elems(const void *seq1, int32_t len1,
+                                      const void *seq2, int32_t len2,
+                                      int32_t k, int size)
 {
-   return fc_lcsubstr_extract(seq1, len1, seq2, len2, NULL);
+   return FC_ELEM_DISPATCH(size, fc_lev_bounded_k_body, seq1, len1, seq2, len2,
+                           k);
+}
+
+int32_t fc_lev_bounded_k(const char32_t *seq1, int32_t len1,
+                         const char32_t *seq2, int32_t len2, int32_t k)
+{
+   return fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, sizeof *seq1);
 }
 
 
 /*******************************************************************************
- * Longest common subsequence
+ * Bounded Damerau distance computation
  ******************************************************************************/
 
-static int32_t fc_lcsubseq0(int32_t *column, const char32_t *seq1, int32_t len1,
-                        const char32_t *seq2, int32_t len2)
+FC_ALWAYS_INLINE int32_t fc_dam_bounded1_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2);
-
-   if (len2 == 0)
-      return 0;
-
-   memset(column, 0, (len2 + 1) * sizeof *column);
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
 
-   for (int32_t i = 1; i <= len1; i++) {
-      int32_t last = 0;
-      for (int32_t j = 1; j <= len2; j++) {
-         const int32_t old = column[j];
-         if (seq1[i - 1] == seq2[j - 1])
-            column[j] = last + 1;
-         else if (column[j] < column[j - 1])
-            column[j] = column[j - 1];
-         last = old;
-      }
+   if (len1 < len2) {
+      FC_SWAP(int32_t, len1, len2);
+      FC_SWAP(const void *, seq1, seq2);
    }
 
-   return column[len2];
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   if (len1 == 2 && len2 == 2 && TRANSPOSED_ELEMS(seq1, seq2, 2, 2, size))
+      return 1;
+   return len1;
 }
 
-int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+static int32_t fc_dam_bounded1_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   return FC_ELEM_DISPATCH(size, fc_dam_bounded1_body, seq1, len1, seq2, len2);
+}
 
-   if (len1 < len2) {
-      FC_SWAP(const char32_t *, seq1, seq2);
-      FC_SWAP(int32_t, len1, len2);
+int32_t fc_dam_bounded1(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_dam_bounded1_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/* Same as fc_lev_bounded2(), with additional models involving transpositions
+ * (t).
+ */
+FC_ALWAYS_INLINE int32_t fc_dam_bounded2_body(const void *seq1, int32_t len1,
+                                              const void *seq2, int32_t len2,
+                                              int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   static const char *const models[3][7] = {
+      {"id", "di", "rr", "rt", "tr", "tt", NULL},
+      {"dr", "rd", "dt", "td", NULL},
+      {"dd", NULL},
+   };
+   int32_t dist = 3;
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+
+   const int32_t diff = len1 - len2;
+   if (diff > 2)
+      return INT32_MAX;
+   if (len2 == 0)
+      return len1;
+
+   for (const char *const *model = models[diff]; *model; model++) {
+      int32_t i = 0, j = 0, cost = 0;
+
+      while (i < len1 && j < len2) {
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            i++;
+            j++;
+            continue;
+         }
+         cost++;
+         if (cost > 2)
+            break;
+         switch ((*model)[cost - 1]) {
+         case 'd':
+            i++;
+            break;
+         case 'i':
+            j++;
+            break;
+         case 't':
+            if (i + 1 < len1 && j + 1 < len2
+                && TRANSPOSED_ELEMS(seq1, seq2, i + 2, j + 2, size)) {
+               i += 2;
+               j += 2;
+            } else {
+               /* Not applicable, give up on this model. */
+               cost = 3;
+               i = len1;
+            }
+            break;
+         default:
+            i++;
+            j++;
+            break;
+         }
+      }
+
+      if (cost <= 2) {
+         if (i < len1)
+            cost += len1 - i;
+         else if (j < len2)
+            cost += len2 - j;
+         if (cost < dist)
+            dist = cost;
+      }
+   }
+
+   return dist;
+}
+
+static int32_t fc_dam_bounded2_elems(const void *seq1, int32_t len1,
+                                     const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_dam_bounded2_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_dam_bounded2(const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_dam_bounded2_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+int32_t (*const fc_dam_bounded[3])(const char32_t *, int32_t, const char32_t *, int32_t) = {
+   fc_lev_bounded0,
+   fc_dam_bounded1,
+   fc_dam_bounded2,
+};
+
+/* Same as fc_dam_bounded, for sequences of elements of "size" bytes. */
+static int32_t (*const fc_dam_bounded_elems[3])(const void *, int32_t,
+                                                const void *, int32_t, int) = {
+   fc_lev_bounded0_elems,
+   fc_dam_bounded1_elems,
+   fc_dam_bounded2_elems,
+};
+
+
+/*******************************************************************************
+ * Bounded normalized distances
+ ******************************************************************************/
+
+/* Returns the largest distance "n" such that n / (double)len <= max, or -1
+ * if there is none. The division is the one done by the unbounded functions,
+ * so that both give the same results.
+ */
+static int32_t fc_budget(double max, int32_t len)
+{
+   if (max < 0)
+      return -1;
+   if (max >= 1)
+      return len;
+
+   int32_t n = (int32_t)(max * len);
+   while (n < len && (n + 1) / (double)len <= max)
+      n++;
+   while (n >= 0 && n / (double)len > max)
+      n--;
+   return n;
+}
+
+/* Computes the distance and the alignment length packed together (see
+ * FC_LALIGN_PACK()), considering only the cells of the matrix that can be on
+ * a path of cost at most "k", as fc_lev_bounded_band() does. Returns
+ * INT32_MAX as soon as all the cells of a row have a distance larger than
+ * "k". The provided buffer should be big enough to hold 3 * (len2 + 1) items.
+ */
+FC_ALWAYS_INLINE int32_t fc_lalign_band_body(int32_t *matrix, bool transpos,
+                                             const void *seq1, int32_t len1,
+                                             const void *seq2, int32_t len2,
+                                             int32_t k, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && len1 >= len2 && len2 > 0);
+   assert(len1 - len2 <= k);
+
+   const int32_t scale = FC_LALIGN_SCALE;
+   const int32_t diff = len1 - len2;
+   const int32_t lo = -((k + diff) / 2);
+   const int32_t hi = (k - diff) / 2;
+   const int32_t inf = INT32_MAX / 2;
+
+   int32_t *transposed = matrix;
+   int32_t *previous = &transposed[len2 + 1];
+   int32_t *current = &previous[len2 + 1];
+
+   for (int32_t j = 0; j <= len2; j++)
+      previous[j] = j <= hi ? FC_LALIGN_PACK(j, j, scale) : inf;
+
+   for (int32_t i = 1; i <= len1; i++) {
+      const int32_t bot = FC_MAX(i + lo, 1);
+      const int32_t top = FC_MIN(i + hi, len2);
+
+      /* Cells just outside of the band are read by the next row. */
+      current[0] = i + lo <= 0 ? FC_LALIGN_PACK(i, i, scale) : inf;
+      if (bot > 1)
+         current[bot - 1] = inf;
+      if (top < len2)
+         current[top + 1] = inf;
+
+      int32_t min = current[0];
+      for (int32_t j = bot; j <= top; j++) {
+         const int32_t idc = FC_MIN(current[j - 1], previous[j]) + scale;
+         const int32_t rc = previous[j - 1] + (fc_elem(seq1, i - 1, size)
+                                               != fc_elem(seq2, j - 1, size)) * scale;
+         int32_t v = FC_MIN(idc, rc);
+         if (transpos && TRANSPOSED_ELEMS(seq1, seq2, i, j, size))
+            v = FC_MIN(v, transposed[j - 2] + scale);
+         current[j] = --v;
+         if (v < min)
+            min = v;
+      }
+      if (FC_LALIGN_DIST(min, scale) > k)
+         return INT32_MAX;
+
+      FC_SWAP3(int32_t *, transposed, previous, current);
+   }
+
+   return previous[len2];
+}
+
+static int32_t fc_lalign_band(int32_t *matrix, bool transpos,
+                              const void *seq1, int32_t len1,
+                              const void *seq2, int32_t len2,
+                              int32_t k, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lalign_band_body, matrix, transpos,
+                           seq1, len1, seq2, len2, k);
+}
+
+/* Band computations are only worth it if the band is narrow, otherwise the
+ * bit-parallel or vectorized algorithms are faster.
+ */
+#define FC_NARROW_BAND(k, len2) (4 * (k) < (len2))
+
+/* Wrapper for fc_lalign_band(). Returns INT32_MAX if the distance is larger
+ * than "k".
+ */
+static int32_t fc_lalign_bounded(bool transpos, const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int32_t k,
+                                 int size)
+{
+   int32_t column[FC_DEFAULT_COLUMN_LEN * 3], *columnp = column;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(column))
+      columnp = fc_malloc(3 * (len2 + 1) * sizeof *columnp);
+
+   int32_t v = fc_lalign_band(columnp, transpos, seq1, len1, seq2, len2, k, size);
+   if (v != INT32_MAX && FC_LALIGN_DIST(v, FC_LALIGN_SCALE) > k)
+      v = INT32_MAX;
+
+   if (columnp != column)
+      fc_free(columnp);
+   return v;
+}
+
+static double fc_nbounded(bool transpos, enum fc_norm_method method, double max,
+                          const void *seq1, int32_t len1,
+                          const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   if (len2 == 0) {
+      const double dist = len1 == 0 ? 0.0 : 1.0;
+      return dist <= max ? dist : HUGE_VAL;
+   }
+
+   double dist;
+   if (method == FC_NORM_LSEQ) {
+      /* The distance is at least the length difference. */
+      const int32_t k = fc_budget(max, len1);
+      if (len1 - len2 > k)
+         return HUGE_VAL;
+
+      int32_t d;
+      if (!transpos)
+         d = FC_NARROW_BAND(k, len2)
+           ? fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, size)
+           : fc_levenshtein_elems(seq1, len1, seq2, len2, size);
+      else if (k < (int32_t)FC_ARRAY_SIZE(fc_dam_bounded_elems))
+         d = fc_dam_bounded_elems[k](seq1, len1, seq2, len2, size);
+      else if (FC_NARROW_BAND(k, len2))
+         d = FC_LALIGN_DIST(fc_lalign_bounded(true, seq1, len1, seq2, len2, k, size),
+                            FC_LALIGN_SCALE);
+      else
+         d = fc_damerau_elems(seq1, len1, seq2, len2, size);
+      if (d > k)
+         return HUGE_VAL;
+      dist = d / (double)len1;
+   } else {
+      assert(method == FC_NORM_LALIGN);
+      /* The alignment length is at most len1 + len2. */
+      const int32_t k = fc_budget(max, len1 + len2);
+      if (len1 - len2 > k)
+         return HUGE_VAL;
+      if (FC_NARROW_BAND(k, len2)) {
+         const int32_t v = fc_lalign_bounded(transpos, seq1, len1, seq2, len2, k,
+                                             size);
+         if (v == INT32_MAX)
+            return HUGE_VAL;
+         dist = FC_LALIGN_DIST(v, FC_LALIGN_SCALE)
+              / (double)FC_LALIGN_LEN(v, FC_LALIGN_SCALE);
+      } else if (transpos)
+         dist = fc_ndamerau_elems(method, seq1, len1, seq2, len2, size);
+      else
+         dist = fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, size);
+   }
+   return dist <= max ? dist : HUGE_VAL;
+}
+
+double fc_nlevenshtein_bounded(enum fc_norm_method method, double max,
+                               const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2)
+{
+   return fc_nbounded(false, method, max, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+double fc_ndamerau_bounded(enum fc_norm_method method, double max,
+                           const char32_t *seq1, int32_t len1,
+                           const char32_t *seq2, int32_t len2)
+{
+   return fc_nbounded(true, method, max, seq1, len1, seq2, len2, sizeof *seq1);
+
+}
+
+
+/*******************************************************************************
+ * Longest common substring
+ ******************************************************************************/
+
+FC_ALWAYS_INLINE int32_t fc_lcsubstr0_body(int32_t *column,
+                                           const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           const void **pos, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   memset(column, 0, len2 * sizeof *column);
+
+   int32_t max_len = 0;
+   int32_t my_pos = INT32_MAX;
+
+   for (int32_t i = 0; i < len1; i++) {
+      int32_t last = 0;
+      for (int32_t j = 0; j < len2; j++) {
+         const int32_t old = column[j];
+         if (fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            column[j] = last + 1;
+            if (max_len < column[j]) {
+               max_len = column[j];
+               my_pos = i;
+            }
+         } else {
+            column[j] = 0;
+         }
+         last = old;
+      }
+   }
+
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? my_pos - max_len + 1 : len1, size);
+   return max_len;
+}
+
+static int32_t fc_lcsubstr0(int32_t *column, const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, const void **pos,
+                            int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lcsubstr0_body, column, seq1, len1,
+                           seq2, len2, pos);
+}
+
+static int32_t fc_lcsubstr_sam(const struct fc_sam *sam,
+                               const void *seq1, int32_t len1,
+                               const void **pos, int size)
+{
+   int32_t end = 0;
+   const int32_t max_len = fc_sam_lcsubstr_elems(sam, seq1, len1, &end, size);
+
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
+}
+
+/* Above this length, a suffix automaton is built from "seq2" and walked with
+ * "seq1", in linear time, instead of computing the whole matrix. The
+ * vectorized kernel is fast enough to win up to fairly long sequences.
+ */
+#ifdef FC_HAVE_SIMD
+   #define FC_LCSUBSTR_SAM_MIN_LEN 1500
+#else
+   #define FC_LCSUBSTR_SAM_MIN_LEN 32
+#endif
+
+static int32_t fc_lcsubstr_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2,
+                                 const void **pos, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 >= FC_LCSUBSTR_SAM_MIN_LEN && len2 >= FC_LCSUBSTR_SAM_MIN_LEN) {
+      struct fc_sam sam;
+      fc_sam_init_elems(&sam, seq2, len2, size);
+      const int32_t max_len = fc_lcsubstr_sam(&sam, seq1, len1, pos, size);
+      fc_sam_fini(&sam);
+      return max_len;
    }
 
+#ifdef FC_HAVE_SIMD
+   /* The diagonal kernel wastes lanes if the shortest sequence doesn't fill
+    * most of a vector.
+    */
+   const int32_t shortest = FC_MIN(len1, len2);
+   if (shortest >= FC_SIMD_SHORT_LEN / 2 && shortest <= FC_SIMD_SHORT_LEN)
+      return fc_simd_lcsubstr_diagonal(seq1, len1, seq2, len2, pos, size);
+   if (len1 >= FC_SIMD_MIN_LEN && len2 >= FC_SIMD_MIN_LEN)
+      return fc_simd_lcsubstr(seq1, len1, seq2, len2, pos, size);
+#endif
+
+   /* We don't swap the sequences here to not mess up the value assigned to
+    * the pointer *pos. This might result in a larger allocation.
+    */
    int32_t column[FC_DEFAULT_COLUMN_LEN], *columnp = column;
    if (len2 >= (int32_t)FC_ARRAY_SIZE(column))
-      columnp = fc_malloc((len2 + 1) * sizeof *columnp);
+      columnp = fc_malloc(len2 * sizeof *columnp);
 
-   int32_t res = fc_lcsubseq0(columnp, seq1, len1, seq2, len2);
+   int32_t dist = fc_lcsubstr0(columnp, seq1, len1, seq2, len2, pos, size);
 
    if (columnp != column)
       fc_free(columnp);
 
-   return res;
+   return dist;
 }
 
-double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
-                    const char32_t *seq2, int32_t len2)
+int32_t fc_lcsubstr_extract(const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            const char32_t **pos)
+{
+   const void *start;
+   const int32_t max_len = fc_lcsubstr_elems(seq1, len1, seq2, len2,
+                                             pos ? &start : NULL, sizeof *seq1);
+   if (pos)
+      *pos = start;
+   return max_len;
+}
+
+int32_t fc_lcsubstr(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_lcsubstr_elems(seq1, len1, seq2, len2, NULL, sizeof *seq1);
+}
+
+void fc_lcsubstr_index_init(struct fc_lcsubstr_index *idx,
+                            const char32_t *ref, int32_t len)
+{
+   assert(IN_RANGE(len));
+
+   idx->sam = fc_malloc(sizeof *idx->sam);
+   fc_sam_init(idx->sam, ref, len);
+}
+
+void fc_lcsubstr_index_fini(struct fc_lcsubstr_index *idx)
+{
+   fc_sam_fini(idx->sam);
+   fc_free(idx->sam);
+}
+
+int32_t fc_lcsubstr_index_query(const struct fc_lcsubstr_index *idx,
+                                const char32_t *seq, int32_t len,
+                                const char32_t **pos)
+{
+   assert(len >= 0);
+
+   const void *start;
+   const int32_t max_len = fc_lcsubstr_sam(idx->sam, seq, len,
+                                           pos ? &start : NULL, sizeof *seq);
+   if (pos)
+      *pos = start;
+   return max_len;
+}
+
+
+/*******************************************************************************
+ * Longest common subsequence
+ ******************************************************************************/
+
+/* Below this length of "seq2", the bit-parallel algorithm only needs a few
+ * words per character, and is always faster than the sparse one.
+ */
+#define FC_SPARSE_MIN_LEN 256
+
+/* Estimated cost of processing a match with the sparse algorithm, relative to
+ * the cost of processing a word with the bit-parallel one, per step of binary
+ * search.
+ */
+#define FC_SPARSE_MATCH_COST 2
+
+/* Positions of each character of "seq" are gathered in lists, stored one after
+ * the other in "pos". ends[id] is the end of the list of the character whose
+ * masks are at the row "id" of "peq", and the list starts where the one of the
+ * previous row ends. "ends" must have room for rows_nr + 1 items, and must
+ * hold the number of positions of each row "id" at ends[id + 1], as set by
+ * fc_sparse_count().
+ */
+static void fc_sparse_count(const struct fc_peq *peq, const void *seq,
+                            int32_t len, int size, int32_t *ends)
+{
+   memset(ends, 0, (peq->rows_nr + 1) * sizeof *ends);
+   for (int32_t j = 0; j < len; j++)
+      ends[fc_peq_slot(peq, fc_elem(seq, j, size))->row + 1]++;
+}
+
+static void fc_sparse_lists(const struct fc_peq *peq, const void *seq,
+                            int32_t len, int size, int32_t *ends, int32_t *pos)
+{
+   for (int32_t id = 1; id <= peq->rows_nr; id++)
+      ends[id] += ends[id - 1];
+   for (int32_t j = 0; j < len; j++)
+      pos[ends[fc_peq_slot(peq, fc_elem(seq, j, size))->row]++] = j;
+}
+
+/* Whether the sparse algorithm is estimated to be faster than the
+ * bit-parallel one, given the number of matching pairs.
+ */
+static bool fc_sparse_faster(int64_t matches, int32_t len1, int32_t len2)
+{
+   int32_t log2 = 1;
+   while ((1 << log2) < len2)
+      log2++;
+   const int32_t words = (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   return matches * log2 * FC_SPARSE_MATCH_COST < (int64_t)len1 * words;
+}
+
+/* Hunt-Szymanski algorithm, which only looks at the pairs of matching
+ * characters, in O((r + n) log n) time, where "r" is the number of matches.
+ * thresh[k] is the smallest position in "seq2" where a common subsequence of
+ * length k + 1 can end. Matches of each character of "seq1", whose rows are
+ * given in "ids1", are processed from right to left, so that each can only
+ * extend subsequences that end before it. "thresh" must have room for len2
+ * items.
+ */
+static int32_t fc_sparse_run(const int32_t *ends, const int32_t *pos,
+                             const int32_t *ids1, int32_t len1, int32_t *thresh)
+{
+   int32_t lcs = 0;
+   for (int32_t i = 0; i < len1; i++) {
+      const int32_t id = ids1[i];
+      const int32_t first = id ? ends[id - 1] : 0;
+
+      for (int32_t p = ends[id] - 1; p >= first; p--) {
+         const int32_t j = pos[p];
+         int32_t lo = 0, hi = lcs;
+         while (lo < hi) {
+            const int32_t mid = (lo + hi) >> 1;
+            if (thresh[mid] < j)
+               lo = mid + 1;
+            else
+               hi = mid;
+         }
+         thresh[lo] = j;
+         if (lo == lcs)
+            lcs++;
+      }
+   }
+   return lcs;
+}
+
+/* Returns -1 if the bit-parallel algorithm is estimated to be faster, after
+ * having built the masks of "peq", which must have been initialized with
+ * fc_peq_init_slots().
+ */
+static int32_t fc_sparse_lcsubseq(struct fc_peq *peq,
+                                  const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2, int size)
+{
+   const int32_t rows_nr = peq->rows_nr;
+   int32_t *ids1 = fc_malloc((len1 + rows_nr + 1 + 2 * len2) * sizeof *ids1);
+   int32_t *ends = &ids1[len1];
+   int32_t *pos = &ends[rows_nr + 1];
+   int32_t *thresh = &pos[len2];
+
+   fc_sparse_count(peq, seq2, len2, size, ends);
+
+   int64_t matches = 0;
+   for (int32_t i = 0; i < len1; i++) {
+      ids1[i] = fc_peq_slot(peq, fc_elem(seq1, i, size))->row;
+      matches += ends[ids1[i] + 1];
+   }
+   if (!fc_sparse_faster(matches, len1, len2)) {
+      fc_free(ids1);
+      fc_peq_init_rows_elems(peq, seq2, size);
+      return -1;
+   }
+
+   fc_sparse_lists(peq, seq2, len2, size, ends, pos);
+   const int32_t lcs = fc_sparse_run(ends, pos, ids1, len1, thresh);
+
+   fc_free(ids1);
+   return lcs;
+}
+
+/* Same as FC_LEV_SHORT_LEN, for the longest common subsequence, whose loop
+ * is cheaper, so that the masks are worth hashing from shorter lengths.
+ */
+#define FC_LCS_SHORT_LEN 16
+
+FC_ALWAYS_INLINE int32_t fc_lcsubseq_short(const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           int size)
+{
+   assert(len2 > 0 && len2 <= FC_LCS_SHORT_LEN);
+
+   uint64_t s = ~UINT64_C(0);
+   for (int32_t i = 0; i < len1; i++) {
+      const uint64_t u = s & fc_short_eq(seq2, len2, fc_elem(seq1, i, size), size);
+      s = (s + u) | (s - u);
+   }
+   return fc_popcount(~s & (~UINT64_C(0) >> (FC_WORD_BITS - len2)));
+}
+
+FC_ALWAYS_INLINE int32_t fc_lcsubseq_body(const void *seq1, int32_t len1,
+                                          const void *seq2, int32_t len2,
+                                          int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   /* Common prefixes and suffixes are necessarily part of a longest common
+    * subsequence.
+    */
+   const int32_t orig_len2 = len2;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   const int32_t stripped = orig_len2 - len2;
+
+   if (len2 == 0)
+      return stripped;
+   if (len2 <= FC_LCS_SHORT_LEN)
+      return stripped + fc_lcsubseq_short(seq1, len1, seq2, len2, size);
+
+   struct fc_peq peq;
+   int32_t lcs = -1;
+
+   if (len2 >= FC_SPARSE_MIN_LEN) {
+      fc_peq_init_slots_elems(&peq, seq2, len2, size);
+      lcs = fc_sparse_lcsubseq(&peq, seq1, len1, seq2, len2, size);
+   } else {
+      fc_peq_init_elems(&peq, seq2, len2, size);
+   }
+   if (lcs < 0)
+      lcs = fc_bitpar_lcsubseq_bounded_elems(&peq, seq1, len1, 0, size);
+
+   fc_peq_fini(&peq);
+   return stripped + lcs;
+}
+
+static int32_t fc_lcsubseq_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_lcsubseq_body, seq1, len1, seq2, len2);
+}
+
+int32_t fc_lcsubseq(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_lcsubseq_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+static double fc_nlcsubseq_elems(const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
 {
    assert(IN_RANGE(len1) && IN_RANGE(len2));
 
    if (len1 == 0 && len2 == 0)
       return 1.;
 
-   const int32_t lcs = fc_lcsubseq(seq1, len1, seq2, len2);
+   const int32_t lcs = fc_lcsubseq_elems(seq1, len1, seq2, len2, size);
    return 1. - (2. * lcs) / (double)(len1 + len2);
 }
 
+double fc_nlcsubseq(const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_nlcsubseq_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+FC_ALWAYS_INLINE double fc_nlcsubseq_bounded_body(double max,
+                                                  const void *seq1, int32_t len1,
+                                                  const void *seq2, int32_t len2,
+                                                  int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   if (len1 == 0 && len2 == 0)
+      return 1. <= max ? 1. : HUGE_VAL;
+   if (len1 < len2) {
+      FC_SWAP(const void *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   /* Find the shortest subsequence length that gives a distance within the
+    * bound. The subsequence can't be longer than the shortest sequence.
+    */
+   const double total = len1 + len2;
+   if (max < 0 || 1. - (2. * len2) / total > max)
+      return HUGE_VAL;
+   int32_t min = max >= 1 ? 0 : (int32_t)((1. - max) * total / 2.);
+   while (min > 0 && 1. - (2. * (min - 1)) / total <= max)
+      min--;
+   while (1. - (2. * min) / total > max)
+      min++;
+
+   const int32_t orig_len2 = len2;
+   STRIP_ELEMS(seq1, seq2, len1, len2, size);
+   const int32_t stripped = orig_len2 - len2;
+
+   int32_t lcs = stripped;
+   if (len2) {
+      struct fc_peq peq;
+      fc_peq_init_elems(&peq, seq2, len2, size);
+      const int32_t ret = fc_bitpar_lcsubseq_bounded_elems(&peq, seq1, len1,
+                                                           min - stripped, size);
+      fc_peq_fini(&peq);
+      if (ret < 0)
+         return HUGE_VAL;
+      lcs += ret;
+   }
+   if (lcs < min)
+      return HUGE_VAL;
+   return 1. - (2. * lcs) / total;
+}
+
+static double fc_nlcsubseq_bounded_elems(double max,
+                                         const void *seq1, int32_t len1,
+                                         const void *seq2, int32_t len2,
+                                         int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_nlcsubseq_bounded_body, max,
+                           seq1, len1, seq2, len2);
+}
+
+double fc_nlcsubseq_bounded(double max, const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2)
+{
+   return fc_nlcsubseq_bounded_elems(max, seq1, len1, seq2, len2, sizeof *seq1);
+}
+
 
 /*******************************************************************************
  * Jaro
  ******************************************************************************/
 
-/* Could be made to use less space by allocating an array of chars, (like
- * Winkler_1994.c does) and only allocating the space needed to hold the longest
- * sequence. Sequences would be made distinguishable by the use of a special
- * mask. But it's not worth it. Better stay consistent with the rest of the
- * implementation and allocate an array of int32_ts. Also, the space overhead is
- * negligible anyway (in comparison to the metrics that use a full matrix), and
- * the maximum length of a sequence is expected to be low.
+/* Jaro distance, given the number of matching characters and the number of
+ * half-transpositions between them.
  */
-static double fc_jaro0(int32_t *matched1, const char32_t *seq1, int32_t len1,
-                       const char32_t *seq2, int32_t len2)
+static double fc_jaro_dist(int32_t matches, int32_t transpos,
+                           int32_t len1, int32_t len2)
 {
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   if (!matches)
+      return len1 || len2 ? 1. : 0.;
+
+   transpos >>= 1;
+   return 1. - (1. / 3. * (  matches / (double)len1
+                           + matches / (double)len2
+                           + (matches - transpos) / (double)matches));
+}
+
+/* Characters of "seq1" and "seq2" that are matched are flagged in bit-vectors.
+ * The first character of "seq2" in the window of a character of "seq1" that is
+ * equal to it and not matched yet is found by masking the pattern-match mask
+ * of this character with the complement of the flags and the window, and
+ * isolating the lowest set bit. Transpositions are then counted by walking
+ * the set bits of both flag vectors in parallel.
+ *
+ * If fewer than "min_matches" characters match, HUGE_VAL is returned as soon
+ * as this is known, and transpositions are not counted.
+ */
+FC_ALWAYS_INLINE double fc_jaro0_body(const struct fc_peq *peq,
+                                      const void *seq1, int32_t len1,
+                                      const void *seq2, int32_t len2,
+                                      int32_t min_matches, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && peq->len == len2);
+
+   if (len1 == 0 || len2 == 0)
+      return min_matches > 0 ? HUGE_VAL : fc_jaro_dist(0, 0, len1, len2);
+
+   const int32_t words1 = (len1 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   const int32_t words2 = (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS;
+   uint64_t matched1[FC_MAX_WORDS], matched2[FC_MAX_WORDS];
+
+   memset(matched1, 0, words1 * sizeof *matched1);
+   memset(matched2, 0, words2 * sizeof *matched2);
+
+   int32_t window = (FC_MAX(len1, len2) >> 1) - 1;
+   if (window < 0)
+      window = 0;
+
+   int32_t matches = 0;
+   const int32_t end1 = FC_MIN(len1, len2 + window);
+
+   for (int32_t i = 0; i < end1; i++) {
+      if (matches + end1 - i < min_matches)
+         return HUGE_VAL;
+
+      const int32_t bot = FC_MAX(i - window, 0);
+      const int32_t top = FC_MIN(i + window + 1, len2) - 1;
+      const int32_t first = bot / FC_WORD_BITS, last = top / FC_WORD_BITS;
+      const uint64_t *eqs = fc_peq_get(peq, fc_elem(seq1, i, size));
+
+      for (int32_t w = first; w <= last; w++) {
+         uint64_t m = eqs[w] & ~matched2[w];
+         if (w == first)
+            m &= ~UINT64_C(0) << (bot % FC_WORD_BITS);
+         if (w == last)
+            m &= ~UINT64_C(0) >> (FC_WORD_BITS - 1 - top % FC_WORD_BITS);
+         if (m) {
+            matched2[w] |= m & -m;
+            matched1[i / FC_WORD_BITS] |= UINT64_C(1) << (i % FC_WORD_BITS);
+            matches++;
+            break;
+         }
+      }
+   }
+   if (matches < min_matches)
+      return HUGE_VAL;
+   if (!matches)
+      return fc_jaro_dist(0, 0, len1, len2);
+
+   int32_t transpos = 0, w2 = 0;
+   uint64_t m2 = matched2[0];
+
+   for (int32_t w1 = 0; w1 < words1; w1++) {
+      for (uint64_t m1 = matched1[w1]; m1; m1 &= m1 - 1) {
+         while (!m2)
+            m2 = matched2[++w2];
+         const int32_t i = w1 * FC_WORD_BITS + fc_ctz(m1);
+         const int32_t j = w2 * FC_WORD_BITS + fc_ctz(m2);
+         transpos += fc_elem(seq1, i, size) != fc_elem(seq2, j, size);
+         m2 &= m2 - 1;
+      }
+   }
+   return fc_jaro_dist(matches, transpos, len1, len2);
+}
 
-   memset(matched1, 0, (len1 + len2) * sizeof *matched1);
+static double fc_jaro0(const struct fc_peq *peq, const void *seq1, int32_t len1,
+                       const void *seq2, int32_t len2, int32_t min_matches,
+                       int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_jaro0_body, peq, seq1, len1, seq2, len2,
+                           min_matches);
+}
+
+/* Below this length, building the pattern-match masks costs more than it
+ * saves, and windows are scanned directly.
+ */
+#define FC_JARO_PEQ_MIN_LEN 16
+
+FC_ALWAYS_INLINE double fc_jaro_short_body(const void *seq1, int32_t len1,
+                                           const void *seq2, int32_t len2,
+                                           int32_t min_matches, int size)
+{
+   assert(len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN);
 
    int32_t window = (FC_MAX(len1, len2) >> 1) - 1;
    if (window < 0)
       window = 0;
 
+   uint32_t matched1 = 0, matched2 = 0;
    int32_t matches = 0;
-   int32_t *matched2 = &matched1[len1];
 
-   for (int32_t i = 0; i < len1; i++) {
-      int32_t bot = i - window;
-      if (bot < 0)
-         bot = 0;
-      int32_t top = i + window + 1;
-      if (top > len2)
-         top = len2;
+   for (int32_t i = 0; i < len1; i++) {
+      if (matches + len1 - i < min_matches)
+         return HUGE_VAL;
+
+      const int32_t bot = FC_MAX(i - window, 0);
+      const int32_t top = FC_MIN(i + window + 1, len2);
+
+      for (int32_t j = bot; j < top; j++) {
+         if (!(matched2 >> j & 1)
+             && fc_elem(seq1, i, size) == fc_elem(seq2, j, size)) {
+            matched1 |= UINT32_C(1) << i;
+            matched2 |= UINT32_C(1) << j;
+            matches++;
+            break;
+         }
+      }
+   }
+   if (matches < min_matches)
+      return HUGE_VAL;
+
+   int32_t transpos = 0;
+   for (; matched1; matched1 &= matched1 - 1, matched2 &= matched2 - 1)
+      transpos += fc_elem(seq1, fc_ctz(matched1), size)
+                  != fc_elem(seq2, fc_ctz(matched2), size);
+
+   return fc_jaro_dist(matches, transpos, len1, len2);
+}
+
+static double fc_jaro_short(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2,
+                            int32_t min_matches, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_jaro_short_body, seq1, len1, seq2, len2,
+                           min_matches);
+}
+
+static double fc_jaro_bounded0(const void *seq1, int32_t len1,
+                               const void *seq2, int32_t len2,
+                               int32_t min_matches, int size)
+{
+   if (len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+      return fc_jaro_short(seq1, len1, seq2, len2, min_matches, size);
+
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
+
+   double dist = fc_jaro0(&peq, seq1, len1, seq2, len2, min_matches, size);
+
+   fc_peq_fini(&peq);
+   return dist;
+}
+
+static double fc_jaro_elems(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   return fc_jaro_bounded0(seq1, len1, seq2, len2, 0, size);
+}
+
+double fc_jaro(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
+{
+   return fc_jaro_elems(seq1, len1, seq2, len2, sizeof *seq1);
+}
+
+/* Factor by which the Jaro distance is multiplied to obtain the Jaro-Winkler
+ * distance.
+ */
+static double fc_winkler_factor(const void *seq1, int32_t len1,
+                                const void *seq2, int32_t len2,
+                                double prefix_scale, int32_t max_prefix,
+                                int size)
+{
+   assert(prefix_scale >= 0 && max_prefix >= 0 && prefix_scale * max_prefix <= 1);
+
+   const int32_t max = FC_MIN(max_prefix, FC_MIN(len1, len2));
+   int32_t prefix = 0;
+
+   while (prefix < max
+          && fc_elem(seq1, prefix, size) == fc_elem(seq2, prefix, size))
+      prefix++;
+   return 1. - prefix * prefix_scale;
+}
+
+static double fc_jaro_winkler_elems(const void *seq1, int32_t len1,
+                                    const void *seq2, int32_t len2,
+                                    double prefix_scale, int32_t max_prefix,
+                                    int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   const double factor = fc_winkler_factor(seq1, len1, seq2, len2,
+                                           prefix_scale, max_prefix, size);
+   return factor * fc_jaro_elems(seq1, len1, seq2, len2, size);
+}
+
+double fc_jaro_winkler(const char32_t *seq1, int32_t len1,
+                       const char32_t *seq2, int32_t len2,
+                       double prefix_scale, int32_t max_prefix)
+{
+   return fc_jaro_winkler_elems(seq1, len1, seq2, len2, prefix_scale,
+                                max_prefix, sizeof *seq1);
+}
+
+/* Whether "matches" characters can give a Jaro-Winkler distance that is not
+ * larger than "max".
+ */
+static bool fc_jaro_winkler_within(int32_t matches, double factor,
+                                   int32_t len1, int32_t len2, double max)
+{
+   return factor * fc_jaro_dist(matches, 0, len1, len2) <= max;
+}
+
+/* The Jaro distance can't be lower than when all matching characters are in
+ * order, and it decreases with the number of matches, so we look for the
+ * smallest number of matches that could give a distance within the bound.
+ * If this is larger than the shortest sequence, the pair is rejected without
+ * looking at it. Otherwise, matching stops as soon as not enough characters
+ * remain, and transpositions are only counted if enough characters matched.
+ */
+static double fc_jaro_winkler_bounded_elems(const void *seq1, int32_t len1,
+                                            const void *seq2, int32_t len2,
+                                            double prefix_scale,
+                                            int32_t max_prefix, double max,
+                                            int size)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   const double factor = fc_winkler_factor(seq1, len1, seq2, len2,
+                                           prefix_scale, max_prefix, size);
+
+   /* Smallest number of matches giving a distance within the bound. */
+   const int32_t len = FC_MIN(len1, len2);
+   if (!fc_jaro_winkler_within(len, factor, len1, len2, max))
+      return HUGE_VAL;
+
+   int32_t min = 0;
+   if (len && factor > 0) {
+      const double sim = 3. * (1. - max / factor) - 1.;
+      if (sim > 0)
+         min = FC_MIN((int32_t)(sim * len1 * len2 / (len1 + len2)), len);
+   }
+   while (min > 0 && fc_jaro_winkler_within(min - 1, factor, len1, len2, max))
+      min--;
+   while (!fc_jaro_winkler_within(min, factor, len1, len2, max))
+      min++;
+
+   const double dist = fc_jaro_bounded0(seq1, len1, seq2, len2, min, size);
+   if (dist == HUGE_VAL)
+      return HUGE_VAL;
+   return factor * dist <= max ? factor * dist : HUGE_VAL;
+}
+
+double fc_jaro_winkler_bounded(const char32_t *seq1, int32_t len1,
+                               const char32_t *seq2, int32_t len2,
+                               double prefix_scale, int32_t max_prefix,
+                               double max)
+{
+   return fc_jaro_winkler_bounded_elems(seq1, len1, seq2, len2, prefix_scale,
+                                        max_prefix, max, sizeof *seq1);
+}
+
+
+/*******************************************************************************
+ * Weighted distances
+ ******************************************************************************/
+
+struct fc_sub_slot {
+   char32_t c1, c2;
+   int32_t cost;        /* Negative if the slot is free. */
+};
+
+/* A character replaced by some substitution of the table, with a Bloom filter
+ * of the characters that replace it, so that most cells of a row don't need
+ * a lookup.
+ */
+struct fc_sub_first {
+   char32_t c1;
+   uint64_t seconds;    /* Zero if the slot is free. */
+};
+
+/* Open-addressing hash tables of the substitutions with a specific cost, and
+ * of the characters they replace. Both have the same number of slots.
+ */
+struct fc_sub_table {
+   uint32_t mask;       /* Number of slots minus one. */
+   int shift;           /* For reducing hash values. */
+   struct fc_sub_first *firsts;
+   struct fc_sub_slot *slots;
+};
+
+static inline uint64_t fc_sub_bit(char32_t c)
+{
+   return UINT64_C(1) << (((uint32_t)c * UINT32_C(0x9E3779B1)) >> 26);
+}
+
+/* Returns the slot of a character, or the free slot where it should be
+ * inserted.
+ */
+static inline struct fc_sub_first *fc_sub_first(const struct fc_sub_table *table,
+                                                char32_t c1)
+{
+   uint32_t i = ((uint32_t)c1 * UINT32_C(0x9E3779B1)) >> table->shift;
+
+   for (;;) {
+      struct fc_sub_first *first = &table->firsts[i];
+      if (!first->seconds || first->c1 == c1)
+         return first;
+      i = (i + 1) & table->mask;
+   }
+}
+
+/* Same as above, for a pair. */
+static inline struct fc_sub_slot *fc_sub_slot(const struct fc_sub_table *table,
+                                              char32_t c1, char32_t c2)
+{
+   const uint32_t h = ((uint32_t)c1 * UINT32_C(0x9E3779B1)) ^ (uint32_t)c2;
+   uint32_t i = (h * UINT32_C(0x85EBCA77)) >> table->shift;
+
+   for (;;) {
+      struct fc_sub_slot *slot = &table->slots[i];
+      if (slot->cost < 0 || (slot->c1 == c1 && slot->c2 == c2))
+         return slot;
+      i = (i + 1) & table->mask;
+   }
+}
+
+/* Returns the Bloom filter of the characters that replace "c1" with a specific
+ * cost, which is zero if there are none, or if there is no table.
+ */
+static inline uint64_t fc_sub_seconds(const struct fc_costs *costs, char32_t c1)
+{
+   return costs->table ? fc_sub_first(costs->table, c1)->seconds : 0;
+}
+
+/* Returns the cost of substituting "c2" for "c1", which must differ.
+ * "seconds" is the result of fc_sub_seconds() for "c1".
+ */
+static inline int32_t fc_sub_cost(const struct fc_costs *costs, uint64_t seconds,
+                                  char32_t c1, char32_t c2)
+{
+   if (seconds & fc_sub_bit(c2)) {
+      const struct fc_sub_slot *slot = fc_sub_slot(costs->table, c1, c2);
+      if (slot->cost >= 0)
+         return slot->cost;
+   }
+   return costs->sub;
+}
+
+void fc_costs_init(struct fc_costs *costs, int32_t ins, int32_t del,
+                   int32_t sub, int32_t transpose,
+                   const struct fc_sub_cost *subs, size_t nr)
+{
+   assert(ins >= 0 && ins <= FC_MAX_COST && del >= 0 && del <= FC_MAX_COST);
+   assert(sub >= 0 && sub <= FC_MAX_COST);
+   assert(transpose >= 0 && transpose <= FC_MAX_COST);
+   assert(nr <= INT32_MAX / 2);
+
+   costs->ins = ins;
+   costs->del = del;
+   costs->sub = sub;
+   costs->transpose = transpose;
+   costs->table = NULL;
+   if (!nr)
+      return;
+
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * nr) {
+      slots_nr <<= 1;
+      shift--;
+   }
+
+   /* Slots are allocated together with the table. */
+   struct fc_sub_table *table = fc_malloc(sizeof *table
+                                          + slots_nr * sizeof *table->firsts
+                                          + slots_nr * sizeof *table->slots);
+   table->mask = slots_nr - 1;
+   table->shift = shift;
+   table->firsts = (struct fc_sub_first *)&table[1];
+   table->slots = (struct fc_sub_slot *)&table->firsts[slots_nr];
+   for (uint32_t i = 0; i < slots_nr; i++) {
+      table->firsts[i].seconds = 0;
+      table->slots[i].cost = -1;
+   }
+
+   for (size_t i = 0; i < nr; i++) {
+      assert(subs[i].cost >= 0 && subs[i].cost <= FC_MAX_COST);
+      struct fc_sub_slot *slot = fc_sub_slot(table, subs[i].c1, subs[i].c2);
+      *slot = (struct fc_sub_slot){subs[i].c1, subs[i].c2, subs[i].cost};
+      struct fc_sub_first *first = fc_sub_first(table, subs[i].c1);
+      first->c1 = subs[i].c1;
+      first->seconds |= fc_sub_bit(subs[i].c2);
+   }
+   costs->table = table;
+}
+
+void fc_costs_fini(struct fc_costs *costs)
+{
+   fc_free(costs->table);
+}
+
+/* Lower bound of the distance, from the difference of lengths. */
+static int32_t fc_costs_min(const struct fc_costs *costs,
+                            int32_t len1, int32_t len2)
+{
+   return len1 > len2 ? (len1 - len2) * costs->del : (len2 - len1) * costs->ins;
+}
+
+/* Computes the matrix row by row, the rows being as long as "seq2", which is
+ * not necessarily the shortest sequence, since insertions and deletions can
+ * cost differently. "table" tells whether costs->table must be looked up.
+ * Returns INT32_MAX as soon as no cell of the next rows can be within "max".
+ * Transpositions jump over a row, so this depends on the last two rows.
+ * The provided buffer should be big enough to hold 3 * (len2 + 1) items.
+ */
+FC_ALWAYS_INLINE int32_t fc_wdistance0(int32_t *matrix,
+                                       const struct fc_costs *costs,
+                                       const char32_t *seq1, int32_t len1,
+                                       const char32_t *seq2, int32_t len2,
+                                       int32_t max, bool transpos, bool table)
+{
+   const int32_t ins = costs->ins, del = costs->del, sub = costs->sub;
+
+   int32_t *transp = matrix;
+   int32_t *previous = &transp[len2 + 1];
+   int32_t *current = &previous[len2 + 1];
+
+   for (int32_t j = 0; j <= len2; j++)
+      previous[j] = j * ins;
+
+   int32_t previous_min = 0;
+   for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = seq1[i - 1];
+      const uint64_t seconds = table ? fc_sub_seconds(costs, c) : 0;
+      int32_t min = *current = i * del;
+
+      for (int32_t j = 1; j <= len2; j++) {
+         int32_t v = FC_MIN(current[j - 1] + ins, previous[j] + del);
+         if (c == seq2[j - 1]) {
+            v = FC_MIN(v, previous[j - 1]);
+         } else {
+            const int32_t sc = table ? fc_sub_cost(costs, seconds, c, seq2[j - 1]) : sub;
+            v = FC_MIN(v, previous[j - 1] + sc);
+            if (transpos && TRANSPOSED(seq1, seq2, i, j))
+               v = FC_MIN(v, transp[j - 2] + costs->transpose);
+         }
+         current[j] = v;
+         min = FC_MIN(min, v);
+      }
+      if (min > max && (!transpos || previous_min + costs->transpose > max))
+         return INT32_MAX;
+      previous_min = min;
+
+      if (transpos)
+         FC_SWAP3(int32_t *, transp, previous, current);
+      else
+         FC_SWAP(int32_t *, previous, current);
+   }
+   return previous[len2];
+}
+
+static int32_t fc_wdistance_const(int32_t *matrix, const struct fc_costs *costs,
+                                  const char32_t *seq1, int32_t len1,
+                                  const char32_t *seq2, int32_t len2,
+                                  int32_t max, bool transpos)
+{
+   if (transpos)
+      return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, true, false);
+   return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, false, false);
+}
+
+static int32_t fc_wdistance_table(int32_t *matrix, const struct fc_costs *costs,
+                                  const char32_t *seq1, int32_t len1,
+                                  const char32_t *seq2, int32_t len2,
+                                  int32_t max, bool transpos)
+{
+   if (transpos)
+      return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, true, true);
+   return fc_wdistance0(matrix, costs, seq1, len1, seq2, len2, max, false, true);
+}
+
+/* When all operations have the same cost "w", the distance is "w" times the
+ * unit-cost one, which is computed with the usual functions. A transposition
+ * that costs as much as two substitutions is never useful.
+ */
+static int32_t fc_wdistance_uniform(int32_t w, const char32_t *seq1, int32_t len1,
+                                    const char32_t *seq2, int32_t len2,
+                                    int32_t max, bool transpos)
+{
+   if (w == 0)
+      return 0;
 
-      for (int32_t j = bot; j < top; j++) {
-         if (!matched2[j] && seq1[i] == seq2[j]) {
-            matched1[i] = matched2[j] = 1;
-            matches++;
-            break;
-         }
-      }
+   const int32_t k = max / w;
+   int32_t dist;
+   if (!transpos) {
+      dist = k < len1 + len2 ? fc_lev_bounded_k(seq1, len1, seq2, len2, k)
+                             : fc_levenshtein(seq1, len1, seq2, len2);
+   } else if (k < (int32_t)FC_ARRAY_SIZE(fc_dam_bounded)) {
+      dist = fc_dam_bounded[k](seq1, len1, seq2, len2);
+   } else {
+      dist = fc_damerau(seq1, len1, seq2, len2);
    }
-   if (!matches)
-      return 0.;
+   return dist > k ? INT32_MAX : dist * w;
+}
 
-   int32_t transpos = 0, k = 0;
+static int32_t fc_wdistance(const struct fc_costs *costs,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2,
+                            int32_t max, bool transpos)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && max >= 0);
+
+   const int32_t w = costs->sub;
+   if (!costs->table && costs->ins == w && costs->del == w) {
+      if (!transpos || costs->transpose == w)
+         return fc_wdistance_uniform(w, seq1, len1, seq2, len2, max, transpos);
+      if (costs->transpose >= 2 * w)
+         return fc_wdistance_uniform(w, seq1, len1, seq2, len2, max, false);
+   }
 
-   for (int32_t i = 0; i < len1; i++) {
-      if (matched1[i]) {
-         int32_t j;
-         for (j = k; j < len2; j++) {
-            if (matched2[j]) {
-               k = j + 1;
-               break;
-            }
-         }
-         if (seq1[i] != seq2[j])
-            transpos++;
-      }
+   /* Matching characters cost nothing, and insertions and deletions cost the
+    * same whatever the character, so the common prefix and suffix can be
+    * skipped as usual.
+    */
+   while (len1 && len2 && *seq1 == *seq2) {
+      seq1++;
+      seq2++;
+      len1--;
+      len2--;
+   }
+   while (len1 && len2 && seq1[len1 - 1] == seq2[len2 - 1]) {
+      len1--;
+      len2--;
    }
 
-   transpos >>= 1;
-   return 1. - (1. / 3. * (  matches / (double)len1
-                           + matches / (double)len2
-                           + (matches - transpos) / (double)matches));
-}
+   if (fc_costs_min(costs, len1, len2) > max)
+      return INT32_MAX;
+   if (len1 == 0 || len2 == 0)
+      return fc_costs_min(costs, len1, len2);
 
-double fc_jaro(const char32_t *seq1, int32_t len1, const char32_t *seq2, int32_t len2)
-{
-   assert(IN_RANGE(len1) && IN_RANGE(len2));
+   int32_t matrix[FC_DEFAULT_COLUMN_LEN * 3], *matrixp = matrix;
+   if (3 * (len2 + 1) > (int32_t)FC_ARRAY_SIZE(matrix))
+      matrixp = fc_malloc(3 * (len2 + 1) * sizeof *matrixp);
+
+   int32_t dist;
+   if (costs->table)
+      dist = fc_wdistance_table(matrixp, costs, seq1, len1, seq2, len2, max, transpos);
+   else
+      dist = fc_wdistance_const(matrixp, costs, seq1, len1, seq2, len2, max, transpos);
+
+   if (matrixp != matrix)
+      fc_free(matrixp);
 
-   int32_t buf[FC_DEFAULT_COLUMN_LEN * 2], *bufp = buf;
+   return dist > max ? INT32_MAX : dist;
+}
 
-   if (len1 + len2 > (int32_t)FC_ARRAY_SIZE(buf))
-      bufp = fc_malloc((len1 + len2) * sizeof *bufp);
+int32_t fc_wlevenshtein(const struct fc_costs *costs,
+                        const char32_t *seq1, int32_t len1,
+                        const char32_t *seq2, int32_t len2)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, INT32_MAX, false);
+}
 
-   double dist = fc_jaro0(bufp, seq1, len1, seq2, len2);
+int32_t fc_wdamerau(const struct fc_costs *costs,
+                    const char32_t *seq1, int32_t len1,
+                    const char32_t *seq2, int32_t len2)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, INT32_MAX, true);
+}
 
-   if (bufp != buf)
-      fc_free(bufp);
+int32_t fc_wlevenshtein_bounded(const struct fc_costs *costs,
+                                const char32_t *seq1, int32_t len1,
+                                const char32_t *seq2, int32_t len2, int32_t max)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, max, false);
+}
 
-   return dist;
+int32_t fc_wdamerau_bounded(const struct fc_costs *costs,
+                            const char32_t *seq1, int32_t len1,
+                            const char32_t *seq2, int32_t len2, int32_t max)
+{
+   return fc_wdistance(costs, seq1, len1, seq2, len2, max, true);
 }
 
 
@@ -680,6 +2055,8 @@ void fc_memo_init(struct fc_memo *ctx, enum fc_metric metric, int32_t max_len,
 
    ctx->seq1 = NULL;
    ctx->len1 = 0;
+   ctx->elem_size = sizeof(char32_t);
+   ctx->costs = NULL;
 
    switch (metric) {
 
@@ -691,11 +2068,7 @@ void fc_memo_init(struct fc_memo *ctx, enum fc_metric metric, int32_t max_len,
       /* Full matrix. */
       ctx->seq2 = fc_malloc(max_len * sizeof *ctx->seq2 + sizeof(int32_t[ctx->mdim][ctx->mdim]));
       ctx->matrix = ctx->seq2 + max_len;
-      int32_t (*matrix)[ctx->mdim] = ctx->matrix;
-      for (int32_t i = 0; i < ctx->mdim; i++)
-         matrix[i][0] = i;
-      for (int32_t j = 1; j < ctx->mdim; j++)
-         matrix[0][j] = j;
+      fc_memo_set_costs(ctx, NULL);
       break;
    }
    case FC_LCSUBSTR: {
@@ -739,34 +2112,78 @@ enum fc_metric fc_memo_metric(const struct fc_memo *ctx)
    fc_fatal("object not properly initialized");
 }
 
-void fc_memo_set_ref(struct fc_memo *ctx,
-                            const char32_t *seq1, int32_t len1)
+static void fc_memo_set_ref_elems(struct fc_memo *ctx, const void *seq1,
+                                  int32_t len1, int size)
 {
    ctx->seq1 = seq1;
    ctx->len1 = len1;
    ctx->len2 = 0;
+   ctx->elem_size = size;
 }
 
-int32_t fc_memo_lcsubstr(struct fc_memo *ctx, const char32_t *seq2, int32_t len2)
+void fc_memo_set_ref(struct fc_memo *ctx,
+                            const char32_t *seq1, int32_t len1)
 {
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->compute == fc_memo_lcsubstr);
+   fc_memo_set_ref_elems(ctx, seq1, len1, sizeof *seq1);
+}
 
-   const char32_t *seq1 = ctx->seq1;
-   const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
+void fc_memo_set_costs(struct fc_memo *ctx, const struct fc_costs *costs)
+{
+   assert(ctx->compute == fc_memo_levenshtein || ctx->compute == fc_memo_damerau);
+
+   ctx->costs = costs;
+   /* The first row and column depend on the costs, and the rest of the matrix
+    * must be recomputed.
+    */
    int32_t (*matrix)[ctx->mdim] = ctx->matrix;
-   const int32_t max_lens = ctx->mdim;
+   for (int32_t i = 0; i < ctx->mdim; i++)
+      matrix[i][0] = costs ? i * costs->del : i;
+   for (int32_t j = 1; j < ctx->mdim; j++)
+      matrix[0][j] = costs ? j * costs->ins : j;
+   ctx->len2 = 0;
+}
 
+/* Returns the length of the common prefix of "seq2" and of the previous
+ * sequence.
+ */
+FC_ALWAYS_INLINE int32_t fc_memo_skip(const struct fc_memo *ctx,
+                                      const void *seq2, int32_t len2, int size)
+{
    int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
+   while (skip < min_len2
+          && fc_elem(ctx->seq2, skip, size) == fc_elem(seq2, skip, size))
       skip++;
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
+   return skip;
+}
+
+/* Replaces the previous sequence with "seq2", past their common prefix. */
+FC_ALWAYS_INLINE void fc_memo_save(struct fc_memo *ctx, const void *seq2,
+                                   int32_t len2, int32_t skip, int size)
+{
+   memcpy((char *)ctx->seq2 + (size_t)skip * size, fc_elem_ptr(seq2, skip, size),
+          (size_t)(len2 - skip) * size);
    ctx->len2 = len2;
+}
+
+FC_ALWAYS_INLINE int32_t fc_memo_lcsubstr_body(struct fc_memo *ctx,
+                                               const void *seq2, int32_t len2,
+                                               int size)
+{
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
+
+   const void *seq1 = ctx->seq1;
+   const int32_t len1 = ctx->len1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+   const int32_t max_lens = ctx->mdim;
+
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
+   fc_memo_save(ctx, seq2, len2, skip, size);
 
    int32_t max_len = matrix[max_lens][skip];
    for (int32_t i = skip + 1; i <= len2; i++) {
+      const char32_t c = fc_elem(seq2, i - 1, size);
       for (int32_t j = 1; j <= len1; j++) {
-         if (seq1[j - 1] == seq2[i - 1]) {
+         if (fc_elem(seq1, j - 1, size) == c) {
             int32_t up_left = matrix[i - 1][j - 1] + 1;
             matrix[i][j] = up_left;
             if (max_len < up_left)
@@ -781,25 +2198,29 @@ int32_t fc_memo_lcsubstr(struct fc_memo *ctx, const char32_t *seq2, int32_t len2
    return max_len;
 }
 
-int32_t fc_memo_lcsubseq(struct fc_memo *ctx,
-                            const char32_t *seq2, int32_t len2)
+int32_t fc_memo_lcsubstr(struct fc_memo *ctx, const char32_t *seq2, int32_t len2)
 {
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->compute == fc_memo_lcsubseq);
+   assert(ctx->compute == fc_memo_lcsubstr);
+   return fc_memo_lcsubstr_body(ctx, seq2, len2, sizeof *seq2);
+}
+
+FC_ALWAYS_INLINE int32_t fc_memo_lcsubseq_body(struct fc_memo *ctx,
+                                               const void *seq2, int32_t len2,
+                                               int size)
+{
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
 
-   const char32_t *seq1 = ctx->seq1;
+   const void *seq1 = ctx->seq1;
    const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
    int32_t (*matrix)[ctx->mdim] = ctx->matrix;
 
-   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
-      skip++;
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
-   ctx->len2 = len2;
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
+   fc_memo_save(ctx, seq2, len2, skip, size);
 
    for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = fc_elem(seq1, i - 1, size);
       for (int32_t j = skip + 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
+         if (c == fc_elem(seq2, j - 1, size)) {
             matrix[i][j] = matrix[i - 1][j - 1] + 1;
          } else {
             const int32_t fst = matrix[i][j - 1];
@@ -811,23 +2232,60 @@ int32_t fc_memo_lcsubseq(struct fc_memo *ctx,
    return matrix[len1][len2];
 }
 
-static int32_t fc_memo_distance(struct fc_memo *ctx,
-                                const char32_t *seq2, int32_t len2,
-                                bool transpos)
+int32_t fc_memo_lcsubseq(struct fc_memo *ctx,
+                            const char32_t *seq2, int32_t len2)
+{
+   assert(ctx->compute == fc_memo_lcsubseq);
+   return fc_memo_lcsubseq_body(ctx, seq2, len2, sizeof *seq2);
+}
+
+/* Computes the cells of the row "i" of the matrix past "skip", with the costs
+ * of ctx->costs. "c" is the character of the reference sequence for this row.
+ */
+FC_ALWAYS_INLINE void fc_memo_wrow(struct fc_memo *ctx, const void *seq2,
+                                   int32_t len2, int32_t skip, int32_t i,
+                                   char32_t c, bool transpos, int size)
+{
+   const struct fc_costs *costs = ctx->costs;
+   const void *seq1 = ctx->seq1;
+   int32_t (*matrix)[ctx->mdim] = ctx->matrix;
+   const uint64_t seconds = fc_sub_seconds(costs, c);
+
+   for (int32_t j = skip + 1; j <= len2; j++) {
+      const char32_t d = fc_elem(seq2, j - 1, size);
+      int32_t v = FC_MIN(matrix[i][j - 1] + costs->ins,
+                         matrix[i - 1][j] + costs->del);
+      if (c == d) {
+         v = FC_MIN(v, matrix[i - 1][j - 1]);
+      } else {
+         v = FC_MIN(v, matrix[i - 1][j - 1] + fc_sub_cost(costs, seconds, c, d));
+         if (transpos && i > 1 && j > 1
+             && fc_elem(seq1, i - 2, size) == d
+             && c == fc_elem(seq2, j - 2, size))
+            v = FC_MIN(v, matrix[i - 2][j - 2] + costs->transpose);
+      }
+      matrix[i][j] = v;
+   }
+}
+
+/* "costs" is either NULL, for unit costs, or ctx->costs. */
+FC_ALWAYS_INLINE int32_t fc_memo_distance(struct fc_memo *ctx,
+                                          const void *seq2, int32_t len2,
+                                          bool transpos,
+                                          const struct fc_costs *costs,
+                                          int size)
 {
-   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim);
+   assert(ctx->seq1 && len2 >= 0 && len2 < ctx->mdim && ctx->elem_size == size);
 
-   const char32_t *seq1 = ctx->seq1;
+   const void *seq1 = ctx->seq1;
    const int32_t len1 = ctx->len1;
-   char32_t *old_seq2 = ctx->seq2;
    int32_t (*matrix)[ctx->mdim] = ctx->matrix;
 
-   if (abs(len1 - len2) > ctx->max_dist)
+   if (costs ? fc_costs_min(costs, len1, len2) > ctx->max_dist
+             : abs(len1 - len2) > ctx->max_dist)
       return INT32_MAX;
 
-   int32_t skip = 0, min_len2 = FC_MIN(ctx->len2, len2);
-   while (skip < min_len2 && old_seq2[skip] == seq2[skip])
-      skip++;
+   const int32_t skip = fc_memo_skip(ctx, seq2, len2, size);
 
    if (skip) {
       /* We could make this check after computing each row, and possibly break
@@ -844,26 +2302,37 @@ static int32_t fc_memo_distance(struct fc_memo *ctx,
        */
       int32_t min = INT32_MAX;
       for (int32_t i = 0; i <= len1; i++) {
-         const int32_t val = matrix[i][skip];
+         int32_t val = matrix[i][skip];
+         /* With weights, a transposition can cost less than the cells of the
+          * column it jumps over.
+          */
+         if (costs && transpos)
+            val = FC_MIN(val, matrix[i][skip - 1] + costs->transpose);
          if (val < min)
             min = val;
       }
       if (min > ctx->max_dist)
          return INT32_MAX;
    }
-   memcpy(&old_seq2[skip], &seq2[skip], (len2 - skip) * sizeof *seq2);
-   ctx->len2 = len2;
+   fc_memo_save(ctx, seq2, len2, skip, size);
 
    for (int32_t i = 1; i <= len1; i++) {
+      const char32_t c = fc_elem(seq1, i - 1, size);
+      if (costs) {
+         fc_memo_wrow(ctx, seq2, len2, skip, i, c, transpos, size);
+         continue;
+      }
       for (int32_t j = skip + 1; j <= len2; j++) {
-         if (seq1[i - 1] == seq2[j - 1]) {
+         if (c == fc_elem(seq2, j - 1, size)) {
             matrix[i][j] = matrix[i - 1][j - 1];
          } else {
             int32_t ic = matrix[i][j - 1] + 1;
             int32_t dc = matrix[i - 1][j] + 1;
             int32_t rc = matrix[i - 1][j - 1] + 1;
             matrix[i][j] = FC_MIN3(ic, dc, rc);
-            if (transpos && TRANSPOSED(seq1, seq2, i, j)) {
+            if (transpos && i > 1 && j > 1
+                && fc_elem(seq1, i - 2, size) == fc_elem(seq2, j - 1, size)
+                && c == fc_elem(seq2, j - 2, size)) {
                ic = matrix[i][j];
                int32_t tc = matrix[i - 2][j - 2] + 1;
                matrix[i][j] = FC_MIN(ic, tc);
@@ -878,17 +2347,747 @@ int32_t fc_memo_levenshtein(struct fc_memo *ctx,
                                    const char32_t *seq2, int32_t len2)
 {
    assert(ctx->compute == fc_memo_levenshtein);
-   return fc_memo_distance(ctx, seq2, len2, false);
+   if (ctx->costs)
+      return fc_memo_distance(ctx, seq2, len2, false, ctx->costs, sizeof *seq2);
+   return fc_memo_distance(ctx, seq2, len2, false, NULL, sizeof *seq2);
 }
 
 int32_t fc_memo_damerau(struct fc_memo *ctx,
                                const char32_t *seq2, int32_t len2)
 {
    assert(ctx->compute == fc_memo_damerau);
-   return fc_memo_distance(ctx, seq2, len2, true);
+   if (ctx->costs)
+      return fc_memo_distance(ctx, seq2, len2, true, ctx->costs, sizeof *seq2);
+   return fc_memo_distance(ctx, seq2, len2, true, NULL, sizeof *seq2);
 }
 
 void fc_memo_fini(struct fc_memo *ctx)
 {
    fc_free(ctx->seq2);
 }
+
+/*******************************************************************************
+ * Batch computation
+ ******************************************************************************/
+
+/* Maximum length of the query for using the vectorized kernels. Above this,
+ * comparing each candidate to the query with a bit-parallel algorithm is
+ * faster.
+ */
+#define FC_BATCH_MAX_QUERY_LEN FC_WORD_BITS
+
+static void fc_batch(enum fc_metric metric,
+                     int32_t (*func)(const struct fc_peq *, const char32_t *,
+                                     int32_t),
+                     const char32_t *query, int32_t qlen,
+                     const char32_t *const *cands, const int32_t *lens,
+                     size_t nr, int32_t *out)
+{
+   struct fc_peq peq;
+   fc_peq_init(&peq, query, qlen);
+
+#ifdef FC_HAVE_SIMD
+   if (qlen <= FC_BATCH_MAX_QUERY_LEN) {
+      fc_simd_batch(metric, &peq, query, qlen, cands, lens, nr, out);
+      fc_peq_fini(&peq);
+      return;
+   }
+#else
+   (void)metric;
+#endif
+   for (size_t i = 0; i < nr; i++)
+      out[i] = func(&peq, cands[i], lens[i]);
+   fc_peq_fini(&peq);
+}
+
+void fc_levenshtein_batch(const char32_t *query, int32_t qlen,
+                          const char32_t *const *cands, const int32_t *lens,
+                          size_t nr, int32_t *out)
+{
+   fc_batch(FC_LEVENSHTEIN, fc_bitpar_levenshtein, query, qlen, cands, lens, nr, out);
+}
+
+void fc_damerau_batch(const char32_t *query, int32_t qlen,
+                      const char32_t *const *cands, const int32_t *lens,
+                      size_t nr, int32_t *out)
+{
+   fc_batch(FC_DAMERAU, fc_bitpar_damerau, query, qlen, cands, lens, nr, out);
+}
+
+void fc_lcsubseq_batch(const char32_t *query, int32_t qlen,
+                       const char32_t *const *cands, const int32_t *lens,
+                       size_t nr, int32_t *out)
+{
+   fc_batch(FC_LCSUBSEQ, fc_bitpar_lcsubseq, query, qlen, cands, lens, nr, out);
+}
+
+
+/*******************************************************************************
+ * Multiple metrics
+ ******************************************************************************/
+
+#define FC_MULTI_BITPAR (FC_MULTI_LEVENSHTEIN | FC_MULTI_DAMERAU | FC_MULTI_LCSUBSEQ)
+
+/* Sets the requested distances from the vertical deltas of the last column, and
+ * the length of the longest common subsequence from the vector "s".
+ */
+static void fc_multi_finish(const struct fc_peq *peq, int32_t len2, unsigned mask,
+                            const uint64_t *vp, const uint64_t *vn,
+                            const uint64_t *dvp, const uint64_t *dvn,
+                            const uint64_t *s, struct fc_multi *out)
+{
+   int32_t lev = len2, dam = len2, lcs = 0;
+
+   for (int32_t w = 0; w < peq->words; w++) {
+      const int32_t rem = peq->len - w * FC_WORD_BITS;
+      const uint64_t valid = rem >= FC_WORD_BITS ? ~UINT64_C(0)
+                                                 : ~UINT64_C(0) >> (FC_WORD_BITS - rem);
+      lev += fc_popcount(vp[w] & valid) - fc_popcount(vn[w] & valid);
+      dam += fc_popcount(dvp[w] & valid) - fc_popcount(dvn[w] & valid);
+      lcs += fc_popcount(~s[w] & valid);
+   }
+   if (mask & FC_MULTI_LEVENSHTEIN)
+      out->levenshtein = lev;
+   if (mask & FC_MULTI_DAMERAU)
+      out->damerau = dam;
+   if (mask & FC_MULTI_LCSUBSEQ)
+      out->lcsubseq = lcs;
+}
+
+/* Fused version of fc_bitpar_levenshtein1(), fc_bitpar_damerau1(), and
+ * fc_bitpar_lcsubseq1(), with "seq1" as pattern. The longest common substring
+ * is computed from the set bits of the masks: the run of matches that ends at
+ * the cell (i, j) extends the one that ends at (i - 1, j - 1) if this cell is
+ * a match, which is checked with the masks of the previous character. The
+ * length of the run is stored for each diagonal in "diags", which must have
+ * room for len1 + len2 items.
+ */
+static void fc_multi_sweep1(const struct fc_peq *peq, const char32_t *seq2,
+                            int32_t len2, unsigned mask, int32_t *diags,
+                            struct fc_multi *out)
+{
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   uint64_t dvp = ~UINT64_C(0), dvn = 0, d0 = 0, prev_eq = 0;
+   uint64_t s = ~UINT64_C(0);
+   int32_t lcsubstr = 0;
+
+   for (int32_t j = 0; j < len2; j++) {
+      const uint64_t eq = *fc_peq_get(peq, seq2[j]);
+
+      if (mask & FC_MULTI_LEVENSHTEIN) {
+         const uint64_t xv = eq | vn;
+         const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+         const uint64_t hp = (vn | ~(xh | vp)) << 1 | 1;
+         const uint64_t hn = (vp & xh) << 1;
+         vp = hn | ~(xv | hp);
+         vn = hp & xv;
+      }
+      if (mask & FC_MULTI_DAMERAU) {
+         const uint64_t tr = ((~d0 & eq) << 1) & prev_eq;
+         d0 = (((eq & dvp) + dvp) ^ dvp) | eq | dvn | tr;
+         const uint64_t hp = (dvn | ~(d0 | dvp)) << 1 | 1;
+         const uint64_t hn = (d0 & dvp) << 1;
+         dvp = hn | ~(d0 | hp);
+         dvn = hp & d0;
+      }
+      if (mask & FC_MULTI_LCSUBSEQ) {
+         const uint64_t u = s & eq;
+         s = (s + u) | (s - u);
+      }
+      if (mask & FC_MULTI_LCSUBSTR) {
+         for (uint64_t m = eq; m; m &= m - 1) {
+            const int32_t i = fc_ctz(m);
+            int32_t *run = &diags[len2 + i - j];
+            *run = prev_eq << 1 >> i & 1 ? *run + 1 : 1;
+            lcsubstr = FC_MAX(lcsubstr, *run);
+         }
+      }
+      prev_eq = eq;
+   }
+
+   fc_multi_finish(peq, len2, mask, &vp, &vn, &dvp, &dvn, &s, out);
+   if (mask & FC_MULTI_LCSUBSTR)
+      out->lcsubstr = lcsubstr;
+}
+
+/* Same as above, for patterns that don't fit in a single word. The metrics
+ * are updated one after the other for each character of "seq2", so that the
+ * inner loops stay as tight as in the separate functions.
+ */
+static void fc_multi_sweepN(const struct fc_peq *peq, const char32_t *seq2,
+                            int32_t len2, unsigned mask, struct fc_multi *out)
+{
+   const int32_t words = peq->words;
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   uint64_t dvp[FC_MAX_WORDS], dvn[FC_MAX_WORDS], d0[FC_MAX_WORDS];
+   uint64_t s[FC_MAX_WORDS];
+   const uint64_t *prev_eqs = peq->rows;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = dvp[w] = s[w] = ~UINT64_C(0);
+      vn[w] = dvn[w] = d0[w] = 0;
+   }
+
+   for (int32_t j = 0; j < len2; j++) {
+      const uint64_t *eqs = fc_peq_get(peq, seq2[j]);
+
+      if (mask & FC_MULTI_LEVENSHTEIN) {
+         uint64_t hp_carry = 1, hn_carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t xv = eqs[w] | vn[w];
+            const uint64_t eq = eqs[w] | hn_carry;
+            const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+            uint64_t hp = vn[w] | ~(xh | vp[w]);
+            uint64_t hn = vp[w] & xh;
+
+            const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+            const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_out;
+            hn_carry = hn_out;
+
+            vp[w] = hn | ~(xv | hp);
+            vn[w] = hp & xv;
+         }
+      }
+      if (mask & FC_MULTI_DAMERAU) {
+         uint64_t hp_carry = 1, hn_carry = 0, tr_carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t eq = eqs[w];
+            const uint64_t x = eq | hn_carry;
+            const uint64_t tr = (((~d0[w] & eq) << 1) | tr_carry) & prev_eqs[w];
+            tr_carry = (~d0[w] & eq) >> (FC_WORD_BITS - 1);
+
+            const uint64_t d = (((x & dvp[w]) + dvp[w]) ^ dvp[w]) | x | dvn[w] | tr;
+            uint64_t hp = dvn[w] | ~(d | dvp[w]);
+            uint64_t hn = d & dvp[w];
+
+            const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+            const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_out;
+            hn_carry = hn_out;
+
+            dvp[w] = hn | ~(d | hp);
+            dvn[w] = hp & d;
+            d0[w] = d;
+         }
+      }
+      if (mask & FC_MULTI_LCSUBSEQ) {
+         uint64_t carry = 0;
+         for (int32_t w = 0; w < words; w++) {
+            const uint64_t u = s[w] & eqs[w];
+            const uint64_t sum = s[w] + carry;
+            const uint64_t x = sum + u;
+            carry = (sum < carry) | (x < u);
+            s[w] = x | (s[w] - u);
+         }
+      }
+      prev_eqs = eqs;
+   }
+
+   fc_multi_finish(peq, len2, mask, vp, vn, dvp, dvn, s, out);
+}
+
+/* "peq" holds the masks of "seq1". */
+static void fc_multi_metric0(const struct fc_peq *peq,
+                             const char32_t *seq1, int32_t len1,
+                             const char32_t *seq2, int32_t len2,
+                             unsigned mask, int32_t *diags, struct fc_multi *out)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2) && peq->len == len1);
+
+   if (len1 == 0 || len2 == 0) {
+      if (mask & FC_MULTI_LEVENSHTEIN)
+         out->levenshtein = len1 + len2;
+      if (mask & FC_MULTI_DAMERAU)
+         out->damerau = len1 + len2;
+      if (mask & FC_MULTI_LCSUBSTR)
+         out->lcsubstr = 0;
+      if (mask & FC_MULTI_LCSUBSEQ)
+         out->lcsubseq = 0;
+   } else if (peq->words == 1) {
+      if (mask & (FC_MULTI_BITPAR | FC_MULTI_LCSUBSTR))
+         fc_multi_sweep1(peq, seq2, len2, mask, diags, out);
+   } else {
+      if (mask & FC_MULTI_BITPAR)
+         fc_multi_sweepN(peq, seq2, len2, mask, out);
+      /* Scanning the set bits of the masks is slower than the vectorized
+       * kernels on long sequences.
+       */
+      if (mask & FC_MULTI_LCSUBSTR)
+         out->lcsubstr = fc_lcsubstr(seq1, len1, seq2, len2);
+   }
+
+   /* The Jaro distance is symmetric, so the masks of "seq1" can be used for
+    * matching the characters of "seq2".
+    */
+   if (mask & FC_MULTI_JARO) {
+      if (len1 < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+         out->jaro = fc_jaro_short(seq1, len1, seq2, len2, 0, sizeof *seq1);
+      else
+         out->jaro = fc_jaro0(peq, seq2, len2, seq1, len1, 0, sizeof *seq1);
+   }
+}
+
+/* Room needed in "diags" for comparing sequences of the given lengths. */
+#define FC_MULTI_DIAGS(mask, len1, len2)                                       \
+   ((mask) & FC_MULTI_LCSUBSTR && (len1) <= FC_WORD_BITS ? (len1) + (len2) : 0)
+
+void fc_multi_metric(const char32_t *seq1, int32_t len1,
+                     const char32_t *seq2, int32_t len2,
+                     unsigned mask, struct fc_multi *out)
+{
+   assert(IN_RANGE(len1) && IN_RANGE(len2));
+
+   /* All the metrics are symmetric, and the shortest sequence needs the
+    * fewest words.
+    */
+   if (len1 > len2) {
+      FC_SWAP(const char32_t *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+
+   struct fc_peq peq;
+   fc_peq_init(&peq, seq1, len1);
+
+   int32_t diags[FC_DEFAULT_COLUMN_LEN], *diagsp = diags;
+   if (FC_MULTI_DIAGS(mask, len1, len2) > (int32_t)FC_ARRAY_SIZE(diags))
+      diagsp = fc_malloc((len1 + len2) * sizeof *diagsp);
+
+   fc_multi_metric0(&peq, seq1, len1, seq2, len2, mask, diagsp, out);
+
+   if (diagsp != diags)
+      fc_free(diagsp);
+   fc_peq_fini(&peq);
+}
+
+void fc_multi_metric_batch(const char32_t *query, int32_t qlen,
+                           const char32_t *const *cands, const int32_t *lens,
+                           size_t nr, unsigned mask, struct fc_multi *out)
+{
+   assert(IN_RANGE(qlen));
+
+   struct fc_peq peq;
+   fc_peq_init(&peq, query, qlen);
+
+   int32_t max_len = 0;
+   for (size_t i = 0; i < nr; i++)
+      max_len = FC_MAX(max_len, lens[i]);
+
+   int32_t diags[FC_DEFAULT_COLUMN_LEN], *diagsp = diags;
+   if (FC_MULTI_DIAGS(mask, qlen, max_len) > (int32_t)FC_ARRAY_SIZE(diags))
+      diagsp = fc_malloc((qlen + max_len) * sizeof *diagsp);
+
+   for (size_t i = 0; i < nr; i++)
+      fc_multi_metric0(&peq, query, qlen, cands[i], lens[i], mask, diagsp, &out[i]);
+
+   if (diagsp != diags)
+      fc_free(diagsp);
+   fc_peq_fini(&peq);
+}
+
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* The vectorized kernels compare characters, so they are only used for
+ * sequences of 4 bytes elements. Others would have to be widened first, which
+ * costs as much as comparing them.
+ */
+FC_ALWAYS_INLINE int32_t fc_hamming0_body(const void *seq1, const void *seq2,
+                                          int32_t len, int32_t k, int size)
+{
+   assert(len >= 0);
+
+#ifdef FC_HAVE_SIMD
+   if (size == sizeof(char32_t) && len >= FC_SIMD_SHORT_LEN)
+      return fc_simd_hamming(seq1, seq2, len, k);
+#endif
+   int32_t dist = 0;
+   for (int32_t i = 0; i < len; i++)
+      if (fc_elem(seq1, i, size) != fc_elem(seq2, i, size) && ++dist > k)
+         break;
+   return dist;
+}
+
+static int32_t fc_hamming0(const void *seq1, const void *seq2,
+                           int32_t len, int32_t k, int size)
+{
+   return FC_ELEM_DISPATCH(size, fc_hamming0_body, seq1, seq2, len, k);
+}
+
+int32_t fc_hamming(const char32_t *seq1, const char32_t *seq2, int32_t len)
+{
+   return fc_hamming0(seq1, seq2, len, len, sizeof *seq1);
+}
+
+int32_t fc_hamming_bounded(const char32_t *seq1, const char32_t *seq2,
+                           int32_t len, int32_t k)
+{
+   return fc_hamming0(seq1, seq2, len, k, sizeof *seq1);
+}
+
+/* Stores in out[i] the distance between "query" and the key "i", as
+ * fc_hamming_bounded() does.
+ */
+static void fc_hamming_scan(const void *query, int32_t len,
+                            const void *keys, size_t nr, int32_t k,
+                            int32_t *out, int size)
+{
+#ifdef FC_HAVE_SIMD
+   if (size == sizeof(char32_t)) {
+      fc_simd_hamming_scan(query, len, keys, nr, k, out);
+      return;
+   }
+#endif
+   const size_t key_size = (size_t)len * size;
+   for (size_t i = 0; i < nr; i++)
+      out[i] = fc_hamming0(query, (const char *)keys + i * key_size, len, k, size);
+}
+
+/* Number of keys compared at once by fc_hamming_search(). */
+#define FC_HAMMING_SCAN_LEN 256
+
+static size_t fc_hamming_search_elems(const void *query, int32_t len,
+                                      const void *keys, size_t nr, int32_t k,
+                                      size_t *matches, int32_t *dists, int size)
+{
+   assert(len >= 0);
+
+   int32_t out[FC_HAMMING_SCAN_LEN];
+   size_t found = 0;
+
+   for (size_t i = 0; i < nr; i += FC_HAMMING_SCAN_LEN) {
+      const size_t cnt = FC_MIN(nr - i, FC_HAMMING_SCAN_LEN);
+      const char *group = (const char *)keys + i * len * size;
+      fc_hamming_scan(query, len, group, cnt, k, out, size);
+      for (size_t j = 0; j < cnt; j++) {
+         if (out[j] > k)
+            continue;
+         matches[found] = i + j;
+         if (dists)
+            dists[found] = out[j];
+         found++;
+      }
+   }
+   return found;
+}
+
+size_t fc_hamming_search(const char32_t *query, int32_t len,
+                         const char32_t *keys, size_t nr, int32_t k,
+                         size_t *matches, int32_t *dists)
+{
+   return fc_hamming_search_elems(query, len, keys, nr, k, matches, dists,
+                                  sizeof *query);
+}
+
+
+/*******************************************************************************
+ * Compiled queries
+ ******************************************************************************/
+
+struct fc_profile {
+   struct fc_peq peq;
+   int32_t *ends;          /* Lists of positions, for the sparse algorithm. */
+   int32_t *pos;
+   int32_t len;
+   char32_t seq[];
+};
+
+void fc_query_init(struct fc_query *q, const char32_t *seq, int32_t len)
+{
+   assert(IN_RANGE(len));
+
+   struct fc_profile *prof = fc_malloc(sizeof *prof + len * sizeof *prof->seq);
+   memcpy(prof->seq, seq, len * sizeof *seq);
+   prof->len = len;
+   fc_peq_init(&prof->peq, seq, len);
+
+   prof->ends = prof->pos = NULL;
+   if (len >= FC_SPARSE_MIN_LEN) {
+      const int32_t rows_nr = prof->peq.rows_nr;
+      prof->ends = fc_malloc((rows_nr + 1 + len) * sizeof *prof->ends);
+      prof->pos = &prof->ends[rows_nr + 1];
+      fc_sparse_count(&prof->peq, seq, len, sizeof *seq, prof->ends);
+      fc_sparse_lists(&prof->peq, seq, len, sizeof *seq, prof->ends, prof->pos);
+   }
+   q->profile = prof;
+}
+
+void fc_query_fini(struct fc_query *q)
+{
+   fc_peq_fini(&q->profile->peq);
+   fc_free(q->profile->ends);
+   fc_free(q->profile);
+}
+
+/* The masks of the query are used unless the compared sequence needs fewer
+ * words, in which case building its own masks is cheaper.
+ */
+static bool fc_query_fits(const struct fc_profile *prof, int32_t len2)
+{
+   return (len2 + FC_WORD_BITS - 1) / FC_WORD_BITS >= prof->peq.words;
+}
+
+#define _(name)                                                                \
+int32_t fc_query_##name(const struct fc_query *q,                              \
+                        const char32_t *seq2, int32_t len2)                    \
+{                                                                              \
+   assert(IN_RANGE(len2));                                                     \
+                                                                               \
+   const struct fc_profile *prof = q->profile;                                 \
+   if (prof->len == 0 || len2 == 0)                                            \
+      return prof->len + len2;                                                 \
+   if (!fc_query_fits(prof, len2))                                             \
+      return fc_##name(prof->seq, prof->len, seq2, len2);                      \
+   return fc_bitpar_##name(&prof->peq, seq2, len2);                            \
+}
+_(levenshtein)
+_(damerau)
+#undef _
+
+int32_t fc_query_lcsubseq(const struct fc_query *q,
+                          const char32_t *seq2, int32_t len2)
+{
+   assert(IN_RANGE(len2));
+
+   const struct fc_profile *prof = q->profile;
+   if (prof->len == 0 || len2 == 0)
+      return 0;
+   if (!fc_query_fits(prof, len2))
+      return fc_lcsubseq(prof->seq, prof->len, seq2, len2);
+   if (!prof->ends)
+      return fc_bitpar_lcsubseq(&prof->peq, seq2, len2);
+
+   /* The lists of positions of the query are ready, so the sparse algorithm
+    * only needs the rows of the characters of "seq2".
+    */
+   const int32_t *ends = prof->ends;
+   int32_t *ids2 = fc_malloc((len2 + prof->len) * sizeof *ids2);
+   int64_t matches = 0;
+   for (int32_t i = 0; i < len2; i++) {
+      const int32_t id = fc_peq_slot(&prof->peq, seq2[i])->row;
+      ids2[i] = id;
+      matches += ends[id] - (id ? ends[id - 1] : 0);
+   }
+
+   int32_t lcs;
+   if (fc_sparse_faster(matches, len2, prof->len))
+      lcs = fc_sparse_run(ends, prof->pos, ids2, len2, &ids2[len2]);
+   else
+      lcs = fc_bitpar_lcsubseq(&prof->peq, seq2, len2);
+
+   fc_free(ids2);
+   return lcs;
+}
+
+double fc_query_jaro(const struct fc_query *q, const char32_t *seq2, int32_t len2)
+{
+   assert(IN_RANGE(len2));
+
+   const struct fc_profile *prof = q->profile;
+   if (prof->len < FC_JARO_PEQ_MIN_LEN && len2 < FC_JARO_PEQ_MIN_LEN)
+      return fc_jaro_short(prof->seq, prof->len, seq2, len2, 0, sizeof *seq2);
+
+   /* The Jaro distance is symmetric, so the masks of the query can be used
+    * for matching the characters of "seq2".
+    */
+   return fc_jaro0(&prof->peq, seq2, len2, prof->seq, prof->len, 0, sizeof *seq2);
+}
+
+
+/*******************************************************************************
+ * Other element types
+ ******************************************************************************/
+
+#define _(S, T)                                                                \
+int32_t fc_levenshtein_##S(const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2)                        \
+{                                                                              \
+   return fc_levenshtein_elems(seq1, len1, seq2, len2, sizeof(T));             \
+}                                                                              \
+                                                                               \
+int32_t fc_damerau_##S(const T *seq1, int32_t len1,                            \
+                       const T *seq2, int32_t len2)                            \
+{                                                                              \
+   return fc_damerau_elems(seq1, len1, seq2, len2, sizeof(T));                 \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubseq_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_lcsubseq_elems(seq1, len1, seq2, len2, sizeof(T));                \
+}                                                                              \
+                                                                               \
+double fc_jaro_##S(const T *seq1, int32_t len1,                                \
+                   const T *seq2, int32_t len2)                                \
+{                                                                              \
+   return fc_jaro_elems(seq1, len1, seq2, len2, sizeof(T));                    \
+}                                                                              \
+                                                                               \
+double fc_nlevenshtein_##S(enum fc_norm_method method,                         \
+                           const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2)                        \
+{                                                                              \
+   return fc_nlevenshtein_elems(method, seq1, len1, seq2, len2, sizeof(T));    \
+}                                                                              \
+                                                                               \
+double fc_ndamerau_##S(enum fc_norm_method method,                             \
+                       const T *seq1, int32_t len1,                            \
+                       const T *seq2, int32_t len2)                            \
+{                                                                              \
+   return fc_ndamerau_elems(method, seq1, len1, seq2, len2, sizeof(T));        \
+}                                                                              \
+                                                                               \
+double fc_nlevenshtein_bounded_##S(enum fc_norm_method method, double max,     \
+                                   const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2)                \
+{                                                                              \
+   return fc_nbounded(false, method, max, seq1, len1, seq2, len2, sizeof(T));  \
+}                                                                              \
+                                                                               \
+double fc_ndamerau_bounded_##S(enum fc_norm_method method, double max,         \
+                               const T *seq1, int32_t len1,                    \
+                               const T *seq2, int32_t len2)                    \
+{                                                                              \
+   return fc_nbounded(true, method, max, seq1, len1, seq2, len2, sizeof(T));   \
+}                                                                              \
+                                                                               \
+static int32_t fc_lev_bounded0_##S(const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2)                \
+{                                                                              \
+   return fc_lev_bounded0_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_lev_bounded1_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_lev_bounded1_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_lev_bounded2_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_lev_bounded2_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t (*const fc_lev_bounded_##S[3])(const T *, int32_t,                     \
+                                       const T *, int32_t) = {                 \
+   fc_lev_bounded0_##S,                                                        \
+   fc_lev_bounded1_##S,                                                        \
+   fc_lev_bounded2_##S,                                                        \
+};                                                                             \
+                                                                               \
+int32_t fc_lev_bounded_k_##S(const T *seq1, int32_t len1,                      \
+                             const T *seq2, int32_t len2, int32_t k)           \
+{                                                                              \
+   return fc_lev_bounded_k_elems(seq1, len1, seq2, len2, k, sizeof(T));        \
+}                                                                              \
+                                                                               \
+int32_t fc_dam_bounded1_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_dam_bounded1_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t fc_dam_bounded2_##S(const T *seq1, int32_t len1,                       \
+                            const T *seq2, int32_t len2)                       \
+{                                                                              \
+   return fc_dam_bounded2_elems(seq1, len1, seq2, len2, sizeof(T));            \
+}                                                                              \
+                                                                               \
+int32_t (*const fc_dam_bounded_##S[3])(const T *, int32_t,                     \
+                                       const T *, int32_t) = {                 \
+   fc_lev_bounded0_##S,                                                        \
+   fc_dam_bounded1_##S,                                                        \
+   fc_dam_bounded2_##S,                                                        \
+};                                                                             \
+                                                                               \
+double fc_jaro_winkler_##S(const T *seq1, int32_t len1,                        \
+                           const T *seq2, int32_t len2,                        \
+                           double prefix_scale, int32_t max_prefix)            \
+{                                                                              \
+   return fc_jaro_winkler_elems(seq1, len1, seq2, len2, prefix_scale,          \
+                                max_prefix, sizeof(T));                        \
+}                                                                              \
+                                                                               \
+double fc_jaro_winkler_bounded_##S(const T *seq1, int32_t len1,                \
+                                   const T *seq2, int32_t len2,                \
+                                   double prefix_scale, int32_t max_prefix,    \
+                                   double max)                                 \
+{                                                                              \
+   return fc_jaro_winkler_bounded_elems(seq1, len1, seq2, len2, prefix_scale,  \
+                                        max_prefix, max, sizeof(T));           \
+}                                                                              \
+                                                                               \
+int32_t fc_hamming_##S(const T *seq1, const T *seq2, int32_t len)              \
+{                                                                              \
+   return fc_hamming0(seq1, seq2, len, len, sizeof(T));                        \
+}                                                                              \
+                                                                               \
+int32_t fc_hamming_bounded_##S(const T *seq1, const T *seq2,                   \
+                               int32_t len, int32_t k)                         \
+{                                                                              \
+   return fc_hamming0(seq1, seq2, len, k, sizeof(T));                          \
+}                                                                              \
+                                                                               \
+size_t fc_hamming_search_##S(const T *query, int32_t len,                      \
+                             const T *keys, size_t nr, int32_t k,              \
+                             size_t *matches, int32_t *dists)                  \
+{                                                                              \
+   return fc_hamming_search_elems(query, len, keys, nr, k, matches, dists,     \
+                                  sizeof(T));                                  \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubstr_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_lcsubstr_elems(seq1, len1, seq2, len2, NULL, sizeof(T));          \
+}                                                                              \
+                                                                               \
+int32_t fc_lcsubstr_extract_##S(const T *seq1, int32_t len1,                   \
+                                const T *seq2, int32_t len2, const T **pos)    \
+{                                                                              \
+   const void *start;                                                          \
+   const int32_t max_len = fc_lcsubstr_elems(seq1, len1, seq2, len2,           \
+                                             pos ? &start : NULL, sizeof(T));  \
+   if (pos)                                                                    \
+      *pos = start;                                                            \
+   return max_len;                                                             \
+}                                                                              \
+                                                                               \
+double fc_nlcsubseq_##S(const T *seq1, int32_t len1,                           \
+                        const T *seq2, int32_t len2)                           \
+{                                                                              \
+   return fc_nlcsubseq_elems(seq1, len1, seq2, len2, sizeof(T));               \
+}                                                                              \
+                                                                               \
+double fc_nlcsubseq_bounded_##S(double max, const T *seq1, int32_t len1,       \
+                                const T *seq2, int32_t len2)                   \
+{                                                                              \
+   return fc_nlcsubseq_bounded_elems(max, seq1, len1, seq2, len2, sizeof(T));  \
+}                                                                              \
+                                                                               \
+void fc_memo_set_ref_##S(struct fc_memo *ctx, const T *seq1, int32_t len1)     \
+{                                                                              \
+   fc_memo_set_ref_elems(ctx, seq1, len1, sizeof(T));                          \
+}                                                                              \
+                                                                               \
+int32_t fc_memo_compute_##S(struct fc_memo *ctx, const T *seq2, int32_t len2)  \
+{                                                                              \
+   if (ctx->compute == fc_memo_levenshtein)                                    \
+      return fc_memo_distance(ctx, seq2, len2, false, ctx->costs, sizeof(T));  \
+   if (ctx->compute == fc_memo_damerau)                                        \
+      return fc_memo_distance(ctx, seq2, len2, true, ctx->costs, sizeof(T));   \
+   if (ctx->compute == fc_memo_lcsubstr)                                       \
+      return fc_memo_lcsubstr_body(ctx, seq2, len2, sizeof(T));                \
+   return fc_memo_lcsubseq_body(ctx, seq2, len2, sizeof(T));                   \
+}
+_(u8, uint8_t)
+_(u16, uint16_t)
+_(u32, uint32_t)
+#undef _
@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <string.h>
+#include "api.h"
+#include "bitpar.h"
+#include "macro.h"
+
+/* Largest alphabet of a packed sequence. */
+#define FC_PACKED_MAX_SYMS (1 << 4)
+
+/* Pattern-match masks of a packed sequence, as in struct fc_peq. Since the
+ * alphabet is small, the row of a symbol is the symbol itself, and characters
+ * of the compared sequence don't need to be looked up in a hash table.
+ */
+struct fc_packed_peq {
+   int32_t len;
+   int32_t words;
+   uint64_t rows[FC_PACKED_MAX_SYMS * FC_MAX_WORDS];
+};
+
+/* Returns the symbol at position "i" of a packed sequence. Since the number of
+ * bits per symbol divides the size of a word, symbols never straddle words.
+ */
+static inline uint64_t fc_packed_get(const uint64_t *seq, int32_t i, int bits)
+{
+   const int32_t pos = i * bits;
+   return seq[pos / FC_WORD_BITS] >> (pos % FC_WORD_BITS)
+          & ((UINT64_C(1) << bits) - 1);
+}
+
+/* Gathers the lowest bit of each field of "bits" bits of a word into the low
+ * bits of the result. The other bits of the fields must be cleared.
+ */
+static uint64_t fc_packed_compress(uint64_t m, int bits)
+{
+   if (bits == 2) {
+      m = (m | m >> 1) & UINT64_C(0x3333333333333333);
+      m = (m | m >> 2) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+      m = (m | m >> 4) & UINT64_C(0x00FF00FF00FF00FF);
+      m = (m | m >> 8) & UINT64_C(0x0000FFFF0000FFFF);
+      return (m | m >> 16) & UINT64_C(0x00000000FFFFFFFF);
+   }
+   m = (m | m >> 3) & UINT64_C(0x0303030303030303);
+   m = (m | m >> 6) & UINT64_C(0x000F000F000F000F);
+   m = (m | m >> 12) & UINT64_C(0x000000FF000000FF);
+   return (m | m >> 24) & UINT64_C(0x000000000000FFFF);
+}
+
+/* Returns the "bits" bits of a packed sequence of "words" words that start at
+ * the bit "pos". The bits past the end of the sequence are garbage.
+ */
+static inline uint64_t fc_packed_window(const uint64_t *seq, int32_t words,
+                                        int64_t pos)
+{
+   const int32_t w = pos / FC_WORD_BITS, shift = pos % FC_WORD_BITS;
+   uint64_t x = seq[w] >> shift;
+   if (shift && w + 1 < words)
+      x |= seq[w + 1] << (FC_WORD_BITS - shift);
+   return x;
+}
+
+/* Same as STRIP in metric.c, for packed sequences. Symbols are compared a
+ * word at a time. Returns the length of the common prefix, which is where
+ * both sequences start afterwards.
+ */
+static int32_t fc_packed_strip(int bits, const uint64_t *seq1, int32_t *len1p,
+                               const uint64_t *seq2, int32_t *len2p)
+{
+   const int32_t syms = FC_WORD_BITS / bits;
+   const int32_t len1 = *len1p, len2 = *len2p, len = FC_MIN(len1, len2);
+   const int32_t words1 = FC_PACKED_WORDS(len1, bits);
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+
+   /* Both prefixes are aligned on words. */
+   int32_t prefix = 0, w = 0;
+   for (; prefix < len; prefix += syms, w++) {
+      const uint64_t x = seq1[w] ^ seq2[w];
+      if (x) {
+         prefix += fc_ctz(x) / bits;
+         break;
+      }
+   }
+   prefix = FC_MIN(prefix, len);
+
+   /* Suffixes are not, so they are compared by windows ending at their last
+    * symbol. The bits before the start of a sequence are zeroes, and the
+    * suffix can't be longer than what is left after the prefix anyway.
+    */
+   int32_t suffix = 0;
+   while (suffix < len - prefix) {
+      const int64_t end1 = (int64_t)(len1 - suffix) * bits;
+      const int64_t end2 = (int64_t)(len2 - suffix) * bits;
+      const uint64_t x1 = end1 >= FC_WORD_BITS
+         ? fc_packed_window(seq1, words1, end1 - FC_WORD_BITS)
+         : seq1[0] << (FC_WORD_BITS - end1);
+      const uint64_t x2 = end2 >= FC_WORD_BITS
+         ? fc_packed_window(seq2, words2, end2 - FC_WORD_BITS)
+         : seq2[0] << (FC_WORD_BITS - end2);
+      if (x1 != x2) {
+         suffix += __builtin_clzll(x1 ^ x2) / bits;
+         break;
+      }
+      suffix += syms;
+   }
+   suffix = FC_MIN(suffix, len - prefix);
+
+   *len1p = len1 - prefix - suffix;
+   *len2p = len2 - prefix - suffix;
+   return prefix;
+}
+
+/* Builds the masks of the "len" symbols of a packed sequence of "seq_words"
+ * words that start at "start". The masks are computed a packed word at a time.
+ * After a xor with a symbol repeated in each field, the fields that are zero
+ * are the positions of this symbol, and their bits only have to be gathered.
+ */
+static void fc_packed_peq_init(struct fc_packed_peq *peq, int bits,
+                               const uint64_t *seq, int32_t seq_words,
+                               int32_t start, int32_t len)
+{
+   const int32_t syms = FC_WORD_BITS / bits;
+   const uint64_t low = bits == 2 ? UINT64_C(0x5555555555555555)
+                                  : UINT64_C(0x1111111111111111);
+   const int32_t words = (len + FC_WORD_BITS - 1) / FC_WORD_BITS;
+
+   peq->len = len;
+   peq->words = words;
+   memset(peq->rows, 0, (words << bits) * sizeof *peq->rows);
+
+   for (int32_t i = 0; i * syms < len; i++) {
+      const int32_t pos = i * syms;
+      const uint64_t valid = len - pos < syms ? (UINT64_C(1) << (len - pos)) - 1
+                                              : ~UINT64_C(0);
+      const uint64_t chunk = fc_packed_window(seq, seq_words,
+                                              (int64_t)(start + pos) * bits);
+      for (int c = 0; c < 1 << bits; c++) {
+         uint64_t x = chunk ^ (c * low);
+         x |= x >> 1;
+         if (bits == 4)
+            x |= x >> 2;
+         const uint64_t m = fc_packed_compress(~x & low, bits) & valid;
+         peq->rows[c * words + pos / FC_WORD_BITS] |= m << (pos % FC_WORD_BITS);
+      }
+   }
+}
+
+bool fc_pack(int bits, const char32_t *alphabet,
+             const char32_t *seq, int32_t len, uint64_t *packed)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len >= 0);
+
+   /* ASCII characters are mapped with a table. */
+   uint8_t ascii[128];
+   memset(ascii, UINT8_MAX, sizeof ascii);
+   int32_t nr = 0;
+   for (; alphabet[nr]; nr++)
+      if (alphabet[nr] < FC_ARRAY_SIZE(ascii))
+         ascii[alphabet[nr]] = nr;
+   assert(nr <= 1 << bits);
+
+   memset(packed, 0, FC_PACKED_WORDS(len, bits) * sizeof *packed);
+   for (int32_t i = 0; i < len; i++) {
+      uint64_t sym;
+      if (seq[i] < FC_ARRAY_SIZE(ascii)) {
+         sym = ascii[seq[i]];
+      } else {
+         sym = 0;
+         while (sym < (uint64_t)nr && alphabet[sym] != seq[i])
+            sym++;
+      }
+      if (sym >= (uint64_t)nr)
+         return false;
+      packed[i * bits / FC_WORD_BITS] |= sym << (i * bits % FC_WORD_BITS);
+   }
+   return true;
+}
+
+
+/*******************************************************************************
+ * Levenshtein
+ ******************************************************************************/
+
+/* Same as fc_bitpar_levenshtein1(). */
+static int32_t fc_packed_levenshtein1(const struct fc_packed_peq *peq, int bits,
+                                      const uint64_t *seq, int32_t start,
+                                      int32_t len)
+{
+   const uint64_t last = UINT64_C(1) << (peq->len - 1);
+   uint64_t vp = ~UINT64_C(0), vn = 0;
+   int32_t dist = peq->len;
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t eq = peq->rows[fc_packed_get(seq, start + i, bits)];
+      const uint64_t xv = eq | vn;
+      const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+      uint64_t hp = vn | ~(xh | vp);
+      uint64_t hn = vp & xh;
+
+      dist += (hp & last) != 0;
+      dist -= (hn & last) != 0;
+
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+   }
+   return dist;
+}
+
+/* Same as fc_bitpar_levenshteinN(). */
+static int32_t fc_packed_levenshteinN(const struct fc_packed_peq *peq, int bits,
+                                      const uint64_t *seq, int32_t start,
+                                      int32_t len)
+{
+   const int32_t words = peq->words;
+   const uint64_t last = UINT64_C(1) << ((peq->len - 1) % FC_WORD_BITS);
+   uint64_t vp[FC_MAX_WORDS], vn[FC_MAX_WORDS];
+   int32_t dist = peq->len;
+
+   for (int32_t w = 0; w < words; w++) {
+      vp[w] = ~UINT64_C(0);
+      vn[w] = 0;
+   }
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t sym = fc_packed_get(seq, start + i, bits);
+      const uint64_t *eqs = &peq->rows[sym * words];
+      uint64_t hp_carry = 1, hn_carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t xv = eqs[w] | vn[w];
+         const uint64_t eq = eqs[w] | hn_carry;
+         const uint64_t xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+         uint64_t hp = vn[w] | ~(xh | vp[w]);
+         uint64_t hn = vp[w] & xh;
+
+         if (w == words - 1) {
+            dist += (hp & last) != 0;
+            dist -= (hn & last) != 0;
+         }
+
+         const uint64_t hp_out = hp >> (FC_WORD_BITS - 1);
+         const uint64_t hn_out = hn >> (FC_WORD_BITS - 1);
+         hp = (hp << 1) | hp_carry;
+         hn = (hn << 1) | hn_carry;
+         hp_carry = hp_out;
+         hn_carry = hn_out;
+
+         vp[w] = hn | ~(xv | hp);
+         vn[w] = hp & xv;
+      }
+   }
+   return dist;
+}
+
+int32_t fc_levenshtein_packed(int bits, const uint64_t *seq1, int32_t len1,
+                              const uint64_t *seq2, int32_t len2)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
+
+   if (len1 < len2) {
+      FC_SWAP(const uint64_t *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+   const int32_t start = fc_packed_strip(bits, seq1, &len1, seq2, &len2);
+   if (len2 == 0)
+      return len1;
+
+   /* The shortest sequence is used as pattern. */
+   struct fc_packed_peq peq;
+   fc_packed_peq_init(&peq, bits, seq2, words2, start, len2);
+   if (peq.words == 1)
+      return fc_packed_levenshtein1(&peq, bits, seq1, start, len1);
+   return fc_packed_levenshteinN(&peq, bits, seq1, start, len1);
+}
+
+
+/*******************************************************************************
+ * Longest common subsequence
+ ******************************************************************************/
+
+/* Same as fc_bitpar_lcsubseq1(). */
+static int32_t fc_packed_lcsubseq1(const struct fc_packed_peq *peq, int bits,
+                                   const uint64_t *seq, int32_t start,
+                                   int32_t len)
+{
+   const uint64_t mask = ~UINT64_C(0) >> (FC_WORD_BITS - peq->len);
+   uint64_t s = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t u = s & peq->rows[fc_packed_get(seq, start + i, bits)];
+      s = (s + u) | (s - u);
+   }
+   return fc_popcount(~s & mask);
+}
+
+/* Same as fc_bitpar_lcsubseqN(). */
+static int32_t fc_packed_lcsubseqN(const struct fc_packed_peq *peq, int bits,
+                                   const uint64_t *seq, int32_t start,
+                                   int32_t len)
+{
+   const int32_t words = peq->words;
+   uint64_t s[FC_MAX_WORDS];
+
+   for (int32_t w = 0; w < words; w++)
+      s[w] = ~UINT64_C(0);
+
+   for (int32_t i = 0; i < len; i++) {
+      const uint64_t sym = fc_packed_get(seq, start + i, bits);
+      const uint64_t *eqs = &peq->rows[sym * words];
+      uint64_t carry = 0;
+
+      for (int32_t w = 0; w < words; w++) {
+         const uint64_t u = s[w] & eqs[w];
+         const uint64_t sum = s[w] + carry;
+         const uint64_t x = sum + u;
+         carry = (sum < carry) | (x < u);
+         s[w] = x | (s[w] - u);
+      }
+   }
+
+   int32_t lcs = 0;
+   for (int32_t w = 0; w < words - 1; w++)
+      lcs += fc_popcount(~s[w]);
+   const int32_t rem = peq->len - (words - 1) * FC_WORD_BITS;
+   return lcs + fc_popcount(~s[words - 1] & (~UINT64_C(0) >> (FC_WORD_BITS - rem)));
+}
+
+int32_t fc_lcsubseq_packed(int bits, const uint64_t *seq1, int32_t len1,
+                           const uint64_t *seq2, int32_t len2)
+{
+   assert(bits == 2 || bits == 4);
+   assert(len1 >= 0 && len1 <= FC_MAX_SEQ_LEN);
+   assert(len2 >= 0 && len2 <= FC_MAX_SEQ_LEN);
+
+   if (len1 < len2) {
+      FC_SWAP(const uint64_t *, seq1, seq2);
+      FC_SWAP(int32_t, len1, len2);
+   }
+   const int32_t words2 = FC_PACKED_WORDS(len2, bits);
+   const int32_t orig_len2 = len2;
+   const int32_t start = fc_packed_strip(bits, seq1, &len1, seq2, &len2);
+   const int32_t stripped = orig_len2 - len2;
+   if (len2 == 0)
+      return stripped;
+
+   struct fc_packed_peq peq;
+   fc_packed_peq_init(&peq, bits, seq2, words2, start, len2);
+   if (peq.words == 1)
+      return stripped + fc_packed_lcsubseq1(&peq, bits, seq1, start, len1);
+   return stripped + fc_packed_lcsubseqN(&peq, bits, seq1, start, len1);
+}
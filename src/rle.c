@@ -0,0 +1,206 @@
+#include <assert.h>
+#include <string.h>
+#include "api.h"
+#include "bitpar.h"
+#include "mem.h"
+#include "macro.h"
+
+/* The matrix is cut into blocks, one per pair of runs, and only the last row
+ * and the last column of each block are computed, in time linear in their
+ * length. See Arbell, Landau and Mitchell, "Edit Distance of Run-Length
+ * Encoded Strings".
+ *
+ * In a block whose runs have the same character, a cell has the same value as
+ * the cell on its upper-left diagonal, since values of adjacent cells differ
+ * by at most one. In a block whose runs differ, every move costs one, so the
+ * value of a cell is the minimum, over the cells of the row above the block
+ * and of the column before it, of their value plus their Chebyshev distance
+ * to the cell.
+ */
+
+struct fc_rle_scratch {
+   int32_t *prefix;     /* prefix[i] = min(across[k] - k) for k <= i. */
+   int32_t *suffix;     /* suffix[i] = min(across[k]) for k >= i. */
+   int32_t *window;     /* Indexes of a monotone queue over "along". */
+};
+
+/* Computes an edge of a block whose runs differ: either its last row, with
+ * "along" the row above the block and "across" the column before it, or its
+ * last column, with the roles swapped. Both start with the top-left corner
+ * of the block. "along" has n + 1 cells, and "across" m + 1, so the edge is at
+ * distance "m" from "along". Sets out[t] for t in [1, n].
+ */
+static void fc_rle_mismatch_edge(const int32_t *along, int32_t n,
+                                 const int32_t *across, int32_t m,
+                                 struct fc_rle_scratch *sc, int32_t *out)
+{
+   int32_t *prefix = sc->prefix, *suffix = sc->suffix, *window = sc->window;
+
+   prefix[0] = across[0];
+   for (int32_t k = 1; k <= m; k++)
+      prefix[k] = FC_MIN(prefix[k - 1], across[k] - k);
+   suffix[m] = across[m];
+   for (int32_t k = m - 1; k >= 0; k--)
+      suffix[k] = FC_MIN(suffix[k + 1], across[k]);
+
+   /* Cells of "along" within distance "m" are in a sliding window, and
+    * farther ones in a running minimum.
+    */
+   int32_t head = 0, tail = 0, far = INT32_MAX;
+   window[tail++] = 0;
+   for (int32_t t = 1; t <= n; t++) {
+      while (tail > head && along[window[tail - 1]] >= along[t])
+         tail--;
+      window[tail++] = t;
+      if (t - m - 1 >= 0) {
+         far = FC_MIN(far, along[t - m - 1] - (t - m - 1));
+         if (window[head] < t - m)
+            head++;
+      }
+
+      int32_t v = m + along[window[head]];
+      if (far != INT32_MAX)
+         v = FC_MIN(v, t + far);
+      if (m - t >= 0)
+         v = FC_MIN(v, m + prefix[m - t]);
+      v = FC_MIN(v, t + suffix[FC_MAX(0, m - t + 1)]);
+      out[t] = v;
+   }
+}
+
+/* Same as above, for a block whose runs have the same character. */
+static void fc_rle_match_edge(const int32_t *along, int32_t n,
+                              const int32_t *across, int32_t m, int32_t *out)
+{
+   for (int32_t t = 1; t <= n; t++)
+      out[t] = t >= m ? along[t - m] : across[m - t];
+}
+
+static int64_t fc_rle_len(const struct fc_run *runs, int32_t nr, int32_t *max_run)
+{
+   int64_t len = 0;
+
+   *max_run = 0;
+   for (int32_t i = 0; i < nr; i++) {
+      assert(runs[i].len > 0);
+      len += runs[i].len;
+      *max_run = FC_MAX(*max_run, runs[i].len);
+   }
+   return len;
+}
+
+int32_t fc_rle_encode(const char32_t *seq, int32_t len, struct fc_run *runs)
+{
+   int32_t nr = 0;
+
+   for (int32_t i = 0; i < len; i++) {
+      if (nr && runs[nr - 1].c == seq[i])
+         runs[nr - 1].len++;
+      else
+         runs[nr++] = (struct fc_run){.c = seq[i], .len = 1};
+   }
+   return nr;
+}
+
+/* Cost of a block relative to a cell of its edges. */
+#define FC_RLE_BLOCK_COST 10
+
+/* Computing a cell of the edges of a block costs about as much as a word of a
+ * column with the bit-parallel algorithm, which processes 64 cells at once, so
+ * runs must be long for the edges to be worth it. Otherwise, the sequences are
+ * decoded.
+ */
+static bool fc_rle_worth(int64_t nr1, int64_t len1, int64_t nr2, int64_t len2)
+{
+   const int64_t rle_cost = nr1 * len2 + nr2 * len1 + FC_RLE_BLOCK_COST * nr1 * nr2;
+   const int64_t bitpar_cost = FC_MAX(len1, len2)
+                               * ((FC_MIN(len1, len2) + FC_WORD_BITS - 1) / FC_WORD_BITS);
+   return rle_cost < bitpar_cost;
+}
+
+static char32_t *fc_rle_decode(const struct fc_run *runs, int32_t nr, char32_t *seq)
+{
+   for (int32_t i = 0; i < nr; i++)
+      for (int32_t k = 0; k < runs[i].len; k++)
+         *seq++ = runs[i].c;
+   return seq;
+}
+
+int32_t fc_levenshtein_rle(const struct fc_run *runs1, int32_t nr1,
+                           const struct fc_run *runs2, int32_t nr2)
+{
+   assert(nr1 >= 0 && nr2 >= 0);
+
+   int32_t max1, max2;
+   int64_t len1 = fc_rle_len(runs1, nr1, &max1);
+   int64_t len2 = fc_rle_len(runs2, nr2, &max2);
+   assert(len1 <= INT32_MAX && len2 <= INT32_MAX);
+
+   /* The row is as long as the second sequence, so use the shortest one. */
+   if (len1 < len2) {
+      FC_SWAP(const struct fc_run *, runs1, runs2);
+      FC_SWAP(int32_t, nr1, nr2);
+      FC_SWAP(int64_t, len1, len2);
+      FC_SWAP(int32_t, max1, max2);
+   }
+   if (len2 == 0)
+      return len1;
+
+   if (!fc_rle_worth(nr1, len1, nr2, len2)) {
+      char32_t *seq1 = fc_malloc((len1 + len2) * sizeof *seq1);
+      char32_t *seq2 = fc_rle_decode(runs1, nr1, seq1);
+      fc_rle_decode(runs2, nr2, seq2);
+      const int32_t dist = fc_levenshtein_long(seq1, len1, seq2, len2, 1);
+      fc_free(seq1);
+      return dist;
+   }
+
+   const int32_t max = FC_MAX(max1, max2) + 1;
+   int32_t *row = fc_malloc((len2 + 1 + 2 * (max1 + 1) + (max2 + 1) + 3 * max)
+                            * sizeof *row);
+   int32_t *left = &row[len2 + 1], *right = &left[max1 + 1];
+   int32_t *top = &right[max1 + 1];
+   struct fc_rle_scratch sc = {
+      .prefix = &top[max2 + 1],
+      .suffix = &top[max2 + 1 + max],
+      .window = &top[max2 + 1 + 2 * max],
+   };
+
+   for (int32_t c = 0; c <= len2; c++)
+      row[c] = c;
+
+   /* The matrix is computed by strips of rows, one per run of "runs1". The
+    * last row of a strip is computed in "row", block by block. The last
+    * column of a block is the first one of the next block.
+    */
+   int32_t x0 = 0;
+   for (int32_t i = 0; i < nr1; i++) {
+      const int32_t h = runs1[i].len;
+      for (int32_t x = 0; x <= h; x++)
+         left[x] = x0 + x;
+
+      int32_t c0 = 0;
+      for (int32_t j = 0; j < nr2; j++) {
+         const int32_t w = runs2[j].len;
+         top[0] = left[0];
+         memcpy(&top[1], &row[c0 + 1], w * sizeof *top);
+
+         if (runs1[i].c == runs2[j].c) {
+            fc_rle_match_edge(top, w, left, h, &row[c0]);
+            fc_rle_match_edge(left, h, top, w, right);
+         } else {
+            fc_rle_mismatch_edge(top, w, left, h, &sc, &row[c0]);
+            fc_rle_mismatch_edge(left, h, top, w, &sc, right);
+         }
+         right[0] = top[w];
+         FC_SWAP(int32_t *, left, right);
+         c0 += w;
+      }
+      x0 += h;
+      row[0] = x0;
+   }
+
+   const int32_t dist = row[len2];
+   fc_free(row);
+   return dist;
+}
@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <string.h>
+#include "sam.h"
+#include "mem.h"
+#include "macro.h"
+#include "elem.h"
+
+static int32_t fc_sam_add_state(struct fc_sam *sam, int32_t len, int32_t link)
+{
+   const int32_t s = sam->states_nr++;
+   sam->states[s] = (struct fc_sam_state){.len = len, .link = link, .edges = -1};
+   return s;
+}
+
+static void fc_sam_add_edge(struct fc_sam *sam, int32_t from, char32_t c,
+                            int32_t to)
+{
+   uint32_t i = fc_sam_hash(sam, from, c);
+   while (sam->slots[i])
+      i = (i + 1) & sam->mask;
+
+   const int32_t e = sam->edges_nr++;
+   sam->edges[e] = (struct fc_sam_edge){
+      .from = from,
+      .c = c,
+      .to = to,
+      .next = sam->states[from].edges,
+   };
+   sam->states[from].edges = e;
+   sam->slots[i] = e + 1;
+}
+
+static void fc_sam_extend(struct fc_sam *sam, int32_t *last, char32_t c)
+{
+   struct fc_sam_state *states = sam->states;
+   const int32_t cur = fc_sam_add_state(sam, states[*last].len + 1, 0);
+   int32_t p = *last;
+   const struct fc_sam_edge *edge = NULL;
+
+   while (p >= 0 && !(edge = fc_sam_edge(sam, p, c))) {
+      fc_sam_add_edge(sam, p, c, cur);
+      p = states[p].link;
+   }
+   *last = cur;
+   if (p < 0)
+      return;
+
+   const int32_t q = edge->to;
+   if (states[p].len + 1 == states[q].len) {
+      states[cur].link = q;
+      return;
+   }
+
+   /* Split the state "q", so that the strings of length len(p) + 1 it holds
+    * get their own state.
+    */
+   const int32_t clone = fc_sam_add_state(sam, states[p].len + 1, states[q].link);
+   for (int32_t e = states[q].edges; e >= 0; e = sam->edges[e].next)
+      fc_sam_add_edge(sam, clone, sam->edges[e].c, sam->edges[e].to);
+
+   struct fc_sam_edge *redirect;
+   while (p >= 0 && (redirect = fc_sam_edge(sam, p, c)) && redirect->to == q) {
+      redirect->to = clone;
+      p = states[p].link;
+   }
+   states[q].link = states[cur].link = clone;
+}
+
+void fc_sam_init_elems(struct fc_sam *sam, const void *seq, int32_t len,
+                       int size)
+{
+   assert(len >= 0 && len <= FC_MAX_SEQ_LEN);
+
+   const int32_t max_states = 2 * len + 1;
+   const int32_t max_edges = 3 * len + 1;
+
+   /* Keep the load factor under 1/2. */
+   uint32_t slots_nr = 8;
+   int shift = 29;
+   while (slots_nr < 2 * (uint32_t)max_edges) {
+      slots_nr <<= 1;
+      shift--;
+   }
+
+   sam->len = len;
+   sam->states_nr = sam->edges_nr = 0;
+   sam->mask = slots_nr - 1;
+   sam->shift = shift;
+
+   sam->states = fc_malloc(max_states * sizeof *sam->states
+                           + max_edges * sizeof *sam->edges
+                           + slots_nr * sizeof *sam->slots);
+   sam->edges = (struct fc_sam_edge *)&sam->states[max_states];
+   sam->slots = (int32_t *)&sam->edges[max_edges];
+   memset(sam->slots, 0, slots_nr * sizeof *sam->slots);
+
+   int32_t last = fc_sam_add_state(sam, 0, -1);
+   for (int32_t i = 0; i < len; i++)
+      fc_sam_extend(sam, &last, fc_elem(seq, i, size));
+
+   assert(sam->states_nr <= max_states && sam->edges_nr <= max_edges);
+}
+
+void fc_sam_fini(struct fc_sam *sam)
+{
+   fc_free(sam->states);
+}
+
+/* Walks the automaton with "seq", following suffix links on mismatches. After
+ * each character, "match" is the length of the longest suffix of the prefix
+ * of "seq" read so far that is a substring of the other sequence.
+ */
+int32_t fc_sam_lcsubstr_elems(const struct fc_sam *sam, const void *seq,
+                              int32_t len, int32_t *end, int size)
+{
+   assert(len >= 0);
+
+   const struct fc_sam_state *states = sam->states;
+   int32_t state = 0, match = 0;
+   int32_t max_len = 0;
+
+   for (int32_t i = 0; i < len; i++) {
+      const char32_t c = fc_elem(seq, i, size);
+      const struct fc_sam_edge *edge;
+      while (!(edge = fc_sam_edge(sam, state, c)) && state) {
+         state = states[state].link;
+         match = states[state].len;
+      }
+      if (edge) {
+         state = edge->to;
+         match++;
+      } else {
+         match = 0;
+      }
+      if (max_len < match) {
+         max_len = match;
+         if (end)
+            *end = i;
+      }
+   }
+   return max_len;
+}
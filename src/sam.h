@@ -0,0 +1,93 @@
+#ifndef FC_SAM_H
+#define FC_SAM_H
+
+#include <stdint.h>
+#include <uchar.h>
+#include "api.h"
+
+struct fc_sam_state {
+   int32_t len;         /* Length of the longest string of the state. */
+   int32_t link;        /* Suffix link, or -1 for the root. */
+   int32_t edges;       /* First outgoing edge, or -1. */
+};
+
+struct fc_sam_edge {
+   int32_t from;
+   char32_t c;
+   int32_t to;
+   int32_t next;        /* Next outgoing edge of "from", or -1. */
+};
+
+/* Suffix automaton of a sequence (Blumer et al.). This is the smallest
+ * automaton that recognizes all the substrings of the sequence. It has at most
+ * 2n - 1 states and 3n - 4 edges, and is built in linear time. Since the
+ * alphabet is huge, edges are stored in a contiguous array, and looked up with
+ * an open-addressing hash table keyed on their source state and label.
+ */
+struct fc_sam {
+   int32_t len;                  /* Length of the sequence. */
+   int32_t states_nr;
+   int32_t edges_nr;
+   uint32_t mask;                /* Number of slots minus one. */
+   int shift;                    /* For reducing hash values. */
+   int32_t *slots;               /* Edge index + 1, or 0 if the slot is free. */
+   struct fc_sam_state *states;
+   struct fc_sam_edge *edges;
+};
+
+/* Builds the automaton of a sequence of elements of "size" bytes. The sequence
+ * is not referenced afterwards.
+ */
+void fc_sam_init_elems(struct fc_sam *, const void *seq, int32_t len, int size);
+
+static inline void fc_sam_init(struct fc_sam *sam, const char32_t *seq,
+                               int32_t len)
+{
+   fc_sam_init_elems(sam, seq, len, sizeof *seq);
+}
+
+void fc_sam_fini(struct fc_sam *);
+
+static inline uint32_t fc_sam_hash(const struct fc_sam *sam, int32_t from,
+                                   char32_t c)
+{
+   return (((uint32_t)c ^ ((uint32_t)from * UINT32_C(0x85EBCA6B)))
+           * UINT32_C(0x9E3779B1)) >> sam->shift;
+}
+
+/* Returns the edge leaving a state with a given label, or NULL if there is
+ * none.
+ */
+static inline struct fc_sam_edge *fc_sam_edge(const struct fc_sam *sam,
+                                              int32_t from, char32_t c)
+{
+   uint32_t i = fc_sam_hash(sam, from, c);
+
+   for (;;) {
+      const int32_t e = sam->slots[i];
+      if (!e)
+         return NULL;
+      struct fc_sam_edge *edge = &sam->edges[e - 1];
+      if (edge->from == from && edge->c == c)
+         return edge;
+      i = (i + 1) & sam->mask;
+   }
+}
+
+/* Computes the length of the longest common substring between the sequence
+ * an automaton was built from and another sequence. If "end" is not NULL and
+ * the length is not zero, it is set to the index in "seq" of the last
+ * character of the leftmost longest common substring. "seq" is made of
+ * elements of "size" bytes.
+ */
+int32_t fc_sam_lcsubstr_elems(const struct fc_sam *, const void *seq,
+                              int32_t len, int32_t *end, int size);
+
+static inline int32_t fc_sam_lcsubstr(const struct fc_sam *sam,
+                                      const char32_t *seq, int32_t len,
+                                      int32_t *end)
+{
+   return fc_sam_lcsubstr_elems(sam, seq, len, end, sizeof *seq);
+}
+
+#endif
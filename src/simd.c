@@ -0,0 +1,936 @@
+#include <assert.h>
+#include <string.h>
+#include "api.h"
+#include "mem.h"
+#include "macro.h"
+#include "bitpar.h"
+#include "elem.h"
+#include "simd.h"
+
+#ifdef FC_HAVE_SIMD
+
+/* Number of cells processed per vector. Values stored in cells are at most
+ * len1 + len2, plus the number of anti-diagonals for garbage cells past the
+ * end of a diagonal, so 16 bits are always enough.
+ */
+#define LANES 32
+
+static_assert(4 * FC_MAX_SEQ_LEN < INT16_MAX, "");
+
+typedef int16_t fc_vec __attribute__((vector_size(LANES * sizeof(int16_t))));
+
+#define VLOAD(v, p) memcpy(&(v), (p), sizeof(v))
+#define VSTORE(p, v) memcpy((p), &(v), sizeof(v))
+
+/* Lane-wise selection. "m" must hold -1 or 0 in each lane. The result has the
+ * type of "a", even if "m" has a different signedness.
+ */
+#define VSEL(m, a, b) ((__typeof__(a))(((m) & (a)) | (~(m) & (b))))
+#define VMIN(a, b) VSEL((a) < (b), a, b)
+#define VMAX(a, b) VSEL((a) > (b), a, b)
+
+/* Defines a function "name" that calls "name##_body" compiled for the best
+ * instruction set supported by the CPU. The body must be always inlined for
+ * this to work.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+   #define FC_DISPATCH(ret, name, params, args)                                \
+   __attribute__((target("avx512f,avx512bw")))                                 \
+   static ret name##_avx512 params { return name##_body args; }                \
+   __attribute__((target("avx2")))                                             \
+   static ret name##_avx2 params { return name##_body args; }                  \
+   ret name params                                                             \
+   {                                                                           \
+      if (__builtin_cpu_supports("avx512bw"))                                  \
+         return name##_avx512 args;                                            \
+      if (__builtin_cpu_supports("avx2"))                                      \
+         return name##_avx2 args;                                              \
+      return name##_body args;                                                 \
+   }
+#else
+   #define FC_DISPATCH(ret, name, params, args)                                \
+   ret name params { return name##_body args; }
+#endif
+
+/* Maps the characters of the sequences to small integers, so that they fit in
+ * 16-bit lanes. Characters of "seq2" are numbered from 1, and characters of
+ * "seq1" that don't appear in "seq2" are mapped to 0. "seq2" is reversed, for
+ * anti-diagonals to be contiguous in memory. Both arrays are padded with LANES
+ * values that don't match anything.
+ */
+static void fc_simd_remap(int16_t *ids1, const void *seq1, int32_t len1,
+                          int16_t *ids2, const void *seq2, int32_t len2,
+                          bool reverse, int size)
+{
+   struct fc_peq peq;
+   fc_peq_init_elems(&peq, seq2, len2, size);
+
+   for (int32_t i = 0; i < len1; i++)
+      ids1[i] = fc_peq_slot(&peq, fc_elem(seq1, i, size))->row;
+   for (int32_t i = len1; i < len1 + LANES; i++)
+      ids1[i] = 0;
+
+   for (int32_t i = 0; i < len2; i++) {
+      const int32_t id = fc_peq_slot(&peq, fc_elem(seq2, i, size))->row;
+      ids2[reverse ? len2 - 1 - i : i] = id;
+   }
+   for (int32_t i = len2; i < len2 + LANES; i++)
+      ids2[i] = -1;
+
+   fc_peq_fini(&peq);
+}
+
+
+/*******************************************************************************
+ * Normalized Levenshtein and Damerau, by longest alignment
+ ******************************************************************************/
+
+/* Cell (i, j) of the matrix is stored at index i of the array of the
+ * anti-diagonal i + j. Its neighbours are then at index i - 1 (up) and i
+ * (left) of the previous anti-diagonal, and at index i - 1 of the one before
+ * (diagonal). Cells on a given anti-diagonal don't depend on each other, so
+ * they can be computed in parallel. "rb" is the reversed version of "seq2".
+ */
+FC_ALWAYS_INLINE double fc_simd_nlevenshtein_kernel_body(const int16_t *a, int32_t len1,
+                                                         const int16_t *rb, int32_t len2,
+                                                         int16_t *buf)
+{
+   const int32_t size = len1 + 1 + LANES;
+   int16_t *d0 = buf, *d1 = &d0[size], *d2 = &d1[size];
+   int16_t *l0 = &d2[size], *l1 = &l0[size], *l2 = &l1[size];
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_vec ud, ld, dd, ul, ll, dl, va, vb;
+         VLOAD(ud, &d1[i - 1]);
+         VLOAD(ld, &d1[i]);
+         VLOAD(dd, &d2[i - 1]);
+         VLOAD(ul, &l1[i - 1]);
+         VLOAD(ll, &l1[i]);
+         VLOAD(dl, &l2[i - 1]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+
+         const fc_vec ic = ld + 1;
+         const fc_vec dc = ud + 1;
+         const fc_vec rc = dd + 1 + (va == vb);
+         fc_vec d = VMIN(dc, rc);
+         d = VMIN(ic, d);
+
+         const fc_vec lic = (ic == d) & (ll + 1);
+         const fc_vec ldc = (dc == d) & (ul + 1);
+         const fc_vec lrc = (rc == d) & (dl + 1);
+         fc_vec l = VMAX(lic, ldc);
+         l = VMAX(l, lrc);
+
+         VSTORE(&d0[i], d);
+         VSTORE(&l0[i], l);
+      }
+      /* The last vector might have overwritten the first column. */
+      if (k <= len2)
+         d0[0] = l0[0] = k;
+      if (k <= len1)
+         d0[k] = l0[k] = k;
+
+      FC_SWAP3(int16_t *, d2, d1, d0);
+      FC_SWAP3(int16_t *, l2, l1, l0);
+   }
+
+   return d1[len1] / (double)l1[len1];
+}
+
+FC_DISPATCH(double, fc_simd_nlevenshtein_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+/* Same as above, with transpositions. These are found on the anti-diagonal
+ * i + j - 4, at index i - 2, so we need two more anti-diagonals, and one
+ * padding cell at the beginning of each array.
+ */
+FC_ALWAYS_INLINE double fc_simd_ndamerau_kernel_body(const int16_t *a, int32_t len1,
+                                                     const int16_t *rb, int32_t len2,
+                                                     int16_t *buf)
+{
+   const int32_t size = len1 + 2 + LANES;
+   int16_t *d[5], *l[5];
+
+   for (int32_t n = 0; n < 5; n++) {
+      d[n] = &buf[(2 * n) * size + 1];
+      l[n] = &buf[(2 * n + 1) * size + 1];
+   }
+
+   const fc_vec none = {0};
+   const fc_vec inf = none + INT16_MAX;
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+      int16_t *d0 = d[0], *d1 = d[1], *d2 = d[2], *d4 = d[4];
+      int16_t *l0 = l[0], *l1 = l[1], *l2 = l[2], *l4 = l[4];
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_vec ud, ld, dd, td, ul, ll, dl, tl, va, vb, ta, tb;
+         VLOAD(ud, &d1[i - 1]);
+         VLOAD(ld, &d1[i]);
+         VLOAD(dd, &d2[i - 1]);
+         VLOAD(td, &d4[i - 2]);
+         VLOAD(ul, &l1[i - 1]);
+         VLOAD(ll, &l1[i]);
+         VLOAD(dl, &l2[i - 1]);
+         VLOAD(tl, &l4[i - 2]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+         VLOAD(ta, &a[i - 2]);
+         VLOAD(tb, &rb[len2 - k + i + 1]);
+
+         const fc_vec transposed = (ta == vb) & (va == tb);
+         const fc_vec ic = ld + 1;
+         const fc_vec dc = ud + 1;
+         const fc_vec rc = dd + 1 + (va == vb);
+         const fc_vec tc = VSEL(transposed, td + 1, inf);
+         fc_vec dist = VMIN(dc, rc);
+         dist = VMIN(ic, dist);
+         dist = VMIN(tc, dist);
+
+         const fc_vec lic = (ic == dist) & (ll + 1);
+         const fc_vec ldc = (dc == dist) & (ul + 1);
+         const fc_vec lrc = (rc == dist) & (dl + 1);
+         const fc_vec ltc = (tc == dist) & (tl + 1);
+         fc_vec len = VMAX(lic, ldc);
+         len = VMAX(len, lrc);
+         len = VMAX(len, ltc);
+
+         VSTORE(&d0[i], dist);
+         VSTORE(&l0[i], len);
+      }
+      if (k <= len2)
+         d0[0] = l0[0] = k;
+      if (k <= len1)
+         d0[k] = l0[k] = k;
+
+      for (int32_t n = 4; n > 0; n--) {
+         FC_SWAP(int16_t *, d[n], d[n - 1]);
+         FC_SWAP(int16_t *, l[n], l[n - 1]);
+      }
+   }
+
+   return d[1][len1] / (double)l[1][len1];
+}
+
+FC_DISPATCH(double, fc_simd_ndamerau_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+/* When the sequences are short enough, distances and alignment lengths are
+ * packed together (see FC_LALIGN_PACK()), so that a single recurrence is
+ * computed instead of two. Packed values are unsigned, so that garbage cells
+ * past the end of an anti-diagonal can wrap around. These are never read by
+ * valid cells. len1 + len2 must be lower than FC_LALIGN16_MAX_LEN, so that
+ * intermediate values don't overflow.
+ */
+typedef uint16_t fc_uvec __attribute__((vector_size(LANES * sizeof(uint16_t))));
+
+#define FC_LALIGN16_SCALE 256
+#define FC_LALIGN16_MAX_LEN 240
+
+static_assert((FC_LALIGN16_MAX_LEN + 2) * FC_LALIGN16_SCALE <= UINT16_MAX, "");
+
+FC_ALWAYS_INLINE double fc_simd_nlevenshtein_packed_body(const int16_t *a, int32_t len1,
+                                                         const int16_t *rb, int32_t len2,
+                                                         int16_t *buf)
+{
+   const int32_t size = len1 + 1 + LANES;
+   const uint16_t scale = FC_LALIGN16_SCALE;
+   uint16_t *d0 = (uint16_t *)buf, *d1 = &d0[size], *d2 = &d1[size];
+
+   d1[0] = FC_LALIGN_PACK(0, 0, scale);
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_uvec up, left, diag;
+         fc_vec va, vb;
+         VLOAD(up, &d1[i - 1]);
+         VLOAD(left, &d1[i]);
+         VLOAD(diag, &d2[i - 1]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+
+         const fc_uvec idc = VMIN(up, left) + scale;
+         const fc_uvec rc = diag + ((fc_uvec)(va != vb) & scale);
+         const fc_uvec v = VMIN(idc, rc) - 1;
+         VSTORE(&d0[i], v);
+      }
+      if (k <= len2)
+         d0[0] = FC_LALIGN_PACK(k, k, scale);
+      if (k <= len1)
+         d0[k] = FC_LALIGN_PACK(k, k, scale);
+
+      FC_SWAP3(uint16_t *, d2, d1, d0);
+   }
+
+   return FC_LALIGN_DIST(d1[len1], scale) / (double)FC_LALIGN_LEN(d1[len1], scale);
+}
+
+FC_DISPATCH(double, fc_simd_nlevenshtein_packed,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+FC_ALWAYS_INLINE double fc_simd_ndamerau_packed_body(const int16_t *a, int32_t len1,
+                                                     const int16_t *rb, int32_t len2,
+                                                     int16_t *buf)
+{
+   const int32_t size = len1 + 2 + LANES;
+   const uint16_t scale = FC_LALIGN16_SCALE;
+   uint16_t *d[5];
+
+   for (int32_t n = 0; n < 5; n++)
+      d[n] = (uint16_t *)&buf[n * size + 1];
+   d[1][0] = FC_LALIGN_PACK(0, 0, scale);
+
+   for (int32_t k = 1; k <= len1 + len2; k++) {
+      const int32_t bot = FC_MAX(1, k - len2);
+      const int32_t top = FC_MIN(len1, k - 1);
+      uint16_t *d0 = d[0], *d1 = d[1], *d2 = d[2], *d4 = d[4];
+
+      for (int32_t i = bot; i <= top; i += LANES) {
+         fc_uvec up, left, diag, tr;
+         fc_vec va, vb, ta, tb;
+         VLOAD(up, &d1[i - 1]);
+         VLOAD(left, &d1[i]);
+         VLOAD(diag, &d2[i - 1]);
+         VLOAD(tr, &d4[i - 2]);
+         VLOAD(va, &a[i - 1]);
+         VLOAD(vb, &rb[len2 - k + i]);
+         VLOAD(ta, &a[i - 2]);
+         VLOAD(tb, &rb[len2 - k + i + 1]);
+
+         /* Lanes without a transposition are set to the maximum value. */
+         const fc_uvec transposed = (fc_uvec)((ta == vb) & (va == tb));
+         const fc_uvec tc = (tr + scale) | ~transposed;
+         const fc_uvec idc = VMIN(up, left) + scale;
+         const fc_uvec rc = diag + ((fc_uvec)(va != vb) & scale);
+         fc_uvec v = VMIN(idc, rc);
+         v = VMIN(v, tc) - 1;
+         VSTORE(&d0[i], v);
+      }
+      if (k <= len2)
+         d0[0] = FC_LALIGN_PACK(k, k, scale);
+      if (k <= len1)
+         d0[k] = FC_LALIGN_PACK(k, k, scale);
+
+      for (int32_t n = 4; n > 0; n--)
+         FC_SWAP(uint16_t *, d[n], d[n - 1]);
+   }
+
+   return FC_LALIGN_DIST(d[1][len1], scale) / (double)FC_LALIGN_LEN(d[1][len1], scale);
+}
+
+FC_DISPATCH(double, fc_simd_ndamerau_packed,
+            (const int16_t *a, int32_t len1, const int16_t *rb, int32_t len2, int16_t *buf),
+            (a, len1, rb, len2, buf))
+
+/* Remaps the sequences and allocates the anti-diagonals. "a" has one padding
+ * value at the beginning, for transpositions.
+ */
+static double fc_simd_normalized(double (*kernel)(const int16_t *, int32_t,
+                                                  const int16_t *, int32_t,
+                                                  int16_t *),
+                                 int32_t diagonals,
+                                 const void *seq1, int32_t len1,
+                                 const void *seq2, int32_t len2, int size)
+{
+   assert(len1 >= len2 && len2 > 0);
+
+   const size_t diag_size = len1 + 2 + LANES;
+   const size_t total = (len1 + 1 + LANES) + (len2 + LANES) + diagonals * diag_size;
+   int16_t *a = fc_malloc(total * sizeof *a);
+   int16_t *rb = &a[len1 + 1 + LANES];
+   int16_t *buf = &rb[len2 + LANES];
+
+   a[0] = 0;
+   fc_simd_remap(&a[1], seq1, len1, rb, seq2, len2, true, size);
+   memset(buf, 0, diagonals * diag_size * sizeof *buf);
+
+   double dist = kernel(&a[1], len1, rb, len2, buf);
+
+   fc_free(a);
+   return dist;
+}
+
+double fc_simd_nlevenshtein(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size)
+{
+   if (len1 + len2 < FC_LALIGN16_MAX_LEN)
+      return fc_simd_normalized(fc_simd_nlevenshtein_packed, 3,
+                                seq1, len1, seq2, len2, size);
+   return fc_simd_normalized(fc_simd_nlevenshtein_kernel, 6,
+                             seq1, len1, seq2, len2, size);
+}
+
+double fc_simd_ndamerau(const void *seq1, int32_t len1,
+                        const void *seq2, int32_t len2, int size)
+{
+   if (len1 + len2 < FC_LALIGN16_MAX_LEN)
+      return fc_simd_normalized(fc_simd_ndamerau_packed, 5,
+                                seq1, len1, seq2, len2, size);
+   return fc_simd_normalized(fc_simd_ndamerau_kernel, 10,
+                             seq1, len1, seq2, len2, size);
+}
+
+
+/*******************************************************************************
+ * Longest common substring
+ ******************************************************************************/
+
+/* A cell only depends on its diagonal neighbour, so there is no need for
+ * anti-diagonals: a whole row can be computed in parallel from the previous
+ * one. Rows are offset by one, so that the cell at index 0 is always zero.
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_lcsubstr_kernel_body(const int16_t *a, int32_t len1,
+                                                      const int16_t *b, int32_t len2,
+                                                      int16_t *buf, int32_t *pos)
+{
+   int16_t *prev = buf, *cur = &buf[len2 + 1 + LANES];
+   int32_t max_len = 0;
+
+   for (int32_t i = 0; i < len1; i++) {
+      const fc_vec none = {0};
+      const fc_vec c = none + a[i];
+      fc_vec row_max = none;
+
+      for (int32_t j = 0; j < len2; j += LANES) {
+         fc_vec up_left, vb;
+         VLOAD(up_left, &prev[j]);
+         VLOAD(vb, &b[j]);
+         const fc_vec v = (c == vb) & (up_left + 1);
+         VSTORE(&cur[j + 1], v);
+         row_max = VMAX(row_max, v);
+      }
+
+      /* Check quickly if a longer substring was found before looking for its
+       * length.
+       */
+      const fc_vec longer = row_max > (int16_t)max_len;
+      uint64_t any[sizeof longer / sizeof(uint64_t)], found = 0;
+      memcpy(any, &longer, sizeof any);
+      for (size_t n = 0; n < FC_ARRAY_SIZE(any); n++)
+         found |= any[n];
+      if (found) {
+         for (int32_t n = 0; n < LANES; n++)
+            if (max_len < row_max[n])
+               max_len = row_max[n];
+         *pos = i;
+      }
+      FC_SWAP(int16_t *, prev, cur);
+   }
+   return max_len;
+}
+
+FC_DISPATCH(int32_t, fc_simd_lcsubstr_kernel,
+            (const int16_t *a, int32_t len1, const int16_t *b, int32_t len2, int16_t *buf, int32_t *pos),
+            (a, len1, b, len2, buf, pos))
+
+int32_t fc_simd_lcsubstr(const void *seq1, int32_t len1,
+                         const void *seq2, int32_t len2,
+                         const void **pos, int size)
+{
+   assert(len1 > 0 && len2 > 0);
+
+   const size_t row_size = len2 + 1 + LANES;
+   const size_t total = (len1 + LANES) + (len2 + LANES) + 2 * row_size;
+   int16_t *a = fc_malloc(total * sizeof *a);
+   int16_t *b = &a[len1 + LANES];
+   int16_t *buf = &b[len2 + LANES];
+
+   fc_simd_remap(a, seq1, len1, b, seq2, len2, false, size);
+   memset(buf, 0, 2 * row_size * sizeof *buf);
+
+   int32_t end = 0;
+   int32_t max_len = fc_simd_lcsubstr_kernel(a, len1, b, len2, buf, &end);
+
+   fc_free(a);
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
+}
+
+/* Same size as fc_vec, for comparing characters without remapping them. */
+typedef char32_t fc_cvec __attribute__((vector_size(sizeof(fc_vec))));
+typedef int32_t fc_cmask __attribute__((vector_size(sizeof(fc_vec))));
+
+static_assert(FC_ARRAY_SIZE((fc_cvec){0}) == FC_SIMD_SHORT_LEN, "");
+
+/* Diagonals of the matrix are compared at once: "x" is held in a vector, and
+ * compared to a window of "y" for each shift. The matches are converted to a
+ * bit-mask, where the longest run of set bits is found by shifting and masking
+ * it until it is empty. The last non-empty mask holds the first position of
+ * the runs that are as long as possible, so we get the leftmost one on the
+ * diagonal with a count of trailing zeros. Among diagonals, the run that ends
+ * first in "seq1" wins ties, which is "x" or "y" depending on "swapped".
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_lcsubstr_short_body(const char32_t *x, int32_t lenx,
+                                                     const char32_t *ypad, int32_t leny,
+                                                     bool swapped, int32_t *end)
+{
+   const int32_t nx = FC_SIMD_SHORT_LEN;
+   const uint32_t xbits = (UINT32_C(1) << lenx) - 1;
+   fc_cvec vx = {0};
+   int32_t max_len = 0;
+
+   memcpy(&vx, x, lenx * sizeof *x);
+
+   /* Lane n is compared with y[n + shift]. */
+   for (int32_t shift = 1 - lenx; shift < leny; shift++) {
+      fc_cvec vy;
+      VLOAD(vy, &ypad[nx + shift]);
+      const fc_cmask eq = (fc_cmask)(vx == vy);
+
+      uint32_t m = 0;
+      for (int32_t n = 0; n < nx; n++)
+         m |= (uint32_t)(eq[n] & 1) << n;
+
+      /* Discard lanes out of "x" or "y". */
+      m &= xbits;
+      if (shift < 0)
+         m &= UINT32_MAX << -shift;
+      if (leny - shift < nx)
+         m &= (UINT32_C(1) << (leny - shift)) - 1;
+
+      if (!m || fc_popcount(m) < max_len)
+         continue;
+
+      uint32_t starts = m;
+      int32_t run = 0;
+      while (m) {
+         starts = m;
+         m &= m >> 1;
+         run++;
+      }
+      const int32_t xend = fc_ctz(starts) + run - 1;
+      const int32_t seq1_end = swapped ? xend + shift : xend;
+      if (run > max_len || (run == max_len && seq1_end < *end)) {
+         max_len = run;
+         *end = seq1_end;
+      }
+   }
+   return max_len;
+}
+
+FC_DISPATCH(int32_t, fc_simd_lcsubstr_short,
+            (const char32_t *x, int32_t lenx, const char32_t *ypad, int32_t leny, bool swapped, int32_t *end),
+            (x, lenx, ypad, leny, swapped, end))
+
+/* Copies "len" elements of "size" bytes to "dst", as characters. */
+static void fc_simd_widen(char32_t *dst, const void *src, int32_t len, int size)
+{
+   if (size == sizeof *dst) {
+      memcpy(dst, src, len * sizeof *dst);
+      return;
+   }
+   for (int32_t i = 0; i < len; i++)
+      dst[i] = fc_elem(src, i, size);
+}
+
+int32_t fc_simd_lcsubstr_diagonal(const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2,
+                                  const void **pos, int size)
+{
+   assert(len1 > 0 && len2 > 0);
+   assert(len1 <= FC_SIMD_SHORT_LEN || len2 <= FC_SIMD_SHORT_LEN);
+
+   /* Put the shortest sequence in the vector. */
+   const bool swapped = len1 > FC_SIMD_SHORT_LEN;
+   const void *x = swapped ? seq2 : seq1, *y = swapped ? seq1 : seq2;
+   const int32_t lenx = swapped ? len2 : len1, leny = swapped ? len1 : len2;
+
+   /* Both sequences are compared as characters. "y" is padded on both sides,
+    * so that windows never go out of bounds.
+    */
+   char32_t xbuf[FC_SIMD_SHORT_LEN];
+   fc_simd_widen(xbuf, x, lenx, size);
+
+   char32_t buf[4 * FC_SIMD_SHORT_LEN], *ypad = buf;
+   const size_t pad_len = leny + 2 * FC_SIMD_SHORT_LEN;
+   if (pad_len > FC_ARRAY_SIZE(buf))
+      ypad = fc_malloc(pad_len * sizeof *ypad);
+   memset(ypad, 0, FC_SIMD_SHORT_LEN * sizeof *ypad);
+   fc_simd_widen(&ypad[FC_SIMD_SHORT_LEN], y, leny, size);
+   memset(&ypad[FC_SIMD_SHORT_LEN + leny], 0, FC_SIMD_SHORT_LEN * sizeof *ypad);
+
+   int32_t end = 0;
+   const int32_t max_len = fc_simd_lcsubstr_short(xbuf, lenx, ypad, leny, swapped, &end);
+
+   if (ypad != buf)
+      fc_free(ypad);
+   if (pos)
+      *pos = fc_elem_ptr(seq1, max_len ? end - max_len + 1 : len1, size);
+   return max_len;
+}
+
+
+
+/*******************************************************************************
+ * Batch computation
+ ******************************************************************************/
+
+/* Same size as fc_vec, with twice as many lanes. */
+typedef int8_t fc_vec8 __attribute__((vector_size(2 * LANES * sizeof(int8_t))));
+
+/* Largest value that fits in the lanes of a fc_vec8. Used when both the query
+ * and the candidates are shorter than this.
+ */
+#define FC_BATCH8_MAX_LEN (INT8_MAX - 1)
+
+/* Candidates are compared to the query by groups, one candidate per lane, so
+ * that there is no dependency between lanes. The characters of the candidates
+ * of a group are interleaved in "chars", and "lens" holds their lengths (or -1
+ * for unused lanes). The matrix is filled column by column, a column
+ * corresponding to a position in the candidates, and its value for a given
+ * candidate is saved in "res" when the end of this candidate is reached.
+ * "cols" must hold 3 * (qlen + 1) vectors.
+ */
+#define _(T, V)                                                                \
+FC_ALWAYS_INLINE void fc_simd_levenshtein_batch_##T##_body(                    \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   const V zero = {0};                                                         \
+   V vlens, vres;                                                              \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++) {                                       \
+      const V v = zero + (T)i;                                                 \
+      VSTORE(&cols[i * n], v);                                                 \
+   }                                                                           \
+   VLOAD(vlens, lens);                                                         \
+   vres = (vlens == 0) & (zero + (T)qlen);                                     \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, diag, left = zero + (T)j;                                           \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+      VLOAD(diag, &cols[0]);                                                   \
+      VSTORE(&cols[0], left);                                                  \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up;                                                                 \
+         VLOAD(up, &cols[i * n]);                                              \
+         const V ic = VMIN(up, left) + 1;                                      \
+         const V rc = diag + 1 + (c == q[i - 1]);                              \
+         left = VMIN(ic, rc);                                                  \
+         VSTORE(&cols[i * n], left);                                           \
+         diag = up;                                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_ALWAYS_INLINE void fc_simd_damerau_batch_##T##_body(                        \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   T *prev2 = cols, *prev = &prev2[(qlen + 1) * n], *cur = &prev[(qlen + 1) * n]; \
+   const V zero = {0};                                                         \
+   V vlens, vres, cprev = zero;                                                \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++) {                                       \
+      const V v = zero + (T)i;                                                 \
+      VSTORE(&prev[i * n], v);                                                 \
+   }                                                                           \
+   VLOAD(vlens, lens);                                                         \
+   vres = (vlens == 0) & (zero + (T)qlen);                                     \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, left = zero + (T)j;                                                 \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+      VSTORE(&cur[0], left);                                                   \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up, diag;                                                           \
+         VLOAD(up, &prev[i * n]);                                              \
+         VLOAD(diag, &prev[(i - 1) * n]);                                      \
+         const V ic = VMIN(up, left) + 1;                                      \
+         const V rc = diag + 1 + (c == q[i - 1]);                              \
+         left = VMIN(ic, rc);                                                  \
+         if (i > 1 && j > 1) {                                                 \
+            V tc;                                                              \
+            VLOAD(tc, &prev2[(i - 2) * n]);                                    \
+            const V transposed = (c == q[i - 2]) & (cprev == q[i - 1]);        \
+            tc = VSEL(transposed, tc + 1, left);                               \
+            left = VMIN(left, tc);                                             \
+         }                                                                     \
+         VSTORE(&cur[i * n], left);                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+      cprev = c;                                                               \
+      FC_SWAP3(T *, prev2, prev, cur);                                         \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_ALWAYS_INLINE void fc_simd_lcsubseq_batch_##T##_body(                       \
+   const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len,   \
+   T *cols, T *res)                                                            \
+{                                                                              \
+   const int32_t n = sizeof(V) / sizeof(T);                                    \
+   const V zero = {0};                                                         \
+   V vlens, vres = zero;                                                       \
+                                                                               \
+   for (int32_t i = 0; i <= qlen; i++)                                         \
+      VSTORE(&cols[i * n], zero);                                              \
+   VLOAD(vlens, lens);                                                         \
+                                                                               \
+   for (int32_t j = 1; j <= max_len; j++) {                                    \
+      V c, diag = zero, left = zero;                                           \
+      VLOAD(c, &chars[(j - 1) * n]);                                           \
+                                                                               \
+      for (int32_t i = 1; i <= qlen; i++) {                                    \
+         V up;                                                                 \
+         VLOAD(up, &cols[i * n]);                                              \
+         const V mc = VMAX(up, left);                                          \
+         left = VSEL(c == q[i - 1], diag + 1, mc);                             \
+         VSTORE(&cols[i * n], left);                                           \
+         diag = up;                                                            \
+      }                                                                        \
+      vres = VSEL(vlens == (T)j, left, vres);                                  \
+   }                                                                           \
+   VSTORE(res, vres);                                                          \
+}                                                                              \
+                                                                               \
+FC_DISPATCH(void, fc_simd_levenshtein_batch_##T,                               \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))                        \
+FC_DISPATCH(void, fc_simd_damerau_batch_##T,                                   \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))                        \
+FC_DISPATCH(void, fc_simd_lcsubseq_batch_##T,                                  \
+            (const T *q, int32_t qlen, const T *chars, const T *lens, int32_t max_len, T *cols, T *res), \
+            (q, qlen, chars, lens, max_len, cols, res))
+_(int8_t, fc_vec8)
+_(int16_t, fc_vec)
+#undef _
+
+/* Fills a group of candidates, and runs the kernel on it. Returns the number
+ * of candidates processed.
+ */
+#define _(T)                                                                   \
+static size_t fc_simd_batch_group_##T(enum fc_metric metric,                  \
+                                      const struct fc_peq *peq,               \
+                                      const int16_t *latin1,                  \
+                                      const T *q, int32_t qlen,               \
+                                      const char32_t *const *cands,           \
+                                      const int32_t *lens, size_t nr,         \
+                                      int32_t max_len, T *buf, int32_t *out)  \
+{                                                                              \
+   const int32_t n = sizeof(fc_vec) / sizeof(T);                               \
+   T glens[sizeof(fc_vec) / sizeof(T)], res[sizeof(fc_vec) / sizeof(T)];       \
+   T *chars = buf, *cols = &chars[max_len * n];                                \
+                                                                               \
+   if (nr > (size_t)n)                                                         \
+      nr = n;                                                                  \
+   for (int32_t k = 0; k < n; k++)                                             \
+      glens[k] = k < (int32_t)nr ? lens[k] : -1;                               \
+   memset(chars, 0, max_len * n * sizeof *chars);                              \
+   for (int32_t k = 0; k < (int32_t)nr; k++)                                   \
+      for (int32_t j = 0; j < lens[k]; j++) {                                  \
+         const char32_t c = cands[k][j];                                       \
+         chars[j * n + k] = c < 256 ? latin1[c] : fc_peq_slot(peq, c)->row;    \
+      }                                                                        \
+                                                                               \
+   switch (metric) {                                                           \
+   case FC_LEVENSHTEIN:                                                        \
+      fc_simd_levenshtein_batch_##T(q, qlen, chars, glens, max_len, cols, res); \
+      break;                                                                   \
+   case FC_DAMERAU:                                                            \
+      fc_simd_damerau_batch_##T(q, qlen, chars, glens, max_len, cols, res);    \
+      break;                                                                   \
+   default:                                                                    \
+      assert(metric == FC_LCSUBSEQ);                                           \
+      fc_simd_lcsubseq_batch_##T(q, qlen, chars, glens, max_len, cols, res);   \
+      break;                                                                   \
+   }                                                                           \
+   for (int32_t k = 0; k < (int32_t)nr; k++)                                   \
+      out[k] = res[k];                                                         \
+   return nr;                                                                  \
+}
+_(int8_t)
+_(int16_t)
+#undef _
+
+/* Above this query length, wide lanes are slower than bit-parallelism. */
+#define FC_BATCH16_MAX_QUERY_LEN 32
+
+static size_t fc_simd_batch_group_bitpar(enum fc_metric metric,
+                                         const struct fc_peq *peq,
+                                         const char32_t *const *cands,
+                                         const int32_t *lens, size_t nr,
+                                         int32_t *out)
+{
+   int32_t (*func)(const struct fc_peq *, const char32_t *, int32_t);
+
+   switch (metric) {
+   case FC_LEVENSHTEIN:
+      func = fc_bitpar_levenshtein;
+      break;
+   case FC_DAMERAU:
+      func = fc_bitpar_damerau;
+      break;
+   default:
+      assert(metric == FC_LCSUBSEQ);
+      func = fc_bitpar_lcsubseq;
+      break;
+   }
+   if (nr > sizeof(fc_vec) / sizeof(int16_t))
+      nr = sizeof(fc_vec) / sizeof(int16_t);
+   for (size_t k = 0; k < nr; k++)
+      out[k] = func(peq, cands[k], lens[k]);
+   return nr;
+}
+
+void fc_simd_batch(enum fc_metric metric, const struct fc_peq *peq,
+                   const char32_t *query, int32_t qlen,
+                   const char32_t *const *cands, const int32_t *lens,
+                   size_t nr, int32_t *out)
+{
+   int32_t max_len = 0;
+   for (size_t k = 0; k < nr; k++)
+      if (max_len < lens[k])
+         max_len = lens[k];
+
+   const size_t size = (max_len + 3 * (qlen + 1)) * sizeof(fc_vec);
+   void *buf = fc_malloc(size + qlen * (sizeof(int16_t) + sizeof(int8_t)));
+   int16_t *q16 = (int16_t *)((char *)buf + size);
+   int8_t *q8 = (int8_t *)&q16[qlen];
+
+   /* Query characters are numbered from 1, and characters of the candidates
+    * that don't appear in the query are mapped to 0. Latin-1 characters are
+    * mapped with a table, which is much cheaper than a lookup in "peq".
+    */
+   int16_t latin1[256];
+   for (int32_t c = 0; c < 256; c++)
+      latin1[c] = fc_peq_slot(peq, c)->row;
+   for (int32_t i = 0; i < qlen; i++)
+      q8[i] = q16[i] = fc_peq_slot(peq, query[i])->row;
+
+   const int32_t n8 = sizeof(fc_vec) / sizeof(int8_t);
+   for (size_t k = 0; k < nr; ) {
+      int32_t group_len = 0;
+      for (size_t g = k; g < k + n8 && g < nr; g++)
+         if (group_len < lens[g])
+            group_len = lens[g];
+
+      if (qlen <= FC_BATCH8_MAX_LEN && group_len <= FC_BATCH8_MAX_LEN)
+         k += fc_simd_batch_group_int8_t(metric, peq, latin1, q8, qlen, &cands[k],
+                                         &lens[k], nr - k, group_len, buf, &out[k]);
+      else if (qlen <= FC_BATCH16_MAX_QUERY_LEN)
+         k += fc_simd_batch_group_int16_t(metric, peq, latin1, q16, qlen, &cands[k],
+                                          &lens[k], nr - k, group_len, buf, &out[k]);
+      else
+         k += fc_simd_batch_group_bitpar(metric, peq, &cands[k], &lens[k],
+                                         nr - k, &out[k]);
+   }
+
+   fc_free(buf);
+}
+
+
+/*******************************************************************************
+ * Hamming distance
+ ******************************************************************************/
+
+/* Number of characters per vector. */
+#define FC_HAMMING_LANES ((int32_t)FC_ARRAY_SIZE((fc_cvec){0}))
+
+/* Sums the lanes of a vector of mismatches, which hold -1 or 0. */
+FC_ALWAYS_INLINE int32_t fc_simd_mismatches(const fc_cmask *ne)
+{
+   int32_t dist = 0;
+
+   for (int32_t n = 0; n < FC_HAMMING_LANES; n++)
+      dist -= (*ne)[n];
+   return dist;
+}
+
+/* Characters are compared one vector at a time, and mismatches are
+ * accumulated in the lanes of a vector. If the distance is bounded, the lanes
+ * are summed after each vector, so that we can stop early, since most keys
+ * compared in a search differ early. The tail is compared character by
+ * character.
+ */
+FC_ALWAYS_INLINE int32_t fc_simd_hamming_body(const char32_t *seq1,
+                                              const char32_t *seq2,
+                                              int32_t len, int32_t k)
+{
+   const int32_t n = FC_HAMMING_LANES;
+   const bool bounded = k < len;
+   fc_cmask acc = {0};
+   int32_t i = 0;
+
+   for (; i + n <= len; i += n) {
+      fc_cvec v1, v2;
+      VLOAD(v1, &seq1[i]);
+      VLOAD(v2, &seq2[i]);
+      acc += (fc_cmask)(v1 != v2);
+      if (bounded && fc_simd_mismatches(&acc) > k)
+         return fc_simd_mismatches(&acc);
+   }
+
+   int32_t dist = fc_simd_mismatches(&acc);
+   for (; i < len; i++)
+      dist += seq1[i] != seq2[i];
+   return dist;
+}
+
+FC_DISPATCH(int32_t, fc_simd_hamming,
+            (const char32_t *seq1, const char32_t *seq2, int32_t len, int32_t k),
+            (seq1, seq2, len, k))
+
+/* Keys that fit in a vector are compared to the query with a single load,
+ * which is masked to the length of the keys. It can read past the end of a
+ * key, but not past the end of the array, so the last keys are copied.
+ */
+FC_ALWAYS_INLINE void fc_simd_hamming_scan_body(const char32_t *query, int32_t len,
+                                                const char32_t *keys, size_t nr,
+                                                int32_t k, int32_t *out)
+{
+   const int32_t n = FC_HAMMING_LANES;
+   size_t i = 0;
+
+   if (len > n) {
+      for (; i < nr; i++)
+         out[i] = fc_simd_hamming_body(query, &keys[i * len], len, k);
+      return;
+   }
+
+   fc_cvec vq = {0};
+   fc_cmask valid;
+   memcpy(&vq, query, len * sizeof *query);
+   for (int32_t lane = 0; lane < n; lane++)
+      valid[lane] = lane < len ? -1 : 0;
+
+   for (; i < nr && (nr - i) * len >= (size_t)n; i++) {
+      fc_cvec vk;
+      VLOAD(vk, &keys[i * len]);
+      const fc_cmask ne = (fc_cmask)(vq != vk) & valid;
+      out[i] = fc_simd_mismatches(&ne);
+   }
+   for (; i < nr; i++) {
+      fc_cvec vk = {0};
+      memcpy(&vk, &keys[i * len], len * sizeof *keys);
+      const fc_cmask ne = (fc_cmask)(vq != vk);
+      out[i] = fc_simd_mismatches(&ne);
+   }
+}
+
+FC_DISPATCH(void, fc_simd_hamming_scan,
+            (const char32_t *query, int32_t len, const char32_t *keys, size_t nr, int32_t k, int32_t *out),
+            (query, len, keys, nr, k, out))
+
+#endif
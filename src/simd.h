@@ -0,0 +1,73 @@
+#ifndef FC_SIMD_H
+#define FC_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <uchar.h>
+#include "api.h"
+#include "bitpar.h"
+
+/* Vectorized kernels are written with the vector extensions of GCC and CLang,
+ * and are compiled for several instruction sets when on x86. The best one is
+ * chosen at runtime. Other compilers use the scalar implementations.
+ */
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5)
+   #define FC_HAVE_SIMD 1
+#endif
+
+/* Minimum length of the shortest sequence for using the vectorized kernels.
+ * Below this, the overhead of the setup is not amortized.
+ */
+#define FC_SIMD_MIN_LEN 16
+
+/* Maximum length of a sequence held in a single vector of characters. */
+#define FC_SIMD_SHORT_LEN 16
+
+#ifdef FC_HAVE_SIMD
+
+/* Same as fc_nlevenshtein() and fc_ndamerau() with FC_NORM_LALIGN, using
+ * anti-diagonal vectorization. "seq1" must be longer than "seq2", or have the
+ * same length. Sequences are made of elements of "size" bytes, which are
+ * remapped to small integers first.
+ */
+double fc_simd_nlevenshtein(const void *seq1, int32_t len1,
+                            const void *seq2, int32_t len2, int size);
+double fc_simd_ndamerau(const void *seq1, int32_t len1,
+                        const void *seq2, int32_t len2, int size);
+
+/* Same as fc_lcsubstr_extract(), vectorized over the columns of each row. */
+int32_t fc_simd_lcsubstr(const void *seq1, int32_t len1,
+                         const void *seq2, int32_t len2,
+                         const void **pos, int size);
+
+/* Same as fc_lcsubstr_extract(), vectorized over diagonals. One of the
+ * sequences must not be longer than FC_SIMD_SHORT_LEN.
+ */
+int32_t fc_simd_lcsubstr_diagonal(const void *seq1, int32_t len1,
+                                  const void *seq2, int32_t len2,
+                                  const void **pos, int size);
+
+/* Same as fc_hamming_bounded(). */
+int32_t fc_simd_hamming(const char32_t *seq1, const char32_t *seq2,
+                        int32_t len, int32_t k);
+
+/* Compares "query" to the "nr" keys of length "len" stored contiguously in
+ * "keys", and stores in out[i] the distance to the key "i", as returned by
+ * fc_hamming_bounded().
+ */
+void fc_simd_hamming_scan(const char32_t *query, int32_t len,
+                          const char32_t *keys, size_t nr,
+                          int32_t k, int32_t *out);
+
+/* Implementation of the fc_*_batch() functions. "metric" must be one of
+ * FC_LEVENSHTEIN, FC_DAMERAU, or FC_LCSUBSEQ, and "peq" must have been built
+ * from the query.
+ */
+void fc_simd_batch(enum fc_metric metric, const struct fc_peq *peq,
+                   const char32_t *query, int32_t qlen,
+                   const char32_t *const *cands, const int32_t *lens,
+                   size_t nr, int32_t *out);
+
+#endif
+
+#endif
@@ -0,0 +1,485 @@
+/* Checks that the uint8_t, uint16_t and uint32_t variants of the metrics
+ * return the same results as the char32_t ones.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "../src/api.h"
+
+#define MAX_LEN 160
+#define CASES_NR 10000
+#define MEMO_SEQS_NR 8
+#define KEYS_NR 40
+
+/* Long enough for fc_lcsubstr() to build a suffix automaton. */
+#define LONG_LEN 1600
+#define LONG_CASES_NR 30
+
+static uint64_t rng = 0x9E3779B97F4A7C15;
+
+static uint32_t rnd(void)
+{
+   rng ^= rng << 13;
+   rng ^= rng >> 7;
+   rng ^= rng << 17;
+   return rng >> 32;
+}
+
+/* A sequence, stored with all element types. */
+struct seq {
+   int32_t len;
+   char32_t c32[MAX_LEN];
+   uint32_t u32[MAX_LEN];
+   uint16_t u16[MAX_LEN];
+   uint8_t u8[MAX_LEN];
+};
+
+/* Draws characters among "alpha" distinct values below "limit". Short
+ * sequences are the most common, but some are longer than a word of the
+ * bit-parallel algorithms.
+ */
+static void seq_random(struct seq *s, uint32_t alpha, uint32_t limit)
+{
+   s->len = rnd() % 4 ? rnd() % 24 : rnd() % MAX_LEN;
+   for (int32_t i = 0; i < s->len; i++)
+      s->c32[i] = limit - 1 - rnd() % alpha;
+}
+
+/* Changes a few characters of a sequence, so that it shares long prefixes
+ * with the previous one, as the memoized algorithms expect.
+ */
+static void seq_mutate(struct seq *s, const struct seq *from, uint32_t limit)
+{
+   *s = *from;
+   if (s->len && rnd() % 2)
+      s->len -= rnd() % s->len;
+   else if (s->len < MAX_LEN)
+      s->c32[s->len++] = limit - 1;
+   if (s->len)
+      s->c32[rnd() % s->len] = limit - 1 - rnd() % 4;
+}
+
+static void seq_convert(struct seq *s, int size)
+{
+   for (int32_t i = 0; i < s->len; i++) {
+      s->u32[i] = s->c32[i];
+      if (size <= 2)
+         s->u16[i] = s->c32[i];
+      if (size == 1)
+         s->u8[i] = s->c32[i];
+   }
+}
+
+static int failures;
+
+#define CHECK(fmt, got, expect, s1, s2, size) do {                             \
+   if ((got) != (expect)) {                                                    \
+      fprintf(stderr, "%s:%d: u%d: got " fmt ", expected " fmt                 \
+              " (lengths %d and %d)\n", __FILE__, __LINE__, 8 * (size),        \
+              got, expect, (s1)->len, (s2)->len);                              \
+      failures++;                                                              \
+   }                                                                           \
+} while (0)
+
+/* Parameters of the metrics, drawn for each pair of sequences. */
+struct params {
+   enum fc_norm_method method;
+   double max;
+   int32_t k;
+   double prefix_scale;
+   int32_t max_prefix;
+};
+
+static void params_random(struct params *p)
+{
+   p->method = rnd() % 2 ? FC_NORM_LSEQ : FC_NORM_LALIGN;
+   p->max = rnd() % 101 / 100.;
+   p->k = rnd() % 8;
+   p->max_prefix = rnd() % 5;
+   p->prefix_scale = p->max_prefix ? 1. / (p->max_prefix + rnd() % 8) : 0.;
+}
+
+/* Arguments of the metrics, where "E" is the member of struct seq holding the
+ * compared elements. Hamming distances are computed on the shortest length.
+ */
+#define SEQS(E) s1->E, s1->len, s2->E, s2->len
+#define SEQS_K(E) SEQS(E), p->k
+#define NORM(E) p->method, SEQS(E)
+#define NORM_BOUNDED(E) p->method, p->max, SEQS(E)
+#define LCS_BOUNDED(E) p->max, SEQS(E)
+#define WINKLER(E) SEQS(E), p->prefix_scale, p->max_prefix
+#define WINKLER_BOUNDED(E) WINKLER(E), p->max
+#define HAMMING(E) s1->E, s2->E, s1->len < s2->len ? s1->len : s2->len
+#define HAMMING_K(E) HAMMING(E), p->k
+
+#define _(name, T, fmt, ARGS)                                                  \
+static void check_##name(const struct seq *s1, const struct seq *s2,           \
+                         const struct params *p, int size)                     \
+{                                                                              \
+   (void)p;                                                                    \
+   const T expect = fc_##name(ARGS(c32));                                      \
+   T got;                                                                      \
+   switch (size) {                                                             \
+   case 1:                                                                     \
+      got = fc_##name##_u8(ARGS(u8));                                          \
+      break;                                                                   \
+   case 2:                                                                     \
+      got = fc_##name##_u16(ARGS(u16));                                        \
+      break;                                                                   \
+   default:                                                                    \
+      got = fc_##name##_u32(ARGS(u32));                                        \
+      break;                                                                   \
+   }                                                                           \
+   CHECK(fmt, got, expect, s1, s2, size);                                      \
+}
+_(levenshtein, int32_t, "%d", SEQS)
+_(nlevenshtein, double, "%.17g", NORM)
+_(nlevenshtein_bounded, double, "%.17g", NORM_BOUNDED)
+_(lev_bounded1, int32_t, "%d", SEQS)
+_(lev_bounded2, int32_t, "%d", SEQS)
+_(lev_bounded_k, int32_t, "%d", SEQS_K)
+_(damerau, int32_t, "%d", SEQS)
+_(ndamerau, double, "%.17g", NORM)
+_(ndamerau_bounded, double, "%.17g", NORM_BOUNDED)
+_(dam_bounded1, int32_t, "%d", SEQS)
+_(dam_bounded2, int32_t, "%d", SEQS)
+_(lcsubstr, int32_t, "%d", SEQS)
+_(lcsubseq, int32_t, "%d", SEQS)
+_(nlcsubseq, double, "%.17g", SEQS)
+_(nlcsubseq_bounded, double, "%.17g", LCS_BOUNDED)
+_(jaro, double, "%.17g", SEQS)
+_(jaro_winkler, double, "%.17g", WINKLER)
+_(jaro_winkler_bounded, double, "%.17g", WINKLER_BOUNDED)
+_(hamming, int32_t, "%d", HAMMING)
+#undef _
+
+/* Distances larger than "k" can differ, since the vectorized kernel stops
+ * after a whole vector.
+ */
+static void check_hamming_bounded(const struct seq *s1, const struct seq *s2,
+                                  const struct params *p, int size)
+{
+   int32_t expect = fc_hamming_bounded(HAMMING_K(c32));
+   int32_t got;
+   switch (size) {
+   case 1:
+      got = fc_hamming_bounded_u8(HAMMING_K(u8));
+      break;
+   case 2:
+      got = fc_hamming_bounded_u16(HAMMING_K(u16));
+      break;
+   default:
+      got = fc_hamming_bounded_u32(HAMMING_K(u32));
+      break;
+   }
+   if (expect > p->k)
+      expect = p->k + 1;
+   if (got > p->k)
+      got = p->k + 1;
+   CHECK("%d", got, expect, s1, s2, size);
+}
+
+
+/* The tables are checked through their first entry, which isn't exported
+ * otherwise.
+ */
+static void check_bounded0(const struct seq *s1, const struct seq *s2, int size)
+{
+   const int32_t lev = fc_lev_bounded[0](SEQS(c32));
+   const int32_t dam = fc_dam_bounded[0](SEQS(c32));
+   int32_t got_lev, got_dam;
+   switch (size) {
+   case 1:
+      got_lev = fc_lev_bounded_u8[0](SEQS(u8));
+      got_dam = fc_dam_bounded_u8[0](SEQS(u8));
+      break;
+   case 2:
+      got_lev = fc_lev_bounded_u16[0](SEQS(u16));
+      got_dam = fc_dam_bounded_u16[0](SEQS(u16));
+      break;
+   default:
+      got_lev = fc_lev_bounded_u32[0](SEQS(u32));
+      got_dam = fc_dam_bounded_u32[0](SEQS(u32));
+      break;
+   }
+   CHECK("%d", got_lev, lev, s1, s2, size);
+   CHECK("%d", got_dam, dam, s1, s2, size);
+}
+
+/* Compares the positions of the substrings too, as offsets in "seq1". */
+#define CHECK_EXTRACT(s1, s2, size) do {                                       \
+   const char32_t *pos;                                                        \
+   const int32_t expect = fc_lcsubstr_extract(SEQS(c32), &pos);                \
+   const long expect_off = pos - s1->c32;                                      \
+   int32_t got;                                                                \
+   long got_off;                                                               \
+   switch (size) {                                                             \
+   case 1: {                                                                   \
+      const uint8_t *p;                                                        \
+      got = fc_lcsubstr_extract_u8(SEQS(u8), &p);                              \
+      got_off = p - s1->u8;                                                    \
+      break;                                                                   \
+   }                                                                           \
+   case 2: {                                                                   \
+      const uint16_t *p;                                                       \
+      got = fc_lcsubstr_extract_u16(SEQS(u16), &p);                            \
+      got_off = p - s1->u16;                                                   \
+      break;                                                                   \
+   }                                                                           \
+   default: {                                                                  \
+      const uint32_t *p;                                                       \
+      got = fc_lcsubstr_extract_u32(SEQS(u32), &p);                            \
+      got_off = p - s1->u32;                                                   \
+      break;                                                                   \
+   }                                                                           \
+   }                                                                           \
+   CHECK("%d", got, expect, s1, s2, size);                                     \
+   CHECK("%ld", got_off, expect_off, s1, s2, size);                            \
+} while (0)
+
+static void check_lcsubstr_extract(const struct seq *s1, const struct seq *s2,
+                                   int size)
+{
+   CHECK_EXTRACT(s1, s2, size);
+}
+
+/* Keys are copies of the query with a few changes, stored contiguously. */
+static struct {
+   char32_t c32[KEYS_NR * MAX_LEN];
+   uint32_t u32[KEYS_NR * MAX_LEN];
+   uint16_t u16[KEYS_NR * MAX_LEN];
+   uint8_t u8[KEYS_NR * MAX_LEN];
+} keys;
+
+static void check_hamming_search(const struct seq *query, const struct seq *s2,
+                                 int32_t k, int size)
+{
+   const int32_t len = query->len;
+   const size_t nr = 1 + rnd() % KEYS_NR;
+
+   for (size_t i = 0; i < nr; i++) {
+      char32_t *key = &keys.c32[i * len];
+      for (int32_t j = 0; j < len; j++)
+         key[j] = query->c32[j];
+      for (int32_t n = rnd() % 6; len && s2->len && n > 0; n--)
+         key[rnd() % len] = s2->c32[rnd() % s2->len];
+      for (int32_t j = 0; j < len; j++) {
+         keys.u32[i * len + j] = key[j];
+         keys.u16[i * len + j] = key[j];
+         keys.u8[i * len + j] = key[j];
+      }
+   }
+
+   size_t matches[KEYS_NR], got_matches[KEYS_NR];
+   int32_t dists[KEYS_NR], got_dists[KEYS_NR];
+   const size_t found = fc_hamming_search(query->c32, len, keys.c32, nr, k,
+                                          matches, dists);
+   size_t got;
+   switch (size) {
+   case 1:
+      got = fc_hamming_search_u8(query->u8, len, keys.u8, nr, k,
+                                 got_matches, got_dists);
+      break;
+   case 2:
+      got = fc_hamming_search_u16(query->u16, len, keys.u16, nr, k,
+                                  got_matches, got_dists);
+      break;
+   default:
+      got = fc_hamming_search_u32(query->u32, len, keys.u32, nr, k,
+                                  got_matches, got_dists);
+      break;
+   }
+   CHECK("%zu", got, found, query, s2, size);
+   for (size_t i = 0; i < found && i < got; i++) {
+      CHECK("%zu", got_matches[i], matches[i], query, s2, size);
+      CHECK("%d", got_dists[i], dists[i], query, s2, size);
+   }
+}
+
+/* Long sequences sharing a substring, which are only compared with
+ * fc_lcsubstr_extract(), since the other metrics don't have a path of their
+ * own for them.
+ */
+static struct long_seq {
+   int32_t len;
+   char32_t c32[LONG_LEN];
+   uint32_t u32[LONG_LEN];
+   uint16_t u16[LONG_LEN];
+   uint8_t u8[LONG_LEN];
+} long1, long2;
+
+static void long_random(struct long_seq *s, const struct long_seq *from,
+                        uint32_t alpha, uint32_t limit)
+{
+   s->len = LONG_LEN - rnd() % 64;
+   for (int32_t i = 0; i < s->len; i++)
+      s->c32[i] = limit - 1 - rnd() % alpha;
+   if (from) {
+      const int32_t len = rnd() % 200;
+      const int32_t src = rnd() % (from->len - len), dst = rnd() % (s->len - len);
+      for (int32_t i = 0; i < len; i++)
+         s->c32[dst + i] = from->c32[src + i];
+   }
+   for (int32_t i = 0; i < s->len; i++) {
+      s->u32[i] = s->c32[i];
+      s->u16[i] = s->c32[i];
+      s->u8[i] = s->c32[i];
+   }
+}
+
+static void check_lcsubstr_long(uint32_t limit, int size)
+{
+   const uint32_t alpha = 2 + rnd() % 40;
+   long_random(&long1, NULL, alpha, limit);
+   long_random(&long2, &long1, alpha, limit);
+
+   const struct long_seq *s1 = &long1, *s2 = &long2;
+   CHECK_EXTRACT(s1, s2, size);
+}
+
+
+static void memo_set_ref(struct fc_memo *m, const struct seq *s, int size)
+{
+   switch (size) {
+   case 1:
+      fc_memo_set_ref_u8(m, s->u8, s->len);
+      break;
+   case 2:
+      fc_memo_set_ref_u16(m, s->u16, s->len);
+      break;
+   default:
+      fc_memo_set_ref_u32(m, s->u32, s->len);
+      break;
+   }
+}
+
+static int32_t memo_compute(struct fc_memo *m, const struct seq *s, int size)
+{
+   switch (size) {
+   case 1:
+      return fc_memo_compute_u8(m, s->u8, s->len);
+   case 2:
+      return fc_memo_compute_u16(m, s->u16, s->len);
+   default:
+      return fc_memo_compute_u32(m, s->u32, s->len);
+   }
+}
+
+/* Compares a reference sequence to a chain of similar sequences with a typed
+ * memo and a char32_t one.
+ */
+static void check_memo(enum fc_metric metric, int32_t max_dist,
+                       const struct fc_costs *costs,
+                       const struct seq *s1, const struct seq *s2,
+                       uint32_t limit, int size)
+{
+   struct fc_memo typed, ref;
+   fc_memo_init(&typed, metric, MAX_LEN, max_dist);
+   fc_memo_init(&ref, metric, MAX_LEN, max_dist);
+   if (costs) {
+      fc_memo_set_costs(&typed, costs);
+      fc_memo_set_costs(&ref, costs);
+   }
+   memo_set_ref(&typed, s1, size);
+   fc_memo_set_ref(&ref, s1->c32, s1->len);
+
+   struct seq seqs[2];
+   seqs[0] = *s2;
+   for (int n = 0; n < MEMO_SEQS_NR; n++) {
+      struct seq *s = &seqs[n % 2];
+      if (n) {
+         seq_mutate(s, &seqs[(n - 1) % 2], limit);
+         seq_convert(s, size);
+      }
+      const int32_t expect = fc_memo_compute(&ref, s->c32, s->len);
+      CHECK("%d", memo_compute(&typed, s, size), expect, s1, s, size);
+   }
+   fc_memo_fini(&typed);
+   fc_memo_fini(&ref);
+}
+
+static void check_pair(const struct seq *s1, const struct seq *s2, int size)
+{
+   struct params p;
+   params_random(&p);
+
+   check_levenshtein(s1, s2, &p, size);
+   check_nlevenshtein(s1, s2, &p, size);
+   check_nlevenshtein_bounded(s1, s2, &p, size);
+   check_lev_bounded1(s1, s2, &p, size);
+   check_lev_bounded2(s1, s2, &p, size);
+   check_lev_bounded_k(s1, s2, &p, size);
+   check_damerau(s1, s2, &p, size);
+   check_ndamerau(s1, s2, &p, size);
+   check_ndamerau_bounded(s1, s2, &p, size);
+   check_dam_bounded1(s1, s2, &p, size);
+   check_dam_bounded2(s1, s2, &p, size);
+   check_bounded0(s1, s2, size);
+   check_lcsubstr(s1, s2, &p, size);
+   check_lcsubstr_extract(s1, s2, size);
+   check_lcsubseq(s1, s2, &p, size);
+   check_nlcsubseq(s1, s2, &p, size);
+   check_nlcsubseq_bounded(s1, s2, &p, size);
+   check_jaro(s1, s2, &p, size);
+   check_jaro_winkler(s1, s2, &p, size);
+   check_jaro_winkler_bounded(s1, s2, &p, size);
+   check_hamming(s1, s2, &p, size);
+   check_hamming_bounded(s1, s2, &p, size);
+   check_hamming_search(s1, s2, p.k, size);
+}
+
+int main(void)
+{
+   static const uint32_t limits[] = {UINT32_C(1) << 8, UINT32_C(1) << 16,
+                                     UINT32_C(0x110000)};
+   struct fc_costs costs[3];
+   for (int i = 0; i < 3; i++) {
+      const char32_t c = limits[i] - 1;
+      const struct fc_sub_cost subs[] = {{c, c - 1, 1}, {c - 1, c, 3}};
+      fc_costs_init(&costs[i], 2, 3, 4, 1, subs, 2);
+   }
+
+   for (int n = 0; n < CASES_NR; n++) {
+      const int size = 1 << (n % 3);
+      const uint32_t alpha = 1 + rnd() % (rnd() % 2 ? 4 : 40);
+      /* Characters of the upper half of the range of each type make sure they
+       * are not sign-extended or truncated.
+       */
+      const uint32_t limit = limits[n % 3];
+
+      /* The bounded functions mostly see unrelated sequences, so they are
+       * also given a close one.
+       */
+      struct seq s1, s2, s3;
+      seq_random(&s1, alpha, limit);
+      seq_random(&s2, alpha, limit);
+      seq_mutate(&s3, &s1, limit);
+      seq_convert(&s1, size);
+      seq_convert(&s2, size);
+      seq_convert(&s3, size);
+
+      check_pair(&s1, &s2, size);
+      check_pair(&s1, &s3, size);
+
+      if (n % 4)
+         continue;
+      const int32_t max_dist = rnd() % 2 ? INT32_MAX : (int32_t)(rnd() % 4);
+      check_memo(FC_LEVENSHTEIN, max_dist, NULL, &s1, &s2, limit, size);
+      check_memo(FC_DAMERAU, max_dist, NULL, &s1, &s2, limit, size);
+      check_memo(FC_LEVENSHTEIN, INT32_MAX, &costs[n % 3], &s1, &s2, limit, size);
+      check_memo(FC_DAMERAU, INT32_MAX, &costs[n % 3], &s1, &s2, limit, size);
+      check_memo(FC_LCSUBSTR, 0, NULL, &s1, &s2, limit, size);
+      check_memo(FC_LCSUBSEQ, 0, NULL, &s1, &s2, limit, size);
+   }
+
+   for (int n = 0; n < LONG_CASES_NR; n++)
+      check_lcsubstr_long(limits[n % 3], 1 << (n % 3));
+
+   for (int i = 0; i < 3; i++)
+      fc_costs_fini(&costs[i]);
+
+   if (failures) {
+      fprintf(stderr, "%d failures\n", failures);
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
@@ -28,6 +28,63 @@ function tests.levenshtein()
    end
 end
 
+-- Reference implementation, for checking the results obtained on long
+-- sequences. Only works with ASCII strings. "costs" is optional, and has the
+-- same fields as the argument of faconde.costs().
+local function ref_distance(s1, s2, transpos, costs)
+   costs = costs or {}
+   local ins, del = costs.ins or 1, costs.del or 1
+   local sub, transpose = costs.sub or 1, costs.transpose or 1
+   local subs = {}
+   for _, s in ipairs(costs.subs or {}) do
+      subs[s[1] .. s[2]] = s[3]
+   end
+   local prev2, prev = nil, {}
+   for j = 0, #s2 do
+      prev[j] = j * ins
+   end
+   for i = 1, #s1 do
+      local cur = {[0] = i * del}
+      for j = 1, #s2 do
+         local cost = s1:byte(i) == s2:byte(j) and 0
+                      or subs[s1:sub(i, i) .. s2:sub(j, j)] or sub
+         cur[j] = math.min(prev[j - 1] + cost, prev[j] + del, cur[j - 1] + ins)
+         if transpos and i > 1 and j > 1 and s1:byte(i) == s2:byte(j - 1)
+            and s1:byte(i - 1) == s2:byte(j) then
+            cur[j] = math.min(cur[j], prev2[j - 2] + transpose)
+         end
+      end
+      prev2, prev = prev, cur
+   end
+   return prev[#s2]
+end
+
+local function random_string(len, alphabet)
+   local chars = {}
+   for i = 1, len do
+      local pos = math.random(#alphabet)
+      chars[i] = alphabet:sub(pos, pos)
+   end
+   return table.concat(chars)
+end
+
+-- Sequences longer than a machine word must be split into several blocks.
+local function check_long(func, transpos)
+   for _, len in ipairs{63, 64, 65, 127, 128, 129, 300} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local s1 = random_string(len, alphabet)
+         local s2 = random_string(math.random(len), alphabet)
+         local ret = ref_distance(s1, s2, transpos)
+         assert(func(s1, s2) == ret)
+         assert(func(s2, s1) == ret)
+      end
+   end
+end
+
+function tests.levenshtein_long()
+   check_long(faconde.levenshtein, false)
+end
+
 function tests.nlevenshtein()
    local cases = {
       "s", "", "", "0.0",
@@ -50,6 +107,58 @@ function tests.nlevenshtein()
    end
 end
 
+-- Reference implementation of the normalization by the longest alignment.
+local function ref_nlalign(s1, s2, transpos)
+   if #s1 < #s2 then
+      s1, s2 = s2, s1
+   end
+   if #s2 == 0 then
+      return #s1 == 0 and 0 or 1
+   end
+   local d, l = {}, {}
+   for i = 0, #s1 do
+      d[i], l[i] = {[0] = i}, {[0] = i}
+   end
+   for j = 1, #s2 do
+      d[0][j], l[0][j] = j, j
+   end
+   for i = 1, #s1 do
+      for j = 1, #s2 do
+         local ic, dc = d[i][j - 1] + 1, d[i - 1][j] + 1
+         local rc = d[i - 1][j - 1] + (s1:byte(i) == s2:byte(j) and 0 or 1)
+         local tc = math.huge
+         if transpos and i > 1 and j > 1 and s1:byte(i - 1) == s2:byte(j)
+            and s1:byte(i) == s2:byte(j - 1) then
+            tc = d[i - 2][j - 2] + 1
+         end
+         local c = math.min(ic, dc, rc, tc)
+         d[i][j] = c
+         l[i][j] = math.max(ic == c and l[i][j - 1] + 1 or 0,
+                            dc == c and l[i - 1][j] + 1 or 0,
+                            rc == c and l[i - 1][j - 1] + 1 or 0,
+                            tc == c and l[i - 2][j - 2] + 1 or 0)
+      end
+   end
+   return d[#s1][#s2] / l[#s1][#s2]
+end
+
+-- Long sequences are processed with vectorized code. Distances and alignment
+-- lengths are packed together when the sum of the lengths is small enough.
+function tests.nlalign_long()
+   for _, len in ipairs{10, 16, 17, 33, 100, 120, 200, 300} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local s1 = random_string(len, alphabet)
+         local s2 = random_string(math.random(len), alphabet)
+         for _, transpos in ipairs{false, true} do
+            local func = transpos and faconde.ndamerau or faconde.nlevenshtein
+            local ret = ref_nlalign(s1, s2, transpos)
+            assert(func(s1, s2, "lalign") == ret)
+            assert(func(s2, s1, "lalign") == ret)
+         end
+      end
+   end
+end
+
 function tests.ndamerau()
    local cases = {
       "s", "", "", "0.0",
@@ -106,6 +215,10 @@ function tests.damerau()
    end
 end
 
+function tests.damerau_long()
+   check_long(faconde.damerau, true)
+end
+
 function tests.lcsubstr()
    local cases = {
          "", "", "0",
@@ -129,6 +242,67 @@ function tests.lcsubstr()
    end
 end
 
+local function ref_lcsubstr(s1, s2)
+   local prev, max_len = {}, 0
+   for i = 1, #s1 do
+      local cur = {}
+      for j = 1, #s2 do
+         cur[j] = s1:byte(i) == s2:byte(j) and (prev[j - 1] or 0) + 1 or 0
+         max_len = math.max(max_len, cur[j])
+      end
+      prev = cur
+   end
+   return max_len
+end
+
+function tests.lcsubstr_long()
+   for _, len in ipairs{10, 16, 17, 33, 100, 300, 2000} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local s1 = random_string(len, alphabet)
+         local s2 = random_string(math.random(len), alphabet)
+         local ret = ref_lcsubstr(s1, s2)
+         assert(faconde.lcsubstr(s1, s2) == ret)
+         assert(faconde.lcsubstr(s2, s1) == ret)
+         local substr = faconde.lcsubstr_extract(s1, s2)
+         assert(#substr == ret and s1:find(substr, 1, true) and s2:find(substr, 1, true))
+      end
+   end
+end
+
+-- Must give the same results as lcsubstr() and lcsubstr_extract() with the
+-- reference sequence as second argument.
+function tests.lcsubstr_index()
+   for _, len in ipairs{0, 1, 10, 100, 2000} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local ref = random_string(len, alphabet)
+         local index = faconde.lcsubstr_index(ref)
+         for _, len2 in ipairs{0, 5, 50, 500} do
+            local str = random_string(len2, alphabet)
+            assert(index:lcsubstr(str) == faconde.lcsubstr(str, ref))
+            assert(index:lcsubstr_extract(str) == faconde.lcsubstr_extract(str, ref))
+         end
+      end
+   end
+end
+
+-- Must give the same results as the standard functions, with the query as
+-- first argument.
+function tests.query()
+   for _, len in ipairs{0, 1, 10, 100, 300} do
+      for _, alphabet in ipairs{"ab", "abcdefghijklmnopqrstuvwxyz"} do
+         local ref = random_string(len, alphabet)
+         local query = faconde.query(ref)
+         for _, len2 in ipairs{0, 5, 50, 500} do
+            local str = random_string(len2, alphabet)
+            assert(query:levenshtein(str) == faconde.levenshtein(ref, str))
+            assert(query:damerau(str) == faconde.damerau(ref, str))
+            assert(query:lcsubseq(str) == faconde.lcsubseq(ref, str))
+            assert(query:jaro(str) == faconde.jaro(ref, str))
+         end
+      end
+   end
+end
+
 function tests.lcsubseq()
    local cases = {
       "", "", "0",
@@ -148,6 +322,72 @@ function tests.lcsubseq()
    end
 end
 
+-- Also accepts arrays of code points.
+local function ref_lcsubseq(s1, s2)
+   if type(s1) == "string" then
+      s1, s2 = {s1:byte(1, -1)}, {s2:byte(1, -1)}
+   end
+   local prev = {}
+   for j = 0, #s2 do
+      prev[j] = 0
+   end
+   for i = 1, #s1 do
+      local cur = {[0] = 0}
+      for j = 1, #s2 do
+         if s1[i] == s2[j] then
+            cur[j] = prev[j - 1] + 1
+         else
+            cur[j] = math.max(prev[j], cur[j - 1])
+         end
+      end
+      prev = cur
+   end
+   return prev[#s2]
+end
+
+function tests.lcsubseq_long()
+   for _, len in ipairs{63, 64, 65, 127, 128, 129, 300} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local s1 = random_string(len, alphabet)
+         local s2 = random_string(math.random(len), alphabet)
+         local ret = ref_lcsubseq(s1, s2)
+         assert(faconde.lcsubseq(s1, s2) == ret)
+         assert(faconde.lcsubseq(s2, s1) == ret)
+      end
+   end
+end
+
+-- Encodes a code point between U+0800 and U+FFFF.
+local function utf8_char(cp)
+   return string.char(0xE0 + math.floor(cp / 0x1000),
+                      0x80 + math.floor(cp / 0x40) % 0x40, 0x80 + cp % 0x40)
+end
+
+-- With many distinct characters, matches are sparse, and another algorithm is
+-- used.
+function tests.lcsubseq_large_alphabet()
+   for _, alphabet_size in ipairs{50, 1000, 20000} do
+      local cps1, cps2 = {}, {}
+      for i = 1, 1000 do
+         cps1[i] = 0x4E00 + math.random(alphabet_size)
+      end
+      for i = 1, math.random(300, 1000) do
+         cps2[i] = 0x4E00 + math.random(alphabet_size)
+      end
+      local chars1, chars2 = {}, {}
+      for i, cp in ipairs(cps1) do
+         chars1[i] = utf8_char(cp)
+      end
+      for i, cp in ipairs(cps2) do
+         chars2[i] = utf8_char(cp)
+      end
+      local s1, s2 = table.concat(chars1), table.concat(chars2)
+      local ret = ref_lcsubseq(cps1, cps2)
+      assert(faconde.lcsubseq(s1, s2) == ret)
+      assert(faconde.lcsubseq(s2, s1) == ret)
+   end
+end
+
 function tests.nlcsubseq()
    local cases = {
       "", "foo", "1.0",
@@ -260,11 +500,20 @@ function tests.jaro()
       -- "JON JAN 0.000 0.000 0.000 0.667",
    }
    for _, case in ipairs(cases) do
-      local seq1, seq2, expect = case:match("([%a]+)%s+([%a]+)%s+(%d+%.%d+)")
+      local seq1, seq2, expect, expect_w =
+         case:match("([%a]+)%s+([%a]+)%s+(%d+%.%d+)%s+(%d+%.%d+)")
       expect = 1 - tonumber(expect)
       local ret = faconde.jaro(seq1, seq2)
       assert(math.abs(expect - ret) < 0.001)
+      -- Jaro-Winkler is in the second column.
+      expect_w = 1 - tonumber(expect_w)
+      ret = faconde.jaro_winkler(seq1, seq2)
+      assert(math.abs(expect_w - ret) < 0.001)
+      assert(faconde.jaro_winkler(seq1, seq2, 0, 0) == faconde.jaro(seq1, seq2))
    end
+   assert(faconde.jaro("", "") == 0)
+   assert(faconde.jaro("abc", "") == 1)
+   assert(faconde.jaro("abc", "xyz") == 1)
 end
 
 local function load_words()
@@ -302,6 +551,398 @@ function tests.lev_bounded_dict()
    end
 end
 
+-- Same as above, for the Damerau distance.
+function tests.dam_bounded_dict()
+   local words = load_words()
+   local ref_word = words[math.random(#words)]
+   for _, word in ipairs(words) do
+      local dist = faconde.damerau(ref_word, word)
+      for k = 0, 2 do
+         local ret = faconde.dam_bounded(ref_word, word, k)
+         if dist <= k then
+            assert(ret == dist)
+         else
+            assert(ret > k)
+         end
+      end
+   end
+end
+
+function tests.dam_bounded()
+   local cases = {
+      "", "", 0, 0,
+      "a", "b", 1, 1,
+      "ab", "ba", 1, 1,
+      "abcd", "acbd", 1, 1,
+      "abcd", "badc", 2, 2,
+      "abcd", "bacde", 2, 2,
+      "abcd", "dcba", 2, nil,
+      "ca", "abc", 2, nil,
+   }
+   for i = 1, #cases, 4 do
+      local s1, s2, max, ret = cases[i], cases[i + 1], cases[i + 2], cases[i + 3]
+      for _, args in ipairs{{s1, s2}, {s2, s1}} do
+         local dist = faconde.dam_bounded(args[1], args[2], max)
+         if ret then
+            assert(dist == ret)
+         else
+            assert(dist > max)
+         end
+      end
+   end
+end
+
+-- Same as above, for distances that don't have a specialized function.
+function tests.lev_bounded_k()
+   local words = load_words()
+   local ref_word = words[math.random(#words)]
+   for _, word in ipairs(words) do
+      local dist = faconde.levenshtein(ref_word, word)
+      for k = 3, 5 do
+         local ret = faconde.lev_bounded(ref_word, word, k)
+         if dist <= k then
+            assert(ret == dist)
+         else
+            assert(ret > k)
+         end
+      end
+   end
+   for _, len in ipairs{10, 100, 300} do
+      local s1 = random_string(len, "abcd")
+      local s2 = random_string(math.random(len), "abcd")
+      local dist = ref_distance(s1, s2, false)
+      for _, k in ipairs{dist - 1, dist, dist + 1} do
+         if k >= 3 then
+            local ret = faconde.lev_bounded(s1, s2, k)
+            assert(dist <= k and ret == dist or dist > k and ret > k)
+         end
+      end
+   end
+end
+
+-- Bounded normalized functions must give the exact result when it is within
+-- the bound, and a larger value otherwise.
+function tests.normalized_bounded()
+   local words = load_words()
+   local cases = {}
+   for i = 1, 2000 do
+      table.insert(cases, {words[math.random(#words)], words[math.random(#words)]})
+   end
+   for _, len in ipairs{10, 100, 300} do
+      local s1 = random_string(len, "abcd")
+      table.insert(cases, {s1, random_string(math.random(len), "abcd")})
+      table.insert(cases, {s1, s1:sub(2) .. "a"})
+   end
+   local function check(ret, dist, max)
+      assert(dist <= max and ret == dist or dist > max and ret > max)
+   end
+   for _, max in ipairs{0, 0.1, 0.25, 0.5, 1} do
+      for _, pair in ipairs(cases) do
+         local s1, s2 = pair[1], pair[2]
+         for _, name in ipairs{"nlevenshtein", "ndamerau"} do
+            for _, method in ipairs{"lseq", "lalign"} do
+               local dist = faconde[name](s1, s2, method)
+               check(faconde[name .. "_bounded"](s1, s2, max, method), dist, max)
+            end
+         end
+         check(faconde.nlcsubseq_bounded(s1, s2, max), faconde.nlcsubseq(s1, s2), max)
+         check(faconde.jaro_winkler_bounded(s1, s2, max), faconde.jaro_winkler(s1, s2), max)
+      end
+   end
+end
+
+-- Batch functions must give the same results as the pairwise ones, whatever
+-- the lengths of the query and of the candidates.
+function tests.batch()
+   local words = load_words()
+   local cands = {}
+   for i = 1, 1000 do
+      cands[i] = words[math.random(#words)]
+   end
+   for _, len in ipairs{0, 10, 100, 300} do
+      table.insert(cands, random_string(len, "abcd"))
+   end
+   for _, query in ipairs{"", words[math.random(#words)], random_string(40, "abcd"),
+                          random_string(200, "abcd")} do
+      for _, name in ipairs{"levenshtein", "damerau", "lcsubseq"} do
+         local ret = faconde[name .. "_batch"](query, cands)
+         assert(#ret == #cands)
+         for i, cand in ipairs(cands) do
+            assert(ret[i] == faconde[name](query, cand))
+         end
+      end
+   end
+   assert(#faconde.levenshtein_batch("abc", {}) == 0)
+end
+
+-- Applies an edit script to the first string, checking that it transforms it
+-- into the second one. Returns the cost of the script and its number of
+-- matches. Only works with ASCII strings.
+local function replay_script(s1, s2, ops)
+   local i, j, cost, matches = 1, 1, 0, 0
+   for k, op in ipairs(ops) do
+      local name, len = op[1], op[2]
+      assert(len > 0 and (k == 1 or ops[k - 1][1] ~= name))
+      for _ = 1, len do
+         if name == "match" then
+            assert(s1:byte(i) and s1:byte(i) == s2:byte(j))
+            i, j, matches = i + 1, j + 1, matches + 1
+         elseif name == "sub" then
+            assert(s1:byte(i) and s2:byte(j) and s1:byte(i) ~= s2:byte(j))
+            i, j, cost = i + 1, j + 1, cost + 1
+         elseif name == "ins" then
+            assert(s2:byte(j))
+            j, cost = j + 1, cost + 1
+         elseif name == "del" then
+            assert(s1:byte(i))
+            i, cost = i + 1, cost + 1
+         else
+            assert(name == "transpose")
+            assert(i < #s1 and j < #s2 and s1:byte(i) == s2:byte(j + 1)
+                   and s1:byte(i + 1) == s2:byte(j))
+            i, j, cost = i + 2, j + 2, cost + 1
+         end
+      end
+   end
+   assert(i == #s1 + 1 and j == #s2 + 1)
+   return cost, matches
+end
+
+-- Metrics computed together must be the same as the ones computed separately,
+-- and only the requested ones must be returned.
+function tests.multi_metric()
+   local names = {"levenshtein", "damerau", "lcsubstr", "lcsubseq", "jaro"}
+   local words = load_words()
+   local cases = {{"", ""}, {"", "abc"}, {"ca", "abc"}}
+   for i = 1, 200 do
+      table.insert(cases, {words[math.random(#words)], words[math.random(#words)]})
+   end
+   for _, len in ipairs{30, 64, 65, 300} do
+      table.insert(cases, {random_string(len, "abcd"), random_string(math.random(len), "abcd")})
+   end
+   for _, case in ipairs(cases) do
+      local ret = faconde.multi_metric(case[1], case[2])
+      for _, name in ipairs(names) do
+         assert(ret[name] == faconde[name](case[1], case[2]))
+      end
+      ret = faconde.multi_metric(case[1], case[2], {"lcsubstr", "jaro"})
+      assert(ret.levenshtein == nil and ret.lcsubstr == faconde.lcsubstr(case[1], case[2]))
+   end
+   local cands = {}
+   for i = 2, #cases do
+      cands[i - 1] = cases[i][2]
+   end
+   local query = words[math.random(#words)]
+   local ret = faconde.multi_metric_batch(query, cands, {"damerau", "lcsubseq"})
+   for i, cand in ipairs(cands) do
+      assert(ret[i].damerau == faconde.damerau(query, cand))
+      assert(ret[i].lcsubseq == faconde.lcsubseq(query, cand))
+      assert(ret[i].jaro == nil)
+   end
+end
+
+function tests.hamming()
+   assert(faconde.hamming("", "") == 0)
+   assert(faconde.hamming("abc", "abd") == 1)
+   assert(faconde.hamming("aéb", "béb") == 1)
+   assert(not pcall(faconde.hamming, "abc", "ab"))
+   for _, len in ipairs{5, 16, 17, 100} do
+      local query, k = random_string(len, "abc"), math.floor(len / 2)
+      local keys, dists = {}, {}
+      for i = 1, 50 do
+         keys[i] = random_string(len, "abc")
+         dists[i] = 0
+         for j = 1, len do
+            if keys[i]:byte(j) ~= query:byte(j) then
+               dists[i] = dists[i] + 1
+            end
+         end
+         assert(faconde.hamming(query, keys[i]) == dists[i])
+         local ret = faconde.hamming_bounded(query, keys[i], k)
+         assert(dists[i] > k and ret > k or ret == dists[i])
+      end
+      local matches, found = faconde.hamming_search(query, keys, k)
+      local n = 0
+      for i = 1, #keys do
+         if dists[i] <= k then
+            n = n + 1
+            assert(matches[n] == i and found[n] == dists[i])
+         end
+      end
+      assert(#matches == n)
+   end
+   assert(not pcall(faconde.hamming_search, "abc", {"abc", "ab"}, 1))
+end
+
+function tests.packed()
+   for _, alphabet in ipairs{"ACGT", "ACGTN", "abcdéfghijklmnop"} do
+      for _, len in ipairs{0, 1, 31, 32, 33, 100, 300} do
+         local s1 = random_string(len, alphabet:sub(1, 4))
+         local s2 = random_string(math.random(0, 300), alphabet:sub(1, 4))
+         local cut = math.floor(len / 3)
+         local s3 = s1:sub(1, cut) .. alphabet:sub(1, 1) .. s1:sub(cut + 2)
+         for _, s in ipairs{s2, s3} do
+            assert(faconde.levenshtein_packed(s1, s, alphabet) == faconde.levenshtein(s1, s))
+            assert(faconde.lcsubseq_packed(s, s1, alphabet) == faconde.lcsubseq(s, s1))
+         end
+      end
+   end
+   assert(not pcall(faconde.levenshtein_packed, "ACGT", "ACGU", "ACGT"))
+   assert(not pcall(faconde.lcsubseq_packed, "a", "b", "abcdefghijklmnopq"))
+end
+
+function tests.rle()
+   local function random_runs(nr, max_len)
+      local runs, str = {}, {}
+      for i = 1, nr do
+         local c = random_string(1, "abc")
+         runs[i] = {c, math.random(max_len)}
+         str[i] = c:rep(runs[i][2])
+      end
+      return runs, table.concat(str)
+   end
+   assert(faconde.levenshtein_rle({}, {}) == 0)
+   assert(faconde.levenshtein_rle({{"a", 3}}, {}) == 3)
+   assert(faconde.levenshtein_rle({{"a", 2}, {"a", 1}}, {{"a", 3}}) == 0)
+   assert(faconde.levenshtein_rle({{"é", 2}}, {{"e", 2}}) == 2)
+   -- Short runs are decoded, long ones are not.
+   for _, max_len in ipairs{1, 10, 1000} do
+      for _ = 1, 20 do
+         local runs1, s1 = random_runs(math.random(0, 8), max_len)
+         local runs2, s2 = random_runs(math.random(0, 8), max_len)
+         local dist = faconde.levenshtein_long(s1, s2)
+         assert(faconde.levenshtein_rle(runs1, runs2) == dist)
+         assert(faconde.levenshtein_rle(runs2, runs1) == dist)
+      end
+   end
+   assert(not pcall(faconde.levenshtein_rle, {{"ab", 1}}, {}))
+   assert(not pcall(faconde.levenshtein_rle, {}, {{"a", 0}}))
+end
+
+function tests.fold()
+   local str = "ÉCOLE Ångström Łódź, Straße À LA CARTE €"
+   assert(faconde.fold(str) == "ecole angstrom łodz, straße a la carte €")
+   assert(faconde.fold(str, "case") == "école ångström łódź, straße à la carte €")
+   assert(faconde.fold(str, "accents") == "ECOLE Angstrom Łodz, Straße A LA CARTE €")
+   assert(faconde.fold("") == "")
+   assert(not pcall(faconde.fold, str, "upper"))
+   -- Invalid bytes are decoded as U+FFFD, one per byte.
+   for _, s in ipairs{"\195A", "\192\175A", "\237\160\128A", "\244\144\128\128A"} do
+      local len = #s - 1
+      assert(faconde.levenshtein(s, ("\239\191\189"):rep(len) .. "A") == 0)
+   end
+end
+
+function tests.weighted()
+   local unit = faconde.costs{}
+   for _ = 1, 50 do
+      local s1 = random_string(math.random(0, 20), "abc")
+      local s2 = random_string(math.random(0, 20), "abc")
+      assert(faconde.wlevenshtein(s1, s2, unit) == faconde.levenshtein(s1, s2))
+      assert(faconde.wdamerau(s1, s2, unit) == faconde.damerau(s1, s2))
+   end
+
+   local params = {ins = 2, del = 3, sub = 4, transpose = 1,
+                   subs = {{"a", "s", 1}, {"é", "e", 0}}}
+   local costs = faconde.costs(params)
+   assert(faconde.wlevenshtein("a", "", costs) == 3)
+   assert(faconde.wlevenshtein("", "a", costs) == 2)
+   assert(faconde.wlevenshtein("a", "s", costs) == 1)
+   assert(faconde.wlevenshtein("s", "a", costs) == 4)
+   assert(faconde.wlevenshtein("café", "cafe", costs) == 0)
+   assert(faconde.wlevenshtein("ab", "ba", costs) == 5)
+   assert(faconde.wdamerau("ab", "ba", costs) == 1)
+   assert(faconde.wlevenshtein("ab", "ba", costs, 4) > 4)
+   assert(faconde.wlevenshtein("ab", "ba", costs, 5) == 5)
+
+   -- Uniform, constant, and table costs are computed by different kernels.
+   local cases = {
+      {ins = 3, del = 3, sub = 3, transpose = 3},
+      {ins = 3, del = 3, sub = 3, transpose = 6},
+      {ins = 1, del = 2, sub = 3, transpose = 0},
+      {ins = 1, del = 2, sub = 3, subs = {{"a", "b", 0}, {"c", "a", 5}}},
+   }
+   for _, p in ipairs(cases) do
+      local c = faconde.costs(p)
+      for _ = 1, 50 do
+         local s1 = random_string(math.random(0, 80), "abcd")
+         local s2 = random_string(math.random(0, 80), "abcd")
+         local lev, dam = ref_distance(s1, s2, false, p), ref_distance(s1, s2, true, p)
+         assert(faconde.wlevenshtein(s1, s2, c) == lev)
+         assert(faconde.wdamerau(s1, s2, c) == dam)
+         local max = math.random(0, dam + 2)
+         local ret = faconde.wdamerau(s1, s2, c, max)
+         assert(dam <= max and ret == dam or dam > max and ret > max)
+      end
+   end
+
+   local memo = faconde.memo("levenshtein", 10)
+   memo:set_ref("a")
+   memo:set_costs(costs)
+   assert(memo:compute("s") == 1)
+   assert(memo:compute("") == 3)
+   assert(memo:compute("ba") == 2)
+   memo:set_costs()
+   assert(memo:compute("ba") == 1)
+   memo = faconde.memo("damerau", 10)
+   memo:set_ref("ab")
+   memo:set_costs(costs)
+   costs = nil
+   collectgarbage()
+   assert(memo:compute("ba") == 1)
+   assert(not pcall(faconde.memo("lcsubseq", 10).set_costs, faconde.memo("lcsubseq", 10), unit))
+
+   assert(not pcall(faconde.costs, {ins = -1}))
+   assert(not pcall(faconde.costs, {sub = "a"}))
+   assert(not pcall(faconde.costs, {subs = {{"ab", "c", 1}}}))
+   assert(not pcall(faconde.costs, {subs = {{"a", "c"}}}))
+   assert(not pcall(faconde.wlevenshtein, "a", "b", {}))
+end
+
+-- Sequences longer than MAX_SEQ_LEN are cut into tiles, computed by several
+-- threads.
+function tests.long()
+   local len = faconde.MAX_SEQ_LEN + 100
+   for _, alphabet in ipairs{"ab", "abcdefghijklmnopqrstuvwxyz"} do
+      local s1 = random_string(len, alphabet)
+      local s2 = random_string(math.random(300), alphabet)
+      for _, threads in ipairs{1, 4} do
+         assert(faconde.levenshtein_long(s1, s2, threads) == ref_distance(s1, s2, false))
+         assert(faconde.damerau_long(s2, s1, threads) == ref_distance(s1, s2, true))
+         assert(faconde.lcsubseq_long(s1, s2, threads) == ref_lcsubseq(s1, s2))
+      end
+   end
+   local s = random_string(100000, "abcd")
+   assert(faconde.levenshtein_long(s, s .. "abc") == 3)
+   assert(faconde.damerau_long("ba" .. s, "ab" .. s) == 1)
+   assert(faconde.lcsubseq_long(s, s:sub(2)) == #s - 1)
+   assert(faconde.levenshtein_long(s, "") == #s)
+   assert(faconde.lcsubseq_long("abc", "xbz") == 1)
+end
+
+-- Long sequences are aligned by divide and conquer.
+function tests.align()
+   assert(faconde.levenshtein_align("", "") == 0)
+   local dist, ops = faconde.damerau_align("abcd", "acbd")
+   assert(dist == 1 and #ops == 3 and ops[2][1] == "transpose" and ops[2][2] == 1)
+   for _, len in ipairs{0, 1, 10, 100, 1000} do
+      for _, alphabet in ipairs{"ab", "abcd", "abcdefghijklmnopqrstuvwxyz"} do
+         local s1 = random_string(len, alphabet)
+         local s2 = random_string(math.random(0, len + 1), alphabet)
+         for _, name in ipairs{"levenshtein", "damerau", "lcsubseq"} do
+            local ret, ops = faconde[name .. "_align"](s1, s2)
+            assert(ret == faconde[name](s1, s2))
+            local cost, matches = replay_script(s1, s2, ops)
+            if name == "lcsubseq" then
+               assert(matches == ret and cost == #s1 + #s2 - 2 * ret)
+            else
+               assert(cost == ret)
+            end
+         end
+      end
+   end
+end
+
 local metrics = {"levenshtein", "damerau", "lcsubstr", "lcsubseq"}
 
 function tests.memo()
@@ -4,6 +4,8 @@ set -o errexit
 
 VG="valgrind --leak-check=full --error-exitcode=1"
 
+$VG ./elem
+
 for file in *.lua; do
    $VG lua -e 'package.cpath="../lua/?.so"' ./$file
 done